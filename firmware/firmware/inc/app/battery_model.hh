@@ -0,0 +1,61 @@
+#ifndef _BATTERY_MODEL_HH_
+#define _BATTERY_MODEL_HH_
+
+#include <stdint.h>
+
+/**
+ * Equivalent circuit model of a battery cell: an open circuit voltage source that depends on state of charge, a series
+ * resistance R0, and kNumRCPairs RC pairs for the slower polarization dynamics. Step() is run once per control tick
+ * and only uses integer math, since the RP2040 has no FPU. Parameter setters can use floating point since they only
+ * run when a register is written.
+ *
+ * Units: current in microamps (positive = discharge), voltage in microvolts, charge in nanocoulombs, resistance in
+ * milliohms, time constants in milliseconds.
+*/
+class BatteryModel {
+public:
+    static const uint16_t kNumOCVPoints = 11; // OCV at 0%, 10%, ... 100% SOC
+    static const uint16_t kNumRCPairs = 2;
+    static const uint32_t kMaxCapacityMAh = 30000; // keeps SOC math inside of 64 bits
+    static const uint16_t kSOCFracBits = 16; // SOC is kept as a fraction of capacity in Q16
+    static const uint16_t kBetaFracBits = 30; // RC pair step factors are kept in Q30
+    static const uint16_t kRCVoltageFracBits = 12; // RC pair voltages are kept in uV Q12 so rounding doesn't pile up
+
+    BatteryModel(uint32_t step_period_us);
+
+    int32_t Step(int32_t current_ua);
+    void Relax();
+
+    void SetCapacityMAh(uint32_t capacity_mah);
+    uint32_t GetCapacityMAh();
+    void SetSOCPercent(float soc_percent);
+    float GetSOCPercent();
+    void SetOCVPoint(uint16_t index, int32_t ocv_uv);
+    int32_t GetOCVPoint(uint16_t index);
+    void SetR0MOhm(uint32_t r0_mohm);
+    uint32_t GetR0MOhm();
+    void SetRCPair(uint16_t index, uint32_t r_mohm, uint32_t tau_ms);
+    uint32_t GetRCPairRMOhm(uint16_t index);
+    uint32_t GetRCPairTauMs(uint16_t index);
+
+    int32_t GetOCV();
+    int32_t GetTerminalVoltage();
+
+private:
+    void UpdateRCPairBeta(uint16_t index);
+
+    uint32_t step_period_us_;
+
+    int64_t capacity_nc_;
+    int64_t charge_nc_; // charge remaining
+    int32_t ocv_uv_[kNumOCVPoints];
+    uint32_t r0_mohm_ = 0;
+    uint32_t rc_r_mohm_[kNumRCPairs];
+    uint32_t rc_tau_ms_[kNumRCPairs];
+    int32_t rc_beta_[kNumRCPairs]; // 1-exp(-step_period/tau) in Q30, how far each RC pair moves towards I*R per step
+    int64_t rc_v_[kNumRCPairs]; // voltage across each RC pair, uV in Q12
+
+    int32_t terminal_voltage_uv_ = 0;
+};
+
+#endif /* _BATTERY_MODEL_HH_ */
@@ -0,0 +1,61 @@
+#ifndef _CURRENT_STATS_HH_
+#define _CURRENT_STATS_HH_
+
+#include <stdint.h>
+
+/**
+ * Running statistics and a coulomb counter for the output current, updated with every ADC sample so that the host can
+ * get averages and totals with one read instead of polling. Statistics are kept over back to back windows of a fixed
+ * length (or since the last reset if the window length is 0) using Welford's method, all in integer math.
+ *
+ * Units: current in microamps, charge in nanocoulombs, time in microseconds unless noted otherwise.
+*/
+class CurrentStats {
+public:
+    static const uint16_t kMeanFracBits = 16; // running mean is kept in uA Q16
+
+    typedef struct {
+        uint32_t num_samples;
+        int32_t mean_ua;
+        int32_t min_ua;
+        int32_t max_ua;
+        uint32_t rms_ua;
+        uint32_t stddev_ua; // population standard deviation
+    } Summary_t;
+
+    CurrentStats();
+
+    void AddSample(int32_t current_ua, uint32_t timestamp_us);
+
+    void SetWindowMs(uint32_t window_ms);
+    uint32_t GetWindowMs();
+    void ResetWindow();
+    Summary_t GetSummary();
+
+    void SetChargeNC(int64_t charge_nc);
+    int64_t GetChargeNC();
+
+private:
+    typedef struct {
+        uint32_t num_samples;
+        int64_t mean_q16; // [uA Q16]
+        uint64_t m2; // sum of squared differences from the mean [uA^2]
+        int32_t min_ua;
+        int32_t max_ua;
+    } Accumulator_t;
+
+    static void ClearAccumulator(Accumulator_t & accumulator);
+    static Summary_t Summarize(Accumulator_t & accumulator);
+    static uint32_t SquareRoot(uint64_t value);
+
+    uint32_t window_ms_ = 0;
+    uint32_t window_start_timestamp_us_ = 0;
+    Accumulator_t window_; // in progress
+    Accumulator_t last_window_; // last completed window
+
+    int64_t charge_nc_ = 0; // positive = discharge
+    bool have_last_timestamp_ = false;
+    uint32_t last_timestamp_us_ = 0;
+};
+
+#endif /* _CURRENT_STATS_HH_ */
@@ -0,0 +1,53 @@
+#ifndef _FLASH_STORE_HH_
+#define _FLASH_STORE_HH_
+
+#include "hardware/flash.h"
+#include <stdint.h>
+
+/**
+ * Keeps a small record (e.g. settings that should survive a power cycle) in a region of flash at the end of the
+ * program flash. Each save goes into the next page of the region instead of erasing and rewriting the same spot, so
+ * the erases are spread over all of the region's sectors. A sector is only erased when the saves move into it, and
+ * the newest record is always in a different sector by then, so losing power part way through a save at worst loses
+ * that save.
+ *
+ * Records are written one per page with a header holding a sequence number and a CRC. Loading scans the region and
+ * picks the valid record with the highest sequence number.
+*/
+class FlashStore {
+public:
+    typedef struct {
+        uint32_t magic; // kMagic, anything else is an erased or torn page
+        uint32_t sequence; // counts up by one with every save
+        uint16_t record_len;
+        uint16_t reserved;
+        uint32_t crc; // CRC-32 over the sequence number, length and record
+    } SlotHeader_t;
+
+    static const uint32_t kMagic = 0x53434253u; // "SCBS"
+    static const uint16_t kSlotLen = FLASH_PAGE_SIZE;
+    static const uint16_t kMaxRecordLen = kSlotLen - sizeof(SlotHeader_t);
+
+    FlashStore(uint32_t flash_offset, uint16_t num_sectors);
+
+    bool Load(void * record_out, uint16_t record_len);
+    bool Save(const void * record_in, uint16_t record_len);
+    void Erase();
+    uint32_t GetSequence();
+
+private:
+    bool Scan(uint16_t & newest_slot);
+    const SlotHeader_t * GetSlotHeader(uint16_t slot);
+    bool SlotIsValid(uint16_t slot);
+    bool SlotIsBlank(uint16_t slot);
+    static uint32_t CalculateCRC(uint32_t crc, const uint8_t * data, uint32_t len);
+
+    uint32_t flash_offset_; // sector aligned, from the start of flash (not XIP_BASE)
+    uint16_t num_sectors_;
+    uint16_t num_slots_;
+    bool scanned_ = false; // next_slot_ and sequence_ are only known after the region has been scanned once
+    uint16_t next_slot_ = 0;
+    uint32_t sequence_ = 0; // of the newest record, 0 if there isn't one
+};
+
+#endif /* _FLASH_STORE_HH_ */
@@ -7,6 +7,9 @@
 #include "hardware/pwm.h"
 #include "hardware/adc.h"
 #include "scbs_comms.hh"
+#include "battery_model.hh"
+#include "current_stats.hh"
+#include "flash_store.hh"
 
 #include <stdint.h>
 
@@ -17,13 +20,75 @@ public:
     static const uint16_t kMaxUARTBufLen = 200;
 
     static const uint32_t kRegAddrSetOutputVoltage = 0x1000;
+    static const uint32_t kRegAddrRampTargetVoltage = 0x1001; // [V] control tick walks the output here at the ramp rate
+    static const uint32_t kRegAddrRampRate = 0x1002; // [V/s] 0 = jump straight to the target
+    static const uint32_t kRegAddrRampDone = 0x1003; // 1 once the output has reached the target
     static const uint32_t kRegAddrReadOutputCurrent = 0x2000;
+    static const uint32_t kRegAddrReadLatchedCurrent = 0x2001; // sampled by the last SYN packet
+    static const uint32_t kRegAddrStatsWindowMs = 0x2100; // 0 = since reset, any write restarts the statistics
+    static const uint32_t kRegAddrStatsNumSamples = 0x2101; // statistics below are over the last completed window
+    static const uint32_t kRegAddrStatsMeanCurrent = 0x2102; // [mA]
+    static const uint32_t kRegAddrStatsMinCurrent = 0x2103; // [mA]
+    static const uint32_t kRegAddrStatsMaxCurrent = 0x2104; // [mA]
+    static const uint32_t kRegAddrStatsRMSCurrent = 0x2105; // [mA]
+    static const uint32_t kRegAddrStatsStdDevCurrent = 0x2106; // [mA]
+    static const uint32_t kRegAddrChargeMAh = 0x2110; // coulomb counter, positive = discharge, write 0 to reset
+    static const uint32_t kRegAddrComparatorEnable = 0x2200; // bit 0 = high, bit 1 = low, any write re-arms both
+    static const uint32_t kRegAddrComparatorHighLevel = 0x2201; // [mA]
+    static const uint32_t kRegAddrComparatorLowLevel = 0x2202; // [mA]
+    static const uint32_t kRegAddrComparatorHysteresis = 0x2203; // [mA]
+    static const uint32_t kRegAddrComparatorStatus = 0x2204; // bit 0 = high tripped, bit 1 = low tripped
+    static const uint32_t kRegAddrEventCount = 0x2205; // EVT packets sent, for spotting lost events
     static const uint32_t kRegAddrReadFirmwareVersion = 0x3000;
+    static const uint32_t kRegAddrGroupID = 0x3001; // SWR/SRD packets sent to "G<id>" reach every cell in the group
+    static const uint32_t kRegAddrUniqueID = 0x3002; // 64 bit board ID from the flash chip, hex
+    static const uint32_t kRegAddrSaveSettings = 0x3003; // write 1 to save settings, 0 to forget them, reads saves done
+    static const uint32_t kRegAddrVoltageCalTable = 0x3100; // [V] output error at 0V, 0.45V, ... 4.5V, 0x3100-0x310A
+    static const uint32_t kRegAddrCurrentCalOffset = 0x3110; // [ADC counts] reading at zero current
+    static const uint32_t kRegAddrCurrentCalGain = 0x3111; // applied after the offset, capture samples stay uncalibrated
+    static const uint32_t kRegAddrStreamPeriodMs = 0x4000; // 0 = streaming off, 209ms min at 9600 baud, max 20 cells
+    static const uint32_t kRegAddrStreamRegAddr = 0x4001;
+    static const uint32_t kRegAddrSyncHopTrimUs = 0x5000; // signed, added to the calculated hop delay
+    static const uint32_t kRegAddrSyncLatchCount = 0x5001;
+    static const uint32_t kRegAddrStagingEnable = 0x5002; // 1 = hold register writes until the next SYN sample time
+    static const uint32_t kRegAddrStagedWriteCount = 0x5003; // write 0 to throw away the staged writes
+    static const uint32_t kRegAddrCommitErrCode = 0x5004; // first error from the last commit, kErrCodeNone if all OK
+    static const uint32_t kRegAddrProfileControl = 0x6000; // write ProfileState_t to stop, start or arm, reads state
+    static const uint32_t kRegAddrProfileLoop = 0x6001; // 1 = start over after the last point
+    static const uint32_t kRegAddrProfileNumPoints = 0x6002; // write to truncate, 0 clears the profile
+    static const uint32_t kRegAddrModelEnable = 0x7000; // 1 = output voltage follows the battery model
+    static const uint32_t kRegAddrModelCapacityMAh = 0x7001;
+    static const uint32_t kRegAddrModelSOC = 0x7002; // [%]
+    static const uint32_t kRegAddrModelR0MOhm = 0x7003;
+    static const uint32_t kRegAddrModelRCPairs = 0x7004; // R [mOhm] then tau [ms] for each RC pair, 0x7004-0x7007
+    static const uint32_t kRegAddrModelOCVTable = 0x7100; // OCV [V] at 0%, 10%, ... 100% SOC, 0x7100-0x710A
+    static const uint32_t kRegAddrCaptureControl = 0x8000; // write CaptureState_t to stop, arm or trigger, reads state
+    static const uint32_t kRegAddrCaptureSamplePeriodUs = 0x8001;
+    static const uint32_t kRegAddrCapturePreTriggerSamples = 0x8002; // history to keep from before the trigger
+    static const uint32_t kRegAddrCaptureTriggerMode = 0x8003; // CaptureTrigger_t
+    static const uint32_t kRegAddrCaptureTriggerLevel = 0x8004; // [mA]
+    static const uint32_t kRegAddrCaptureNumSamples = 0x8005; // read the samples out with BRD packets once done
+    static const uint32_t kRegAddrCaptureTriggerIndex = 0x8006; // index of the trigger sample in the readout
+
+    static const uint16_t kMaxNumProfilePoints = 256;
+    static const uint16_t kMaxNumStagedWrites = 16;
+    static const uint16_t kCaptureBufLen = 4096; // [samples]
+    static const uint32_t kMinCaptureSamplePeriodUs = 20;
+    static const uint16_t kMaxNumStreamCells = MRDPacket::kMaxNumValues; // one value per cell in a telemetry frame
+    static const uint16_t kFlashStoreNumSectors = 4; // saves are spread over 4 * 16 pages
+    static const uint32_t kSettingsSaveQuietTimeUs = 20000; // idle line needed before writing settings to flash
+    static const uint16_t kNumVoltageCalPoints = 11; // evenly spaced from 0V to the max output voltage
+    static const uint16_t kCurrentCalGainFracBits = 16; // current gain is kept in Q16
+
+    static const uint16_t kFirstCellID = 1; // ID given to the cell closest to the host by a DIS packet with last_cell_id 0
 
     static const uint16_t kErrCodeNone = 0x00;
     static const uint16_t kErrCodeAddrNotRecognized = 0x01;
     static const uint16_t kErrCodePacketLengthExceeded = 0x02;
     static const uint16_t kErrCodeWriteNotSupported = 0x03;
+    static const uint16_t kErrCodeInvalidValue = 0x04;
+    static const uint16_t kErrCodeBusy = 0x05;
+    static const uint16_t kErrCodeFlashWriteFailed = 0x06;
     static const uint16_t kErrCodeReceivedInvalidPacket = 0x0F;
 
     typedef struct {
@@ -42,30 +107,75 @@ public:
         uint16_t csense_adc_input = 2;
 
         uint16_t led_pin = 25;
+
+        uint32_t flash_store_offset = PICO_FLASH_SIZE_BYTES - kFlashStoreNumSectors * FLASH_SECTOR_SIZE; // end of flash
     } SCBSConfig_t;
 
+    typedef enum {
+        PROFILE_STOPPED = 0,
+        PROFILE_PLAYING,
+        PROFILE_ARMED // starts playing at the time set by the next SYN packet
+    } ProfileState_t;
+
+    typedef enum {
+        COMPARATOR_HIGH = 0, // current at or above the high level
+        COMPARATOR_LOW, // current at or below the low level
+        kNumComparators
+    } Comparator_t;
+
+    typedef enum {
+        EVENT_CURRENT_HIGH = 1, // comparator codes are 1 + 2*comparator for tripped, +1 for cleared
+        EVENT_CURRENT_HIGH_CLEARED,
+        EVENT_CURRENT_LOW,
+        EVENT_CURRENT_LOW_CLEARED
+    } EventCode_t;
+
+    typedef enum {
+        CAPTURE_IDLE = 0,
+        CAPTURE_ARMED, // sampling into the pre-trigger history, waiting for the trigger
+        CAPTURE_TRIGGERED, // filling the rest of the buffer
+        CAPTURE_DONE
+    } CaptureState_t;
+
+    typedef enum {
+        CAPTURE_TRIGGER_MANUAL = 0, // only triggered by writing CAPTURE_TRIGGERED (e.g. with an MWR to every cell)
+        CAPTURE_TRIGGER_RISING, // current goes from below the trigger level to at or above it
+        CAPTURE_TRIGGER_FALLING // current goes from above the trigger level to at or below it
+    } CaptureTrigger_t;
+
     SCBS(SCBSConfig_t config);
+    ~SCBS();
 
     void Init();
     void Update();
 
     uint16_t GetCellID();
+    uint64_t GetUniqueID();
+    float GetOutputVoltage();
 
 private:
     void DISPacketHandler(DISPacket packet_in);
     void MWRPacketHandler(MWRPacket packet_in);
     void MRDPacketHandler(MRDPacket packet_in);
+    void AppendAndForwardMRDPacket(MRDPacket packet_in);
     void SWRPacketHandler(SWRPacket packet_in);
     void SRDPacketHandler(SRDPacket packet_in);
+    void RespondToSRDPacket(SRDPacket packet_in);
     void SRSPacketHandler(SRSPacket packet_in);
+    void VWRPacketHandler(VWRPacket packet_in);
+    void SYNPacketHandler(SYNPacket packet_in);
+    void PRFPacketHandler(PRFPacket packet_in);
+    void BRDPacketHandler(BRDPacket packet_in);
+    void BRSPacketHandler(BRSPacket packet_in);
+    void EVTPacketHandler(EVTPacket packet_in);
 
-    uint16_t WriteRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]);
+    uint16_t WriteRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen], bool allow_staging = true);
     uint16_t ReadRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPacketFieldLen]);
 
     void FlushUARTBuf();
     void AppendCharToUARTBuf(char new_char);
 
-    void TransmitError(uint16_t err_code);
+    void TransmitError(uint16_t err_code, uint16_t tag = BSPacket::kNoTag);
     template <class PacketType>
     void TransmitPacket(PacketType packet);
     uint16_t ReceivePacket();
@@ -74,16 +184,149 @@ private:
     void ReadOutputCurrent();
     float GetOutputCurrent();
 
+    void StreamTelemetry();
+    void UpdateComparators();
+    void TransmitEvents();
+    uint32_t GetUARTBitsPerChar();
+    uint32_t GetMinStreamPeriodMs();
+    uint32_t CalculateHopDelayUs(uint16_t packet_len);
+    void SyncSample();
+    uint16_t StageWrite(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]);
+    void CommitStagedWrites();
+
+    static bool ControlTickCallback(repeating_timer_t * rt);
+    void ControlTick();
+    uint16_t WriteProfilePoints(uint16_t first_point_index, char points_in[][BSPacket::kMaxPacketFieldLen], uint16_t num_points);
+    uint16_t SetProfileState(ProfileState_t new_state);
+    void PlayProfile();
+    void StepRamp();
+    uint16_t WriteModelRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]);
+    uint16_t ReadModelRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPacketFieldLen]);
+    uint16_t WriteCalibrationRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]);
+    uint16_t ReadCalibrationRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPacketFieldLen]);
+    int32_t GetVoltageCalOffsetUV(int32_t voltage_uv);
+    int32_t ADCCountsToCurrentUA(uint16_t adc_counts);
+    uint16_t CurrentToADCCounts(float current);
+
+    static bool CaptureTimerCallback(repeating_timer_t * rt);
+    bool CaptureSample();
+    uint16_t SetCaptureState(CaptureState_t new_state);
+    bool CaptureIsRunning();
+
     void TurnOnStatusLED(uint32_t on_time_ms);
 
+    static const uint16_t kPersistentRecordVersion = 2; // bump when PersistentRecord_t changes
+
+    // Everything that should survive a power cycle. Only saved when asked to (or when a DIS packet changes the cell
+    // ID), to keep flash wear down.
+    typedef struct {
+        uint16_t version;
+        uint16_t cell_id;
+        uint16_t group_id;
+        uint16_t comparator_enable;
+        int32_t voltage_cal_offsets_uv[kNumVoltageCalPoints];
+        int32_t current_cal_offset_counts;
+        uint32_t current_cal_gain_q16;
+        uint32_t stream_period_ms;
+        uint32_t stream_reg_addr;
+        uint32_t stats_window_ms;
+        int32_t sync_hop_trim_us;
+        float ramp_rate; // [V/s]
+        float comparator_levels[kNumComparators]; // [mA]
+        float comparator_hysteresis; // [mA]
+    } PersistentRecord_t;
+    static_assert(sizeof(PersistentRecord_t) <= FlashStore::kMaxRecordLen);
+
+    void LoadPersistentRecord();
+    PersistentRecord_t SnapshotPersistentRecord();
+    bool SavePersistentRecord(PersistentRecord_t record);
+    void SavePendingSettings();
+
     SCBSConfig_t config_;
+    FlashStore flash_store_;
+    PersistentRecord_t persistent_record_; // as last loaded or saved
+    PersistentRecord_t default_record_; // compiled-in settings, what an erased flash store comes back up with
+    PersistentRecord_t pending_record_; // settings as they were when kRegAddrSaveSettings was written
+    bool settings_save_pending_ = false; // pending_record_ is waiting to be saved
+    bool settings_forget_pending_ = false; // flash is waiting to be erased
+    bool cell_id_save_pending_ = false; // set by a DIS that changed the cell ID, cleared once it's saved
+    uint64_t unique_id_ = 0;
 
     char uart_rx_buf_[kMaxUARTBufLen];
     uint16_t uart_rx_buf_len_ = 0;
+    uint32_t uart_rx_timestamp_ = 0; // when the last character of the packet in uart_rx_buf_ arrived
 
-    uint16_t cell_id_;
+    uint16_t cell_id_ = 0;
+    uint16_t group_id_ = BSPacket::kNoGroupID;
+    int32_t voltage_cal_offsets_uv_[kNumVoltageCalPoints]; // subtracted from the setpoint before it goes to the PWM
+    int32_t current_cal_offset_counts_ = 0;
+    uint32_t current_cal_gain_q16_ = 1 << kCurrentCalGainFracBits;
     float output_voltage_ = 0.0f; // [V]
     float output_current_ = 0.0f; // [mA]
+    CurrentStats current_stats_; // fed with every current sample
+
+    uint16_t comparator_enable_ = 0; // bit per Comparator_t
+    float comparator_levels_[kNumComparators] = {0.0f, 0.0f}; // [mA]
+    float comparator_hysteresis_ = 0.0f; // [mA]
+    uint16_t comparator_status_ = 0; // bit per Comparator_t, set while tripped
+    uint16_t events_pending_ = 0; // bit per EventCode_t, waiting for TransmitEvents()
+    float event_currents_[EVENT_CURRENT_LOW_CLEARED+1]; // [mA] reading that caused each pending event
+    uint32_t event_count_ = 0;
+
+    uint32_t stream_period_ms_ = 0;
+    uint32_t stream_reg_addr_ = kRegAddrReadOutputCurrent;
+    uint32_t stream_last_timestamp_ = 0;
+
+    bool sync_pending_ = false;
+    uint32_t sync_timestamp_ = 0; // when to take the synchronized sample
+    int32_t sync_hop_trim_us_ = 0;
+    uint32_t sync_latch_count_ = 0;
+    float latched_current_ = 0.0f; // [mA]
+
+    typedef struct {
+        uint32_t reg_addr;
+        char value[BSPacket::kMaxPacketFieldLen];
+    } StagedWrite_t;
+
+    bool staging_enabled_ = false;
+    StagedWrite_t staged_writes_[kMaxNumStagedWrites]; // applied in order at the next sync time
+    uint16_t num_staged_writes_ = 0;
+    uint16_t commit_err_code_ = kErrCodeNone;
+
+    typedef struct {
+        uint32_t time_ms; // since the start of the profile
+        float voltage; // [V]
+    } ProfilePoint_t;
+
+    repeating_timer_t control_timer_ = {};
+    ProfilePoint_t profile_points_[kMaxNumProfilePoints];
+    uint16_t profile_num_points_ = 0;
+    uint16_t profile_point_index_ = 0; // start of the segment being played
+    volatile ProfileState_t profile_state_ = PROFILE_STOPPED; // shared with the control tick
+    bool profile_loop_ = false;
+    uint64_t profile_start_timestamp_ = 0;
+
+    float ramp_target_voltage_ = 0.0f; // [V]
+    float ramp_rate_ = 0.0f; // [V/s]
+    volatile bool ramp_active_ = false; // shared with the control tick
+
+    BatteryModel battery_model_;
+    volatile bool battery_model_enabled_ = false; // shared with the control tick
+
+    repeating_timer_t capture_timer_ = {};
+    uint16_t capture_buf_[kCaptureBufLen]; // ring buffer of raw ADC counts
+    uint16_t capture_write_index_ = 0; // where the next sample goes in capture_buf_
+    uint16_t capture_num_samples_ = 0; // ending at capture_write_index_
+    uint16_t capture_samples_left_ = 0; // still to take after the trigger
+    uint16_t capture_trigger_index_ = 0; // counted from the oldest sample
+    volatile CaptureState_t capture_state_ = CAPTURE_IDLE; // shared with the capture timer
+    volatile bool capture_force_trigger_ = false;
+    volatile uint16_t capture_last_counts_ = 0; // most recent sample, used by ReadOutputCurrent() during a capture
+    uint32_t capture_sample_period_us_ = 100;
+    uint16_t capture_pre_trigger_samples_ = kCaptureBufLen/4;
+    CaptureTrigger_t capture_trigger_mode_ = CAPTURE_TRIGGER_MANUAL;
+    float capture_trigger_level_ = 0.0f; // [mA]
+    uint16_t capture_trigger_level_counts_ = 0;
 
     bool status_led_on_ = false;
     uint32_t status_led_off_timestamp_ = 0;
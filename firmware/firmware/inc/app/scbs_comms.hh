@@ -10,9 +10,40 @@ public:
     static const uint16_t kMaxPacketFieldLen = 20;
     static const uint16_t kPacketHeaderLen = 6; // $BSDIS, no EOS
     static const uint16_t kPacketTailLen = 3; // *FC, no EOS
-    static const uint16_t kMaxPacketContentsLen = kMaxPacketLen - kPacketHeaderLen - kPacketTailLen;
+    static const uint16_t kMaxPacketTagLen = 5; // #FFFF, no EOS
+    static const uint16_t kMaxPacketContentsLen = kMaxPacketLen - kPacketHeaderLen - kMaxPacketTagLen - kPacketTailLen;
 
-    static const uint16_t kNumPacketTypes = 6;
+    // Any packet can carry an optional tag on its header (e.g. "$BSSRD#1A,3,2000*CS"). Cells copy the tag onto
+    // packets they forward and onto the SRS packets they respond with, so a host can have several requests in flight
+    // and match each response to its request. kNoTag means the packet is untagged and is sent without the suffix.
+    static const uint16_t kNoTag = 0;
+
+    static const uint16_t kBroadcastCellID = 0; // for packets with a cell_id that should go to every cell
+
+    // Read packets (MRD, SRD) can carry a list of register addresses in a single field, separated by '|'
+    // (e.g. "1000|2000|3000"). Registers are read in list order and the values are returned in the same order.
+    static const uint16_t kMaxNumRegAddrs = 4;
+    static const uint16_t kMaxRegAddrStrLen = 8; // 32-bit address in hex, no EOS
+    static const uint16_t kMaxRegAddrsStrLen = kMaxNumRegAddrs*(kMaxRegAddrStrLen+1); // separators and EOS
+    static_assert(kMaxRegAddrsStrLen < kMaxPacketContentsLen/4); // leave most of the packet for values
+
+    // Single packets (SWR, SRD) can go to several cells at once by putting an inclusive cell ID range (e.g. "3-14") or a
+    // group (e.g. "G2", every cell with its group ID register set to 2) in the cell ID field.
+    static const uint16_t kNoGroupID = 0;
+    static const uint16_t kMaxCellSelectorStrLen = 11; // "65535-65535", no EOS
+    typedef struct {
+        uint16_t first_cell_id;
+        uint16_t last_cell_id; // same as first_cell_id for a single cell
+        uint16_t group_id; // kNoGroupID unless the packet is for a group, cell IDs are ignored if set
+    } CellSelector_t;
+
+    static CellSelector_t SingleCell(uint16_t cell_id);
+    static CellSelector_t CellRange(uint16_t first_cell_id, uint16_t last_cell_id);
+    static CellSelector_t CellGroup(uint16_t group_id);
+    static bool SelectsCell(CellSelector_t cells, uint16_t cell_id, uint16_t group_id);
+    static bool IsMulticast(CellSelector_t cells);
+
+    static const uint16_t kNumPacketTypes = 12;
 
     typedef enum {
         DIS = 0, // cell discover
@@ -22,6 +53,12 @@ public:
         SWR, // single write
         // MRS, // multi response
         SRS, // single response
+        VWR, // vector write
+        SYN, // synchronized sample trigger
+        PRF, // voltage profile points
+        BRD, // bulk read
+        BRS, // bulk response
+        EVT, // event notification
         UNKNOWN
     } PacketType_t;
     static_assert(static_cast<uint16_t>(UNKNOWN) == kNumPacketTypes);
@@ -34,12 +71,19 @@ public:
         "BSSWR",
         // "BSMRS",
         "BSSRS",
+        "BSVWR",
+        "BSSYN",
+        "BSPRF",
+        "BSBRD",
+        "BSBRS",
+        "BSEVT",
         "?????"
     }; // Note: these must be <= kPacketHeaderLen characters (not including EOS).
 
     // Overloaded constructors.
     BSPacket();
     BSPacket(char from_str_buf[kMaxPacketLen]);
+    virtual ~BSPacket() {} // host tools hold parsed packets by base pointer
 
     // Public interface functions.
     virtual void FromString(char from_str_buf[kMaxPacketLen]);
@@ -48,14 +92,22 @@ public:
     bool IsValid();
 
     PacketType_t GetPacketType();
+    uint16_t GetTag();
+    void SetTag(uint16_t tag_in);
 protected:
     uint16_t PacketizeContents(char packet_contents_str[kMaxPacketContentsLen], char to_str_buf[kMaxPacketLen]);
+    static char * SplitTag(char * header_str);
+    static uint16_t RegAddrsFromString(char * reg_addrs_str, uint32_t reg_addrs_out[kMaxNumRegAddrs]);
+    static uint16_t RegAddrsToString(uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in, char reg_addrs_str[kMaxRegAddrsStrLen]);
+    static bool CellSelectorFromString(char * cells_str, CellSelector_t & cells_out);
+    static uint16_t CellSelectorToString(CellSelector_t cells, char cells_str[kMaxCellSelectorStrLen+1]);
     
     char packet_str_[kMaxPacketLen];
     // uint16_t packet_str_len_;
 
     bool is_valid_;
     PacketType_t packet_type_ = UNKNOWN;
+    uint16_t tag_ = kNoTag;
 };
 
 // Battery Simulator Cell Discover Packet
@@ -86,16 +138,20 @@ public:
 // Battery Simulator Multi Read Packet
 class MRDPacket : public BSPacket {
 public:
-    static const uint16_t kMaxNumValues = 20;
+    static const uint16_t kMaxNumValues = 20; // Total across all cells, each cell appends one value per register.
 
     MRDPacket(uint32_t reg_addr_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in);
+    MRDPacket(uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in);
     MRDPacket(char from_str_buf[kMaxPacketLen]);
 
     void FromString(char from_str_buf[kMaxPacketLen]);
     uint16_t ToString(char to_str_buf[kMaxPacketLen]);
 
-    uint32_t reg_addr = 0x00u;
-    char values[kMaxNumValues][kMaxPacketFieldLen];
+    static uint16_t MaxNumCells(uint16_t num_reg_addrs_in, uint16_t max_value_len);
+
+    uint32_t reg_addrs[kMaxNumRegAddrs];
+    uint16_t num_reg_addrs = 0;
+    char values[kMaxNumValues][kMaxPacketFieldLen]; // num_reg_addrs values per cell, in chain order
     uint16_t num_values;
 };
 
@@ -103,12 +159,16 @@ public:
 class SWRPacket : public BSPacket {
 public:
     SWRPacket(uint16_t cell_id_in, uint32_t reg_addr_in, char value_in[kMaxPacketFieldLen]);
+    SWRPacket(CellSelector_t cells_in, uint32_t reg_addr_in, char value_in[kMaxPacketFieldLen]);
     SWRPacket(char from_str_buf[kMaxPacketLen]);
 
     void FromString(char from_str_buf[kMaxPacketLen]);
     uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+    CellSelector_t GetCells();
 
-    uint16_t cell_id = 0;
+    uint16_t cell_id = 0; // first cell if this is for a range of cells
+    uint16_t last_cell_id = 0;
+    uint16_t group_id = kNoGroupID;
     uint32_t reg_addr = 0x00u;
     char value[kMaxPacketFieldLen];
 };
@@ -117,26 +177,133 @@ public:
 class SRDPacket : public BSPacket {
 public:
     SRDPacket(uint16_t cell_id_in, uint32_t reg_addr_in);
+    SRDPacket(uint16_t cell_id_in, uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in);
+    SRDPacket(CellSelector_t cells_in, uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in);
     SRDPacket(char from_str_buf[kMaxPacketLen]);
 
     void FromString(char from_str_buf[kMaxPacketLen]);
     uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+    CellSelector_t GetCells();
 
-    uint16_t cell_id = 0;
-    uint32_t reg_addr = 0x00u;
+    uint16_t cell_id = 0; // first cell if this is for a range of cells
+    uint16_t last_cell_id = 0;
+    uint16_t group_id = kNoGroupID;
+    uint32_t reg_addrs[kMaxNumRegAddrs];
+    uint16_t num_reg_addrs = 0;
 };
 
 // Battery Simulator Single Response Packet
 class SRSPacket : public BSPacket {
 public:
+    static const uint16_t kMaxNumValues = kMaxNumRegAddrs; // one value per register in a multi-register SRD
+
     SRSPacket(uint16_t cell_id_in, char value_in[kMaxPacketFieldLen]);
+    SRSPacket(uint16_t cell_id_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in);
     SRSPacket(char from_str_buf[kMaxPacketLen]);
 
     void FromString(char from_str_buf[kMaxPacketLen]);
     uint16_t ToString(char to_str_buf[kMaxPacketLen]);
 
     uint16_t cell_id = 0;
-    char value[kMaxPacketFieldLen];
+    char values[kMaxNumValues][kMaxPacketFieldLen];
+    uint16_t num_values = 0;
+};
+
+// Battery Simulator Vector Write Packet
+class VWRPacket : public BSPacket {
+public:
+    static const uint16_t kMaxNumValues = 20;
+    // Make sure a full packet of short values (e.g. "3.70") fits alongside the longest register address.
+    static_assert(kMaxNumValues * (4 + 1) + 8 <= kMaxPacketContentsLen);
+
+    VWRPacket(uint32_t reg_addr_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in);
+    VWRPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint32_t reg_addr = 0x00u;
+    char values[kMaxNumValues][kMaxPacketFieldLen]; // values[0] is consumed by the next cell in the chain
+    uint16_t num_values;
+};
+
+// Battery Simulator Synchronized Sample Packet
+class SYNPacket : public BSPacket {
+public:
+    SYNPacket(uint32_t delay_us_in);
+    SYNPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint32_t delay_us = 0; // time from when the receiving cell gets the packet until all cells sample
+};
+
+// Battery Simulator Profile Points Packet
+class PRFPacket : public BSPacket {
+public:
+    static const uint16_t kMaxNumPoints = 12;
+    // Make sure a full packet of typical points (e.g. "123456:3.700") fits.
+    static_assert(kMaxNumPoints * (12 + 1) + 6 + 6 <= kMaxPacketContentsLen);
+
+    PRFPacket(uint16_t cell_id_in, uint16_t first_point_index_in, char points_in[][kMaxPacketFieldLen], uint16_t num_points_in);
+    PRFPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint16_t cell_id = 0; // kBroadcastCellID to load the points into every cell
+    uint16_t first_point_index = 0;
+    char points[kMaxNumPoints][kMaxPacketFieldLen]; // "<time_ms>:<voltage>"
+    uint16_t num_points = 0;
+};
+
+// Battery Simulator Bulk Read Packet
+class BRDPacket : public BSPacket {
+public:
+    BRDPacket(uint16_t cell_id_in, uint16_t offset_in, uint16_t num_samples_in);
+    BRDPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint16_t cell_id = 0;
+    uint16_t offset = 0; // index of the first sample to read
+    uint16_t num_samples = 0; // cell responds with fewer if the buffer runs out or they don't fit in a BRS packet
+};
+
+// Battery Simulator Bulk Response Packet
+class BRSPacket : public BSPacket {
+public:
+    static const uint16_t kSampleStrLen = 3; // 12-bit samples as fixed width hex, packed with no delimiters
+    static const uint16_t kMaxNumSamples = 56;
+    // Make sure a full packet of samples fits alongside the longest cell ID and offset.
+    static_assert(kMaxNumSamples * kSampleStrLen + 6 + 6 <= kMaxPacketContentsLen);
+
+    BRSPacket(uint16_t cell_id_in, uint16_t offset_in, uint16_t samples_in[], uint16_t num_samples_in);
+    BRSPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint16_t cell_id = 0;
+    uint16_t offset = 0;
+    uint16_t samples[kMaxNumSamples];
+    uint16_t num_samples = 0;
+};
+
+// Battery Simulator Event Packet, sent by a cell on its own and forwarded to the host like an SRS
+class EVTPacket : public BSPacket {
+public:
+    EVTPacket(uint16_t cell_id_in, uint16_t event_code_in, char value_in[kMaxPacketFieldLen]);
+    EVTPacket(char from_str_buf[kMaxPacketLen]);
+
+    void FromString(char from_str_buf[kMaxPacketLen]);
+    uint16_t ToString(char to_str_buf[kMaxPacketLen]);
+
+    uint16_t cell_id = 0; // cell that raised the event
+    uint16_t event_code = 0;
+    char value[kMaxPacketFieldLen]; // e.g. the reading that caused the event
 };
 
 #endif /* _SCBS_COMMS_HH_ */
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "battery_model.hh"
+
+#include <math.h> // for exp, only used when parameters change
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+const int64_t kNanoCoulombsPerMAh = 3600000000ll; // 1mAh = 3.6C
+const int32_t kSOCOne = 1 << BatteryModel::kSOCFracBits; // 100% SOC
+const int64_t kBetaOne = 1ll << BatteryModel::kBetaFracBits;
+
+// Default parameters are roughly a 2.5Ah 18650 cell.
+const uint32_t kDefaultCapacityMAh = 2500;
+const int32_t kDefaultOCVUV[BatteryModel::kNumOCVPoints] = {
+    3000000, 3450000, 3550000, 3620000, 3670000, 3720000, 3780000, 3850000, 3930000, 4030000, 4180000
+};
+const uint32_t kDefaultR0MOhm = 50;
+const uint32_t kDefaultRCPairRMOhm[BatteryModel::kNumRCPairs] = {20, 30};
+const uint32_t kDefaultRCPairTauMs[BatteryModel::kNumRCPairs] = {10000, 100000};
+
+/**
+ * @brief Constructor, loads default parameters and starts out fully charged and relaxed.
+ * @param[in] step_period_us Time between calls to Step().
+*/
+BatteryModel::BatteryModel(uint32_t step_period_us) {
+    step_period_us_ = step_period_us;
+    capacity_nc_ = kDefaultCapacityMAh * kNanoCoulombsPerMAh;
+    charge_nc_ = capacity_nc_;
+    for (uint16_t i = 0; i < kNumOCVPoints; i++) {
+        ocv_uv_[i] = kDefaultOCVUV[i];
+    }
+    r0_mohm_ = kDefaultR0MOhm;
+    for (uint16_t i = 0; i < kNumRCPairs; i++) {
+        SetRCPair(i, kDefaultRCPairRMOhm[i], kDefaultRCPairTauMs[i]);
+    }
+    Relax();
+}
+
+/**
+ * @brief Advances the model by one step period. Current is held constant over the step, which lets the RC pairs use
+ * the exact solution instead of an approximation that depends on the step size.
+ * @param[in] current_ua Current drawn from the cell over the step (positive = discharge).
+ * @retval Terminal voltage at the end of the step.
+*/
+int32_t BatteryModel::Step(int32_t current_ua) {
+    // Coulomb counting, uA * us = pC.
+    charge_nc_ -= static_cast<int64_t>(current_ua) * step_period_us_ / 1000;
+    charge_nc_ = MIN(MAX(charge_nc_, 0), capacity_nc_);
+
+    int64_t voltage_uv = GetOCV();
+    voltage_uv -= static_cast<int64_t>(current_ua) * r0_mohm_ / 1000; // uA * mOhm = nV
+    for (uint16_t i = 0; i < kNumRCPairs; i++) {
+        // Each RC pair closes a fraction beta of the gap to I*R every step. Fractional uV are kept, otherwise rounding
+        // error adds up to about tau/step_period uV of offset on slow pairs.
+        int64_t steady_state_v = static_cast<int64_t>(current_ua) * rc_r_mohm_[i] * (1 << kRCVoltageFracBits) / 1000;
+        rc_v_[i] += ((steady_state_v - rc_v_[i]) * rc_beta_[i] + (kBetaOne >> 1)) >> kBetaFracBits;
+        voltage_uv -= (rc_v_[i] + (1 << (kRCVoltageFracBits-1))) >> kRCVoltageFracBits;
+    }
+    terminal_voltage_uv_ = static_cast<int32_t>(voltage_uv);
+    return terminal_voltage_uv_;
+}
+
+/**
+ * @brief Discharges the RC pairs, as if the cell had been sitting with no load for a long time.
+*/
+void BatteryModel::Relax() {
+    for (uint16_t i = 0; i < kNumRCPairs; i++) {
+        rc_v_[i] = 0;
+    }
+    terminal_voltage_uv_ = GetOCV();
+}
+
+/**
+ * @brief Sets the capacity of the cell, keeping the same state of charge.
+ * @param[in] capacity_mah New capacity, railed to 1-kMaxCapacityMAh.
+*/
+void BatteryModel::SetCapacityMAh(uint32_t capacity_mah) {
+    capacity_mah = MIN(MAX(capacity_mah, 1u), kMaxCapacityMAh);
+    float soc_percent = GetSOCPercent();
+    capacity_nc_ = capacity_mah * kNanoCoulombsPerMAh;
+    SetSOCPercent(soc_percent);
+}
+
+uint32_t BatteryModel::GetCapacityMAh() {
+    return static_cast<uint32_t>(capacity_nc_ / kNanoCoulombsPerMAh);
+}
+
+/**
+ * @brief Sets the charge remaining in the cell.
+ * @param[in] soc_percent State of charge, railed to 0-100%.
+*/
+void BatteryModel::SetSOCPercent(float soc_percent) {
+    soc_percent = MIN(MAX(soc_percent, 0.0f), 100.0f);
+    charge_nc_ = static_cast<int64_t>(static_cast<double>(capacity_nc_) * soc_percent / 100.0);
+}
+
+float BatteryModel::GetSOCPercent() {
+    return static_cast<float>(100.0 * charge_nc_ / capacity_nc_);
+}
+
+/**
+ * @brief Sets a point in the open circuit voltage table.
+ * @param[in] index Point to set, point i is at i*100/(kNumOCVPoints-1) percent SOC. Ignored if out of range.
+ * @param[in] ocv_uv Open circuit voltage at that SOC.
+*/
+void BatteryModel::SetOCVPoint(uint16_t index, int32_t ocv_uv) {
+    if (index < kNumOCVPoints) {
+        ocv_uv_[index] = ocv_uv;
+    }
+}
+
+int32_t BatteryModel::GetOCVPoint(uint16_t index) {
+    return index < kNumOCVPoints ? ocv_uv_[index] : 0;
+}
+
+void BatteryModel::SetR0MOhm(uint32_t r0_mohm) {
+    r0_mohm_ = r0_mohm;
+}
+
+uint32_t BatteryModel::GetR0MOhm() {
+    return r0_mohm_;
+}
+
+/**
+ * @brief Sets the parameters of an RC pair. Set r_mohm to 0 to take the pair out of the model.
+ * @param[in] index RC pair to set, ignored if out of range.
+ * @param[in] r_mohm Resistance of the pair.
+ * @param[in] tau_ms Time constant of the pair (R*C).
+*/
+void BatteryModel::SetRCPair(uint16_t index, uint32_t r_mohm, uint32_t tau_ms) {
+    if (index >= kNumRCPairs) {
+        return;
+    }
+    rc_r_mohm_[index] = r_mohm;
+    rc_tau_ms_[index] = tau_ms;
+    UpdateRCPairBeta(index);
+}
+
+uint32_t BatteryModel::GetRCPairRMOhm(uint16_t index) {
+    return index < kNumRCPairs ? rc_r_mohm_[index] : 0;
+}
+
+uint32_t BatteryModel::GetRCPairTauMs(uint16_t index) {
+    return index < kNumRCPairs ? rc_tau_ms_[index] : 0;
+}
+
+/**
+ * @brief Looks up the open circuit voltage for the current state of charge, interpolating between table points.
+*/
+int32_t BatteryModel::GetOCV() {
+    int64_t soc_q16 = (charge_nc_ << kSOCFracBits) / capacity_nc_;
+    int64_t table_pos = MIN(MAX(soc_q16, 0), kSOCOne) * (kNumOCVPoints-1); // integer part is the table index
+    uint16_t index = static_cast<uint16_t>(table_pos >> kSOCFracBits);
+    if (index >= kNumOCVPoints-1) {
+        return ocv_uv_[kNumOCVPoints-1];
+    }
+    int64_t fraction = table_pos & (kSOCOne-1);
+    return ocv_uv_[index] + static_cast<int32_t>(((ocv_uv_[index+1] - ocv_uv_[index]) * fraction) >> kSOCFracBits);
+}
+
+int32_t BatteryModel::GetTerminalVoltage() {
+    return terminal_voltage_uv_;
+}
+
+/**
+ * @brief Recalculates the step factor of an RC pair after its time constant changes.
+*/
+void BatteryModel::UpdateRCPairBeta(uint16_t index) {
+    if (rc_tau_ms_[index] == 0) {
+        rc_beta_[index] = static_cast<int32_t>(kBetaOne); // no capacitance, behaves like a plain resistor
+        return;
+    }
+    double alpha = exp(-static_cast<double>(step_period_us_) / (rc_tau_ms_[index] * 1000.0));
+    rc_beta_[index] = static_cast<int32_t>((1.0 - alpha) * kBetaOne + 0.5);
+}
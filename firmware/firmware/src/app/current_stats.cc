@@ -0,0 +1,131 @@
+#include "current_stats.hh"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+/**
+ * @brief Constructor, starts out with empty statistics, no charge counted, and no window (statistics since reset).
+*/
+CurrentStats::CurrentStats() {
+    ClearAccumulator(window_);
+    ClearAccumulator(last_window_);
+}
+
+/**
+ * @brief Adds a current sample to the statistics and the coulomb counter. Rolls over to a new window first if the
+ * sample is past the end of the current one.
+ * @param[in] current_ua Current sample (positive = discharge).
+ * @param[in] timestamp_us When the sample was taken, from time_us_32(). Differences are safe across wrapping.
+*/
+void CurrentStats::AddSample(int32_t current_ua, uint32_t timestamp_us) {
+    // Coulomb counting, each sample stands for the time since the one before it. uA * us = pC.
+    if (have_last_timestamp_) {
+        charge_nc_ += static_cast<int64_t>(current_ua) * (timestamp_us - last_timestamp_us_) / 1000;
+    }
+    have_last_timestamp_ = true;
+    last_timestamp_us_ = timestamp_us;
+
+    if (window_ms_ > 0 && timestamp_us - window_start_timestamp_us_ >= window_ms_*1000) {
+        last_window_ = window_;
+        ClearAccumulator(window_);
+        window_start_timestamp_us_ = timestamp_us;
+    }
+
+    // Welford's method, numerically stable and doesn't need the sum of squares to fit anywhere.
+    window_.num_samples++;
+    int64_t sample_q16 = static_cast<int64_t>(current_ua) * (1 << kMeanFracBits);
+    int64_t delta_q16 = sample_q16 - window_.mean_q16;
+    window_.mean_q16 += delta_q16 / window_.num_samples;
+    int64_t new_delta_q16 = sample_q16 - window_.mean_q16;
+    // Both deltas have the same sign so the product is never negative. Dropping half the fraction bits from each keeps
+    // it in range for any current the cell can measure.
+    window_.m2 += static_cast<uint64_t>((delta_q16 >> (kMeanFracBits/2)) * (new_delta_q16 >> (kMeanFracBits/2))) >> kMeanFracBits;
+    window_.min_ua = MIN(window_.min_ua, current_ua);
+    window_.max_ua = MAX(window_.max_ua, current_ua);
+}
+
+/**
+ * @brief Sets the length of the statistics window and starts a new one.
+ * @param[in] window_ms Window length, or 0 to keep statistics since the last reset.
+*/
+void CurrentStats::SetWindowMs(uint32_t window_ms) {
+    window_ms_ = window_ms;
+    ResetWindow();
+}
+
+uint32_t CurrentStats::GetWindowMs() {
+    return window_ms_;
+}
+
+/**
+ * @brief Throws away the statistics collected so far, including the last completed window.
+*/
+void CurrentStats::ResetWindow() {
+    ClearAccumulator(window_);
+    ClearAccumulator(last_window_);
+    window_start_timestamp_us_ = last_timestamp_us_;
+}
+
+/**
+ * @brief Returns the statistics for the last completed window, or the statistics since the last reset if there's no
+ * window.
+*/
+CurrentStats::Summary_t CurrentStats::GetSummary() {
+    return Summarize(window_ms_ > 0 ? last_window_ : window_);
+}
+
+void CurrentStats::SetChargeNC(int64_t charge_nc) {
+    charge_nc_ = charge_nc;
+}
+
+int64_t CurrentStats::GetChargeNC() {
+    return charge_nc_;
+}
+
+void CurrentStats::ClearAccumulator(Accumulator_t & accumulator) {
+    accumulator.num_samples = 0;
+    accumulator.mean_q16 = 0;
+    accumulator.m2 = 0;
+    accumulator.min_ua = INT32_MAX;
+    accumulator.max_ua = INT32_MIN;
+}
+
+/**
+ * @brief Turns an accumulator into the numbers that get reported. Everything is 0 if there are no samples.
+*/
+CurrentStats::Summary_t CurrentStats::Summarize(Accumulator_t & accumulator) {
+    Summary_t summary = {0, 0, 0, 0, 0, 0};
+    if (accumulator.num_samples == 0) {
+        return summary;
+    }
+    summary.num_samples = accumulator.num_samples;
+    summary.mean_ua = static_cast<int32_t>((accumulator.mean_q16 + (1 << (kMeanFracBits-1))) >> kMeanFracBits);
+    summary.min_ua = accumulator.min_ua;
+    summary.max_ua = accumulator.max_ua;
+    uint64_t variance = accumulator.m2 / accumulator.num_samples;
+    summary.stddev_ua = SquareRoot(variance);
+    int64_t mean_ua = summary.mean_ua;
+    summary.rms_ua = SquareRoot(variance + static_cast<uint64_t>(mean_ua * mean_ua)); // mean square = var + mean^2
+    return summary;
+}
+
+/**
+ * @brief Integer square root, rounded down. Bit by bit so it doesn't need floating point or division.
+*/
+uint32_t CurrentStats::SquareRoot(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return static_cast<uint32_t>(root);
+}
@@ -0,0 +1,181 @@
+#include "flash_store.hh"
+#include "hardware/sync.h"
+#include <stdio.h> // for printing
+#include <string.h> // for memcpy
+
+const uint16_t kSlotsPerSector = FLASH_SECTOR_SIZE / FlashStore::kSlotLen;
+const uint32_t kCRCPolynomial = 0xEDB88320u; // CRC-32 (reflected), same as zlib
+
+/**
+ * @brief Constructor. Doesn't touch flash, the region is scanned on the first Load() or Save().
+ * @param[in] flash_offset Start of the region from the start of flash, must be sector aligned.
+ * @param[in] num_sectors Number of sectors in the region, at least 2 so that the newest record is never erased.
+*/
+FlashStore::FlashStore(uint32_t flash_offset, uint16_t num_sectors) {
+    flash_offset_ = flash_offset;
+    num_sectors_ = num_sectors < 2 ? 2 : num_sectors;
+    num_slots_ = num_sectors_ * kSlotsPerSector;
+}
+
+/**
+ * @brief Finds the newest valid record in the region and copies it out.
+ * @param[out] record_out Buffer to copy the record into.
+ * @param[in] record_len Expected record length. A stored record of any other length (e.g. saved by firmware with a
+ * different record layout) doesn't count.
+ * @retval true if a record was found, false if the region is empty and record_out was left alone.
+*/
+bool FlashStore::Load(void * record_out, uint16_t record_len) {
+    uint16_t newest_slot;
+    if (!Scan(newest_slot)) {
+        return false;
+    }
+    const SlotHeader_t * header = GetSlotHeader(newest_slot);
+    if (header->record_len != record_len) {
+        printf("FlashStore::Load: Newest record is %d bytes but expected %d.\r\n", header->record_len, record_len);
+        return false;
+    }
+    memcpy(record_out, reinterpret_cast<const uint8_t *>(header) + sizeof(SlotHeader_t), record_len);
+    return true;
+}
+
+/**
+ * @brief Saves a record into the next slot in the region, erasing the sector that the slot is in first if the slot
+ * is the first one in its sector. Interrupts are held off while flash is busy since nothing can run from flash then.
+ * @param[in] record_in Record to save.
+ * @param[in] record_len Length of the record, up to kMaxRecordLen.
+ * @retval true if the record was saved and reads back correctly.
+*/
+bool FlashStore::Save(const void * record_in, uint16_t record_len) {
+    if (record_len > kMaxRecordLen) {
+        printf("FlashStore::Save: Record is %d bytes but max is %d.\r\n", record_len, kMaxRecordLen);
+        return false;
+    }
+    if (!scanned_) {
+        uint16_t newest_slot;
+        Scan(newest_slot);
+    }
+    if (next_slot_ % kSlotsPerSector != 0 && !SlotIsBlank(next_slot_)) {
+        // Left over from a torn save, skip ahead to a fresh sector rather than erasing the one with the newest record.
+        next_slot_ = (next_slot_ / kSlotsPerSector + 1) * kSlotsPerSector % num_slots_;
+    }
+
+    uint8_t slot_buf[kSlotLen];
+    memset(slot_buf, 0xFF, kSlotLen);
+    SlotHeader_t header;
+    header.magic = kMagic;
+    header.sequence = sequence_ + 1;
+    header.record_len = record_len;
+    header.reserved = 0xFFFF;
+    header.crc = CalculateCRC(0, reinterpret_cast<uint8_t *>(&header.sequence), sizeof(header.sequence) + sizeof(header.record_len));
+    header.crc = CalculateCRC(header.crc, reinterpret_cast<const uint8_t *>(record_in), record_len);
+    memcpy(slot_buf, &header, sizeof(SlotHeader_t));
+    memcpy(slot_buf + sizeof(SlotHeader_t), record_in, record_len);
+
+    uint32_t slot_offset = flash_offset_ + next_slot_ * kSlotLen;
+    uint32_t interrupt_status = save_and_disable_interrupts();
+    if (next_slot_ % kSlotsPerSector == 0) {
+        flash_range_erase(slot_offset, FLASH_SECTOR_SIZE);
+    }
+    flash_range_program(slot_offset, slot_buf, kSlotLen);
+    restore_interrupts(interrupt_status);
+
+    uint16_t saved_slot = next_slot_;
+    next_slot_ = (next_slot_ + 1) % num_slots_;
+    if (!SlotIsValid(saved_slot)) {
+        printf("FlashStore::Save: Record didn't read back correctly from slot %d.\r\n", saved_slot);
+        return false;
+    }
+    sequence_ = header.sequence;
+    return true;
+}
+
+/**
+ * @brief Erases the whole region so that the next Load() finds nothing.
+*/
+void FlashStore::Erase() {
+    uint32_t interrupt_status = save_and_disable_interrupts();
+    flash_range_erase(flash_offset_, num_sectors_ * FLASH_SECTOR_SIZE);
+    restore_interrupts(interrupt_status);
+    scanned_ = true;
+    next_slot_ = 0;
+    sequence_ = 0;
+}
+
+/**
+ * @brief Returns the sequence number of the newest record, which is the number of saves since the region was last
+ * erased.
+*/
+uint32_t FlashStore::GetSequence() {
+    return sequence_;
+}
+
+/** Private Functions **/
+
+/**
+ * @brief Scans every slot for the newest valid record, which could be anywhere once the saves have wrapped around the
+ * region, and works out where the next save goes.
+ * @param[out] newest_slot Slot holding the newest record.
+ * @retval true if there was a valid record.
+*/
+bool FlashStore::Scan(uint16_t & newest_slot) {
+    bool found = false;
+    newest_slot = 0;
+    for (uint16_t slot = 0; slot < num_slots_; slot++) {
+        if (SlotIsValid(slot) && (!found || GetSlotHeader(slot)->sequence > GetSlotHeader(newest_slot)->sequence)) {
+            found = true;
+            newest_slot = slot;
+        }
+    }
+    scanned_ = true;
+    next_slot_ = found ? (newest_slot + 1) % num_slots_ : 0;
+    sequence_ = found ? GetSlotHeader(newest_slot)->sequence : 0;
+    return found;
+}
+
+const FlashStore::SlotHeader_t * FlashStore::GetSlotHeader(uint16_t slot) {
+    return reinterpret_cast<const SlotHeader_t *>(XIP_BASE + flash_offset_ + slot * kSlotLen);
+}
+
+/**
+ * @brief Checks that a slot holds a complete record: right magic number, sane length and matching CRC.
+*/
+bool FlashStore::SlotIsValid(uint16_t slot) {
+    const SlotHeader_t * header = GetSlotHeader(slot);
+    if (header->magic != kMagic || header->record_len > kMaxRecordLen) {
+        return false;
+    }
+    uint32_t crc = CalculateCRC(0, reinterpret_cast<const uint8_t *>(&header->sequence), sizeof(header->sequence) + sizeof(header->record_len));
+    crc = CalculateCRC(crc, reinterpret_cast<const uint8_t *>(header) + sizeof(SlotHeader_t), header->record_len);
+    return crc == header->crc;
+}
+
+/**
+ * @brief Checks that a slot is still erased and can be programmed without erasing its sector.
+*/
+bool FlashStore::SlotIsBlank(uint16_t slot) {
+    const uint8_t * slot_data = reinterpret_cast<const uint8_t *>(GetSlotHeader(slot));
+    for (uint16_t i = 0; i < kSlotLen; i++) {
+        if (slot_data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Bitwise CRC-32, slow but tiny and only run when loading or saving.
+ * @param[in] crc CRC so far, 0 to start a new one.
+ * @param[in] data Data to add to the CRC.
+ * @param[in] len Length of data.
+ * @retval Updated CRC.
+*/
+uint32_t FlashStore::CalculateCRC(uint32_t crc, const uint8_t * data, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint16_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (kCRCPolynomial & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
@@ -1,4 +1,5 @@
 #include "scbs.hh"
+#include "pico/unique_id.h"
 #include <stdio.h> // for printing
 #include <stdlib.h> // for strtof
 
@@ -7,12 +8,19 @@ const uint16_t kPWMDefaultDuty = 0; // out of kMaxPWMCount.
 const float kPowerSupplyVoltage5V = 5.0f; // [V]
 const float kMaxOutputVoltage = 4.5f; // [V]
 const float kMinOutputVoltage = 0.0f; // [V]
+const int32_t kPowerSupplyVoltage5VUV = 5000000; // [uV]
+const int32_t kMaxOutputVoltageUV = 4500000; // [uV] same as kMaxOutputVoltage
+const int32_t kVoltageCalStepUV = kMaxOutputVoltageUV / (SCBS::kNumVoltageCalPoints - 1); // [uV] between table points
+const float kMaxVoltageCalOffset = 1.0f; // [V]
 
+// Typical output error vs. setpoint, used for the calibration table until a board has its own saved.
 const float kOutputVoltageCalCoeffX3 = -0.006624709f;
 const float kOutputVoltageCalCoeffX2 = 0.07218648f;
 const float kOutputVoltageCalCoeffX = -0.278278555f;
 const float kOutputVoltageCalCoeffConst = 0.079586014f;
 
+const int64_t kControlTickPeriodUs = 1000; // 1kHz
+
 const uint32_t kPacketReceivedBlinkTimeMs = 10;
 const uint32_t kRegisterWriteBlinkTimeMs = 500;
 const uint32_t kRegisterReadBlinkTimeMs = 100;
@@ -21,14 +29,37 @@ const uint32_t kRegisterReadBlinkTimeMs = 100;
 const uint16_t kMaxADCCount = 1<<12;
 // const float kADCConversionFactor = kPowerSupplyVoltage3V3 / kMaxADCCount;
 const float kMaxCsenseCurrent = 200.0f;
+// 200mA / 4096 counts = 3125/64 uA per count, exactly, so the fixed point conversion doesn't round.
+const int64_t kCsenseUAPerCountNum = 3125;
+const uint16_t kCsenseUAPerCountShift = 6;
+const int32_t kMaxCurrentCalOffsetCounts = kMaxADCCount / 8;
+const float kMinCurrentCalGain = 0.5f;
+const float kMaxCurrentCalGain = 2.0f;
 
 /** Public Functions **/
 
 /**
  * @brief Constructor, copies configuration into the new SCBS object.
 */
-SCBS::SCBS(SCBSConfig_t config) {
+SCBS::SCBS(SCBSConfig_t config)
+    : flash_store_(config.flash_store_offset, kFlashStoreNumSectors),
+      battery_model_(kControlTickPeriodUs)
+{
     config_ = config;
+    for (uint16_t i = 0; i < kNumVoltageCalPoints; i++) {
+        float voltage = i * kVoltageCalStepUV * 1e-6f;
+        float offset = ((kOutputVoltageCalCoeffX3*voltage + kOutputVoltageCalCoeffX2)*voltage
+            + kOutputVoltageCalCoeffX)*voltage + kOutputVoltageCalCoeffConst;
+        voltage_cal_offsets_uv_[i] = static_cast<int32_t>(offset * 1e6f);
+    }
+}
+
+/**
+ * @brief Destructor, stops the control tick and any capture in progress so that they don't fire on a deleted object.
+*/
+SCBS::~SCBS() {
+    cancel_repeating_timer(&control_timer_);
+    cancel_repeating_timer(&capture_timer_);
 }
 
 /**
@@ -63,6 +94,19 @@ void SCBS::Init() {
     adc_init();
     adc_gpio_init(config_.csense_pin);
 
+    // Come back up with the cell ID, calibration and settings from before the power cycle, so that the host only has
+    // to check that the chain is still in the same order instead of rediscovering and reconfiguring it.
+    pico_unique_board_id_t board_id;
+    pico_get_unique_board_id(&board_id);
+    unique_id_ = 0;
+    for (uint16_t i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++) {
+        unique_id_ = (unique_id_ << 8) | board_id.id[i];
+    }
+    LoadPersistentRecord();
+
+    // Start the control tick, negative period so that it's measured from the start of each tick.
+    add_repeating_timer_us(-kControlTickPeriodUs, ControlTickCallback, this, &control_timer_);
+
     // give em a little blink
     gpio_put(config_.led_pin, 1);
     sleep_ms(100);
@@ -75,6 +119,9 @@ void SCBS::Init() {
  * @brief Update function, should be called every loop.
 */
 void SCBS::Update() {
+    // Synchronized Sample Process (first, to keep loop latency out of the sample time)
+    SyncSample();
+
     // Communication Process
     if (ReceivePacket() != 0) {
         TurnOnStatusLED(kPacketReceivedBlinkTimeMs);
@@ -101,6 +148,24 @@ void SCBS::Update() {
                 case BSPacket::SRS:
                     SRSPacketHandler(SRSPacket(uart_rx_buf_));
                     break;
+                case BSPacket::VWR:
+                    VWRPacketHandler(VWRPacket(uart_rx_buf_));
+                    break;
+                case BSPacket::SYN:
+                    SYNPacketHandler(SYNPacket(uart_rx_buf_));
+                    break;
+                case BSPacket::PRF:
+                    PRFPacketHandler(PRFPacket(uart_rx_buf_));
+                    break;
+                case BSPacket::BRD:
+                    BRDPacketHandler(BRDPacket(uart_rx_buf_));
+                    break;
+                case BSPacket::BRS:
+                    BRSPacketHandler(BRSPacket(uart_rx_buf_));
+                    break;
+                case BSPacket::EVT:
+                    EVTPacketHandler(EVTPacket(uart_rx_buf_));
+                    break;
                 default:
                     printf("SCBS::Update():     Unrecognized packet type.\r\n");
             }
@@ -110,10 +175,18 @@ void SCBS::Update() {
         FlushUARTBuf();
     }
     
-    // GPIO Process
-    SetOutputVoltage(output_voltage_);
+    // GPIO Process (output voltage is set by the control tick)
     ReadOutputCurrent();
 
+    // Event Process (comparators are checked on every current sample, send out anything they caught)
+    TransmitEvents();
+
+    // Streaming Telemetry Process
+    StreamTelemetry();
+
+    // Persistence Process (settings and cell ID, once nothing would notice interrupts being held off)
+    SavePendingSettings();
+
     // Update status LED
     if (status_led_on_ && time_us_32() > status_led_off_timestamp_) {
         gpio_put(config_.led_pin, 0);
@@ -128,6 +201,20 @@ uint16_t SCBS::GetCellID() {
     return cell_id_;
 }
 
+/**
+ * @brief Returns the board's unique ID, read from the flash chip at init.
+*/
+uint64_t SCBS::GetUniqueID() {
+    return unique_id_;
+}
+
+/**
+ * @brief Returns the output voltage setpoint, which follows the profile while one is playing.
+*/
+float SCBS::GetOutputVoltage() {
+    return output_voltage_;
+}
+
 /** Private Functions **/
 
 /**
@@ -140,10 +227,16 @@ void SCBS::DISPacketHandler(DISPacket packet_in) {
         printf("SCBS::DISPacketHandler: Formed a valid DIS packet!\r\n");
         cell_id_ = packet_in.last_cell_id + 1;
         DISPacket packet_out = DISPacket(cell_id_);
+        packet_out.SetTag(packet_in.GetTag());
         TransmitPacket(packet_out);
+
+        // Keep the new cell ID across power cycles, but only if it changed since rediscovering an unchanged chain
+        // shouldn't wear the flash. Saved later by Update(), since the flash write holds off interrupts and the host
+        // may already be sending the next request.
+        cell_id_save_pending_ = persistent_record_.cell_id != cell_id_;
     } else {
         printf("SCBS::DISPacketHandler: Formed a DIS packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
     }
 }
 
@@ -159,7 +252,7 @@ void SCBS::MWRPacketHandler(MWRPacket packet_in) {
         uint16_t err_code = WriteRegister(packet_in.reg_addr, packet_in.value);
         if (err_code != kErrCodeNone) {
             printf("SCBS::MWRPacketHandler: Register write to address 0x%X failed with code 0x%X.\r\n", packet_in.reg_addr, err_code);
-            TransmitError(err_code);
+            TransmitError(err_code, packet_in.GetTag());
             return; // drop original packet
         } else {
             // Pass to next device in the chain.
@@ -167,91 +260,140 @@ void SCBS::MWRPacketHandler(MWRPacket packet_in) {
         }
     } else {
         printf("SCBS::MWRPacketHandler: Formed an MWR packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
     }
 }
 
 /**
- * @brief Handler for an MRD (Multiple ReaD) packet. Performs a register read and appends the value to the end of the
- * MRD packet and forwards to the next device, or returns an SRS packet with an error code if something went wrong.
+ * @brief Handler for an MRD (Multiple ReaD) packet. Reads each register in the packet's register address list and
+ * appends the values to the end of the MRD packet (in list order) and forwards to the next device, or returns an SRS
+ * packet with an error code if something went wrong.
  * @param[in] packet_in Incoming MRD packet.
 */
 void SCBS::MRDPacketHandler(MRDPacket packet_in) {
     if (packet_in.IsValid()) {
         printf("SCBS::MRDPacketHandler: Formed a valid MRD packet!\r\n");
-        if (packet_in.num_values >= MRDPacket::kMaxNumValues) {
-            printf("SCBS::MRDPacketHandler: Incoming packet had too many values! Throwing a tantrum to draw attention.\r\n");
-            TransmitError(kErrCodePacketLengthExceeded);
-            return; // drop original packet
-        }
-        char my_value[BSPacket::kMaxPacketFieldLen] = "";
+        AppendAndForwardMRDPacket(packet_in);
+    } else {
+        printf("SCBS::MRDPacketHandler: Formed an MRD packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Reads each register in an MRD packet's register address list, appends the values to the end of the packet and
+ * forwards it to the next device. Returns an SRS packet with an error code instead if something went wrong.
+ * @param[in] packet_in MRD packet to append to.
+*/
+void SCBS::AppendAndForwardMRDPacket(MRDPacket packet_in) {
+    if (packet_in.num_values + packet_in.num_reg_addrs > MRDPacket::kMaxNumValues) {
+        printf("SCBS::AppendAndForwardMRDPacket: Incoming packet had too many values! Throwing a tantrum to draw attention.\r\n");
+        TransmitError(kErrCodePacketLengthExceeded, packet_in.GetTag());
+        return; // drop original packet
+    }
+    for (uint16_t i = 0; i < packet_in.num_reg_addrs; i++) {
+        // Frankenstein new values into the received packet buffer.
+        char * my_value = packet_in.values[packet_in.num_values+i];
         memset(my_value, '\0', BSPacket::kMaxPacketFieldLen);
-        uint16_t err_code = ReadRegister(packet_in.reg_addr, my_value);
+        uint16_t err_code = ReadRegister(packet_in.reg_addrs[i], my_value);
         if (err_code != kErrCodeNone) {
-            printf("SCBS::MRDPacketHandler: Register read from address 0x%X failed with code 0x%X.\r\n", packet_in.reg_addr, err_code);
-            TransmitError(err_code);
-        } else {
-            // Frankenstein new value into the received packet buffer and send it to the next device.
-            strncpy(packet_in.values[packet_in.num_values], my_value, MRDPacket::kMaxPacketFieldLen);
-            MRDPacket packet_out = MRDPacket(packet_in.reg_addr, packet_in.values, packet_in.num_values+1);
-            TransmitPacket(packet_out);
+            printf("SCBS::AppendAndForwardMRDPacket: Register read from address 0x%X failed with code 0x%X.\r\n", packet_in.reg_addrs[i], err_code);
+            TransmitError(err_code, packet_in.GetTag());
+            return; // drop original packet
         }
-    } else {
-        printf("SCBS::MRDPacketHandler: Formed an MRD packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
     }
+    // Send the packet with my values on the end to the next device.
+    MRDPacket packet_out = MRDPacket(
+        packet_in.reg_addrs,
+        packet_in.num_reg_addrs,
+        packet_in.values,
+        packet_in.num_values+packet_in.num_reg_addrs
+    );
+    packet_out.SetTag(packet_in.GetTag());
+    TransmitPacket(packet_out);
 }
 
 /**
  * @brief Handler for an SWR (Single WRite) packet. Performs a register write and responds with an SRS packet
  * containing the error code if this is the cell being written to, otherwise forwards the packet if it's valid.
+ * SWR packets for a range or group of cells are handled like an MWR packet by the cells they select: the write is
+ * performed and the packet forwarded, or dropped with an error SRS if the write failed. The packet making it back to
+ * the host means every selected cell was written.
  * @param[in] packet_in Incoming SWR packet.
 */
 void SCBS::SWRPacketHandler(SWRPacket packet_in) {
     if (packet_in.IsValid()) {
         printf("SCBS::MWRPacketHandler: Formed a valid SWR packet!\r\n");
 
-        if (packet_in.cell_id == cell_id_) {
+        if (BSPacket::IsMulticast(packet_in.GetCells())) {
+            if (BSPacket::SelectsCell(packet_in.GetCells(), cell_id_, group_id_)) {
+                uint16_t err_code = WriteRegister(packet_in.reg_addr, packet_in.value);
+                if (err_code != kErrCodeNone) {
+                    printf("SCBS::SWRPacketHandler: Register write to address 0x%X failed with code 0x%X.\r\n", packet_in.reg_addr, err_code);
+                    TransmitError(err_code, packet_in.GetTag());
+                    return; // drop original packet
+                }
+            }
+            TransmitPacket(packet_in); // Pass on to the rest of the selected cells.
+        } else if (packet_in.cell_id == cell_id_) {
             // This single write packet is destined for me! Process and send a response.
             uint16_t err_code = WriteRegister(packet_in.reg_addr, packet_in.value);
-            TransmitError(err_code); // Send back error code or OK if all went well.
+            TransmitError(err_code, packet_in.GetTag()); // Send back error code or OK if all went well.
         } else {
             TransmitPacket(packet_in); // It's for someone else, forward to next device.
         }
     } else {
         printf("SCBS::SWRPacketHandler: Formed an SWR packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
     }
 }
 
 /**
- * @brief Handler for an SRD (Single ReaD) packet. Performs a register read and responds with an
- * SRS packet containing the error code or read value if this is the cell being read from, otherwise
- * forwards the packet if it's valid.
+ * @brief Handler for an SRD (Single ReaD) packet. Reads each register in the packet's register address list and
+ * responds with an SRS packet containing the error code or read values (in list order) if this is the cell being read
+ * from, otherwise forwards the packet if it's valid. SRD packets for a range or group of cells get an SRS from each
+ * cell they select and are always forwarded, so the packet making it back to the host means all the SRSs are in.
  * @param[in] packet_in Incoming SRD packet.
 */
 void SCBS::SRDPacketHandler(SRDPacket packet_in) {
     if (packet_in.IsValid()) {
         printf("SCBS::MWRPacketHandler: Formed a valid SRD packet!\r\n");
 
-        if (packet_in.cell_id == cell_id_) {
-            // This single packet read is destined for me! Process and send a response.
-            char my_value[BSPacket::kMaxPacketFieldLen] = "";
-            memset(my_value, '\0', BSPacket::kMaxPacketFieldLen);
-            uint16_t err_code = ReadRegister(packet_in.reg_addr, my_value);
-            if (err_code != kErrCodeNone) {
-                TransmitError(err_code); // Something went wrong, send back an error code.
-            } else {
-                SRSPacket packet_out = SRSPacket(cell_id_, my_value);
-                TransmitPacket(packet_out); // Send back the value that was read.
+        if (BSPacket::IsMulticast(packet_in.GetCells())) {
+            if (BSPacket::SelectsCell(packet_in.GetCells(), cell_id_, group_id_)) {
+                RespondToSRDPacket(packet_in);
             }
+            TransmitPacket(packet_in); // Pass on to the rest of the selected cells.
+        } else if (packet_in.cell_id == cell_id_) {
+            // This single packet read is destined for me! Process and send a response.
+            RespondToSRDPacket(packet_in);
         } else {
             TransmitPacket(packet_in); // It's for someone else, forward to next device.
         }
     } else {
         printf("SCBS::SWRPacketHandler: Formed an SRD packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Reads each register in an SRD packet's register address list and sends back an SRS packet with the values (in
+ * list order), or with an error code if something went wrong.
+ * @param[in] packet_in SRD packet to respond to.
+*/
+void SCBS::RespondToSRDPacket(SRDPacket packet_in) {
+    char my_values[SRSPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+    memset(my_values, '\0', sizeof(my_values));
+    for (uint16_t i = 0; i < packet_in.num_reg_addrs; i++) {
+        uint16_t err_code = ReadRegister(packet_in.reg_addrs[i], my_values[i]);
+        if (err_code != kErrCodeNone) {
+            TransmitError(err_code, packet_in.GetTag()); // Something went wrong, send back an error code.
+            return;
+        }
     }
+    SRSPacket packet_out = SRSPacket(cell_id_, my_values, packet_in.num_reg_addrs);
+    packet_out.SetTag(packet_in.GetTag()); // so the host can match this response to its request
+    TransmitPacket(packet_out); // Send back the values that were read.
 }
 
 /**
@@ -264,27 +406,395 @@ void SCBS::SRSPacketHandler(SRSPacket packet_in) {
         TransmitPacket(packet_in);
     } else {
         printf("SCBS::SRSPacketHandler: Formed an SRS packet but it wasn't valid!\r\n");
-        TransmitError(kErrCodeReceivedInvalidPacket);
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for a VWR (Vector WRite) packet. Writes the first value in the packet to a register, then pops it off
+ * and forwards the remaining values to the next device, so that each cell in the chain gets its own value from a single
+ * frame. Packets that have run out of values are forwarded untouched. Returns an SRS packet with an error code if
+ * something went wrong.
+ * @param[in] packet_in Incoming VWR packet.
+*/
+void SCBS::VWRPacketHandler(VWRPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::VWRPacketHandler: Formed a valid VWR packet!\r\n");
+        if (packet_in.num_values == 0) {
+            TransmitPacket(packet_in); // Cells upstream used up all the values, nothing for me.
+            return;
+        }
+
+        uint16_t err_code = WriteRegister(packet_in.reg_addr, packet_in.values[0]);
+        if (err_code != kErrCodeNone) {
+            printf("SCBS::VWRPacketHandler: Register write to address 0x%X failed with code 0x%X.\r\n", packet_in.reg_addr, err_code);
+            TransmitError(err_code, packet_in.GetTag());
+            return; // drop original packet
+        } else {
+            // Pop my value off the front and pass the rest to the next device in the chain.
+            VWRPacket packet_out = VWRPacket(packet_in.reg_addr, packet_in.values+1, packet_in.num_values-1);
+            packet_out.SetTag(packet_in.GetTag());
+            TransmitPacket(packet_out);
+        }
+    } else {
+        printf("SCBS::VWRPacketHandler: Formed a VWR packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for a SYN (SYNchronized sample) packet. Schedules a current sample for delay_us after the packet was
+ * received, then forwards the packet with the time it takes to reach the next cell taken off of delay_us, so that every
+ * cell in the chain samples at the same moment. The samples are read back later from kRegAddrReadLatchedCurrent. Staged
+ * writes are committed and armed profiles start at the same moment. A SYN that comes in before the last one's time has
+ * come is answered with kErrCodeBusy and not forwarded, so the pending sync (and the writes staged for it) keeps the
+ * time it was given.
+ * @param[in] packet_in Incoming SYN packet.
+*/
+void SCBS::SYNPacketHandler(SYNPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::SYNPacketHandler: Formed a valid SYN packet!\r\n");
+        if (sync_pending_) {
+            printf("SCBS::SYNPacketHandler: Last sync hasn't happened yet, rejecting this one.\r\n");
+            TransmitError(kErrCodeBusy, packet_in.GetTag());
+            return;
+        }
+        sync_timestamp_ = uart_rx_timestamp_ + packet_in.delay_us;
+        sync_pending_ = true;
+        if (profile_state_ == PROFILE_ARMED) {
+            // Start time is in the future, PlayProfile() holds the output until then.
+            profile_start_timestamp_ = time_us_64() + static_cast<int32_t>(sync_timestamp_ - time_us_32());
+            profile_point_index_ = 0;
+            profile_state_ = PROFILE_PLAYING;
+        }
+
+        // Hop delay includes the time already spent processing the packet. The forwarded delay can print with fewer
+        // digits than the incoming one, so size the hop off of the outgoing packet and settle it with a second pass.
+        uint32_t processing_time_us = time_us_32() - uart_rx_timestamp_;
+        SYNPacket packet_out = SYNPacket(packet_in.delay_us);
+        packet_out.SetTag(packet_in.GetTag());
+        for (uint16_t i = 0; i < 2; i++) {
+            uint32_t hop_delay_us = processing_time_us + CalculateHopDelayUs(packet_out.ToString(NULL));
+            if (hop_delay_us > packet_in.delay_us) {
+                printf("SCBS::SYNPacketHandler: Delay of %uus is too short to reach the next cell, samples will be skewed.\r\n", packet_in.delay_us);
+                hop_delay_us = packet_in.delay_us;
+            }
+            packet_out.delay_us = packet_in.delay_us - hop_delay_us;
+        }
+        TransmitPacket(packet_out);
+    } else {
+        printf("SCBS::SYNPacketHandler: Formed a SYN packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for a PRF (PRoFile) packet. Loads the profile points into this cell's profile if the packet is for
+ * this cell or for all cells. Packets for this cell get an SRS response with the error code, packets for all cells are
+ * forwarded like an MWR, and packets for someone else are forwarded untouched.
+ * @param[in] packet_in Incoming PRF packet.
+*/
+void SCBS::PRFPacketHandler(PRFPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::PRFPacketHandler: Formed a valid PRF packet!\r\n");
+        if (packet_in.cell_id != cell_id_ && packet_in.cell_id != BSPacket::kBroadcastCellID) {
+            TransmitPacket(packet_in); // It's for someone else, forward to next device.
+            return;
+        }
+
+        uint16_t err_code = WriteProfilePoints(packet_in.first_point_index, packet_in.points, packet_in.num_points);
+        if (packet_in.cell_id == cell_id_) {
+            TransmitError(err_code, packet_in.GetTag()); // Send back error code or OK if all went well.
+        } else if (err_code != kErrCodeNone) {
+            printf("SCBS::PRFPacketHandler: Profile write failed with code 0x%X.\r\n", err_code);
+            TransmitError(err_code, packet_in.GetTag());
+            return; // drop original packet
+        } else {
+            TransmitPacket(packet_in); // Pass to next device in the chain.
+        }
+    } else {
+        printf("SCBS::PRFPacketHandler: Formed a PRF packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for a BRD (Bulk ReaD) packet. Responds with a BRS packet containing a chunk of the capture buffer
+ * (oldest sample first) if this is the cell being read from, otherwise forwards the packet if it's valid. Responds with
+ * an SRS packet with an error code if there's no finished capture or the offset is past the end of it.
+ * @param[in] packet_in Incoming BRD packet.
+*/
+void SCBS::BRDPacketHandler(BRDPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::BRDPacketHandler: Formed a valid BRD packet!\r\n");
+        if (packet_in.cell_id != cell_id_) {
+            TransmitPacket(packet_in); // It's for someone else, forward to next device.
+            return;
+        }
+
+        if (capture_state_ != CAPTURE_DONE) {
+            printf("SCBS::BRDPacketHandler: No finished capture to read.\r\n");
+            TransmitError(capture_state_ == CAPTURE_IDLE ? kErrCodeInvalidValue : kErrCodeBusy, packet_in.GetTag());
+            return;
+        } else if (packet_in.offset >= capture_num_samples_) {
+            printf("SCBS::BRDPacketHandler: Offset %d is past the last sample.\r\n", packet_in.offset);
+            TransmitError(kErrCodeInvalidValue, packet_in.GetTag());
+            return;
+        }
+        uint16_t num_samples = packet_in.num_samples;
+        num_samples = num_samples < BRSPacket::kMaxNumSamples ? num_samples : BRSPacket::kMaxNumSamples;
+        num_samples = num_samples < capture_num_samples_ - packet_in.offset ? num_samples : capture_num_samples_ - packet_in.offset;
+        uint16_t samples[BRSPacket::kMaxNumSamples];
+        uint16_t oldest_index = (capture_write_index_ + kCaptureBufLen - capture_num_samples_) % kCaptureBufLen;
+        for (uint16_t i = 0; i < num_samples; i++) {
+            samples[i] = capture_buf_[(oldest_index + packet_in.offset + i) % kCaptureBufLen];
+        }
+        BRSPacket packet_out = BRSPacket(cell_id_, packet_in.offset, samples, num_samples);
+        packet_out.SetTag(packet_in.GetTag()); // so the host can match this response to its request
+        TransmitPacket(packet_out);
+    } else {
+        printf("SCBS::BRDPacketHandler: Formed a BRD packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for a BRS (Bulk ReSponse) packet. Forwards the packet if it's valid.
+ * @param[in] packet_in Incoming BRS packet.
+*/
+void SCBS::BRSPacketHandler(BRSPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::BRSPacketHandler: Formed a valid BRS packet!\r\n");
+        TransmitPacket(packet_in);
+    } else {
+        printf("SCBS::BRSPacketHandler: Formed a BRS packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
+    }
+}
+
+/**
+ * @brief Handler for an EVT (EVenT) packet raised by a cell upstream. Forwards the packet if it's valid.
+ * @param[in] packet_in Incoming EVT packet.
+*/
+void SCBS::EVTPacketHandler(EVTPacket packet_in) {
+    if (packet_in.IsValid()) {
+        printf("SCBS::EVTPacketHandler: Formed a valid EVT packet!\r\n");
+        TransmitPacket(packet_in);
+    } else {
+        printf("SCBS::EVTPacketHandler: Formed an EVT packet but it wasn't valid!\r\n");
+        TransmitError(kErrCodeReceivedInvalidPacket, packet_in.GetTag());
     }
 }
 
 /**
  * @brief Converts a value from a string to the relevant datatype and writes it to a register. Called by various packet handler functions.
+ * While staging is on, writes to anything but the staging registers are held until the next sync time instead.
  * @param[in] reg_addr Address of register to read.
  * @param[in] value_in String buffer to read value from.
+ * @param[in] allow_staging false to write the register right away even if staging is on (used by the commit).
  * @retval Error code, or kErrCodeNone if write succeeded.
 */
-uint16_t SCBS::WriteRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]) {
+uint16_t SCBS::WriteRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen], bool allow_staging) {
+    bool is_staging_reg = reg_addr >= kRegAddrStagingEnable && reg_addr <= kRegAddrCommitErrCode;
+    if (allow_staging && staging_enabled_ && !is_staging_reg) {
+        return StageWrite(reg_addr, value_in);
+    }
+
     switch(reg_addr) {
         case kRegAddrSetOutputVoltage: {
+            if (battery_model_enabled_ || profile_state_ != PROFILE_STOPPED) {
+                // The control tick would overwrite the setpoint within a tick anyway.
+                printf("SCBS::WriteRegister: Battery model or profile is in control of the output voltage.\r\n");
+                return kErrCodeBusy;
+            }
             float new_output_voltage = strtof(value_in, NULL);
+            ramp_active_ = false; // a direct write cancels any ramp in progress
             output_voltage_ = SetOutputVoltage(new_output_voltage);
             break;
-        } case kRegAddrReadOutputCurrent: {
+        } case kRegAddrRampTargetVoltage: {
+            if (battery_model_enabled_ || profile_state_ != PROFILE_STOPPED) {
+                printf("SCBS::WriteRegister: Battery model or profile is in control of the output voltage.\r\n");
+                return kErrCodeBusy;
+            }
+            float new_target_voltage = strtof(value_in, NULL);
+            if (new_target_voltage > kMaxOutputVoltage) {
+                new_target_voltage = kMaxOutputVoltage;
+            } else if (new_target_voltage < kMinOutputVoltage) {
+                new_target_voltage = kMinOutputVoltage;
+            }
+            ramp_active_ = false; // hold off the control tick while the target changes
+            ramp_target_voltage_ = new_target_voltage;
+            if (ramp_rate_ > 0.0f) {
+                ramp_active_ = true;
+            } else {
+                output_voltage_ = SetOutputVoltage(ramp_target_voltage_);
+            }
+            break;
+        } case kRegAddrRampRate: {
+            float new_ramp_rate = strtof(value_in, NULL);
+            if (new_ramp_rate < 0.0f) {
+                return kErrCodeInvalidValue;
+            }
+            ramp_rate_ = new_ramp_rate;
+            break;
+        } case kRegAddrStreamPeriodMs: {
+            uint32_t new_stream_period_ms = strtoul(value_in, NULL, 10);
+            if (new_stream_period_ms != 0 && cell_id_ > kMaxNumStreamCells) {
+                // Refused here so that the MWR turning streaming on comes back with an error on a chain this long.
+                printf("SCBS::WriteRegister: Cell %d is past the end of a telemetry frame.\r\n", cell_id_);
+                return kErrCodePacketLengthExceeded;
+            } else if (new_stream_period_ms != 0 && new_stream_period_ms < GetMinStreamPeriodMs()) {
+                return kErrCodeInvalidValue; // frames would back up on the link
+            }
+            stream_period_ms_ = new_stream_period_ms;
+            stream_last_timestamp_ = time_us_32();
+            break;
+        } case kRegAddrStreamRegAddr: {
+            stream_reg_addr_ = strtoul(value_in, NULL, 16);
+            break;
+        } case kRegAddrGroupID: {
+            uint32_t new_group_id = strtoul(value_in, NULL, 10);
+            if (new_group_id > UINT16_MAX) {
+                return kErrCodeInvalidValue;
+            }
+            group_id_ = new_group_id;
+            break;
+        } case kRegAddrSaveSettings: {
+            uint32_t save = strtoul(value_in, NULL, 10);
+            if (save > 1) {
+                return kErrCodeInvalidValue;
+            }
+            // Written to flash later by Update(), like a DIS's cell ID. Reads of this register count the saves that
+            // have actually been done.
+            if (save == 0) {
+                // Back to defaults at the next power cycle, running settings are left alone. The flash counts as
+                // holding the defaults from here on as far as saves of the cell ID are concerned, so the forgotten
+                // settings stay that way.
+                settings_forget_pending_ = true;
+                settings_save_pending_ = false;
+                persistent_record_ = default_record_;
+            } else {
+                pending_record_ = SnapshotPersistentRecord();
+                settings_save_pending_ = true;
+                settings_forget_pending_ = false;
+            }
+            break;
+        } case kRegAddrSyncHopTrimUs: {
+            sync_hop_trim_us_ = strtol(value_in, NULL, 10);
+            break;
+        } case kRegAddrSyncLatchCount: {
+            sync_latch_count_ = strtoul(value_in, NULL, 10);
+            break;
+        } case kRegAddrStagingEnable: {
+            staging_enabled_ = strtoul(value_in, NULL, 10) != 0;
+            break;
+        } case kRegAddrStagedWriteCount: {
+            if (strtoul(value_in, NULL, 10) != 0) {
+                return kErrCodeInvalidValue; // can only clear, writes get added by staging them
+            }
+            num_staged_writes_ = 0;
+            break;
+        } case kRegAddrProfileControl: {
+            return SetProfileState(static_cast<ProfileState_t>(strtoul(value_in, NULL, 10)));
+        } case kRegAddrStatsWindowMs: {
+            current_stats_.SetWindowMs(strtoul(value_in, NULL, 10));
+            break;
+        } case kRegAddrChargeMAh: {
+            current_stats_.SetChargeNC(static_cast<int64_t>(strtod(value_in, NULL) * 3.6e9)); // 1mAh = 3.6C
+            break;
+        } case kRegAddrProfileLoop: {
+            profile_loop_ = strtoul(value_in, NULL, 10) != 0;
+            break;
+        } case kRegAddrProfileNumPoints: {
+            uint32_t new_num_points = strtoul(value_in, NULL, 10);
+            if (profile_state_ != PROFILE_STOPPED) {
+                return kErrCodeBusy;
+            } else if (new_num_points > profile_num_points_) {
+                return kErrCodeInvalidValue; // can only truncate, points get added with PRF packets
+            }
+            profile_num_points_ = new_num_points;
+            break;
+        } case kRegAddrComparatorEnable: {
+            comparator_enable_ = strtoul(value_in, NULL, 10) & ((1 << kNumComparators) - 1);
+            comparator_status_ = 0; // re-arm, anything still past a level gets reported again
+            break;
+        } case kRegAddrComparatorHighLevel: {
+            comparator_levels_[COMPARATOR_HIGH] = strtof(value_in, NULL);
+            break;
+        } case kRegAddrComparatorLowLevel: {
+            comparator_levels_[COMPARATOR_LOW] = strtof(value_in, NULL);
+            break;
+        } case kRegAddrComparatorHysteresis: {
+            float new_hysteresis = strtof(value_in, NULL);
+            if (new_hysteresis < 0.0f) {
+                return kErrCodeInvalidValue;
+            }
+            comparator_hysteresis_ = new_hysteresis;
+            break;
+        } case kRegAddrCaptureControl: {
+            return SetCaptureState(static_cast<CaptureState_t>(strtoul(value_in, NULL, 10)));
+        } case kRegAddrCaptureSamplePeriodUs:
+        case kRegAddrCapturePreTriggerSamples:
+        case kRegAddrCaptureTriggerMode:
+        case kRegAddrCaptureTriggerLevel: {
+            if (CaptureIsRunning()) {
+                return kErrCodeBusy; // the capture timer is using these
+            }
+            uint32_t new_value = strtoul(value_in, NULL, 10);
+            if (reg_addr == kRegAddrCaptureSamplePeriodUs) {
+                if (new_value < kMinCaptureSamplePeriodUs) {
+                    return kErrCodeInvalidValue;
+                }
+                capture_sample_period_us_ = new_value;
+            } else if (reg_addr == kRegAddrCapturePreTriggerSamples) {
+                if (new_value >= kCaptureBufLen) {
+                    return kErrCodeInvalidValue; // need room for the trigger sample
+                }
+                capture_pre_trigger_samples_ = new_value;
+            } else if (reg_addr == kRegAddrCaptureTriggerMode) {
+                if (new_value > CAPTURE_TRIGGER_FALLING) {
+                    return kErrCodeInvalidValue;
+                }
+                capture_trigger_mode_ = static_cast<CaptureTrigger_t>(new_value);
+            } else {
+                float new_level = strtof(value_in, NULL);
+                if (new_level < 0.0f || new_level > kMaxCsenseCurrent) {
+                    return kErrCodeInvalidValue;
+                }
+                capture_trigger_level_ = new_level; // converted to counts when armed, in case the calibration changes
+            }
+            break;
+        } case kRegAddrCommitErrCode:
+        case kRegAddrRampDone:
+        case kRegAddrComparatorStatus:
+        case kRegAddrEventCount:
+        case kRegAddrCaptureNumSamples:
+        case kRegAddrCaptureTriggerIndex:
+        case kRegAddrReadLatchedCurrent:
+        case kRegAddrStatsNumSamples:
+        case kRegAddrStatsMeanCurrent:
+        case kRegAddrStatsMinCurrent:
+        case kRegAddrStatsMaxCurrent:
+        case kRegAddrStatsRMSCurrent:
+        case kRegAddrStatsStdDevCurrent:
+        case kRegAddrReadOutputCurrent: {
             printf("SCBS::WriteRegister: Writing to register 0x%X is not supported.\r\n", reg_addr);
             return kErrCodeWriteNotSupported;
             break;
         } default: {
+            if (reg_addr >= kRegAddrModelEnable && reg_addr < kRegAddrModelOCVTable + BatteryModel::kNumOCVPoints) {
+                uint16_t err_code = WriteModelRegister(reg_addr, value_in);
+                if (err_code != kErrCodeNone) {
+                    return err_code;
+                }
+                break;
+            } else if (reg_addr >= kRegAddrVoltageCalTable && reg_addr <= kRegAddrCurrentCalGain) {
+                uint16_t err_code = WriteCalibrationRegister(reg_addr, value_in);
+                if (err_code != kErrCodeNone) {
+                    return err_code;
+                }
+                break;
+            }
             printf("SCBS::MWRPacketHandler: Register address 0x%x was not recognized.\r\n", reg_addr);
             return kErrCodeAddrNotRecognized;
         }
@@ -304,13 +814,142 @@ uint16_t SCBS::ReadRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPack
         case kRegAddrSetOutputVoltage:
             snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", output_voltage_);
             break;
+        case kRegAddrRampTargetVoltage:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", ramp_target_voltage_);
+            break;
+        case kRegAddrRampRate:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", ramp_rate_);
+            break;
+        case kRegAddrRampDone:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", !ramp_active_);
+            break;
         case kRegAddrReadOutputCurrent:
             snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", output_current_);
             break;
         case kRegAddrReadFirmwareVersion:
             snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, SCBS_FIRMWARE_VERSION);
             break;
+        case kRegAddrGroupID:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", group_id_);
+            break;
+        case kRegAddrUniqueID:
+            // Two halves since the embedded printf doesn't do 64 bit integers.
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%08X%08X",
+                static_cast<uint32_t>(unique_id_ >> 32), static_cast<uint32_t>(unique_id_));
+            break;
+        case kRegAddrSaveSettings:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", flash_store_.GetSequence());
+            break;
+        case kRegAddrStreamPeriodMs:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", stream_period_ms_);
+            break;
+        case kRegAddrStreamRegAddr:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%X", stream_reg_addr_);
+            break;
+        case kRegAddrReadLatchedCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", latched_current_);
+            break;
+        case kRegAddrSyncHopTrimUs:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", sync_hop_trim_us_);
+            break;
+        case kRegAddrSyncLatchCount:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", sync_latch_count_);
+            break;
+        case kRegAddrStagingEnable:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", staging_enabled_);
+            break;
+        case kRegAddrStagedWriteCount:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", num_staged_writes_);
+            break;
+        case kRegAddrCommitErrCode:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%X", commit_err_code_);
+            break;
+        case kRegAddrProfileControl:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", profile_state_);
+            break;
+        case kRegAddrProfileLoop:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", profile_loop_);
+            break;
+        case kRegAddrProfileNumPoints:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", profile_num_points_);
+            break;
+        case kRegAddrComparatorEnable:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", comparator_enable_);
+            break;
+        case kRegAddrComparatorHighLevel:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", comparator_levels_[COMPARATOR_HIGH]);
+            break;
+        case kRegAddrComparatorLowLevel:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", comparator_levels_[COMPARATOR_LOW]);
+            break;
+        case kRegAddrComparatorHysteresis:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", comparator_hysteresis_);
+            break;
+        case kRegAddrComparatorStatus:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", comparator_status_);
+            break;
+        case kRegAddrEventCount:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", event_count_);
+            break;
+        case kRegAddrCaptureControl:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", capture_state_);
+            break;
+        case kRegAddrCaptureSamplePeriodUs:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", capture_sample_period_us_);
+            break;
+        case kRegAddrCapturePreTriggerSamples:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", capture_pre_trigger_samples_);
+            break;
+        case kRegAddrCaptureTriggerMode:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", capture_trigger_mode_);
+            break;
+        case kRegAddrCaptureTriggerLevel:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", capture_trigger_level_);
+            break;
+        case kRegAddrCaptureNumSamples:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", capture_num_samples_);
+            break;
+        case kRegAddrCaptureTriggerIndex:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", capture_trigger_index_);
+            break;
+        case kRegAddrStatsWindowMs:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", current_stats_.GetWindowMs());
+            break;
+        case kRegAddrStatsNumSamples:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", current_stats_.GetSummary().num_samples);
+            break;
+        case kRegAddrStatsMeanCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", current_stats_.GetSummary().mean_ua * 1e-3f);
+            break;
+        case kRegAddrStatsMinCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", current_stats_.GetSummary().min_ua * 1e-3f);
+            break;
+        case kRegAddrStatsMaxCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", current_stats_.GetSummary().max_ua * 1e-3f);
+            break;
+        case kRegAddrStatsRMSCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", current_stats_.GetSummary().rms_ua * 1e-3f);
+            break;
+        case kRegAddrStatsStdDevCurrent:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", current_stats_.GetSummary().stddev_ua * 1e-3f);
+            break;
+        case kRegAddrChargeMAh:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.6f", current_stats_.GetChargeNC() / 3.6e9);
+            break;
         default:
+            if (reg_addr >= kRegAddrModelEnable && reg_addr < kRegAddrModelOCVTable + BatteryModel::kNumOCVPoints) {
+                uint16_t err_code = ReadModelRegister(reg_addr, value_out);
+                if (err_code != kErrCodeNone) {
+                    return err_code;
+                }
+                break;
+            } else if (reg_addr >= kRegAddrVoltageCalTable && reg_addr <= kRegAddrCurrentCalGain) {
+                uint16_t err_code = ReadCalibrationRegister(reg_addr, value_out);
+                if (err_code != kErrCodeNone) {
+                    return err_code;
+                }
+                break;
+            }
             printf("SCBS::ReadRegister: Register address 0x%x was not recognized.\r\n", reg_addr);
             return kErrCodeAddrNotRecognized;
     }
@@ -341,8 +980,9 @@ void SCBS::AppendCharToUARTBuf(char new_char) {
  * @brief Forms a SRS packet with the given error code and sends it. Error codes are printed in hex and prefixed with "ERR:".
  * The success case has kErrCodeNone replaced with "OK".
  * @param[in] err_code Error code to place in the SRS packet, or kErrCodeNone if success.
+ * @param[in] tag Tag of the packet being responded to, echoed in the SRS packet.
 */
-void SCBS::TransmitError(uint16_t err_code) {
+void SCBS::TransmitError(uint16_t err_code, uint16_t tag) {
     char err_str[BSPacket::kMaxPacketFieldLen];
     memset(err_str, '\0', BSPacket::kMaxPacketFieldLen);
     if (err_code == kErrCodeNone) {
@@ -352,6 +992,7 @@ void SCBS::TransmitError(uint16_t err_code) {
     }
     
     SRSPacket packet_out = SRSPacket(cell_id_, err_str);
+    packet_out.SetTag(tag);
     TransmitPacket(packet_out);
 }
 
@@ -376,6 +1017,7 @@ uint16_t SCBS::ReceivePacket() {
         char new_char = uart_getc(config_.uart_id);
         if (new_char == '\n') {
             // Encountered end of a string.
+            uart_rx_timestamp_ = time_us_32();
             AppendCharToUARTBuf(new_char);
             printf("SCBS::ReceivePacket(): Received sentence %s", uart_rx_buf_);
             return strlen(uart_rx_buf_);
@@ -404,35 +1046,37 @@ float SCBS::SetOutputVoltage(float voltage) {
     }
 
     // Relies on MWR handler to rail the voltage to nice setpoints. Absolute rails here.
-    float voltage2 = voltage*voltage;
-    float voltage3 = voltage2*voltage;
-    float estimated_offset = 
-        voltage3*kOutputVoltageCalCoeffX3 + 
-        voltage2*kOutputVoltageCalCoeffX2 + 
-        voltage*kOutputVoltageCalCoeffX + 
-        kOutputVoltageCalCoeffConst;
-
-    
-    float pwm_voltage = voltage - estimated_offset; // calibrate
+    int32_t voltage_uv = static_cast<int32_t>(voltage * 1e6f);
+    int32_t pwm_voltage_uv = voltage_uv - GetVoltageCalOffsetUV(voltage_uv); // calibrate
     // Make sure calibration didn't take things off the rails.
-    if (pwm_voltage > kPowerSupplyVoltage5V) {
-        pwm_voltage = kPowerSupplyVoltage5V;
-    } else if (pwm_voltage < 0.0f) {
-        pwm_voltage = 0.0f;
+    if (pwm_voltage_uv > kPowerSupplyVoltage5VUV) {
+        pwm_voltage_uv = kPowerSupplyVoltage5VUV;
+    } else if (pwm_voltage_uv < 0) {
+        pwm_voltage_uv = 0;
     }
-    uint16_t duty = 1000 - static_cast<uint16_t>(pwm_voltage / kPowerSupplyVoltage5V * kMaxPWMCount); // out of kMaxPWMCount
+    uint16_t duty = kMaxPWMCount - pwm_voltage_uv / (kPowerSupplyVoltage5VUV / kMaxPWMCount); // out of kMaxPWMCount
     pwm_set_chan_level(pwm_gpio_to_slice_num(config_.pwm_pin), config_.pwm_channel, duty);
 
     return voltage; // Return voltage railed by SCBS specs.
 }
 
 /**
- * @brief Reads the current sense ADC input and updates the SCBS object's internal output current value.
+ * @brief Reads the current sense ADC input, updates the SCBS object's internal output current value, and feeds the
+ * sample to the current statistics, coulomb counter and comparators. Uses the latest capture sample instead of reading the ADC while
+ * a capture is running.
 */
 void SCBS::ReadOutputCurrent() {
-    adc_select_input(config_.csense_adc_input);
-    uint16_t adc_counts = adc_read();
-    output_current_ = adc_counts * kMaxCsenseCurrent / kMaxADCCount;
+    uint16_t adc_counts;
+    if (CaptureIsRunning()) {
+        adc_counts = capture_last_counts_; // the capture timer has the ADC, don't fight it for conversions
+    } else {
+        adc_select_input(config_.csense_adc_input);
+        adc_counts = adc_read();
+    }
+    int32_t current_ua = ADCCountsToCurrentUA(adc_counts);
+    output_current_ = current_ua * 1e-3f;
+    current_stats_.AddSample(current_ua, time_us_32());
+    UpdateComparators();
 }
 
 /**
@@ -443,6 +1087,741 @@ float SCBS::GetOutputCurrent() {
     return output_current_;
 }
 
+/**
+ * @brief Starts a telemetry frame every stream_period_ms_ if this is the first cell in the chain. The frame is an MRD
+ * packet for stream_reg_addr_ that goes through the normal MRD path, so this cell and every cell downstream appends its
+ * value before the frame arrives back at the host. Lets the host get pack-wide samples without sending any requests.
+ * A frame only has room for kMaxNumStreamCells values, so cells further down the chain refuse to turn streaming on.
+*/
+void SCBS::StreamTelemetry() {
+    if (stream_period_ms_ == 0 || cell_id_ != kFirstCellID) {
+        return; // streaming is off, or someone upstream is in charge of starting frames
+    }
+    uint32_t timestamp = time_us_32();
+    if (timestamp - stream_last_timestamp_ < stream_period_ms_*1000) {
+        return; // subtraction is safe across time_us_32() wrapping
+    }
+    stream_last_timestamp_ = timestamp;
+
+    char no_values[1][BSPacket::kMaxPacketFieldLen] = {""};
+    AppendAndForwardMRDPacket(MRDPacket(stream_reg_addr_, no_values, 0));
+}
+
+/**
+ * @brief Checks the latest current sample against the enabled comparators. A comparator trips when the current reaches
+ * its level, and clears once the current has backed off by the hysteresis, so a reading that sits on the level doesn't
+ * flood the chain with events. Trips and clears are queued up for TransmitEvents().
+*/
+void SCBS::UpdateComparators() {
+    for (uint16_t i = 0; i < kNumComparators; i++) {
+        uint16_t mask = 1 << i;
+        if (!(comparator_enable_ & mask)) {
+            continue;
+        }
+        // Work in terms of distance past the level, so both comparators trip at >= 0.
+        float past_level = (i == COMPARATOR_HIGH) ? output_current_ - comparator_levels_[i] : comparator_levels_[i] - output_current_;
+        bool tripped = comparator_status_ & mask;
+        if (!tripped && past_level >= 0.0f) {
+            comparator_status_ |= mask;
+        } else if (tripped && past_level < -comparator_hysteresis_) {
+            comparator_status_ &= ~mask;
+        } else {
+            continue;
+        }
+        uint16_t event_code = EVENT_CURRENT_HIGH + 2*i + (tripped ? 1 : 0);
+        events_pending_ |= 1 << event_code;
+        event_currents_[event_code] = output_current_;
+    }
+}
+
+/**
+ * @brief Sends an EVT packet for each event waiting to go out. Events travel to the host through the rest of the chain
+ * like an SRS, in between the packets this cell is forwarding.
+*/
+void SCBS::TransmitEvents() {
+    for (uint16_t event_code = EVENT_CURRENT_HIGH; events_pending_ != 0; event_code++) {
+        if (!(events_pending_ & (1 << event_code))) {
+            continue;
+        }
+        events_pending_ &= ~(1 << event_code);
+        char value[BSPacket::kMaxPacketFieldLen];
+        snprintf(value, BSPacket::kMaxPacketFieldLen-1, "%.2f", event_currents_[event_code]);
+        TransmitPacket(EVTPacket(cell_id_, event_code, value));
+        event_count_++;
+    }
+}
+
+/**
+ * @brief Returns the number of bits the UART sends for each character: start bit, data bits, parity bit and stop bits.
+*/
+uint32_t SCBS::GetUARTBitsPerChar() {
+    uint32_t bits_per_char = 1 + config_.uart_data_bits + config_.uart_stop_bits;
+    if (config_.uart_parity != UART_PARITY_NONE) {
+        bits_per_char++;
+    }
+    return bits_per_char;
+}
+
+/**
+ * @brief Returns the shortest telemetry stream period, the time a full length frame takes on the wire (209ms at 9600
+ * baud). The first cell can't tell how long the chain is, so it has to allow for the longest frame; anything faster
+ * would back the frames up on the link and block the main loop in uart_puts().
+*/
+uint32_t SCBS::GetMinStreamPeriodMs() {
+    uint32_t frame_bits = BSPacket::kMaxPacketLen * GetUARTBitsPerChar();
+    return (frame_bits * 1000 + config_.uart_baud - 1) / config_.uart_baud; // rounded up
+}
+
+/**
+ * @brief Calculates how long it takes a packet to get from this cell to the next one. Most of that is the time it takes
+ * to shift the packet out over the UART, with kRegAddrSyncHopTrimUs on top to account for how long the next cell takes
+ * to notice it.
+ * @param[in] packet_len Length of the packet string, not including the "\r\n" line ending.
+ * @retval Hop delay, in microseconds.
+*/
+uint32_t SCBS::CalculateHopDelayUs(uint16_t packet_len) {
+    uint32_t frame_bits = (packet_len+2) * GetUARTBitsPerChar(); // +2 for "\r\n"
+    int32_t hop_delay_us = static_cast<int32_t>((uint64_t)frame_bits * 1000000 / config_.uart_baud) + sync_hop_trim_us_;
+    return hop_delay_us > 0 ? static_cast<uint32_t>(hop_delay_us) : 0;
+}
+
+/**
+ * @brief Takes the synchronized current sample and commits any staged writes once the time scheduled by the last SYN
+ * packet has been reached.
+*/
+void SCBS::SyncSample() {
+    if (!sync_pending_ || static_cast<int32_t>(time_us_32() - sync_timestamp_) < 0) {
+        return; // nothing scheduled, or not time yet (signed difference is safe across time_us_32() wrapping)
+    }
+    CommitStagedWrites(); // first, so that the whole chain steps as close together as possible
+    ReadOutputCurrent();
+    latched_current_ = output_current_;
+    sync_latch_count_++;
+    sync_pending_ = false;
+}
+
+/**
+ * @brief Holds a register write until the next sync time. A later write to the same register replaces the staged
+ * value, so only the last value written gets committed.
+ * @param[in] reg_addr Address of register to write.
+ * @param[in] value_in String buffer to read value from. Not checked until the commit.
+ * @retval Error code, or kErrCodeNone if the write was staged.
+*/
+uint16_t SCBS::StageWrite(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]) {
+    uint16_t index = 0;
+    while (index < num_staged_writes_ && staged_writes_[index].reg_addr != reg_addr) {
+        index++;
+    }
+    if (index >= kMaxNumStagedWrites) {
+        printf("SCBS::StageWrite: No room to stage a write to 0x%X, max is %d writes.\r\n", reg_addr, kMaxNumStagedWrites);
+        return kErrCodeBusy;
+    }
+    staged_writes_[index].reg_addr = reg_addr;
+    memset(staged_writes_[index].value, '\0', BSPacket::kMaxPacketFieldLen);
+    strncpy(staged_writes_[index].value, value_in, BSPacket::kMaxPacketFieldLen-1);
+    if (index == num_staged_writes_) {
+        num_staged_writes_++;
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Applies the staged writes in the order they were staged and clears them. Keeps going past a failed write so
+ * one bad value doesn't hold up the rest, and keeps the first error code for kRegAddrCommitErrCode.
+*/
+void SCBS::CommitStagedWrites() {
+    if (num_staged_writes_ == 0) {
+        return; // leave the error code from the last real commit alone
+    }
+    commit_err_code_ = kErrCodeNone;
+    for (uint16_t i = 0; i < num_staged_writes_; i++) {
+        uint16_t err_code = WriteRegister(staged_writes_[i].reg_addr, staged_writes_[i].value, false);
+        if (err_code != kErrCodeNone && commit_err_code_ == kErrCodeNone) {
+            printf("SCBS::CommitStagedWrites: Staged write to 0x%X failed with code 0x%X.\r\n", staged_writes_[i].reg_addr, err_code);
+            commit_err_code_ = err_code;
+        }
+    }
+    num_staged_writes_ = 0;
+}
+
+/**
+ * @brief Hardware timer callback for the control tick, runs in interrupt context.
+ * @param[in] rt Repeating timer, user_data points to the SCBS object.
+ * @retval true to keep the timer running.
+*/
+bool SCBS::ControlTickCallback(repeating_timer_t * rt) {
+    static_cast<SCBS *>(rt->user_data)->ControlTick();
+    return true;
+}
+
+/**
+ * @brief Runs every kControlTickPeriodUs from the hardware timer. Steps the battery model if it's on, the profile if
+ * one is playing, or the ramp if one is in progress, and sets the output voltage, so the output is updated at a steady
+ * rate no matter how busy Update() is with packets.
+*/
+void SCBS::ControlTick() {
+    if (battery_model_enabled_) {
+        // Uses the last current measured by Update(), the ADC isn't touched from here.
+        output_voltage_ = battery_model_.Step(static_cast<int32_t>(output_current_ * 1000.0f)) * 1e-6f;
+    } else if (profile_state_ == PROFILE_PLAYING) {
+        PlayProfile();
+    } else if (ramp_active_) {
+        StepRamp();
+    }
+    SetOutputVoltage(output_voltage_);
+}
+
+/**
+ * @brief Moves output_voltage_ one control tick's worth of the ramp rate toward the ramp target, and ends the ramp once
+ * it gets there. Called from the control tick.
+*/
+void SCBS::StepRamp() {
+    float max_step = ramp_rate_ * kControlTickPeriodUs * 1e-6f;
+    float error = ramp_target_voltage_ - output_voltage_;
+    if (error <= max_step && error >= -max_step) {
+        output_voltage_ = ramp_target_voltage_;
+        ramp_active_ = false;
+    } else {
+        output_voltage_ += error > 0.0f ? max_step : -max_step;
+    }
+}
+
+/**
+ * @brief Parses profile points and loads them into the profile. Points are loaded starting at first_point_index, and
+ * the profile is cut off after the last point loaded, so uploading from index 0 replaces the whole profile.
+ * @param[in] first_point_index Index in the profile of the first point, can't leave a gap after the existing points.
+ * @param[in] points_in Array of profile points, each of the form "<time_ms>:<voltage>". Times must not go backwards.
+ * @param[in] num_points Number of profile points.
+ * @retval Error code, or kErrCodeNone if the points were loaded.
+*/
+uint16_t SCBS::WriteProfilePoints(uint16_t first_point_index, char points_in[][BSPacket::kMaxPacketFieldLen], uint16_t num_points) {
+    if (profile_state_ != PROFILE_STOPPED) {
+        printf("SCBS::WriteProfilePoints: Can't load points while the profile is playing or armed.\r\n");
+        return kErrCodeBusy;
+    } else if (first_point_index > profile_num_points_) {
+        printf("SCBS::WriteProfilePoints: First point index %d would leave a gap after point %d.\r\n", first_point_index, profile_num_points_);
+        return kErrCodeInvalidValue;
+    } else if (first_point_index + num_points > kMaxNumProfilePoints) {
+        printf("SCBS::WriteProfilePoints: Profile can only hold %d points.\r\n", kMaxNumProfilePoints);
+        return kErrCodePacketLengthExceeded;
+    }
+
+    for (uint16_t i = 0; i < num_points; i++) {
+        char * end_ptr;
+        ProfilePoint_t point;
+        point.time_ms = strtoul(points_in[i], &end_ptr, 10);
+        if (*end_ptr != ':') {
+            printf("SCBS::WriteProfilePoints: Unable to parse profile point %s.\r\n", points_in[i]);
+            return kErrCodeInvalidValue;
+        }
+        point.voltage = strtof(end_ptr+1, NULL);
+        uint16_t point_index = first_point_index + i;
+        if (point_index > 0 && point.time_ms < profile_points_[point_index-1].time_ms) {
+            printf("SCBS::WriteProfilePoints: Profile point %d goes back in time.\r\n", point_index);
+            return kErrCodeInvalidValue;
+        }
+        profile_points_[point_index] = point;
+        profile_num_points_ = point_index + 1;
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Stops, starts or arms the profile.
+ * @param[in] new_state PROFILE_STOPPED holds the current output voltage, PROFILE_PLAYING starts from the first point
+ * right away, PROFILE_ARMED starts from the first point at the time set by the next SYN packet.
+ * @retval Error code, or kErrCodeNone if the state was changed.
+*/
+uint16_t SCBS::SetProfileState(ProfileState_t new_state) {
+    switch (new_state) {
+        case PROFILE_STOPPED:
+            break;
+        case PROFILE_PLAYING:
+        case PROFILE_ARMED:
+            if (battery_model_enabled_) {
+                printf("SCBS::SetProfileState: Battery model is in control of the output voltage.\r\n");
+                return kErrCodeBusy;
+            } else if (profile_num_points_ == 0) {
+                printf("SCBS::SetProfileState: No profile points loaded.\r\n");
+                return kErrCodeInvalidValue;
+            }
+            profile_start_timestamp_ = time_us_64();
+            profile_point_index_ = 0;
+            ramp_active_ = false; // profile takes over from here
+            break;
+        default:
+            printf("SCBS::SetProfileState: Unrecognized profile state %d.\r\n", new_state);
+            return kErrCodeInvalidValue;
+    }
+    profile_state_ = new_state; // set last, the control tick may be waiting to use the fields above
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Sets output_voltage_ by interpolating between the profile points on either side of the current time. Stops
+ * the profile after the last point unless looping is on. Called from the control tick.
+*/
+void SCBS::PlayProfile() {
+    uint64_t timestamp = time_us_64();
+    if (timestamp < profile_start_timestamp_) {
+        return; // armed profile was started by a SYN packet and the start time hasn't come yet
+    }
+    uint32_t duration_ms = profile_points_[profile_num_points_-1].time_ms;
+    uint64_t elapsed_ms = (timestamp - profile_start_timestamp_) / 1000;
+    if (elapsed_ms >= duration_ms) {
+        if (!profile_loop_ || duration_ms == 0) {
+            output_voltage_ = profile_points_[profile_num_points_-1].voltage;
+            profile_state_ = PROFILE_STOPPED;
+            return;
+        }
+        // Move the start time up by whole loops so that the time doesn't drift and the cursor can start over.
+        uint64_t num_loops = elapsed_ms / duration_ms;
+        profile_start_timestamp_ += num_loops * duration_ms * 1000;
+        elapsed_ms -= num_loops * duration_ms;
+        profile_point_index_ = 0;
+    }
+
+    // Points are in time order, so the cursor only has to move forward. Points with the same time make a step.
+    while (profile_point_index_+1 < profile_num_points_ && profile_points_[profile_point_index_+1].time_ms <= elapsed_ms) {
+        profile_point_index_++;
+    }
+    ProfilePoint_t * from_point = &profile_points_[profile_point_index_];
+    if (elapsed_ms < from_point->time_ms || profile_point_index_+1 >= profile_num_points_) {
+        output_voltage_ = from_point->voltage; // before the first point
+        return;
+    }
+    ProfilePoint_t * to_point = &profile_points_[profile_point_index_+1];
+    float fraction = static_cast<float>(elapsed_ms - from_point->time_ms) / (to_point->time_ms - from_point->time_ms);
+    output_voltage_ = from_point->voltage + fraction * (to_point->voltage - from_point->voltage);
+}
+
+/**
+ * @brief Writes one of the battery model registers (kRegAddrModelEnable through the end of the OCV table). Parameters
+ * can only be changed while the model is off, since the control tick could be halfway through a step.
+ * @param[in] reg_addr Address of register to write.
+ * @param[in] value_in String buffer to read value from.
+ * @retval Error code, or kErrCodeNone if write succeeded.
+*/
+uint16_t SCBS::WriteModelRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]) {
+    if (reg_addr == kRegAddrModelEnable) {
+        bool enable = strtoul(value_in, NULL, 10) != 0;
+        if (enable && profile_state_ != PROFILE_STOPPED) {
+            printf("SCBS::WriteModelRegister: Profile is in control of the output voltage.\r\n");
+            return kErrCodeBusy;
+        }
+        if (enable) {
+            ramp_active_ = false; // model takes over from here
+        }
+        battery_model_enabled_ = enable;
+        return kErrCodeNone;
+    } else if (battery_model_enabled_) {
+        printf("SCBS::WriteModelRegister: Can't change battery model parameters while the model is running.\r\n");
+        return kErrCodeBusy;
+    }
+
+    if (reg_addr >= kRegAddrModelOCVTable) {
+        float ocv = strtof(value_in, NULL);
+        battery_model_.SetOCVPoint(reg_addr - kRegAddrModelOCVTable, static_cast<int32_t>(ocv * 1e6f + 0.5f));
+        return kErrCodeNone;
+    } else if (reg_addr >= kRegAddrModelRCPairs && reg_addr < kRegAddrModelRCPairs + 2*BatteryModel::kNumRCPairs) {
+        uint16_t pair_index = (reg_addr - kRegAddrModelRCPairs) / 2;
+        uint32_t r_mohm = battery_model_.GetRCPairRMOhm(pair_index);
+        uint32_t tau_ms = battery_model_.GetRCPairTauMs(pair_index);
+        if ((reg_addr - kRegAddrModelRCPairs) % 2 == 0) {
+            r_mohm = strtoul(value_in, NULL, 10);
+        } else {
+            tau_ms = strtoul(value_in, NULL, 10);
+        }
+        battery_model_.SetRCPair(pair_index, r_mohm, tau_ms);
+        return kErrCodeNone;
+    }
+
+    switch (reg_addr) {
+        case kRegAddrModelCapacityMAh: {
+            uint32_t capacity_mah = strtoul(value_in, NULL, 10);
+            if (capacity_mah == 0 || capacity_mah > BatteryModel::kMaxCapacityMAh) {
+                return kErrCodeInvalidValue;
+            }
+            battery_model_.SetCapacityMAh(capacity_mah);
+            break;
+        } case kRegAddrModelSOC: {
+            float soc_percent = strtof(value_in, NULL);
+            if (soc_percent < 0.0f || soc_percent > 100.0f) {
+                return kErrCodeInvalidValue;
+            }
+            battery_model_.SetSOCPercent(soc_percent);
+            battery_model_.Relax(); // fresh start at the new SOC
+            break;
+        } case kRegAddrModelR0MOhm: {
+            battery_model_.SetR0MOhm(strtoul(value_in, NULL, 10));
+            break;
+        } default: {
+            printf("SCBS::WriteModelRegister: Register address 0x%x was not recognized.\r\n", reg_addr);
+            return kErrCodeAddrNotRecognized;
+        }
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Reads one of the battery model registers (kRegAddrModelEnable through the end of the OCV table).
+ * @param[in] reg_addr Address of register to read.
+ * @param[out] value_out String buffer to read value into.
+ * @retval Error code, or kErrCodeNone if read succeeded.
+*/
+uint16_t SCBS::ReadModelRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPacketFieldLen]) {
+    if (reg_addr >= kRegAddrModelOCVTable) {
+        snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.3f", battery_model_.GetOCVPoint(reg_addr - kRegAddrModelOCVTable) * 1e-6f);
+        return kErrCodeNone;
+    } else if (reg_addr >= kRegAddrModelRCPairs && reg_addr < kRegAddrModelRCPairs + 2*BatteryModel::kNumRCPairs) {
+        uint16_t pair_index = (reg_addr - kRegAddrModelRCPairs) / 2;
+        snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", (reg_addr - kRegAddrModelRCPairs) % 2 == 0
+            ? battery_model_.GetRCPairRMOhm(pair_index)
+            : battery_model_.GetRCPairTauMs(pair_index));
+        return kErrCodeNone;
+    }
+
+    switch (reg_addr) {
+        case kRegAddrModelEnable:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", battery_model_enabled_);
+            break;
+        case kRegAddrModelCapacityMAh:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", battery_model_.GetCapacityMAh());
+            break;
+        case kRegAddrModelSOC:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.2f", battery_model_.GetSOCPercent());
+            break;
+        case kRegAddrModelR0MOhm:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%u", battery_model_.GetR0MOhm());
+            break;
+        default:
+            printf("SCBS::ReadModelRegister: Register address 0x%x was not recognized.\r\n", reg_addr);
+            return kErrCodeAddrNotRecognized;
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Hardware timer callback for the capture, runs in interrupt context.
+ * @param[in] rt Repeating timer, user_data points to the SCBS object.
+ * @retval true to keep the timer running, false once the capture buffer is full.
+*/
+bool SCBS::CaptureTimerCallback(repeating_timer_t * rt) {
+    return static_cast<SCBS *>(rt->user_data)->CaptureSample();
+}
+
+/**
+ * @brief Runs every capture_sample_period_us_ from the hardware timer while a capture is running. Takes a current
+ * sample into the capture ring buffer, checks for the trigger while armed, and finishes the capture once the buffer has
+ * been filled after the trigger. History from before the trigger beyond capture_pre_trigger_samples_ is dropped so that
+ * it can't be overwritten partway through the readout.
+ * @retval true to keep sampling, false when the capture is done.
+*/
+bool SCBS::CaptureSample() {
+    adc_select_input(config_.csense_adc_input);
+    uint16_t counts = adc_read();
+    uint16_t last_counts = capture_last_counts_;
+    capture_last_counts_ = counts;
+    capture_buf_[capture_write_index_] = counts;
+    capture_write_index_ = (capture_write_index_ + 1) % kCaptureBufLen;
+    if (capture_num_samples_ < kCaptureBufLen) {
+        capture_num_samples_++;
+    }
+
+    if (capture_state_ == CAPTURE_TRIGGERED) {
+        capture_samples_left_--;
+    } else if (capture_state_ == CAPTURE_ARMED) {
+        bool have_edge = capture_num_samples_ > 1; // need a sample from this capture to compare against
+        bool triggered = capture_force_trigger_
+            || (have_edge && capture_trigger_mode_ == CAPTURE_TRIGGER_RISING
+                && last_counts < capture_trigger_level_counts_ && counts >= capture_trigger_level_counts_)
+            || (have_edge && capture_trigger_mode_ == CAPTURE_TRIGGER_FALLING
+                && last_counts > capture_trigger_level_counts_ && counts <= capture_trigger_level_counts_);
+        if (triggered) {
+            uint16_t history = capture_num_samples_ - 1;
+            capture_trigger_index_ = history < capture_pre_trigger_samples_ ? history : capture_pre_trigger_samples_;
+            capture_num_samples_ = capture_trigger_index_ + 1;
+            capture_samples_left_ = kCaptureBufLen - 1 - capture_pre_trigger_samples_;
+            capture_state_ = CAPTURE_TRIGGERED;
+        }
+    }
+
+    if (capture_state_ == CAPTURE_TRIGGERED && capture_samples_left_ == 0) {
+        capture_state_ = CAPTURE_DONE;
+        return false; // stops the timer
+    }
+    return true;
+}
+
+/**
+ * @brief Stops, arms or triggers the capture. Arming throws away the last capture and starts sampling into the
+ * pre-trigger history. Triggering only works while armed, and is ignored if the capture was already triggered so that
+ * a trigger broadcast to every cell doesn't fail on cells that beat it to the trigger. A finished capture has to be
+ * armed again before it can be triggered, rather than the trigger quietly doing nothing.
+ * @param[in] new_state CAPTURE_IDLE, CAPTURE_ARMED or CAPTURE_TRIGGERED.
+ * @retval Error code, or kErrCodeNone if the state was changed.
+*/
+uint16_t SCBS::SetCaptureState(CaptureState_t new_state) {
+    switch (new_state) {
+        case CAPTURE_IDLE:
+            cancel_repeating_timer(&capture_timer_);
+            capture_state_ = CAPTURE_IDLE;
+            break;
+        case CAPTURE_ARMED:
+            if (CaptureIsRunning()) {
+                printf("SCBS::SetCaptureState: Capture is already running.\r\n");
+                return kErrCodeBusy;
+            }
+            capture_write_index_ = 0;
+            capture_num_samples_ = 0;
+            capture_trigger_index_ = 0;
+            capture_force_trigger_ = false;
+            capture_trigger_level_counts_ = CurrentToADCCounts(capture_trigger_level_);
+            capture_state_ = CAPTURE_ARMED; // set before starting the timer, the first sample can come in right away
+            add_repeating_timer_us(-static_cast<int64_t>(capture_sample_period_us_), CaptureTimerCallback, this, &capture_timer_);
+            break;
+        case CAPTURE_TRIGGERED:
+            if (capture_state_ == CAPTURE_IDLE) {
+                printf("SCBS::SetCaptureState: Capture needs to be armed before it can be triggered.\r\n");
+                return kErrCodeInvalidValue;
+            } else if (capture_state_ == CAPTURE_DONE) {
+                printf("SCBS::SetCaptureState: Capture is done, it needs to be armed again before it can be triggered.\r\n");
+                return kErrCodeInvalidValue;
+            }
+            capture_force_trigger_ = true; // picked up by the next sample
+            break;
+        default:
+            printf("SCBS::SetCaptureState: Unrecognized capture state %d.\r\n", new_state);
+            return kErrCodeInvalidValue;
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Returns true while the capture timer is sampling (armed or triggered).
+*/
+bool SCBS::CaptureIsRunning() {
+    return capture_state_ == CAPTURE_ARMED || capture_state_ == CAPTURE_TRIGGERED;
+}
+
+/**
+ * @brief Writes one of the calibration registers (the voltage table, current offset and current gain). Voltage table
+ * changes are applied to the output right away.
+ * @param[in] reg_addr Address of register to write.
+ * @param[in] value_in Value to write.
+ * @retval Error code, or kErrCodeNone if write succeeded.
+*/
+uint16_t SCBS::WriteCalibrationRegister(uint32_t reg_addr, char value_in[BSPacket::kMaxPacketFieldLen]) {
+    if (reg_addr < kRegAddrVoltageCalTable + kNumVoltageCalPoints) {
+        float new_offset = strtof(value_in, NULL);
+        if (new_offset < -kMaxVoltageCalOffset || new_offset > kMaxVoltageCalOffset) {
+            return kErrCodeInvalidValue;
+        }
+        voltage_cal_offsets_uv_[reg_addr - kRegAddrVoltageCalTable] = static_cast<int32_t>(new_offset * 1e6f);
+        SetOutputVoltage(output_voltage_);
+        return kErrCodeNone;
+    }
+
+    switch (reg_addr) {
+        case kRegAddrCurrentCalOffset: {
+            int32_t new_offset = strtol(value_in, NULL, 10);
+            if (new_offset < -kMaxCurrentCalOffsetCounts || new_offset > kMaxCurrentCalOffsetCounts) {
+                return kErrCodeInvalidValue;
+            }
+            current_cal_offset_counts_ = new_offset;
+            break;
+        } case kRegAddrCurrentCalGain: {
+            float new_gain = strtof(value_in, NULL);
+            if (new_gain < kMinCurrentCalGain || new_gain > kMaxCurrentCalGain) {
+                return kErrCodeInvalidValue;
+            }
+            current_cal_gain_q16_ = static_cast<uint32_t>(new_gain * (1 << kCurrentCalGainFracBits) + 0.5f);
+            break;
+        } default: {
+            printf("SCBS::WriteCalibrationRegister: Register address 0x%x was not recognized.\r\n", reg_addr);
+            return kErrCodeAddrNotRecognized;
+        }
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Reads one of the calibration registers (the voltage table, current offset and current gain).
+ * @param[in] reg_addr Address of register to read.
+ * @param[out] value_out String buffer to read value into.
+ * @retval Error code, or kErrCodeNone if read succeeded.
+*/
+uint16_t SCBS::ReadCalibrationRegister(uint32_t reg_addr, char value_out[BSPacket::kMaxPacketFieldLen]) {
+    if (reg_addr < kRegAddrVoltageCalTable + kNumVoltageCalPoints) {
+        snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.4f", voltage_cal_offsets_uv_[reg_addr - kRegAddrVoltageCalTable] * 1e-6f);
+        return kErrCodeNone;
+    }
+
+    switch (reg_addr) {
+        case kRegAddrCurrentCalOffset:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%d", current_cal_offset_counts_);
+            break;
+        case kRegAddrCurrentCalGain:
+            snprintf(value_out, BSPacket::kMaxPacketFieldLen-1, "%.5f", static_cast<float>(current_cal_gain_q16_) / (1 << kCurrentCalGainFracBits));
+            break;
+        default:
+            printf("SCBS::ReadCalibrationRegister: Register address 0x%x was not recognized.\r\n", reg_addr);
+            return kErrCodeAddrNotRecognized;
+    }
+    return kErrCodeNone;
+}
+
+/**
+ * @brief Looks up the output error at a voltage setpoint by interpolating between the calibration table points.
+ * @param[in] voltage_uv Voltage setpoint, between 0 and the max output voltage.
+ * @retval Output error to subtract from the setpoint [uV].
+*/
+int32_t SCBS::GetVoltageCalOffsetUV(int32_t voltage_uv) {
+    int32_t index = voltage_uv / kVoltageCalStepUV;
+    if (index < 0) {
+        return voltage_cal_offsets_uv_[0];
+    } else if (index >= kNumVoltageCalPoints-1) {
+        return voltage_cal_offsets_uv_[kNumVoltageCalPoints-1];
+    }
+    int32_t delta_uv = voltage_cal_offsets_uv_[index+1] - voltage_cal_offsets_uv_[index];
+    return voltage_cal_offsets_uv_[index] + static_cast<int64_t>(delta_uv) * (voltage_uv - index*kVoltageCalStepUV) / kVoltageCalStepUV;
+}
+
+/**
+ * @brief Converts a raw current sense reading to a calibrated current.
+ * @param[in] adc_counts Raw ADC counts.
+ * @retval Current [uA], can be slightly negative near zero if the offset is larger than the reading.
+*/
+int32_t SCBS::ADCCountsToCurrentUA(uint16_t adc_counts) {
+    int64_t counts_q16 = static_cast<int64_t>(adc_counts - current_cal_offset_counts_) * current_cal_gain_q16_;
+    return static_cast<int32_t>(counts_q16 * kCsenseUAPerCountNum / (1 << (kCurrentCalGainFracBits + kCsenseUAPerCountShift)));
+}
+
+/**
+ * @brief Converts a calibrated current to the raw current sense reading that would produce it, for comparing against
+ * raw samples (e.g. the capture trigger level).
+ * @param[in] current Current [mA].
+ * @retval Raw ADC counts, railed to the ADC range.
+*/
+uint16_t SCBS::CurrentToADCCounts(float current) {
+    float counts = current * 1000.0f * (1 << kCsenseUAPerCountShift) / kCsenseUAPerCountNum
+        * (1 << kCurrentCalGainFracBits) / current_cal_gain_q16_ + current_cal_offset_counts_;
+    if (counts < 0.0f) {
+        return 0;
+    } else if (counts > kMaxADCCount - 1) {
+        return kMaxADCCount - 1;
+    }
+    return static_cast<uint16_t>(counts + 0.5f);
+}
+
+/**
+ * @brief Restores the settings saved in flash, or leaves the defaults alone if nothing was saved (or it was saved by
+ * firmware with a different record layout). Must be called before anything changes the settings, since it also takes
+ * the compiled-in defaults.
+*/
+void SCBS::LoadPersistentRecord() {
+    default_record_ = SnapshotPersistentRecord();
+    PersistentRecord_t record;
+    if (!flash_store_.Load(&record, sizeof(record)) || record.version != kPersistentRecordVersion) {
+        printf("SCBS::LoadPersistentRecord: No saved settings, using defaults.\r\n");
+        persistent_record_ = default_record_;
+        return;
+    }
+    persistent_record_ = record;
+
+    cell_id_ = record.cell_id;
+    group_id_ = record.group_id;
+    memcpy(voltage_cal_offsets_uv_, record.voltage_cal_offsets_uv, sizeof(voltage_cal_offsets_uv_));
+    current_cal_offset_counts_ = record.current_cal_offset_counts;
+    current_cal_gain_q16_ = record.current_cal_gain_q16;
+    stream_period_ms_ = record.stream_period_ms;
+    if (stream_period_ms_ < GetMinStreamPeriodMs()) {
+        stream_period_ms_ = 0; // saved before the minimum period was enforced
+    }
+    stream_reg_addr_ = record.stream_reg_addr;
+    current_stats_.SetWindowMs(record.stats_window_ms);
+    sync_hop_trim_us_ = record.sync_hop_trim_us;
+    ramp_rate_ = record.ramp_rate;
+    comparator_enable_ = record.comparator_enable;
+    memcpy(comparator_levels_, record.comparator_levels, sizeof(comparator_levels_));
+    comparator_hysteresis_ = record.comparator_hysteresis;
+    printf("SCBS::LoadPersistentRecord: Restored settings for cell %d.\r\n", cell_id_);
+}
+
+/**
+ * @brief Collects the settings that are kept across power cycles into a record.
+*/
+SCBS::PersistentRecord_t SCBS::SnapshotPersistentRecord() {
+    PersistentRecord_t record;
+    memset(&record, 0, sizeof(record)); // no stray padding bytes in the CRC
+    record.version = kPersistentRecordVersion;
+    record.cell_id = cell_id_;
+    record.group_id = group_id_;
+    record.comparator_enable = comparator_enable_;
+    memcpy(record.voltage_cal_offsets_uv, voltage_cal_offsets_uv_, sizeof(record.voltage_cal_offsets_uv));
+    record.current_cal_offset_counts = current_cal_offset_counts_;
+    record.current_cal_gain_q16 = current_cal_gain_q16_;
+    record.stream_period_ms = stream_period_ms_;
+    record.stream_reg_addr = stream_reg_addr_;
+    record.stats_window_ms = current_stats_.GetWindowMs();
+    record.sync_hop_trim_us = sync_hop_trim_us_;
+    record.ramp_rate = ramp_rate_;
+    memcpy(record.comparator_levels, comparator_levels_, sizeof(record.comparator_levels));
+    record.comparator_hysteresis = comparator_hysteresis_;
+    return record;
+}
+
+/**
+ * @brief Saves a record of settings to flash. Erasing a sector takes tens of milliseconds with interrupts held off,
+ * so this shouldn't be called while anything timing sensitive (e.g. a capture) is going on.
+ * @param[in] record Settings to save.
+ * @retval true if the record was saved.
+*/
+bool SCBS::SavePersistentRecord(PersistentRecord_t record) {
+    if (!flash_store_.Save(&record, sizeof(record))) {
+        printf("SCBS::SavePersistentRecord: Failed to save settings.\r\n");
+        return false;
+    }
+    persistent_record_ = record;
+    return true;
+}
+
+/**
+ * @brief Does the flash writes asked for by kRegAddrSaveSettings, then saves the cell ID given by the last DIS packet
+ * if it hasn't been saved yet, keeping the rest of the record that's in flash. Waits until the line has been quiet for
+ * kSettingsSaveQuietTimeUs with nothing half received, and no capture, profile or battery model is running, since the
+ * flash write holds off the timers and anything arriving over the UART meanwhile could overflow its receive FIFO.
+*/
+void SCBS::SavePendingSettings() {
+    if (!settings_forget_pending_ && !settings_save_pending_ && !cell_id_save_pending_) {
+        return;
+    } else if (uart_rx_buf_len_ > 0 || uart_is_readable(config_.uart_id)
+        || time_us_32() - uart_rx_timestamp_ < kSettingsSaveQuietTimeUs) {
+        return; // try again once the line is quiet
+    } else if (CaptureIsRunning() || profile_state_ != PROFILE_STOPPED || battery_model_enabled_) {
+        return; // try again once it's over
+    }
+    if (settings_forget_pending_) {
+        settings_forget_pending_ = false;
+        flash_store_.Erase();
+    }
+    if (settings_save_pending_) {
+        settings_save_pending_ = false;
+        pending_record_.cell_id = cell_id_; // a DIS since the write gave the cell a newer one
+        SavePersistentRecord(pending_record_);
+    }
+    if (!cell_id_save_pending_) {
+        return;
+    }
+    cell_id_save_pending_ = false;
+    if (persistent_record_.cell_id == cell_id_) {
+        return; // already saved along with the rest of the settings
+    }
+    PersistentRecord_t record = persistent_record_;
+    record.cell_id = cell_id_;
+    SavePersistentRecord(record);
+}
+
 /**
  * @brief Turns on the status LED for the designated interval. Relies on Update() to turn off the LED after the interval
  * has elapsed (does not busy wait).
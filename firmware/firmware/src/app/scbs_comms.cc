@@ -7,6 +7,11 @@
 #include <cstring>
 
 #define SCBS_PACKET_DELIM ","
+#define SCBS_REG_ADDR_LIST_DELIM "|"
+#define SCBS_TAG_DELIM "#"
+#define SCBS_CELL_RANGE_DELIM "-"
+#define SCBS_CELL_GROUP_PREFIX "G"
+#define SCBS_TAG_BASE 16
 #define SCBS_NUMBERS_BASE 10
 #define SCBS_ADDR_BASE 16
 #define SCBS_CHECKSUM_BASE 16
@@ -29,11 +34,12 @@ BSPacket::BSPacket(char from_str_buf[kMaxPacketLen])
 
 /**
  * @brief Populates a BSPacket instance from a packet string. Checks for start and end tokens, calculates
- * checksum, sets packet type.
+ * checksum, sets packet type and tag.
  * @param[in] from_str_buf Incoming packet string buffer.
 */
 void BSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
     is_valid_ = false;
+    tag_ = kNoTag;
     // packet_str_len_ = from_str_buf_len;
     strncpy(packet_str_, from_str_buf, kMaxPacketLen);
 
@@ -55,6 +61,10 @@ void BSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
     strncpy(strtok_buf, from_str_buf, kMaxPacketFieldLen); // strtok modifies the input string, be safe!
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
     header_str++; // ignore the leading '$' sign, this is OK since CalculateChecksum() checks for this.
+    char * tag_str = SplitTag(header_str);
+    if (tag_str) {
+        tag_ = static_cast<uint16_t>(strtoul(tag_str, NULL, SCBS_TAG_BASE));
+    }
     for (uint16_t i = 0; i < kNumPacketTypes; i++) { // excludes UNKNOWN type
         if (strcmp(header_str, BSPacket::packet_header_strs[i]) == 0) {
             packet_type_ = static_cast<PacketType_t>(i);
@@ -71,22 +81,30 @@ void BSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 /**
  * @brief Blindly blasts the packet into a string buffer. Child classes have smarter implementations
  * that build a string from their fields.
- * @param[out] to_str_buf String buffer to copy packet_str_ into.
+ * @param[out] to_str_buf String buffer to copy packet_str_ into. Ignored if NULL.
 */
 uint16_t BSPacket::ToString(char to_str_buf[kMaxPacketLen]) {
-    strncpy(to_str_buf, packet_str_, kMaxPacketLen);
+    if (to_str_buf != NULL) {
+        strncpy(to_str_buf, packet_str_, kMaxPacketLen);
+    }
     return strlen(packet_str_);
 }
 
 /**
  * @brief Writes a packet string containing field values to a string buffer. Used by child classes to encapsulate their
- * contents into packet_str_ with valid formatting.
+ * contents into packet_str_ with valid formatting. The tag is appended to the header if the packet has one.
  * @param[in] packet_contents_str String with everything except the header and tail (does not include tokens).
  * @param[out] to_str_buf String buffer to write completed packet to. Ignored if NULL.
 */
 uint16_t BSPacket::PacketizeContents(char packet_contents_str[kMaxPacketContentsLen], char to_str_buf[kMaxPacketLen]) {
-    snprintf(packet_str_, kMaxPacketLen-kPacketTailLen, "$%s,%s*",
+    char tag_str[kMaxPacketTagLen+1];
+    memset(tag_str, '\0', kMaxPacketTagLen+1);
+    if (tag_ != kNoTag) {
+        snprintf(tag_str, kMaxPacketTagLen+1, SCBS_TAG_DELIM "%X", tag_);
+    }
+    snprintf(packet_str_, kMaxPacketLen-kPacketTailLen, "$%s%s,%s*",
         BSPacket::packet_header_strs[packet_type_],
+        tag_str,
         packet_contents_str
     );
     uint16_t checksum = BSPacket::CalculateChecksum();
@@ -99,6 +117,153 @@ uint16_t BSPacket::PacketizeContents(char packet_contents_str[kMaxPacketContents
     return strlen(packet_str_);
 }
 
+/**
+ * @brief Splits the tag off of a header field (e.g. "$BSSRD#1A" becomes "$BSSRD") so that the header can be compared
+ * against packet_header_strs.
+ * @param[in] header_str Header field, modified in place.
+ * @retval Pointer to the tag string (without the '#'), or NULL if the header wasn't tagged.
+*/
+char * BSPacket::SplitTag(char * header_str) {
+    char * tag_delim_ptr = strchr(header_str, SCBS_TAG_DELIM[0]);
+    if (!tag_delim_ptr) {
+        return NULL;
+    }
+    *tag_delim_ptr = '\0';
+    return tag_delim_ptr+1;
+}
+
+/**
+ * @brief Parses a register address list field (hex addresses separated by '|', e.g. "1000|2000").
+ * @param[in] reg_addrs_str Register address list field. Parsing stops at the first character that isn't part of the
+ * list, so it's OK for this to run into the end token.
+ * @param[out] reg_addrs_out Array to write register addresses into.
+ * @retval Number of register addresses parsed, or 0 if the field was missing or had too many addresses.
+*/
+uint16_t BSPacket::RegAddrsFromString(char * reg_addrs_str, uint32_t reg_addrs_out[kMaxNumRegAddrs]) {
+    if (reg_addrs_str == NULL) {
+        return 0;
+    }
+    uint16_t num_reg_addrs = 0;
+    char * reg_addr_str = reg_addrs_str;
+    while (true) {
+        if (num_reg_addrs >= kMaxNumRegAddrs) {
+            printf("BSPacket::RegAddrsFromString(): Too many register addresses in %s, max is %d.\r\n", reg_addrs_str, kMaxNumRegAddrs);
+            return 0;
+        }
+        char * end_ptr;
+        reg_addrs_out[num_reg_addrs] = (uint32_t)strtoul(reg_addr_str, &end_ptr, SCBS_ADDR_BASE);
+        num_reg_addrs++;
+        if (*end_ptr != SCBS_REG_ADDR_LIST_DELIM[0]) {
+            break; // end of the list
+        }
+        reg_addr_str = end_ptr+1;
+    }
+    return num_reg_addrs;
+}
+
+/**
+ * @brief Writes a register address list field (hex addresses separated by '|', e.g. "1000|2000").
+ * @param[in] reg_addrs_in Register addresses to write.
+ * @param[in] num_reg_addrs_in Number of register addresses, railed to kMaxNumRegAddrs.
+ * @param[out] reg_addrs_str String buffer to write register address list into.
+ * @retval Length of the register address list string.
+*/
+uint16_t BSPacket::RegAddrsToString(uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in, char reg_addrs_str[kMaxRegAddrsStrLen]) {
+    memset(reg_addrs_str, '\0', kMaxRegAddrsStrLen);
+    for (uint16_t i = 0; i < MIN(num_reg_addrs_in, kMaxNumRegAddrs); i++) {
+        char reg_addr_str[kMaxRegAddrStrLen+2]; // +2 for delimiter and EOS
+        snprintf(reg_addr_str, kMaxRegAddrStrLen+2, "%s%X",
+            i == 0 ? "" : SCBS_REG_ADDR_LIST_DELIM,
+            reg_addrs_in[i]
+        );
+        strncat(reg_addrs_str, reg_addr_str, kMaxRegAddrsStrLen-strlen(reg_addrs_str)-1);
+    }
+    return strlen(reg_addrs_str);
+}
+
+/**
+ * @brief Makes a cell selector for a single cell.
+*/
+BSPacket::CellSelector_t BSPacket::SingleCell(uint16_t cell_id) {
+    return CellRange(cell_id, cell_id);
+}
+
+/**
+ * @brief Makes a cell selector for an inclusive range of cell IDs.
+*/
+BSPacket::CellSelector_t BSPacket::CellRange(uint16_t first_cell_id, uint16_t last_cell_id) {
+    CellSelector_t cells = {first_cell_id, last_cell_id, kNoGroupID};
+    return cells;
+}
+
+/**
+ * @brief Makes a cell selector for every cell with a given group ID.
+*/
+BSPacket::CellSelector_t BSPacket::CellGroup(uint16_t group_id) {
+    CellSelector_t cells = {0, 0, group_id};
+    return cells;
+}
+
+/**
+ * @brief Checks whether a cell is one of the cells picked out by a cell selector.
+ * @param[in] cells Cell selector from a packet.
+ * @param[in] cell_id ID of the cell to check.
+ * @param[in] group_id Group ID of the cell to check, kNoGroupID if it isn't in a group.
+ * @retval true if the cell is selected.
+*/
+bool BSPacket::SelectsCell(CellSelector_t cells, uint16_t cell_id, uint16_t group_id) {
+    if (cells.group_id != kNoGroupID) {
+        return group_id == cells.group_id;
+    }
+    return cell_id >= cells.first_cell_id && cell_id <= cells.last_cell_id;
+}
+
+/**
+ * @brief Returns true if a cell selector can pick out more than one cell.
+*/
+bool BSPacket::IsMulticast(CellSelector_t cells) {
+    return cells.group_id != kNoGroupID || cells.first_cell_id != cells.last_cell_id;
+}
+
+/**
+ * @brief Parses a cell ID field, which can be a single cell ID ("5"), an inclusive range ("3-14") or a group ("G2").
+ * @param[in] cells_str Cell ID field.
+ * @param[out] cells_out Cell selector to write into.
+ * @retval true if the field was parsed, false if it was missing or malformed (e.g. a backwards range).
+*/
+bool BSPacket::CellSelectorFromString(char * cells_str, CellSelector_t & cells_out) {
+    if (cells_str == NULL) {
+        return false;
+    }
+    char * end_ptr;
+    if (cells_str[0] == SCBS_CELL_GROUP_PREFIX[0]) {
+        cells_out = CellGroup((uint16_t)strtoul(cells_str+1, &end_ptr, SCBS_NUMBERS_BASE));
+        return end_ptr != cells_str+1 && cells_out.group_id != kNoGroupID;
+    }
+    uint16_t first_cell_id = (uint16_t)strtoul(cells_str, &end_ptr, SCBS_NUMBERS_BASE);
+    uint16_t last_cell_id = first_cell_id;
+    if (*end_ptr == SCBS_CELL_RANGE_DELIM[0]) {
+        last_cell_id = (uint16_t)strtoul(end_ptr+1, NULL, SCBS_NUMBERS_BASE);
+    }
+    cells_out = CellRange(first_cell_id, last_cell_id);
+    return first_cell_id <= last_cell_id;
+}
+
+/**
+ * @brief Writes a cell ID field from a cell selector, in the shortest form that means the same thing.
+ * @param[in] cells Cell selector to write.
+ * @param[out] cells_str String buffer to write the cell ID field into.
+ * @retval Length of the cell ID field.
+*/
+uint16_t BSPacket::CellSelectorToString(CellSelector_t cells, char cells_str[kMaxCellSelectorStrLen+1]) {
+    if (cells.group_id != kNoGroupID) {
+        return snprintf(cells_str, kMaxCellSelectorStrLen+1, SCBS_CELL_GROUP_PREFIX "%d", cells.group_id);
+    } else if (cells.first_cell_id != cells.last_cell_id) {
+        return snprintf(cells_str, kMaxCellSelectorStrLen+1, "%d" SCBS_CELL_RANGE_DELIM "%d", cells.first_cell_id, cells.last_cell_id);
+    }
+    return snprintf(cells_str, kMaxCellSelectorStrLen+1, "%d", cells.first_cell_id);
+}
+
 /**
  * @brief Calculates a checksum for the packet string stored in the packet.
  * @retval Calculated checksum.
@@ -130,6 +295,19 @@ BSPacket::PacketType_t BSPacket::GetPacketType() {
     return packet_type_;
 }
 
+uint16_t BSPacket::GetTag() {
+    return tag_;
+}
+
+/**
+ * @brief Sets the packet's tag and regenerates packet_str_ so the new tag goes out with the packet.
+ * @param[in] tag_in New tag, or kNoTag to send the packet untagged.
+*/
+void BSPacket::SetTag(uint16_t tag_in) {
+    tag_ = tag_in;
+    ToString(NULL);
+}
+
 /** DISPacket **/
 
 /**
@@ -168,6 +346,7 @@ void DISPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 
     strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSDIS")) {
         // Header is wrong (different packet type).
         printf("DISPacket::FromString(): Failed due to invalid header, expected $BSDIS but got %s.\r\n", header_str);
@@ -238,6 +417,7 @@ void MWRPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 
     strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSMWR")) {
         // Header is wrong (different packet type).
         printf("MWRPacket::FromString(): Failed due to invalid header, expected $BSMWR but got %s.\r\n", header_str);
@@ -270,21 +450,36 @@ uint16_t MWRPacket::ToString(char to_str_buf[kMaxPacketLen]) {
 
 /** MRD Packet **/
 /**
- * @brief Construct MRDPacket from values.
+ * @brief Construct MRDPacket from values for a single register.
  * @param[in] reg_addr_in Address of register to read from on all cells.
  * @param[in] values_in Array of values being appended to by cells as they are read.
  * @param[in] num_values_in Number of cells that have been read so far.
 */
-MRDPacket::MRDPacket(uint32_t reg_addr_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in) {
+MRDPacket::MRDPacket(uint32_t reg_addr_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in)
+    : MRDPacket(&reg_addr_in, 1, values_in, num_values_in)
+{
+}
+
+/**
+ * @brief Construct MRDPacket from values for a list of registers.
+ * @param[in] reg_addrs_in Addresses of registers to read from on all cells.
+ * @param[in] num_reg_addrs_in Number of register addresses, railed to kMaxNumRegAddrs.
+ * @param[in] values_in Array of values being appended to by cells as they are read (num_reg_addrs_in per cell).
+ * @param[in] num_values_in Number of values that have been appended so far.
+*/
+MRDPacket::MRDPacket(uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in) {
     packet_type_ = MRD;
 
     // Populate values.
-    reg_addr = reg_addr_in;
-    for (uint16_t i = 0; i < num_values_in; i++) {
+    num_reg_addrs = MIN(num_reg_addrs_in, kMaxNumRegAddrs);
+    for (uint16_t i = 0; i < num_reg_addrs; i++) {
+        reg_addrs[i] = reg_addrs_in[i];
+    }
+    num_values = MIN(num_values_in, kMaxNumValues);
+    for (uint16_t i = 0; i < num_values; i++) {
         memset(values[i], '\0', kMaxPacketFieldLen);
         strncpy(values[i], values_in[i], kMaxPacketFieldLen-1); // make sure to always end with '\0'
     }
-    num_values = num_values_in;
 
     // Populate packet_str_.
     ToString(NULL);
@@ -304,6 +499,8 @@ MRDPacket::MRDPacket(char from_str_buf[kMaxPacketLen]) {
  * @param[in] from_str_buf String buffer to extract MRDPacket values from.
 */
 void MRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    memset(reg_addrs, 0, sizeof(reg_addrs));
+    num_reg_addrs = 0;
     for (uint16_t i = 0; i < kMaxNumValues; i++) {
         memset(values[i], '\0', kMaxPacketFieldLen);
     }
@@ -322,14 +519,19 @@ void MRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
     // Look for end_token_ptr first since we don't know when we'll see it (variable number of values).
     char * end_token_ptr = strchr(strtok_buf, '*'); // don't guard against NULL since already done in CalculateChecksum()
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSMRD")) {
         // Header is wrong (different packet type).
         printf("MRDPacket::FromString(): Failed due to invalid header, expected $BSMRD but got %s.\r\n", header_str);
         return;
     }
 
-    char * reg_addr_str = strtok(NULL, SCBS_PACKET_DELIM);
-    reg_addr = (uint32_t)strtoul(reg_addr_str, NULL, SCBS_ADDR_BASE);
+    char * reg_addrs_str = strtok(NULL, SCBS_PACKET_DELIM);
+    num_reg_addrs = RegAddrsFromString(reg_addrs_str, reg_addrs);
+    if (num_reg_addrs == 0) {
+        printf("MRDPacket::FromString: Unable to parse register address list.\r\n");
+        return;
+    }
 
     char * value_str = strtok(NULL, SCBS_PACKET_DELIM);
     while(value_str != NULL) {
@@ -352,9 +554,7 @@ void MRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 */
 uint16_t MRDPacket::ToString(char to_str_buf[kMaxPacketLen]) {
     char contents_str[kMaxPacketContentsLen];
-    snprintf(contents_str, kMaxPacketContentsLen, "%X",
-        reg_addr
-    );
+    RegAddrsToString(reg_addrs, num_reg_addrs, contents_str);
     for (uint16_t i = 0; i < num_values; i++) {
         if (strlen(contents_str) >= kMaxPacketContentsLen-kMaxPacketFieldLen-1) {
             // Use >= and -1 since leaving room for delimiters and EOF.
@@ -370,6 +570,23 @@ uint16_t MRDPacket::ToString(char to_str_buf[kMaxPacketLen]) {
     return strlen(packet_str_);
 }
 
+/**
+ * @brief Calculates how many cells can be read with a single MRD packet before ToString() runs out of room. Assumes
+ * the longest possible register address list, so the result is conservative.
+ * @param[in] num_reg_addrs_in Number of registers read from each cell.
+ * @param[in] max_value_len Longest value string (not including EOS) that any cell will append.
+ * @retval Maximum number of cells, or 0 if the arguments are out of range.
+*/
+uint16_t MRDPacket::MaxNumCells(uint16_t num_reg_addrs_in, uint16_t max_value_len) {
+    if (num_reg_addrs_in == 0 || num_reg_addrs_in > kMaxNumRegAddrs || max_value_len >= kMaxPacketFieldLen) {
+        return 0;
+    }
+    // ToString() appends values while less than kMaxPacketFieldLen+1 chars of kMaxPacketContentsLen remain.
+    uint16_t room = kMaxPacketContentsLen-kMaxPacketFieldLen-1 - (kMaxRegAddrsStrLen-1);
+    uint16_t max_num_values = (room + max_value_len) / (max_value_len+1); // each value also costs a delimiter
+    return MIN(max_num_values, kMaxNumValues) / num_reg_addrs_in;
+}
+
 /** SWR Packet **/
 
 /**
@@ -378,11 +595,24 @@ uint16_t MRDPacket::ToString(char to_str_buf[kMaxPacketLen]) {
  * @param[in] reg_addr_in Register to write to on target cell.
  * @param[in] value_in Value to write to register on target cell.
 */
-SWRPacket::SWRPacket(uint16_t cell_id_in, uint32_t reg_addr_in, char value_in[kMaxPacketFieldLen]) {
+SWRPacket::SWRPacket(uint16_t cell_id_in, uint32_t reg_addr_in, char value_in[kMaxPacketFieldLen])
+    : SWRPacket(SingleCell(cell_id_in), reg_addr_in, value_in)
+{
+}
+
+/**
+ * @brief Construct SWRPacket from values for a range or group of cells.
+ * @param[in] cells_in Cells to write to.
+ * @param[in] reg_addr_in Target register to write to.
+ * @param[in] value_in Value to write.
+*/
+SWRPacket::SWRPacket(CellSelector_t cells_in, uint32_t reg_addr_in, char value_in[kMaxPacketFieldLen]) {
     packet_type_ = SWR;
 
     // Populate values.
-    cell_id = cell_id_in;
+    cell_id = cells_in.first_cell_id;
+    last_cell_id = cells_in.last_cell_id;
+    group_id = cells_in.group_id;
     reg_addr = reg_addr_in;
     memset(value, '\0', kMaxPacketFieldLen);
     strncpy(value, value_in, kMaxPacketFieldLen-1); // make sure to always end with '\0'
@@ -417,14 +647,22 @@ void SWRPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 
     strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSSWR")) {
         // Header is wrong (different packet type).
         printf("SWRPacket::FromString(): Failed due to invalid header, expected $BSSWR but got %s.\r\n", header_str);
         return;
     }
 
-    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
-    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
+    CellSelector_t cells;
+    if (!CellSelectorFromString(strtok(NULL, SCBS_PACKET_DELIM), cells)) {
+        printf("SWRPacket::FromString(): Unable to parse cell ID field.\r\n");
+        is_valid_ = false;
+        return;
+    }
+    cell_id = cells.first_cell_id;
+    last_cell_id = cells.last_cell_id;
+    group_id = cells.group_id;
 
     char * reg_addr_str = strtok(NULL, SCBS_PACKET_DELIM);
     reg_addr = (uint32_t)strtoul(reg_addr_str, NULL, SCBS_ADDR_BASE);
@@ -441,9 +679,11 @@ void SWRPacket::FromString(char from_str_buf[kMaxPacketLen]) {
  * @param[out] to_str_buf String buffer to write packet to.
 */
 uint16_t SWRPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char cells_str[kMaxCellSelectorStrLen+1];
+    CellSelectorToString(GetCells(), cells_str);
     char contents_str[kMaxPacketContentsLen];
-    snprintf(contents_str, kMaxPacketContentsLen, "%d,%X,%s",
-        cell_id,
+    snprintf(contents_str, kMaxPacketContentsLen, "%s,%X,%s",
+        cells_str,
         reg_addr,
         value
     );
@@ -451,19 +691,54 @@ uint16_t SWRPacket::ToString(char to_str_buf[kMaxPacketLen]) {
     return strlen(packet_str_);
 }
 
+/**
+ * @brief Returns the cells that the packet is for.
+*/
+BSPacket::CellSelector_t SWRPacket::GetCells() {
+    CellSelector_t cells = {cell_id, last_cell_id, group_id};
+    return cells;
+}
+
 /** SRD Packet **/
 
 /**
- * @brief Construct SRDPacket from values.
+ * @brief Construct SRDPacket from values for a single register.
  * @param[in] cell_id_in Cell ID to read from.
  * @param[in] reg_addr_in Target register to read from.
 */
-SRDPacket::SRDPacket(uint16_t cell_id_in, uint32_t reg_addr_in) {
+SRDPacket::SRDPacket(uint16_t cell_id_in, uint32_t reg_addr_in)
+    : SRDPacket(cell_id_in, &reg_addr_in, 1)
+{
+}
+
+/**
+ * @brief Construct SRDPacket from values for a list of registers.
+ * @param[in] cell_id_in Cell ID to read from.
+ * @param[in] reg_addrs_in Target registers to read from, in the order the values should be returned.
+ * @param[in] num_reg_addrs_in Number of target registers, railed to kMaxNumRegAddrs.
+*/
+SRDPacket::SRDPacket(uint16_t cell_id_in, uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in)
+    : SRDPacket(SingleCell(cell_id_in), reg_addrs_in, num_reg_addrs_in)
+{
+}
+
+/**
+ * @brief Construct SRDPacket from values for a range or group of cells. Each cell read from sends back its own SRS.
+ * @param[in] cells_in Cells to read from.
+ * @param[in] reg_addrs_in Target registers to read from, in the order the values should be returned.
+ * @param[in] num_reg_addrs_in Number of target registers, railed to kMaxNumRegAddrs.
+*/
+SRDPacket::SRDPacket(CellSelector_t cells_in, uint32_t reg_addrs_in[], uint16_t num_reg_addrs_in) {
     packet_type_ = SRD;
 
     // Populate values.
-    cell_id = cell_id_in;
-    reg_addr = reg_addr_in;
+    cell_id = cells_in.first_cell_id;
+    last_cell_id = cells_in.last_cell_id;
+    group_id = cells_in.group_id;
+    num_reg_addrs = MIN(num_reg_addrs_in, kMaxNumRegAddrs);
+    for (uint16_t i = 0; i < num_reg_addrs; i++) {
+        reg_addrs[i] = reg_addrs_in[i];
+    }
 
     // Populate packet_str_.
     ToString(NULL);
@@ -483,6 +758,9 @@ SRDPacket::SRDPacket(char from_str_buf[kMaxPacketLen]) {
  * @param[in] from_str_buf String buffer to parse into SRDPacket.
 */
 void SRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    memset(reg_addrs, 0, sizeof(reg_addrs));
+    num_reg_addrs = 0;
+
     BSPacket::FromString(from_str_buf);
     if (!is_valid_) {
         printf("SRDPacket::FromString(): Failed due to invalid packet.\r\n");
@@ -494,17 +772,28 @@ void SRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 
     strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSSRD")) {
         // Header is wrong (different packet type).
         printf("SRDPacket::FromString(): Failed due to invalid header, expected $BSSRD but got %s.\r\n", header_str);
         return;
     }
 
-    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
-    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
-
-    char * reg_addr_str = strtok(NULL, SCBS_PACKET_DELIM);
-    reg_addr = (uint32_t)strtoul(reg_addr_str, NULL, SCBS_ADDR_BASE);
+    CellSelector_t cells;
+    if (!CellSelectorFromString(strtok(NULL, SCBS_PACKET_DELIM), cells)) {
+        printf("SRDPacket::FromString(): Unable to parse cell ID field.\r\n");
+        return;
+    }
+    cell_id = cells.first_cell_id;
+    last_cell_id = cells.last_cell_id;
+    group_id = cells.group_id;
+
+    char * reg_addrs_str = strtok(NULL, SCBS_PACKET_DELIM);
+    num_reg_addrs = RegAddrsFromString(reg_addrs_str, reg_addrs);
+    if (num_reg_addrs == 0) {
+        printf("SRDPacket::FromString: Unable to parse register address list.\r\n");
+        return;
+    }
     
     is_valid_ = true; // Got here without aborting, good enough!
 }
@@ -514,28 +803,54 @@ void SRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
  * @param[out] to_str_buf String buffer to write SRDPacket string into.
 */
 uint16_t SRDPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char reg_addrs_str[kMaxRegAddrsStrLen];
+    RegAddrsToString(reg_addrs, num_reg_addrs, reg_addrs_str);
+    char cells_str[kMaxCellSelectorStrLen+1];
+    CellSelectorToString(GetCells(), cells_str);
     char contents_str[kMaxPacketContentsLen];
-    snprintf(contents_str, kMaxPacketContentsLen, "%d,%X",
-        cell_id,
-        reg_addr
+    snprintf(contents_str, kMaxPacketContentsLen, "%s,%s",
+        cells_str,
+        reg_addrs_str
     );
     BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
     return strlen(packet_str_);
 }
 
+/**
+ * @brief Returns the cells that the packet is for.
+*/
+BSPacket::CellSelector_t SRDPacket::GetCells() {
+    CellSelector_t cells = {cell_id, last_cell_id, group_id};
+    return cells;
+}
+
 /** SRS Packet **/
 /**
  * @brief Construct SRSPacket from values.
  * @param[in] cell_id_in Cell ID that the response is being sent from.
  * @param[in] value_in Response value.
 */
-SRSPacket::SRSPacket(uint16_t cell_id_in, char value_in[kMaxPacketFieldLen]) {
+SRSPacket::SRSPacket(uint16_t cell_id_in, char value_in[kMaxPacketFieldLen])
+    : SRSPacket(cell_id_in, reinterpret_cast<char (*)[kMaxPacketFieldLen]>(value_in), 1)
+{
+}
+
+/**
+ * @brief Construct SRSPacket with multiple values (response to a multi-register SRD).
+ * @param[in] cell_id_in Cell ID that the response is being sent from.
+ * @param[in] values_in Response values.
+ * @param[in] num_values_in Number of response values, railed to kMaxNumValues.
+*/
+SRSPacket::SRSPacket(uint16_t cell_id_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in) {
     packet_type_ = SRS;
 
     // Populate values.
     cell_id = cell_id_in;
-    memset(value, '\0', kMaxPacketFieldLen);
-    strncpy(value, value_in, kMaxPacketFieldLen-1); // make sure to always end with '\0'
+    num_values = MIN(num_values_in, kMaxNumValues);
+    for (uint16_t i = 0; i < num_values; i++) {
+        memset(values[i], '\0', kMaxPacketFieldLen);
+        strncpy(values[i], values_in[i], kMaxPacketFieldLen-1); // make sure to always end with '\0'
+    }
 
     // Populate packet_str_.
     ToString(NULL);
@@ -555,7 +870,10 @@ SRSPacket::SRSPacket(char from_str_buf[kMaxPacketLen]) {
  * @param[in] from_str_buf String buffer containing SRSPacket.
 */
 void SRSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
-    memset(value, '\0', kMaxPacketFieldLen); // make value blank in case stuff fails
+    for (uint16_t i = 0; i < kMaxNumValues; i++) {
+        memset(values[i], '\0', kMaxPacketFieldLen); // make values blank in case stuff fails
+    }
+    num_values = 0;
 
     BSPacket::FromString(from_str_buf);
     if (!is_valid_) {
@@ -563,10 +881,13 @@ void SRSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
         return;
     }
 
+    is_valid_ = false; // set false again so if something SRS specific goes wrong it shows up
     char strtok_buf[kMaxPacketLen];
 
     strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    char * end_token_ptr = strchr(strtok_buf, '*'); // don't guard against NULL since already done in CalculateChecksum()
     char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
     if (strcmp(header_str, "$BSSRS")) {
         // Header is wrong (different packet type).
         printf("SRSPacket::FromString(): Failed due to invalid header, expected $BSSRS but got %s.\r\n", header_str);
@@ -577,8 +898,15 @@ void SRSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
     cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
 
     char * value_str = strtok(NULL, SCBS_PACKET_DELIM);
-    char * end_token_ptr = strchr(value_str, '*');
-    strncpy(value, value_str, MIN(end_token_ptr - value_str, kMaxPacketFieldLen-1));
+    while(value_str != NULL) {
+        if (num_values >= kMaxNumValues) {
+            printf("SRSPacket::FromString: Tried to store too many values, got to %d but max is %d.\r\n", num_values+1, kMaxNumValues);
+            return; // too many values to store!
+        }
+        strncpy(values[num_values], value_str, MIN(end_token_ptr - value_str, kMaxPacketFieldLen-1));
+        num_values++;
+        value_str = strtok(NULL, SCBS_PACKET_DELIM);
+    }
 
     is_valid_ = true; // Got here without aborting, good enough!
 }
@@ -589,10 +917,583 @@ void SRSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
 */
 uint16_t SRSPacket::ToString(char to_str_buf[kMaxPacketLen]) {
     char contents_str[kMaxPacketContentsLen];
-    snprintf(contents_str, kMaxPacketContentsLen, "%d,%s",
+    snprintf(contents_str, kMaxPacketContentsLen, "%d",
+        cell_id
+    );
+    for (uint16_t i = 0; i < num_values; i++) {
+        char value_str[kMaxPacketFieldLen+1];
+        snprintf(value_str, kMaxPacketFieldLen+1, ",%s", values[i]);
+        strncat(contents_str, value_str, kMaxPacketFieldLen+1); // +1 for delimiter
+    }
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** VWR Packet **/
+
+/**
+ * @brief Construct VWRPacket from values.
+ * @param[in] reg_addr_in Address of register to write to on each cell.
+ * @param[in] values_in Array of values to write, one per cell. The first value goes to the next cell in the chain.
+ * @param[in] num_values_in Number of values in values_in.
+*/
+VWRPacket::VWRPacket(uint32_t reg_addr_in, char values_in[][kMaxPacketFieldLen], uint16_t num_values_in) {
+    packet_type_ = VWR;
+
+    // Populate values.
+    reg_addr = reg_addr_in;
+    num_values = MIN(num_values_in, kMaxNumValues);
+    for (uint16_t i = 0; i < num_values; i++) {
+        memset(values[i], '\0', kMaxPacketFieldLen);
+        strncpy(values[i], values_in[i], kMaxPacketFieldLen-1); // make sure to always end with '\0'
+    }
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct VWRPacket from string.
+ * @param[in] from_str_buf String of the form $BSVWR,<reg_addr>,<value_0>,<value_1>,...*<checksum>.
+*/
+VWRPacket::VWRPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = VWR;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fill in a VWRPacket's values from an input string.
+ * @param[in] from_str_buf String buffer to extract VWRPacket values from.
+*/
+void VWRPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    for (uint16_t i = 0; i < kMaxNumValues; i++) {
+        memset(values[i], '\0', kMaxPacketFieldLen);
+    }
+    num_values = 0;
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("VWRPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something VWR specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    // Look for end_token_ptr first since we don't know when we'll see it (variable number of values).
+    char * end_token_ptr = strchr(strtok_buf, '*'); // don't guard against NULL since already done in CalculateChecksum()
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSVWR")) {
+        // Header is wrong (different packet type).
+        printf("VWRPacket::FromString(): Failed due to invalid header, expected $BSVWR but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * reg_addr_str = strtok(NULL, SCBS_PACKET_DELIM);
+    reg_addr = (uint32_t)strtoul(reg_addr_str, NULL, SCBS_ADDR_BASE);
+
+    char * value_str = strtok(NULL, SCBS_PACKET_DELIM);
+    while(value_str != NULL) {
+        if (num_values >= kMaxNumValues) {
+            printf("VWRPacket::FromString: Tried to store too many values, got to %d but max is %d.\r\n", num_values+1, kMaxNumValues);
+            return; // too many values to store!
+        }
+        strncpy(values[num_values], value_str, MIN(end_token_ptr - value_str, kMaxPacketFieldLen-1));
+        num_values++;
+        value_str = strtok(NULL, SCBS_PACKET_DELIM);
+    }
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Generate a VWRPacket string from its values. Values that don't fit in kMaxPacketLen are dropped from the end.
+ * @param[out] to_str_buf String buffer to write VWRPacket string into.
+ * @retval Length of VWRPacket string that was written.
+*/
+uint16_t VWRPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    snprintf(contents_str, kMaxPacketContentsLen, "%X",
+        reg_addr
+    );
+    for (uint16_t i = 0; i < num_values; i++) {
+        if (strlen(contents_str) >= kMaxPacketContentsLen-kMaxPacketFieldLen-1) {
+            // Use >= and -1 since leaving room for delimiters and EOF.
+            printf("VWRPacket::ToString: Ran out of room for values!\r\n");
+            break;
+        }
+        char value_str[kMaxPacketFieldLen+1];
+        snprintf(value_str, kMaxPacketFieldLen+1, ",%s", values[i]);
+        strncat(contents_str, value_str, kMaxPacketFieldLen+1); // +1 for delimiter
+    }
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** SYN Packet **/
+
+/**
+ * @brief Construct SYNPacket from values.
+ * @param[in] delay_us_in Time from when the next cell receives the packet until the synchronized sample is taken.
+*/
+SYNPacket::SYNPacket(uint32_t delay_us_in) {
+    packet_type_ = SYN;
+
+    // Populate values.
+    delay_us = delay_us_in;
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct SYNPacket from string.
+ * @param[in] from_str_buf String of the form $BSSYN,<delay_us>*<checksum> (e.g. $BSSYN,200000*15).
+*/
+SYNPacket::SYNPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = SYN;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fills SYNPacket field values from a string buffer.
+ * @param[in] from_str_buf String buffer to read.
+*/
+void SYNPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    delay_us = 0;
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("SYNPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something SYN specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSSYN")) {
+        // Header is wrong (different packet type).
+        printf("SYNPacket::FromString(): Failed due to invalid header, expected $BSSYN but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * delay_us_str = strtok(NULL, SCBS_PACKET_DELIM);
+    if (delay_us_str == NULL) {
+        printf("SYNPacket::FromString(): Missing delay field.\r\n");
+        return;
+    }
+    delay_us = (uint32_t)strtoul(delay_us_str, NULL, SCBS_NUMBERS_BASE);
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Writes a packet string containing field values to a string buffer.
+ * @param[out] to_str_buf String buffer to write packet to.
+*/
+uint16_t SYNPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    snprintf(contents_str, kMaxPacketContentsLen, "%u",
+        delay_us
+    );
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** PRF Packet **/
+
+/**
+ * @brief Construct PRFPacket from values.
+ * @param[in] cell_id_in ID of cell to load the points into, or kBroadcastCellID for all cells.
+ * @param[in] first_point_index_in Index in the cell's profile of the first point in the packet.
+ * @param[in] points_in Array of profile points, each of the form "<time_ms>:<voltage>".
+ * @param[in] num_points_in Number of profile points, railed to kMaxNumPoints.
+*/
+PRFPacket::PRFPacket(uint16_t cell_id_in, uint16_t first_point_index_in, char points_in[][kMaxPacketFieldLen], uint16_t num_points_in) {
+    packet_type_ = PRF;
+
+    // Populate values.
+    cell_id = cell_id_in;
+    first_point_index = first_point_index_in;
+    num_points = MIN(num_points_in, kMaxNumPoints);
+    for (uint16_t i = 0; i < num_points; i++) {
+        memset(points[i], '\0', kMaxPacketFieldLen);
+        strncpy(points[i], points_in[i], kMaxPacketFieldLen-1); // make sure to always end with '\0'
+    }
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct PRFPacket from string.
+ * @param[in] from_str_buf String of the form $BSPRF,<cell_id>,<first_point_index>,<time_ms>:<voltage>,...*<checksum>
+ * (e.g. $BSPRF,2,0,0:3.700,1000:3.650*5A).
+*/
+PRFPacket::PRFPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = PRF;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fill in a PRFPacket's values from an input string.
+ * @param[in] from_str_buf String buffer to extract PRFPacket values from.
+*/
+void PRFPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    for (uint16_t i = 0; i < kMaxNumPoints; i++) {
+        memset(points[i], '\0', kMaxPacketFieldLen);
+    }
+    num_points = 0;
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("PRFPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something PRF specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    // Look for end_token_ptr first since we don't know when we'll see it (variable number of points).
+    char * end_token_ptr = strchr(strtok_buf, '*'); // don't guard against NULL since already done in CalculateChecksum()
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSPRF")) {
+        // Header is wrong (different packet type).
+        printf("PRFPacket::FromString(): Failed due to invalid header, expected $BSPRF but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * first_point_index_str = strtok(NULL, SCBS_PACKET_DELIM);
+    if (cell_id_str == NULL || first_point_index_str == NULL) {
+        printf("PRFPacket::FromString(): Missing cell ID or first point index.\r\n");
+        return;
+    }
+    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
+    first_point_index = (uint16_t)strtoul(first_point_index_str, NULL, SCBS_NUMBERS_BASE);
+
+    char * point_str = strtok(NULL, SCBS_PACKET_DELIM);
+    while(point_str != NULL) {
+        if (num_points >= kMaxNumPoints) {
+            printf("PRFPacket::FromString: Tried to store too many points, got to %d but max is %d.\r\n", num_points+1, kMaxNumPoints);
+            return; // too many points to store!
+        }
+        strncpy(points[num_points], point_str, MIN(end_token_ptr - point_str, kMaxPacketFieldLen-1));
+        num_points++;
+        point_str = strtok(NULL, SCBS_PACKET_DELIM);
+    }
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Generate a PRFPacket string from its values. Points that don't fit in kMaxPacketLen are dropped from the end.
+ * @param[out] to_str_buf String buffer to write PRFPacket string into.
+ * @retval Length of PRFPacket string that was written.
+*/
+uint16_t PRFPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    snprintf(contents_str, kMaxPacketContentsLen, "%d,%d",
         cell_id,
+        first_point_index
+    );
+    for (uint16_t i = 0; i < num_points; i++) {
+        if (strlen(contents_str) >= kMaxPacketContentsLen-kMaxPacketFieldLen-1) {
+            // Use >= and -1 since leaving room for delimiters and EOF.
+            printf("PRFPacket::ToString: Ran out of room for points!\r\n");
+            break;
+        }
+        char point_str[kMaxPacketFieldLen+1];
+        snprintf(point_str, kMaxPacketFieldLen+1, ",%s", points[i]);
+        strncat(contents_str, point_str, kMaxPacketFieldLen+1); // +1 for delimiter
+    }
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** BRD Packet **/
+
+/**
+ * @brief Construct BRDPacket from values.
+ * @param[in] cell_id_in ID of cell to read from.
+ * @param[in] offset_in Index of the first sample to read.
+ * @param[in] num_samples_in Number of samples to read.
+*/
+BRDPacket::BRDPacket(uint16_t cell_id_in, uint16_t offset_in, uint16_t num_samples_in) {
+    packet_type_ = BRD;
+
+    // Populate values.
+    cell_id = cell_id_in;
+    offset = offset_in;
+    num_samples = num_samples_in;
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct BRDPacket from string.
+ * @param[in] from_str_buf String of the form $BSBRD,<cell_id>,<offset>,<num_samples>*<checksum>
+ * (e.g. $BSBRD,2,112,56*5A).
+*/
+BRDPacket::BRDPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = BRD;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fills BRDPacket field values from a string buffer.
+ * @param[in] from_str_buf String buffer to read.
+*/
+void BRDPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    cell_id = 0;
+    offset = 0;
+    num_samples = 0;
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("BRDPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something BRD specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSBRD")) {
+        // Header is wrong (different packet type).
+        printf("BRDPacket::FromString(): Failed due to invalid header, expected $BSBRD but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * offset_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * num_samples_str = strtok(NULL, SCBS_PACKET_DELIM);
+    if (cell_id_str == NULL || offset_str == NULL || num_samples_str == NULL) {
+        printf("BRDPacket::FromString(): Missing cell ID, offset or number of samples.\r\n");
+        return;
+    }
+    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
+    offset = (uint16_t)strtoul(offset_str, NULL, SCBS_NUMBERS_BASE);
+    num_samples = (uint16_t)strtoul(num_samples_str, NULL, SCBS_NUMBERS_BASE);
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Writes a packet string containing field values to a string buffer.
+ * @param[out] to_str_buf String buffer to write packet to.
+*/
+uint16_t BRDPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    snprintf(contents_str, kMaxPacketContentsLen, "%d,%d,%d",
+        cell_id,
+        offset,
+        num_samples
+    );
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** BRS Packet **/
+
+/**
+ * @brief Construct BRSPacket from values.
+ * @param[in] cell_id_in ID of cell that the samples came from.
+ * @param[in] offset_in Index of the first sample in the packet.
+ * @param[in] samples_in Array of 12-bit samples.
+ * @param[in] num_samples_in Number of samples, railed to kMaxNumSamples.
+*/
+BRSPacket::BRSPacket(uint16_t cell_id_in, uint16_t offset_in, uint16_t samples_in[], uint16_t num_samples_in) {
+    packet_type_ = BRS;
+
+    // Populate values.
+    cell_id = cell_id_in;
+    offset = offset_in;
+    num_samples = MIN(num_samples_in, kMaxNumSamples);
+    for (uint16_t i = 0; i < num_samples; i++) {
+        samples[i] = samples_in[i];
+    }
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct BRSPacket from string.
+ * @param[in] from_str_buf String of the form $BSBRS,<cell_id>,<offset>,<samples>*<checksum>, where samples are packed
+ * as kSampleStrLen hex digits each (e.g. $BSBRS,2,112,7FF800A01*5A).
+*/
+BRSPacket::BRSPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = BRS;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fill in a BRSPacket's values from an input string.
+ * @param[in] from_str_buf String buffer to extract BRSPacket values from.
+*/
+void BRSPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    memset(samples, 0, sizeof(samples));
+    num_samples = 0;
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("BRSPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something BRS specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSBRS")) {
+        // Header is wrong (different packet type).
+        printf("BRSPacket::FromString(): Failed due to invalid header, expected $BSBRS but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * offset_str = strtok(NULL, SCBS_PACKET_DELIM);
+    if (cell_id_str == NULL || offset_str == NULL || strchr(offset_str, '*') != NULL) {
+        printf("BRSPacket::FromString(): Missing cell ID, offset or samples.\r\n");
+        return;
+    }
+    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
+    offset = (uint16_t)strtoul(offset_str, NULL, SCBS_NUMBERS_BASE);
+
+    // Samples field starts right after the offset's delimiter and runs into the end token (it's empty if there are no
+    // samples, so don't use strtok here since it would skip ahead to the checksum).
+    char * samples_str = offset_str + strlen(offset_str) + 1;
+    uint16_t samples_str_len = strcspn(samples_str, "*");
+    if (samples_str_len % kSampleStrLen != 0 || samples_str_len / kSampleStrLen > kMaxNumSamples) {
+        printf("BRSPacket::FromString(): Samples field has a bad length of %d.\r\n", samples_str_len);
+        return;
+    }
+    for (; num_samples < samples_str_len / kSampleStrLen; num_samples++) {
+        char sample_str[kSampleStrLen+1];
+        strncpy(sample_str, samples_str + num_samples*kSampleStrLen, kSampleStrLen);
+        sample_str[kSampleStrLen] = '\0';
+        samples[num_samples] = (uint16_t)strtoul(sample_str, NULL, 16);
+    }
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Generate a BRSPacket string from its values.
+ * @param[out] to_str_buf String buffer to write BRSPacket string into.
+ * @retval Length of BRSPacket string that was written.
+*/
+uint16_t BRSPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    uint16_t contents_len = snprintf(contents_str, kMaxPacketContentsLen, "%d,%d,",
+        cell_id,
+        offset
+    );
+    for (uint16_t i = 0; i < num_samples; i++) {
+        snprintf(contents_str + contents_len, kSampleStrLen+1, "%03X", samples[i] & 0xFFF);
+        contents_len += kSampleStrLen;
+    }
+    BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
+    return strlen(packet_str_);
+}
+
+/** EVT Packet **/
+
+/**
+ * @brief Construct EVTPacket from values.
+ * @param[in] cell_id_in ID of the cell that raised the event.
+ * @param[in] event_code_in What happened, defined by the cell.
+ * @param[in] value_in Value that goes with the event.
+*/
+EVTPacket::EVTPacket(uint16_t cell_id_in, uint16_t event_code_in, char value_in[kMaxPacketFieldLen]) {
+    packet_type_ = EVT;
+
+    // Populate values.
+    cell_id = cell_id_in;
+    event_code = event_code_in;
+    memset(value, '\0', kMaxPacketFieldLen);
+    strncpy(value, value_in, kMaxPacketFieldLen-1); // make sure to always end with '\0'
+
+    // Populate packet_str_.
+    ToString(NULL);
+}
+
+/**
+ * @brief Construct EVTPacket from string.
+ * @param[in] from_str_buf String of the form $BSEVT,<cell_id>,<event_code>,<value>*<checksum>
+ * (e.g. $BSEVT,3,1,152.34*5A).
+*/
+EVTPacket::EVTPacket(char from_str_buf[kMaxPacketLen]) {
+    packet_type_ = EVT;
+    FromString(from_str_buf);
+}
+
+/**
+ * @brief Fills EVTPacket field values from a string buffer.
+ * @param[in] from_str_buf String buffer to read.
+*/
+void EVTPacket::FromString(char from_str_buf[kMaxPacketLen]) {
+    cell_id = 0;
+    event_code = 0;
+    memset(value, '\0', kMaxPacketFieldLen);
+
+    BSPacket::FromString(from_str_buf);
+    if (!is_valid_) {
+        printf("EVTPacket::FromString(): Failed due to invalid packet.\r\n");
+        return;
+    }
+
+    is_valid_ = false; // set false again so if something EVT specific goes wrong it shows up
+    char strtok_buf[kMaxPacketLen];
+
+    strncpy(strtok_buf, from_str_buf, kMaxPacketLen); // strtok modifies the input string, be safe!
+    char * end_token_ptr = strchr(strtok_buf, '*'); // don't guard against NULL since already done in CalculateChecksum()
+    char * header_str = strtok(strtok_buf, SCBS_PACKET_DELIM);
+    SplitTag(header_str); // tag was already parsed by BSPacket::FromString()
+    if (strcmp(header_str, "$BSEVT")) {
+        // Header is wrong (different packet type).
+        printf("EVTPacket::FromString(): Failed due to invalid header, expected $BSEVT but got %s.\r\n", header_str);
+        return;
+    }
+
+    char * cell_id_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * event_code_str = strtok(NULL, SCBS_PACKET_DELIM);
+    char * value_str = strtok(NULL, SCBS_PACKET_DELIM);
+    if (cell_id_str == NULL || event_code_str == NULL || value_str == NULL) {
+        printf("EVTPacket::FromString(): Missing cell ID, event code or value.\r\n");
+        return;
+    }
+    cell_id = (uint16_t)strtoul(cell_id_str, NULL, SCBS_NUMBERS_BASE);
+    event_code = (uint16_t)strtoul(event_code_str, NULL, SCBS_NUMBERS_BASE);
+    strncpy(value, value_str, MIN(end_token_ptr - value_str, kMaxPacketFieldLen-1));
+
+    is_valid_ = true; // Got here without aborting, good enough!
+}
+
+/**
+ * @brief Writes a packet string containing field values to a string buffer.
+ * @param[out] to_str_buf String buffer to write packet to.
+*/
+uint16_t EVTPacket::ToString(char to_str_buf[kMaxPacketLen]) {
+    char contents_str[kMaxPacketContentsLen];
+    snprintf(contents_str, kMaxPacketContentsLen, "%d,%d,%s",
+        cell_id,
+        event_code,
         value
     );
     BSPacket::PacketizeContents(contents_str, to_str_buf); // Send to parent class for header and tail.
     return strlen(packet_str_);
-}
\ No newline at end of file
+}
@@ -0,0 +1,67 @@
+#ifndef _REACTOR_HH_
+#define _REACTOR_HH_
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Single threaded epoll event loop for the host side tools. File descriptors are registered with a callback that runs
+ * on the reactor thread whenever epoll reports them ready, and one-shot timers run on the same thread when they come
+ * due, so anything that only gets touched from callbacks never needs a lock.
+ *
+ * Post() and Stop() are the only functions that are safe to call from other threads. Posted callbacks are queued and
+ * the reactor is woken up through an eventfd to run them.
+*/
+class Reactor {
+public:
+    typedef std::function<void(uint32_t events)> FDCallback_t; // events is a mask of EPOLLIN, EPOLLOUT, etc
+    typedef std::function<void()> Callback_t;
+    typedef uint64_t TimerID_t;
+
+    static const TimerID_t kNoTimer = 0;
+    static const uint16_t kMaxEventsPerWait = 32;
+
+    Reactor();
+    ~Reactor();
+
+    bool AddFD(int fd, uint32_t events, FDCallback_t callback);
+    bool ModifyFD(int fd, uint32_t events);
+    void RemoveFD(int fd);
+
+    TimerID_t AddTimer(uint64_t delay_us, Callback_t callback);
+    void CancelTimer(TimerID_t timer_id);
+
+    void Post(Callback_t callback);
+    void Run();
+    void RunOnce(int timeout_ms);
+    void Stop();
+    bool IsReactorThread();
+
+    static uint64_t GetTimeUs();
+
+private:
+    typedef std::pair<uint64_t, TimerID_t> TimerKey_t; // due time, then ID so that timers due at once stay in order
+
+    void RunTimers();
+    void RunPosted();
+    int GetWaitTimeoutMs(int timeout_ms);
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1; // eventfd used by Post() and Stop()
+    bool running_ = false;
+    std::thread::id reactor_thread_id_;
+
+    std::map<int, FDCallback_t> fd_callbacks_;
+    std::map<TimerKey_t, Callback_t> timers_;
+    std::map<TimerID_t, uint64_t> timer_due_times_;
+    TimerID_t last_timer_id_ = kNoTimer;
+
+    std::mutex posted_mutex_;
+    std::vector<Callback_t> posted_; // guarded by posted_mutex_
+};
+
+#endif /* _REACTOR_HH_ */
@@ -0,0 +1,172 @@
+#ifndef _SCBS_ANALYZER_HH_
+#define _SCBS_ANALYZER_HH_
+
+#include "scbs_capture.hh"
+#include "scbs_latency_histogram.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <utility>
+#include <string>
+
+/**
+ * Decodes the traffic on a chain's serial link, as recorded by SCBSCaptureWriter, into request/response exchanges.
+ *
+ * Requests are matched to responses the same way SCBSMaster does it: by tag, with multicast SRDs waiting for the SRD
+ * itself to come back around the chain. Untagged requests (e.g. from scbs_utils.py) are matched in order to the next
+ * untagged packet of the type they're answered with. Each exchange is timed from the end of the request to the end of
+ * the response. A chain is a ring of store-and-forward links (host to cell 1, cell to cell, last cell back to host),
+ * and every packet crosses all of them, so the per-hop latency of an exchange is its end-to-end latency divided by the
+ * number of cells plus one. The number of cells comes from the config, or from the first DIS response seen.
+ *
+ * Lines with a bad checksum and lines that aren't packets are flagged. So are retries: a request sent again, with the
+ * same tag or untagged both times, while the first one is still outstanding, or sent again with any tag within a
+ * timeout of the first one going unanswered. Requests that go unanswered for longer than the timeout are reported as
+ * such, as are the ones still outstanding when the capture ends.
+ *
+ * Everything is streamed: exchanges, flags and time series intervals go out through callbacks as soon as they're
+ * known, and only outstanding requests are kept, so captures of any size can be analyzed in fixed memory. Feed() can
+ * also be called with live traffic.
+*/
+class SCBSAnalyzer {
+public:
+    static const uint32_t kDefaultTimeoutUs = SCBSMaster::kDefaultTimeoutMs * 1000;
+    static const uint32_t kDefaultIntervalUs = 1000000;
+    static const uint16_t kBitsPerChar = 10; // 8N1, see SerialPort::ConfigureRaw()
+
+    typedef enum {
+        ANSWERED = 0, // by the response the request was waiting for
+        ERROR, // answered, with an error code from a cell, or came back around the chain with no cell claiming it
+        RETRIED, // the same request was sent again before this one was answered
+        UNANSWERED, // nothing came back before the timeout (or the tag was reused), or the capture ended first
+        kNumOutcomes
+    } Outcome_t;
+
+    typedef enum {
+        CHECKSUM_FAILURE = 0,
+        MALFORMED, // not a packet: no tokens, too long, or an unknown packet type
+        RETRY,
+        UNSOLICITED, // a response with no request waiting for it
+        kNumFlagTypes
+    } FlagType_t;
+
+    static constexpr const char * kOutcomeNames[kNumOutcomes] = {"answered", "error", "retried", "unanswered"};
+    static constexpr const char * kFlagTypeNames[kNumFlagTypes] = {
+        "checksum_failure", "malformed", "retry", "unsolicited"
+    };
+
+    typedef struct {
+        uint32_t timeout_us = kDefaultTimeoutUs; // how long a request waits for its response
+        uint32_t interval_us = kDefaultIntervalUs; // length of each time series interval
+        uint16_t num_cells = 0; // 0 to learn it from the first DIS response
+    } Config_t;
+
+    typedef struct {
+        uint64_t request_time_us = 0; // when the last character of the request was captured
+        uint64_t response_time_us = 0; // same for the response, 0 if unanswered
+        BSPacket::PacketType_t packet_type = BSPacket::UNKNOWN; // of the request
+        uint16_t tag = BSPacket::kNoTag;
+        Outcome_t outcome = ANSWERED;
+        uint16_t err_code = SCBSMaster::kErrCodeNone; // from a cell, or one of SCBSMaster's (timeout, etc.)
+        uint16_t err_cell_id = 0;
+        uint64_t latency_us = 0; // end to end, 0 if unanswered
+        uint64_t per_hop_us = 0; // 0 if unanswered or the number of cells isn't known yet
+        std::string request_str; // without "\r\n"
+    } Exchange_t;
+
+    typedef struct {
+        uint64_t time_us = 0;
+        SCBSCapture::Direction_t direction = SCBSCapture::TO_CHAIN;
+        FlagType_t flag_type = CHECKSUM_FAILURE;
+        std::string line; // without "\r\n"
+    } Flag_t;
+
+    typedef struct {
+        uint64_t start_time_us = 0;
+        uint32_t num_requests = 0;
+        uint32_t num_completed = 0; // exchanges that finished in this interval, whatever their outcome
+        uint32_t num_errors = 0;
+        uint32_t num_unanswered = 0;
+        uint32_t num_flags[kNumFlagTypes] = {0};
+        uint64_t num_chars[SCBSCapture::kNumDirections] = {0, 0}; // by direction
+        SCBSLatencyHistogram latency_us; // answered and error exchanges that finished in this interval
+    } Interval_t;
+
+    typedef struct {
+        uint64_t duration_us = 0; // capture time of the last character seen
+        uint16_t num_cells = 0;
+        uint64_t num_chars[SCBSCapture::kNumDirections] = {0, 0}; // by direction
+        uint64_t num_packets[SCBSCapture::kNumDirections] = {0, 0}; // valid packets, by direction
+        uint64_t num_requests[BSPacket::kNumPacketTypes] = {0}; // by packet type
+        uint64_t num_outcomes[kNumOutcomes] = {0};
+        uint64_t num_flags[SCBSCapture::kNumDirections][kNumFlagTypes] = {{0}}; // by direction, then flag type
+        SCBSLatencyHistogram latency_us; // end to end, answered and error exchanges
+        SCBSLatencyHistogram per_hop_us;
+        SCBSLatencyHistogram latency_by_type_us[BSPacket::kNumPacketTypes];
+    } Summary_t;
+
+    typedef std::function<void(const Exchange_t & exchange)> ExchangeCallback_t;
+    typedef std::function<void(const Flag_t & flag)> FlagCallback_t;
+    typedef std::function<void(const Interval_t & interval)> IntervalCallback_t;
+
+    SCBSAnalyzer();
+    SCBSAnalyzer(Config_t config);
+
+    void SetExchangeCallback(ExchangeCallback_t callback);
+    void SetFlagCallback(FlagCallback_t callback);
+    void SetIntervalCallback(IntervalCallback_t callback);
+
+    void Feed(SCBSCapture::Direction_t direction, uint64_t time_us, const char * chars, size_t num_chars);
+    void Finish();
+    bool Analyze(SCBSCaptureReader & reader);
+    const Summary_t & GetSummary();
+
+    static void WriteSummary(FILE * file, const Summary_t & summary, uint32_t baud = 0);
+    static void WriteSummaryJSON(FILE * file, const Summary_t & summary);
+    static void WriteExchangeCSVHeader(FILE * file);
+    static void WriteExchangeCSV(FILE * file, const Exchange_t & exchange);
+    static void WriteIntervalCSVHeader(FILE * file);
+    static void WriteIntervalCSV(FILE * file, const Interval_t & interval);
+
+private:
+    typedef struct {
+        Exchange_t exchange;
+        std::string key; // request_str without the tag and checksum, for spotting retries
+        bool is_multicast = false;
+        bool is_answered_by_cell = false;
+    } Request_t;
+
+    void OnLine(SCBSCapture::Direction_t direction, uint64_t time_us, const std::string & line);
+    void OnRequest(uint64_t time_us, const std::string & line, BSPacket::PacketType_t packet_type, uint16_t tag);
+    void OnResponse(uint64_t time_us, const std::string & line, BSPacket::PacketType_t packet_type, uint16_t tag);
+    void Complete(Request_t & request, uint64_t time_us, Outcome_t outcome, uint16_t err_code);
+    void ExpireOutstanding(uint64_t time_us, bool expire_all = false);
+    void Flag(uint64_t time_us, SCBSCapture::Direction_t direction, FlagType_t flag_type, const std::string & line);
+    void AdvanceTo(uint64_t time_us);
+
+    static bool ParseHeader(const std::string & line, BSPacket::PacketType_t & packet_type, uint16_t & tag,
+        bool & is_checksum_ok);
+    static std::string GetRequestKey(const std::string & line);
+    static bool IsResponseTo(BSPacket::PacketType_t packet_type, BSPacket::PacketType_t request_type);
+
+    Config_t config_;
+    ExchangeCallback_t exchange_callback_;
+    FlagCallback_t flag_callback_;
+    IntervalCallback_t interval_callback_;
+
+    std::string lines_[SCBSCapture::kNumDirections]; // partial line so far, by direction
+    bool is_line_too_long_[SCBSCapture::kNumDirections] = {false, false}; // dropping chars until a line ending
+    std::map<uint16_t, Request_t> tagged_; // outstanding tagged requests, by tag
+    std::deque<Request_t> untagged_; // outstanding untagged requests, oldest first
+    std::deque<std::pair<uint64_t, std::string>> unanswered_keys_; // recently timed out requests, for spotting retries
+    Summary_t summary_;
+    Interval_t interval_;
+    bool has_interval_ = false;
+};
+
+#endif /* _SCBS_ANALYZER_HH_ */
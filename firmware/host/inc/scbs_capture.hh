@@ -0,0 +1,113 @@
+#ifndef _SCBS_CAPTURE_HH_
+#define _SCBS_CAPTURE_HH_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/**
+ * Compact binary log of the traffic on a serial link to a chain, both directions, with microsecond timestamps. Written
+ * by SCBSCaptureWriter (e.g. from SCBSCaptureProxy while a host tool talks to a real chain), and read back with
+ * SCBSCaptureReader for replaying into the chain simulator or analyzing offline.
+ *
+ * File layout, all integers little endian:
+ *   Header (24 bytes): "SCBSCAP", version (uint8), start time (uint64, wall clock us since the epoch), baud (uint32),
+ *   reserved (uint32, 0).
+ *   Records, one per chunk of characters as it was read off the link: LEB128 varint of (time since the previous
+ *   record in us << 1 | direction), LEB128 varint of the number of characters, then the characters.
+ * A record for a packet-sized chunk with a short gap costs 3-4 bytes on top of the characters themselves.
+*/
+class SCBSCapture {
+public:
+    static constexpr const char * kMagic = "SCBSCAP";
+    static const uint16_t kMagicLen = 7;
+    static const uint8_t kVersion = 1;
+    static const uint16_t kHeaderLen = 24;
+    static const uint32_t kMaxRecordLen = 65535; // longer chunks are split across records
+
+    typedef enum {
+        TO_CHAIN = 0, // written by the host
+        FROM_CHAIN = 1 // read by the host
+    } Direction_t;
+    static const uint16_t kNumDirections = 2;
+
+    typedef struct {
+        uint64_t start_time_us = 0; // wall clock when the capture started, us since the epoch
+        uint32_t baud = 0;
+    } Header_t;
+
+    typedef struct {
+        Direction_t direction = TO_CHAIN;
+        uint64_t time_us = 0; // since the capture started
+        std::string chars;
+    } Record_t;
+};
+
+/**
+ * Writes a capture file. Not thread safe, use from one thread (e.g. the reactor thread).
+*/
+class SCBSCaptureWriter {
+public:
+    typedef struct {
+        uint32_t num_records = 0;
+        uint64_t num_chars[2] = {0, 0}; // by direction
+    } Stats_t;
+
+    SCBSCaptureWriter();
+    ~SCBSCaptureWriter();
+
+    bool Open(const char * path, uint32_t baud);
+    void Close();
+    bool IsOpen();
+
+    bool Write(SCBSCapture::Direction_t direction, uint64_t time_us, const char * chars, size_t num_chars);
+    void Flush();
+    Stats_t GetStats();
+
+private:
+    bool WriteVarint(uint64_t value);
+
+    FILE * file_ = NULL;
+    uint64_t open_time_us_ = 0; // Reactor::GetTimeUs() when the file was opened
+    uint64_t last_time_us_ = 0; // of the last record, since open_time_us_
+    Stats_t stats_;
+};
+
+/**
+ * Reads a capture file one record at a time. The file is memory mapped and read front to back, so captures much bigger
+ * than memory are paged in as they're read and dropped again by the kernel as needed, and NextView() hands out records
+ * without copying them.
+*/
+class SCBSCaptureReader {
+public:
+    typedef struct {
+        SCBSCapture::Direction_t direction = SCBSCapture::TO_CHAIN;
+        uint64_t time_us = 0; // since the capture started
+        const char * chars = NULL; // points into the mapped file, good until Close()
+        size_t num_chars = 0;
+    } RecordView_t;
+
+    SCBSCaptureReader();
+    ~SCBSCaptureReader();
+
+    bool Open(const char * path);
+    void Close();
+    SCBSCapture::Header_t GetHeader();
+    uint64_t GetSize();
+    uint64_t GetOffset();
+
+    bool Next(SCBSCapture::Record_t & record);
+    bool NextView(RecordView_t & record);
+    bool Rewind();
+
+private:
+    bool ReadVarint(uint64_t & value);
+
+    const uint8_t * data_ = NULL; // mapped file
+    uint64_t size_ = 0;
+    uint64_t offset_ = 0; // of the next record
+    SCBSCapture::Header_t header_;
+    uint64_t time_us_ = 0;
+};
+
+#endif /* _SCBS_CAPTURE_HH_ */
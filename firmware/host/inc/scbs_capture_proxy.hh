@@ -0,0 +1,60 @@
+#ifndef _SCBS_CAPTURE_PROXY_HH_
+#define _SCBS_CAPTURE_PROXY_HH_
+
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_capture.hh"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+/**
+ * Sits between a host tool and a chain and records everything that goes over the link. The chain's serial port is
+ * opened here, and a pty is created in its place; the host tool opens the pty's path as if it were the chain, and every
+ * character is passed through untouched while being written to an SCBSCaptureWriter with the time it was read.
+ *
+ * Since it works at the serial port level, anything can be captured this way (scbsd, scbsbench, the Python scripts),
+ * without changes to the tool. Everything runs on the reactor thread.
+*/
+class SCBSCaptureProxy {
+public:
+    static const uint16_t kChunkLen = 256; // characters moved per read
+
+    typedef struct {
+        uint64_t num_chars_to_chain = 0;
+        uint64_t num_chars_from_chain = 0;
+    } Stats_t;
+
+    typedef std::function<void()> HangUpCallback_t;
+
+    SCBSCaptureProxy(Reactor & reactor, SCBSCaptureWriter & writer);
+    ~SCBSCaptureProxy();
+
+    bool Open(const char * chain_port_path, uint32_t baud = SerialPort::kDefaultBaud);
+    void Close();
+    void SetHangUpCallback(HangUpCallback_t callback);
+    const char * GetPortPath();
+    Stats_t GetStats();
+
+private:
+    void OnChainEvents(uint32_t events);
+    void OnPtyEvents(uint32_t events);
+    void FlushPending(int fd, std::string & pending);
+    void UpdateEvents();
+
+    Reactor & reactor_;
+    SCBSCaptureWriter & writer_;
+    SerialPort chain_port_;
+    int pty_master_fd_ = -1;
+    int pty_slave_fd_ = -1; // held open so the pty never hangs up between host tool runs
+    std::string port_path_;
+    HangUpCallback_t hang_up_callback_;
+
+    // Touched only on the reactor thread.
+    std::string to_chain_pending_; // read from the pty, not yet written to the chain
+    std::string from_chain_pending_; // read from the chain, not yet written to the pty
+    Stats_t stats_;
+};
+
+#endif /* _SCBS_CAPTURE_PROXY_HH_ */
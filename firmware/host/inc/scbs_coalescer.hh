@@ -0,0 +1,86 @@
+#ifndef _SCBS_COALESCER_HH_
+#define _SCBS_COALESCER_HH_
+
+#include "reactor.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * Merges single cell register reads into MRD sweeps. Reads are held for a short window; when the window closes, every
+ * read of the same register is answered from one MRD, which collects that register from every cell in the chain in a
+ * single trip, instead of one SRD round trip per cell.
+ *
+ * MRD values come back in chain order, so the value for cell N is taken from position N-1. This relies on the cell
+ * IDs having been assigned by a DIS in chain order, which is what verify_topology() in scbs_utils.py checks for.
+ *
+ * A window with only one cell reading a register is sent as a plain SRD. Reads that a sweep can't answer (the MRD
+ * failed, or the chain is too long for one MRD to hold every cell's value) fall back to one SRD each. Once a sweep has
+ * failed for being too long, later windows go straight to SRDs for sweep_retry_us, then a sweep is tried again in case
+ * the chain has been made shorter since. The first sweep that fits goes back to sweeping every window.
+*/
+class SCBSCoalescer {
+public:
+    static const uint32_t kDefaultHoldUs = 2000;
+    static const uint32_t kDefaultSweepRetryUs = 10000000; // after a sweep didn't fit, before trying another
+    static const uint16_t kMinNumCellsForSweep = 2; // any fewer and an SRD is cheaper than sweeping the whole chain
+    static const uint16_t kErrCodePacketLengthExceeded = 0x02; // same as SCBS::kErrCodePacketLengthExceeded
+
+    typedef struct {
+        uint16_t err_code = SCBSMaster::kErrCodeNone; // from the cell (SCBS::kErrCode*) or the master
+        char value[BSPacket::kMaxPacketFieldLen] = "";
+    } ReadResult_t;
+
+    typedef struct {
+        uint32_t num_reads = 0;
+        uint32_t num_sweeps = 0; // MRD packets sent
+        uint32_t num_single_reads = 0; // SRD packets sent, including fallbacks
+        uint32_t num_fallbacks = 0; // reads a sweep couldn't answer
+    } Stats_t;
+
+    typedef std::function<void(ReadResult_t & result)> ReadCallback_t;
+
+    SCBSCoalescer(Reactor & reactor, SCBSMaster & master, uint32_t hold_us = kDefaultHoldUs,
+        uint32_t sweep_retry_us = kDefaultSweepRetryUs);
+    ~SCBSCoalescer();
+
+    void Read(uint16_t cell_id, uint32_t reg_addr, ReadCallback_t callback);
+    std::future<ReadResult_t> Read(uint16_t cell_id, uint32_t reg_addr);
+    Stats_t GetStats();
+
+private:
+    typedef struct {
+        uint16_t cell_id;
+        ReadCallback_t callback;
+    } PendingRead_t;
+
+    typedef struct {
+        std::vector<PendingRead_t> reads;
+        Reactor::TimerID_t timer_id = Reactor::kNoTimer;
+    } Batch_t;
+
+    void AddRead(uint16_t cell_id, uint32_t reg_addr, ReadCallback_t callback);
+    void SendBatch(uint32_t reg_addr);
+    void OnSweepResponse(uint32_t reg_addr, std::vector<PendingRead_t> & reads, SCBSMaster::Response_t & response);
+    void SendSingleRead(uint32_t reg_addr, PendingRead_t & read);
+
+    Reactor & reactor_;
+    SCBSMaster & master_;
+    uint32_t hold_us_;
+    uint32_t sweep_retry_us_;
+
+    // Touched only on the reactor thread.
+    std::map<uint32_t, Batch_t> batches_; // by register address
+    bool sweep_too_long_ = false; // the last MRD came back with kErrCodePacketLengthExceeded
+    uint64_t sweep_too_long_time_us_ = 0; // when it came back
+    Stats_t stats_;
+    std::mutex stats_mutex_;
+};
+
+#endif /* _SCBS_COALESCER_HH_ */
@@ -0,0 +1,79 @@
+#ifndef _SCBS_DAEMON_HH_
+#define _SCBS_DAEMON_HH_
+
+#include "reactor.hh"
+#include "scbs_master.hh"
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+
+/**
+ * Shares one SCBS chain between several local processes. The daemon owns the master (and so the serial port) and
+ * listens on a Unix domain socket. Clients speak the same line protocol as the chain itself: each line a client writes
+ * is a packet string, and the responses to it come back on that client's connection under the client's own tag (or
+ * untagged, if the request was untagged). Requests from every client are retagged and pipelined through the master.
+ *
+ * Lines that don't start with '$' are daemon commands:
+ *     PRIORITY,<n>   Requests from this connection wait in queue n, 0 being the highest. Answered with "OK".
+ *     SUBSCRIBE,<0|1> Turns forwarding of unsolicited packets (streamed telemetry, events) on or off. Answered with "OK".
+ * A bad command is answered with "ERR". A request that fails without a response from the chain (timeout, bad packet,
+ * lost port) is answered with an SRS from cell 0 carrying the master's error code, e.g. "$BSSRS#5,0,ERR:100*CS".
+ *
+ * Each client gets at most kMaxClientInFlight requests handed to the master at once, the rest wait in the daemon, so a
+ * client that writes a big batch can't crowd out other clients at the same priority. A client that stops reading is
+ * disconnected once kMaxClientTxBufLen characters are waiting to go to it, rather than buffering for it without limit.
+*/
+class SCBSDaemon {
+public:
+    static const uint16_t kMaxNumClients = 32;
+    static const uint16_t kMaxClientInFlight = SCBSMaster::kDefaultWindow;
+    static const uint16_t kMaxClientBacklog = 1024; // requests waiting in the daemon per client
+    static const uint16_t kMaxSocketPathLen = 107; // sun_path, no EOS
+    static const uint16_t kListenBacklog = 8;
+    static const uint16_t kChunkLen = 1024;
+    static const uint32_t kMaxClientTxBufLen = 65536; // characters waiting for a client that isn't reading
+
+    SCBSDaemon(Reactor & reactor, SCBSMaster & master);
+    ~SCBSDaemon();
+
+    bool Listen(const char * socket_path);
+    void Close();
+    uint16_t GetNumClients();
+
+private:
+    typedef struct {
+        uint32_t client_id = 0;
+        int fd = -1;
+        uint8_t priority = SCBSMaster::kDefaultPriority;
+        bool is_subscribed = false;
+        bool is_dropping = false; // DropClient() is posted, ignore the client until it runs
+        uint16_t num_in_flight = 0; // handed to the master and not completed yet
+        std::deque<std::string> backlog; // waiting for room under kMaxClientInFlight
+        std::string rx_buf;
+        std::string tx_buf;
+    } Client_t;
+
+    void OnAccept();
+    void OnClientEvents(uint32_t client_id, uint32_t events);
+    void OnClientLine(Client_t * client, std::string & line);
+    void OnCommand(Client_t * client, std::string & line);
+    void OnUnsolicitedPacket(const char * packet_str);
+    void SendRequests(Client_t * client);
+    void OnResponse(uint32_t client_id, uint16_t client_tag, SCBSMaster::Response_t & response);
+    void SendError(Client_t * client, uint16_t client_tag, uint16_t err_code);
+    void WriteLine(Client_t * client, const char * line);
+    void FlushClient(Client_t * client);
+    void DropClient(uint32_t client_id);
+    void DropClientLater(Client_t * client);
+
+    Reactor & reactor_;
+    SCBSMaster & master_;
+    int listen_fd_ = -1;
+    std::string socket_path_;
+    uint32_t last_client_id_ = 0;
+    std::map<uint32_t, Client_t *> clients_; // by client ID, so late responses for a dropped client are ignored
+};
+
+#endif /* _SCBS_DAEMON_HH_ */
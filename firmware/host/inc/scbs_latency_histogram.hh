@@ -0,0 +1,48 @@
+#ifndef _SCBS_LATENCY_HISTOGRAM_HH_
+#define _SCBS_LATENCY_HISTOGRAM_HH_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Latency histogram with HDR (high dynamic range) style buckets. Values below 2^kSubBucketBits get a bucket each, and
+ * every power of two above that is split into the same number of linear sub-buckets, so any value is recorded to within
+ * 1/2^(kSubBucketBits-1) of itself no matter how large it is. Recording is a few shifts and an increment, and the
+ * memory used is fixed, so a load run can record every request without keeping the samples.
+ *
+ * Percentiles are reported as the highest value that shares a bucket with the sample at that percentile (the same
+ * convention as HdrHistogram), so they never understate latency.
+*/
+class SCBSLatencyHistogram {
+public:
+    static const uint16_t kSubBucketBits = 8; // 128 sub-buckets per power of two, < 1% error
+    static const uint32_t kNumBuckets = (1u << kSubBucketBits) + (64 - kSubBucketBits) * (1u << (kSubBucketBits - 1));
+
+    typedef std::pair<uint64_t, uint64_t> Bucket_t; // highest value in the bucket, count
+
+    SCBSLatencyHistogram();
+
+    void Record(uint64_t value, uint64_t count = 1);
+    void Merge(const SCBSLatencyHistogram & other);
+    void Reset();
+
+    uint64_t GetCount() const;
+    uint64_t GetMin() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+    uint64_t GetValueAtPercentile(double percentile) const;
+    std::vector<Bucket_t> GetBuckets() const;
+
+    static uint32_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketHighestValue(uint32_t index);
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    double sum_ = 0.0;
+};
+
+#endif /* _SCBS_LATENCY_HISTOGRAM_HH_ */
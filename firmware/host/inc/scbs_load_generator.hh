@@ -0,0 +1,109 @@
+#ifndef _SCBS_LOAD_GENERATOR_HH_
+#define _SCBS_LOAD_GENERATOR_HH_
+
+#include "reactor.hh"
+#include "scbs_master.hh"
+#include "scbs_latency_histogram.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <future>
+#include <random>
+
+/**
+ * Sends a weighted mix of DIS, MRD, MWR, SRD and SWR requests through a master and measures how the chain copes.
+ *
+ * With a target rate, requests are issued on a fixed schedule whether or not earlier ones have come back (open loop),
+ * and latency is measured from when each request was due to go out, so a chain that falls behind shows it in the tail
+ * instead of quietly slowing the schedule down. Without one, max_in_flight requests are kept outstanding and a new one
+ * goes out as soon as one completes, which finds the most the chain can do.
+ *
+ * Everything runs on the reactor thread. Run() is safe to call from any thread, one run at a time.
+*/
+class SCBSLoadGenerator {
+public:
+    typedef enum {
+        DIS = 0,
+        MRD,
+        MWR,
+        SRD,
+        SWR,
+        kNumRequestTypes
+    } RequestType_t;
+
+    static constexpr const char * kRequestTypeNames[kNumRequestTypes] = {"DIS", "MRD", "MWR", "SRD", "SWR"};
+
+    typedef struct {
+        uint16_t mix[kNumRequestTypes] = {0, 1, 0, 1, 0}; // relative weights, default half MRD and half SRD
+        double rate = 0.0; // requests per second, 0 for as fast as the chain will go
+        uint32_t num_requests = 1000; // stop after this many, 0 for no limit
+        uint32_t duration_ms = 0; // stop after this long, 0 for no limit
+        uint16_t max_in_flight = SCBSMaster::kDefaultWindow; // only used without a target rate
+        uint16_t num_cells = 1; // SRD and SWR go to a random cell between 1 and num_cells
+        uint32_t read_reg_addr = 0x2000; // output current
+        uint32_t write_reg_addr = 0x1000; // output voltage
+        char write_value[BSPacket::kMaxPacketFieldLen] = "3.60";
+        uint8_t priority = SCBSMaster::kDefaultPriority;
+        uint32_t seed = 1; // picks the request types and cells, so runs are repeatable
+    } Config_t;
+
+    typedef struct {
+        Config_t config;
+        uint64_t elapsed_us = 0; // from the first request going out until the last one completed
+        uint32_t num_sent[kNumRequestTypes] = {0};
+        uint32_t num_completed = 0; // including errors
+        uint32_t num_errors = 0; // including timeouts
+        uint32_t num_timeouts = 0;
+        SCBSLatencyHistogram latency_us; // every completed request, including errors
+    } Report_t;
+
+    typedef std::function<void(Report_t & report)> DoneCallback_t;
+
+    SCBSLoadGenerator(Reactor & reactor, SCBSMaster & master);
+    ~SCBSLoadGenerator();
+
+    void Run(Config_t config, DoneCallback_t callback);
+    std::future<Report_t> Run(Config_t config);
+    void Stop();
+
+    static bool ParseMix(const char * mix_str, uint16_t mix[kNumRequestTypes]);
+    static uint32_t GetNumSent(const Report_t & report);
+    static double GetThroughput(const Report_t & report);
+    static double GetErrorRate(const Report_t & report);
+    static void WriteCSVHeader(FILE * file);
+    static void WriteCSV(FILE * file, const Report_t & report, const char * label);
+    static void WriteJSON(FILE * file, const Report_t & report, const char * label);
+    static void WriteSummary(FILE * file, const Report_t & report);
+
+private:
+    void Start(Config_t config, DoneCallback_t callback);
+    void OnRateTimer();
+    void FillWindow();
+    void SendNext(uint64_t due_time_us);
+    void OnResponse(uint64_t due_time_us, SCBSMaster::Response_t & response);
+    bool IsDoneSending();
+    void FinishIfDone();
+
+    Reactor & reactor_;
+    SCBSMaster & master_;
+
+    // Touched only on the reactor thread.
+    bool running_ = false;
+    bool stop_requested_ = false;
+    bool filling_window_ = false; // responses that complete inside Send() mustn't refill the window again
+    Config_t config_;
+    DoneCallback_t callback_;
+    Report_t report_;
+    std::mt19937 rng_;
+    std::discrete_distribution<int> type_dist_;
+    uint64_t start_time_us_ = 0;
+    uint64_t last_completed_time_us_ = 0;
+    uint32_t num_issued_ = 0;
+    uint32_t num_outstanding_ = 0;
+    double next_due_time_us_ = 0.0; // kept as a double so that the schedule doesn't drift at rates that don't divide 1 s
+    Reactor::TimerID_t rate_timer_id_ = Reactor::kNoTimer;
+};
+
+#endif /* _SCBS_LOAD_GENERATOR_HH_ */
@@ -0,0 +1,136 @@
+#ifndef _SCBS_MASTER_HH_
+#define _SCBS_MASTER_HH_
+
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class SCBSRegisterCache;
+
+/**
+ * Host end of an SCBS chain. Packets are built with the same BSPacket classes that the firmware uses, tagged, and
+ * written to the serial port from a Reactor. Up to window requests are on the chain at once, and each response is
+ * matched back to its request by tag, so on a long chain the link stays busy instead of sitting idle for a whole
+ * round trip per request.
+ *
+ * Send() can be called from any thread. Response callbacks (and the unsolicited packet callback, for untagged packets
+ * like streamed telemetry and events) run on the reactor thread, so they must not block on a future from Send().
+*/
+class SCBSMaster {
+public:
+    static const uint16_t kDefaultWindow = 8; // same as DEFAULT_PIPELINE_WINDOW in scbs_utils.py
+    static const uint32_t kDefaultTimeoutMs = 2000;
+    static const uint16_t kMaxTag = 0xFFFF;
+    static const uint16_t kRxBufLen = 4*BSPacket::kMaxPacketLen;
+    static const uint8_t kNumPriorities = 4; // 0 is the highest, queued requests go out highest priority first
+    static const uint8_t kDefaultPriority = 2;
+
+    // Errors raised by the master itself, numbered above the SCBS::kErrCode* values that come back in an SRS.
+    static const uint16_t kErrCodeNone = 0x00; // same as SCBS::kErrCodeNone
+    static const uint16_t kErrCodeTimeout = 0x100; // no response before the timeout
+    static const uint16_t kErrCodeDisconnected = 0x101; // port closed or hung up with the request outstanding
+    static const uint16_t kErrCodeInvalidRequest = 0x102; // request packet was not valid, never sent
+    static const uint16_t kErrCodeNotAnswered = 0x103; // request came back around the chain, no cell claimed it
+    static const uint16_t kErrCodeQueueFull = 0x104; // every tag is already outstanding, never sent
+
+    typedef struct {
+        uint16_t window = kDefaultWindow; // max number of requests on the chain at once
+        uint32_t timeout_ms = kDefaultTimeoutMs; // measured from when the request is written to the port
+    } SCBSMasterConfig_t;
+
+    typedef struct {
+        uint16_t tag = BSPacket::kNoTag;
+        uint16_t err_code = kErrCodeNone; // first error from an SRS, or one of the master's own error codes
+        uint16_t err_cell_id = 0; // cell that sent the error, if it came from a cell
+        uint64_t latency_us = 0; // from being written to the port until the response completed it
+        char packet_str[BSPacket::kMaxPacketLen] = ""; // packet that completed the request, without "\r\n"
+        std::vector<std::string> srs_strs; // SRS packets collected along the way by a multicast SRD or SWR
+    } Response_t;
+
+    typedef struct {
+        uint32_t num_sent = 0;
+        uint32_t num_completed = 0;
+        uint32_t num_errors = 0; // completed with an error, including timeouts
+        uint32_t num_timeouts = 0;
+        uint32_t num_invalid_packets = 0; // received lines that didn't parse (e.g. bad checksum)
+        uint32_t num_unsolicited_packets = 0; // untagged, or tagged with a tag that isn't outstanding
+        uint32_t num_cache_hits = 0; // SRDs answered from the register cache, never sent
+    } Stats_t;
+
+    typedef std::function<void(Response_t & response)> ResponseCallback_t;
+    typedef std::function<void(const char * packet_str)> PacketCallback_t;
+
+    SCBSMaster(Reactor & reactor, SerialPort & port);
+    SCBSMaster(Reactor & reactor, SerialPort & port, SCBSMasterConfig_t config);
+    ~SCBSMaster();
+
+    bool Start();
+    void Stop();
+
+    void Send(BSPacket & request, ResponseCallback_t callback, uint8_t priority = kDefaultPriority);
+    std::future<Response_t> Send(BSPacket & request, uint8_t priority = kDefaultPriority);
+    void SetUnsolicitedPacketCallback(PacketCallback_t callback);
+    void SetRegisterCache(SCBSRegisterCache * cache);
+
+    uint32_t GetNumOutstanding();
+    Stats_t GetStats();
+
+    static uint16_t ParseErrCode(SRSPacket & srs, bool & is_err);
+    static BSPacket * ParsePacket(const char * packet_str);
+    static uint16_t RetagPacketString(char packet_str[BSPacket::kMaxPacketLen], uint16_t tag);
+
+private:
+    typedef struct {
+        BSPacket::PacketType_t packet_type = BSPacket::UNKNOWN;
+        bool is_multicast = false; // SRS packets are collected until the request itself comes back
+        bool is_answered_by_cell = false; // a cell swaps the request for a response, so an echo means nobody did
+        char packet_str[BSPacket::kMaxPacketLen] = "";
+        ResponseCallback_t callback;
+        Response_t response;
+        Reactor::TimerID_t timer_id = Reactor::kNoTimer;
+        uint64_t sent_time_us = 0;
+    } Request_t;
+
+    void OnPortEvents(uint32_t events);
+    void OnPacketReceived(char packet_str[BSPacket::kMaxPacketLen]);
+    void TransmitQueued();
+    void FlushTx();
+    void Complete(uint16_t tag, uint16_t err_code);
+    void FailAll(uint16_t err_code);
+    bool AnswerFromCache(SRDPacket & srd, Request_t * pending);
+    uint16_t ClaimTag();
+
+    Reactor & reactor_;
+    SerialPort & port_;
+    SCBSMasterConfig_t config_;
+    bool is_started_ = false;
+    bool is_stopped_ = false; // Stop() was called, or the port hung up
+    SCBSRegisterCache * cache_ = NULL;
+
+    // Touched only on the reactor thread.
+    std::map<uint16_t, Request_t *> in_flight_;
+    std::string tx_buf_;
+    char rx_buf_[kRxBufLen];
+    uint16_t rx_buf_len_ = 0;
+    PacketCallback_t unsolicited_packet_callback_;
+
+    // Shared with threads calling Send().
+    std::mutex mutex_;
+    std::deque<Request_t *> queued_[kNumPriorities];
+    std::set<uint16_t> tags_in_use_;
+    uint16_t last_tag_ = BSPacket::kNoTag;
+    bool kick_posted_ = false; // a TransmitQueued() is already waiting on the reactor
+    Stats_t stats_;
+};
+
+#endif /* _SCBS_MASTER_HH_ */
@@ -0,0 +1,51 @@
+#ifndef _SCBS_MULTI_CHAIN_HH_
+#define _SCBS_MULTI_CHAIN_HH_
+
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+/**
+ * Drives several chains, each on its own serial port, from one Reactor. Every chain gets its own SCBSMaster, so each
+ * chain pipelines and times out independently, and nothing on one chain waits for another. Talking to the chains is all
+ * waiting on serial ports, so one event loop keeps every chain busy without a thread per chain.
+ *
+ * Scatter() sends the same request to every chain at once and gathers the responses, so an operation like "MRD the
+ * current on every pack" finishes in about the time of the slowest chain instead of the sum of all of them.
+*/
+class SCBSMultiChain {
+public:
+    typedef std::function<void(std::vector<SCBSMaster::Response_t> & responses)> GatherCallback_t;
+
+    SCBSMultiChain(Reactor & reactor);
+    ~SCBSMultiChain();
+
+    int AddChain(const char * port_path, uint32_t baud = SerialPort::kDefaultBaud,
+        SCBSMaster::SCBSMasterConfig_t config = SCBSMaster::SCBSMasterConfig_t());
+    void Stop();
+
+    uint16_t GetNumChains();
+    SCBSMaster & GetMaster(uint16_t chain_index);
+
+    void Scatter(BSPacket & request, GatherCallback_t callback, uint8_t priority = SCBSMaster::kDefaultPriority);
+    std::future<std::vector<SCBSMaster::Response_t>> Scatter(BSPacket & request,
+        uint8_t priority = SCBSMaster::kDefaultPriority);
+
+private:
+    typedef struct {
+        std::unique_ptr<SerialPort> port;
+        std::unique_ptr<SCBSMaster> master;
+    } Chain_t;
+
+    Reactor & reactor_;
+    std::vector<Chain_t> chains_;
+};
+
+#endif /* _SCBS_MULTI_CHAIN_HH_ */
@@ -0,0 +1,78 @@
+#ifndef _SCBS_REGISTER_CACHE_HH_
+#define _SCBS_REGISTER_CACHE_HH_
+
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+
+/**
+ * Cache of register values keyed by (cell ID, register address), so that registers which rarely change (setpoints,
+ * firmware version) aren't read over the link again and again. Attach it to an SCBSMaster with SetRegisterCache():
+ * single cell SRDs are then answered from the cache whenever every register they ask for is fresh, and every response
+ * that carries register values (SRS, MRD) refills it, so callers don't change.
+ *
+ * How long a value stays fresh is set per register. Registers without a TTL aren't cached at all, so measurements like
+ * the output current are always read from the cell. Writes go straight through to the chain and drop the registers they
+ * write, both when they're sent and when they complete, so a read that follows a write always goes to the cell and sees
+ * the value the firmware actually kept (which may be clamped, reformatted, or staged until the next SYN). A DIS, which
+ * can hand out different cell IDs, and a SYN, which commits staged writes, empty the whole cache.
+ *
+ * All methods are thread safe.
+*/
+class SCBSRegisterCache {
+public:
+    static const uint64_t kTTLNone = 0; // never cached
+    static const uint64_t kTTLForever = UINT64_MAX; // cached until written, or the chain is rediscovered
+    static const uint64_t kDefaultSettingTTLUs = 60000000; // settings go back to their saved values if the cell reboots
+    static const uint64_t kDefaultSetpointTTLUs = 1000000; // output setpoints also move with ramps, profiles and the model
+
+    typedef struct {
+        uint32_t num_hits = 0;
+        uint32_t num_misses = 0; // includes registers that aren't cached at all
+        uint32_t num_stores = 0;
+        uint32_t num_invalidations = 0; // entries dropped by writes, DIS or SYN
+    } Stats_t;
+
+    SCBSRegisterCache();
+
+    void SetTTL(uint32_t reg_addr, uint64_t ttl_us);
+    uint64_t GetTTL(uint32_t reg_addr);
+
+    bool Lookup(uint16_t cell_id, uint32_t reg_addrs[], uint16_t num_reg_addrs,
+        char values[][BSPacket::kMaxPacketFieldLen]);
+    void Store(uint16_t cell_id, uint32_t reg_addr, const char * value);
+    void Invalidate(uint16_t cell_id, uint32_t reg_addr);
+    void InvalidateRegister(uint32_t reg_addr);
+    void Clear();
+
+    void OnRequest(const char * request_str);
+    void OnResponse(const char * request_str, SCBSMaster::Response_t & response);
+
+    Stats_t GetStats();
+
+private:
+    typedef struct {
+        char value[BSPacket::kMaxPacketFieldLen] = "";
+        uint64_t stored_time_us = 0;
+    } Entry_t;
+
+    // Every cell's entry for a register is next to each other, so a whole register can be dropped at once.
+    static uint64_t GetKey(uint16_t cell_id, uint32_t reg_addr) {
+        return (static_cast<uint64_t>(reg_addr) << 16) | cell_id;
+    }
+    void StoreSRS(const char * srs_str, uint32_t reg_addrs[], uint16_t num_reg_addrs);
+    void StoreMRD(const char * mrd_str);
+    void StoreLocked(uint16_t cell_id, uint32_t reg_addr, const char * value, uint64_t now_us);
+    void InvalidateLocked(uint16_t cell_id, uint32_t reg_addr);
+    void InvalidateRegisterLocked(uint32_t reg_addr);
+
+    std::mutex mutex_;
+    std::map<uint32_t, uint64_t> ttls_us_; // by register address
+    std::map<uint64_t, Entry_t> entries_; // by GetKey()
+    Stats_t stats_;
+};
+
+#endif /* _SCBS_REGISTER_CACHE_HH_ */
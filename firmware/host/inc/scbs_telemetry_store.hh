@@ -0,0 +1,201 @@
+#ifndef _SCBS_TELEMETRY_STORE_HH_
+#define _SCBS_TELEMETRY_STORE_HH_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Telemetry file for long soak tests: time series of register values, one series per cell and register, e.g. every
+ * cell's output voltage and current from periodic MRD sweeps. Written by SCBSTelemetryWriter, queried by time range
+ * with SCBSTelemetryReader.
+ *
+ * Samples are stored in chunks of up to chunk_len samples from one series, with the timestamps and the values in
+ * separate columns. Timestamps are delta-of-delta encoded, so samples taken on a fixed period cost one byte each.
+ * Values are XOR encoded against the previous value (as in Facebook's Gorilla), so a value that doesn't change costs
+ * one bit, and one that does only costs the bits that differ from the last value. A chunk header holds the chunk's
+ * time range, so a query only decodes the chunks that overlap it.
+ *
+ * File layout, all integers little endian:
+ *   Header (24 bytes): "SCBSTLM", version (uint8), start time (uint64, wall clock us since the epoch), chunk_len
+ *   (uint32), reserved (uint32, 0).
+ *   Chunks, each one a header (40 bytes): kChunkMagic (uint32), cell ID (uint16), reserved (uint16, 0), register
+ *   address (uint32), number of samples (uint32), first and last sample time (uint64 each, us since the start),
+ *   timestamp and value column lengths (uint32 each); then the timestamp column: LEB128 varint of the second sample's
+ *   delta, then zigzagged LEB128 varints of the change in delta for the rest; then the value column: the first value's
+ *   64 bits, then the XOR encoded bits for the rest, most significant bit first, padded to a byte.
+ *   Index, written on a clean close: the offset (uint64) of every chunk, then a trailer (24 bytes): index offset
+ *   (uint64), number of chunks (uint64), kIndexMagic. Without one (the writer was killed), the reader walks the chunk
+ *   headers instead, and keeps every chunk that was written completely. The last chunk of each series may then be
+ *   one that was flushed while it was still being filled.
+*/
+class SCBSTelemetryStore {
+public:
+    static constexpr const char * kMagic = "SCBSTLM";
+    static const uint16_t kMagicLen = 7;
+    static const uint8_t kVersion = 1;
+    static const uint16_t kHeaderLen = 24;
+    static const uint32_t kChunkMagic = 0x4B4E4843; // "CHNK"
+    static const uint16_t kChunkHeaderLen = 40;
+    static constexpr const char * kIndexMagic = "SCBSIDX";
+    static const uint16_t kIndexMagicLen = 8; // including EOS
+    static const uint16_t kTrailerLen = 24;
+    static const uint32_t kDefaultChunkLen = 1024; // samples, about 1-3 kB per chunk for slowly changing values
+
+    typedef struct {
+        uint64_t start_time_us = 0; // wall clock when the file was created, us since the epoch
+        uint32_t chunk_len = kDefaultChunkLen;
+    } Header_t;
+
+    typedef struct {
+        uint64_t time_us = 0; // since the file was created
+        double value = 0.0;
+    } Sample_t;
+
+    typedef struct {
+        uint16_t cell_id = 0;
+        uint32_t reg_addr = 0;
+        uint32_t num_samples = 0;
+        uint64_t first_time_us = 0;
+        uint64_t last_time_us = 0;
+        uint32_t times_len = 0; // bytes in the timestamp column
+        uint32_t values_len = 0; // bytes in the value column
+        uint64_t offset = 0; // of the chunk header in the file
+    } ChunkInfo_t;
+
+    typedef struct {
+        uint16_t cell_id = 0;
+        uint32_t reg_addr = 0;
+        uint64_t num_samples = 0;
+        uint32_t num_chunks = 0;
+        uint64_t first_time_us = 0;
+        uint64_t last_time_us = 0;
+    } Series_t;
+
+    static uint64_t GetSeriesKey(uint16_t cell_id, uint32_t reg_addr);
+};
+
+/**
+ * Compresses one series' samples into the column format of a chunk. Samples must be appended in time order.
+*/
+class SCBSTelemetryChunk {
+public:
+    SCBSTelemetryChunk(uint16_t cell_id, uint32_t reg_addr);
+
+    void Append(uint64_t time_us, double value);
+    void Clear();
+
+    SCBSTelemetryStore::ChunkInfo_t GetInfo();
+    const std::string & GetTimes();
+    const std::string & GetValues();
+
+    static bool Decode(const SCBSTelemetryStore::ChunkInfo_t & info, const uint8_t * times, const uint8_t * values,
+        std::function<bool(const SCBSTelemetryStore::Sample_t & sample)> callback);
+
+private:
+    void WriteBits(uint64_t bits, uint16_t num_bits);
+
+    SCBSTelemetryStore::ChunkInfo_t info_;
+    std::string times_;
+    std::string values_;
+    uint16_t num_free_bits_ = 0; // unused low bits in the last byte of values_
+    int64_t last_delta_us_ = 0;
+    uint64_t last_value_bits_ = 0;
+    uint16_t last_leading_zeros_ = 0; // of the last XOR that was stored with its own window
+    uint16_t last_trailing_zeros_ = 0;
+    bool has_window_ = false;
+};
+
+/**
+ * Appends samples to a telemetry file. Each series fills a chunk in memory, and the chunk is written out once it has
+ * chunk_len samples, so finished chunks are only ever appended. Flush() writes the partly filled chunks after them
+ * too, to bound what a crash can lose; they stay open, and the next flush writes them again in the same place with the
+ * samples since, so flushing often doesn't cut chunks short. Not thread safe, use from one thread (e.g. the reactor
+ * thread, from master callbacks).
+*/
+class SCBSTelemetryWriter {
+public:
+    typedef struct {
+        uint64_t num_samples = 0;
+        uint64_t num_skipped = 0; // MRD values that weren't numbers, e.g. "ERR:1"
+        uint32_t num_chunks = 0; // finished and written to the file so far
+        uint64_t num_bytes = 0; // in the file so far, including flushed chunks that are still being filled
+    } Stats_t;
+
+    SCBSTelemetryWriter();
+    ~SCBSTelemetryWriter();
+
+    bool Open(const char * path, uint32_t chunk_len = SCBSTelemetryStore::kDefaultChunkLen);
+    void Close();
+    bool IsOpen();
+
+    bool Append(uint16_t cell_id, uint32_t reg_addr, uint64_t time_us, double value);
+    uint16_t AppendMRD(uint64_t time_us, const char * mrd_str);
+    bool Flush();
+    Stats_t GetStats();
+
+private:
+    bool PutChunk(SCBSTelemetryChunk & chunk, uint64_t & chunk_len);
+    bool WriteChunk(SCBSTelemetryChunk & chunk);
+    bool WriteTail();
+
+    FILE * file_ = NULL;
+    uint32_t chunk_len_ = SCBSTelemetryStore::kDefaultChunkLen;
+    uint64_t open_time_us_ = 0; // Reactor::GetTimeUs() when the file was opened
+    std::map<uint64_t, SCBSTelemetryChunk> chunks_; // chunk being filled for each series, by series key
+    std::map<uint64_t, uint64_t> last_times_us_; // of the last sample in each series, so that series stay in order
+    std::vector<uint64_t> chunk_offsets_; // for the index
+    uint64_t tail_offset_ = 0; // end of the finished chunks, where flushed chunks that are still being filled start
+    Stats_t stats_;
+};
+
+/**
+ * Reads a telemetry file. The file is memory mapped and only the chunks that overlap a query are touched, so a query
+ * over an hour of a multi-day soak test reads a few pages rather than the whole file.
+*/
+class SCBSTelemetryReader {
+public:
+    typedef std::function<void(const SCBSTelemetryStore::Sample_t & sample)> SampleCallback_t;
+
+    typedef struct {
+        uint64_t start_time_us = 0;
+        uint64_t num_samples = 0;
+        double min = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+    } Aggregate_t;
+
+    SCBSTelemetryReader();
+    ~SCBSTelemetryReader();
+
+    bool Open(const char * path);
+    void Close();
+    SCBSTelemetryStore::Header_t GetHeader();
+    bool IsIndexed();
+    uint32_t GetNumChunks();
+    std::vector<SCBSTelemetryStore::Series_t> GetSeries();
+
+    uint64_t Query(uint16_t cell_id, uint32_t reg_addr, uint64_t start_time_us, uint64_t end_time_us,
+        SampleCallback_t callback);
+    uint64_t Query(uint16_t cell_id, uint32_t reg_addr, uint64_t start_time_us, uint64_t end_time_us,
+        std::vector<SCBSTelemetryStore::Sample_t> & samples);
+    std::vector<Aggregate_t> Aggregate(uint16_t cell_id, uint32_t reg_addr, uint64_t start_time_us,
+        uint64_t end_time_us, uint64_t bucket_us);
+
+private:
+    bool ReadIndex();
+    void ScanChunks();
+    bool ReadChunkInfo(uint64_t offset, SCBSTelemetryStore::ChunkInfo_t & info);
+
+    const uint8_t * data_ = NULL; // mapped file
+    uint64_t size_ = 0;
+    SCBSTelemetryStore::Header_t header_;
+    bool is_indexed_ = false;
+    uint32_t num_chunks_ = 0;
+    std::map<uint64_t, std::vector<SCBSTelemetryStore::ChunkInfo_t>> chunks_; // by series key, in time order
+};
+
+#endif /* _SCBS_TELEMETRY_STORE_HH_ */
@@ -0,0 +1,33 @@
+#ifndef _SERIAL_PORT_HH_
+#define _SERIAL_PORT_HH_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Non-blocking serial port for talking to an SCBS chain from Linux. Opens a tty (or the slave end of a pty, which is
+ * how the chain simulator stands in for hardware), puts it in raw 8N1 mode at the requested baud rate, and exposes the
+ * file descriptor so that it can be registered with a Reactor.
+*/
+class SerialPort {
+public:
+    static const uint32_t kDefaultBaud = 9600; // matches SCBS::SCBSConfig_t
+
+    SerialPort();
+    ~SerialPort();
+
+    bool Open(const char * path, uint32_t baud = kDefaultBaud);
+    void Close();
+    bool IsOpen();
+    int GetFD();
+
+    ssize_t Read(char * buf, size_t len);
+    ssize_t Write(const char * buf, size_t len);
+
+    static bool ConfigureRaw(int fd, uint32_t baud);
+
+private:
+    int fd_ = -1;
+};
+
+#endif /* _SERIAL_PORT_HH_ */
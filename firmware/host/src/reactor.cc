@@ -0,0 +1,247 @@
+#include "reactor.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/**
+ * @brief Constructor, creates the epoll instance and the eventfd used to wake it up from other threads. The thread
+ * that constructs the reactor is treated as the reactor thread until Run() is called from somewhere else.
+*/
+Reactor::Reactor() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        printf("Reactor::Reactor(): Unable to create epoll instance: %s.\r\n", strerror(errno));
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        printf("Reactor::Reactor(): Unable to create eventfd: %s.\r\n", strerror(errno));
+    }
+    reactor_thread_id_ = std::this_thread::get_id();
+    AddFD(wake_fd_, EPOLLIN, [this](uint32_t events) {
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0) {}
+    });
+}
+
+/**
+ * @brief Destructor, closes the epoll instance and the eventfd. File descriptors added with AddFD() belong to the
+ * caller and are left open.
+*/
+Reactor::~Reactor() {
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+/**
+ * @brief Starts watching a file descriptor. Must be called from the reactor thread (or before Run()).
+ * @param[in] fd File descriptor to watch, should be non-blocking.
+ * @param[in] events Mask of epoll events to watch for, e.g. EPOLLIN | EPOLLOUT.
+ * @param[in] callback Called on the reactor thread with the events that were reported.
+ * @retval True if the file descriptor was added, false if epoll refused it or it was already added.
+*/
+bool Reactor::AddFD(int fd, uint32_t events, FDCallback_t callback) {
+    if (fd_callbacks_.count(fd) > 0) {
+        printf("Reactor::AddFD(): File descriptor %d was already added.\r\n", fd);
+        return false;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        printf("Reactor::AddFD(): Unable to add file descriptor %d: %s.\r\n", fd, strerror(errno));
+        return false;
+    }
+    fd_callbacks_[fd] = callback;
+    return true;
+}
+
+/**
+ * @brief Changes the events watched for on a file descriptor that was added with AddFD(), e.g. to start watching for
+ * EPOLLOUT while there's data waiting to be written.
+ * @param[in] fd File descriptor to modify.
+ * @param[in] events New mask of epoll events.
+ * @retval True if successful.
+*/
+bool Reactor::ModifyFD(int fd, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+        printf("Reactor::ModifyFD(): Unable to modify file descriptor %d: %s.\r\n", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stops watching a file descriptor. Safe to call from inside that file descriptor's own callback.
+ * @param[in] fd File descriptor to remove. Not closed.
+*/
+void Reactor::RemoveFD(int fd) {
+    if (fd_callbacks_.erase(fd) > 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+    }
+}
+
+/**
+ * @brief Schedules a callback to run once on the reactor thread after a delay. Must be called from the reactor thread,
+ * use Post() to schedule a timer from somewhere else.
+ * @param[in] delay_us Time to wait before running the callback, in microseconds.
+ * @param[in] callback Function to run.
+ * @retval ID that can be passed to CancelTimer().
+*/
+Reactor::TimerID_t Reactor::AddTimer(uint64_t delay_us, Callback_t callback) {
+    TimerID_t timer_id = ++last_timer_id_;
+    uint64_t due_time_us = GetTimeUs() + delay_us;
+    timers_[TimerKey_t(due_time_us, timer_id)] = callback;
+    timer_due_times_[timer_id] = due_time_us;
+    return timer_id;
+}
+
+/**
+ * @brief Cancels a timer that hasn't run yet. Cancelling a timer that already ran (or kNoTimer) does nothing.
+ * @param[in] timer_id ID returned by AddTimer().
+*/
+void Reactor::CancelTimer(TimerID_t timer_id) {
+    std::map<TimerID_t, uint64_t>::iterator it = timer_due_times_.find(timer_id);
+    if (it == timer_due_times_.end()) {
+        return;
+    }
+    timers_.erase(TimerKey_t(it->second, timer_id));
+    timer_due_times_.erase(it);
+}
+
+/**
+ * @brief Queues a callback to run on the reactor thread and wakes the reactor up. Safe to call from any thread.
+ * @param[in] callback Function to run.
+*/
+void Reactor::Post(Callback_t callback) {
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.push_back(callback);
+    }
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        printf("Reactor::Post(): Unable to wake reactor: %s.\r\n", strerror(errno));
+    }
+}
+
+/**
+ * @brief Runs the event loop on the calling thread until Stop() is called.
+*/
+void Reactor::Run() {
+    reactor_thread_id_ = std::this_thread::get_id();
+    running_ = true;
+    while (running_) {
+        RunOnce(-1);
+    }
+}
+
+/**
+ * @brief Waits for events once and runs everything that became ready: file descriptor callbacks, due timers and
+ * posted callbacks.
+ * @param[in] timeout_ms Longest time to wait for something to happen, or -1 to wait until the next timer is due.
+*/
+void Reactor::RunOnce(int timeout_ms) {
+    struct epoll_event events[kMaxEventsPerWait];
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEventsPerWait, GetWaitTimeoutMs(timeout_ms));
+    if (num_events < 0 && errno != EINTR) {
+        printf("Reactor::RunOnce(): epoll_wait failed: %s.\r\n", strerror(errno));
+    }
+    for (int i = 0; i < num_events; i++) {
+        // Callback may be removed by an earlier callback in the same batch, so look it up every time.
+        std::map<int, FDCallback_t>::iterator it = fd_callbacks_.find(events[i].data.fd);
+        if (it != fd_callbacks_.end()) {
+            FDCallback_t callback = it->second; // copy, the callback is allowed to remove itself
+            callback(events[i].events);
+        }
+    }
+    RunTimers();
+    RunPosted();
+}
+
+/**
+ * @brief Makes Run() return after it finishes what it's currently doing. Safe to call from any thread.
+*/
+void Reactor::Stop() {
+    Post([this]() { running_ = false; });
+}
+
+/**
+ * @brief Returns true if called from the thread that is running the reactor.
+*/
+bool Reactor::IsReactorThread() {
+    return std::this_thread::get_id() == reactor_thread_id_;
+}
+
+/**
+ * @brief Returns the monotonic clock in microseconds. All timer due times are on this clock.
+*/
+uint64_t Reactor::GetTimeUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000ull + static_cast<uint64_t>(now.tv_nsec) / 1000ull;
+}
+
+/**
+ * @brief Runs every timer that was due when the pass started, earliest first.
+*/
+void Reactor::RunTimers() {
+    uint64_t now_us = GetTimeUs();
+    while (!timers_.empty()) {
+        std::map<TimerKey_t, Callback_t>::iterator it = timers_.begin();
+        if (it->first.first > now_us) {
+            break; // rest of the timers are due later
+        }
+        Callback_t callback = it->second;
+        timer_due_times_.erase(it->first.second);
+        timers_.erase(it);
+        callback();
+    }
+}
+
+/**
+ * @brief Runs everything that was queued by Post(), in the order it was posted.
+*/
+void Reactor::RunPosted() {
+    std::vector<Callback_t> posted;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted.swap(posted_);
+    }
+    for (size_t i = 0; i < posted.size(); i++) {
+        posted[i]();
+    }
+}
+
+/**
+ * @brief Works out how long epoll_wait can sleep for without making the next timer late.
+ * @param[in] timeout_ms Timeout requested by the caller, -1 for no limit.
+ * @retval Timeout to pass to epoll_wait, in milliseconds.
+*/
+int Reactor::GetWaitTimeoutMs(int timeout_ms) {
+    if (timers_.empty()) {
+        return timeout_ms;
+    }
+    uint64_t now_us = GetTimeUs();
+    uint64_t due_time_us = timers_.begin()->first.first;
+    int timer_timeout_ms = 0;
+    if (due_time_us > now_us) {
+        timer_timeout_ms = static_cast<int>((due_time_us - now_us + 999) / 1000); // round up, don't spin
+    }
+    if (timeout_ms < 0 || timer_timeout_ms < timeout_ms) {
+        return timer_timeout_ms;
+    }
+    return timeout_ms;
+}
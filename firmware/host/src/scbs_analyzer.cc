@@ -0,0 +1,607 @@
+#include "scbs_analyzer.hh"
+
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * @brief Constructor, with the default timeout and interval, learning the number of cells from the capture.
+*/
+SCBSAnalyzer::SCBSAnalyzer()
+    : SCBSAnalyzer(Config_t())
+{
+}
+
+/**
+ * @brief Constructor.
+ * @param[in] config Timeout, time series interval, and the number of cells if it's known up front.
+*/
+SCBSAnalyzer::SCBSAnalyzer(Config_t config)
+    : config_(config)
+{
+    summary_.num_cells = config_.num_cells;
+}
+
+/**
+ * @brief Sets the callback for each request once its outcome is known.
+*/
+void SCBSAnalyzer::SetExchangeCallback(ExchangeCallback_t callback) {
+    exchange_callback_ = callback;
+}
+
+/**
+ * @brief Sets the callback for each flagged line (bad checksum, not a packet, retry, unsolicited).
+*/
+void SCBSAnalyzer::SetFlagCallback(FlagCallback_t callback) {
+    flag_callback_ = callback;
+}
+
+/**
+ * @brief Sets the callback for each time series interval once it's over. Intervals with no traffic are included.
+*/
+void SCBSAnalyzer::SetIntervalCallback(IntervalCallback_t callback) {
+    interval_callback_ = callback;
+}
+
+/**
+ * @brief Feeds characters captured off the link. Lines are put back together separately for each direction, and each
+ * line is handled at the time of the chunk that finished it.
+ * @param[in] direction Which way the characters were going.
+ * @param[in] time_us When the characters were captured, since the capture started. Must not go backwards.
+ * @param[in] chars Characters, not null terminated.
+ * @param[in] num_chars Number of characters.
+*/
+void SCBSAnalyzer::Feed(SCBSCapture::Direction_t direction, uint64_t time_us, const char * chars, size_t num_chars) {
+    AdvanceTo(time_us);
+    if (time_us > summary_.duration_us) {
+        summary_.duration_us = time_us;
+    }
+    summary_.num_chars[direction] += num_chars;
+    interval_.num_chars[direction] += num_chars;
+
+    std::string & line = lines_[direction];
+    for (size_t i = 0; i < num_chars; i++) {
+        if (chars[i] == '\n') {
+            if (is_line_too_long_[direction]) {
+                Flag(time_us, direction, MALFORMED, line);
+                is_line_too_long_[direction] = false;
+            } else if (!line.empty()) {
+                OnLine(direction, time_us, line);
+            }
+            line.clear();
+        } else if (chars[i] == '\r') {
+            continue;
+        } else if (line.size() < BSPacket::kMaxPacketLen - 1u) {
+            line += chars[i];
+        } else {
+            is_line_too_long_[direction] = true; // same as SCBSMaster, which drops lines that don't fit a packet
+        }
+    }
+}
+
+/**
+ * @brief Wraps up at the end of a capture: requests that are still outstanding are reported as unanswered, with
+ * SCBSMaster::kErrCodeDisconnected, and the last time series interval is closed. Partial lines are dropped.
+*/
+void SCBSAnalyzer::Finish() {
+    ExpireOutstanding(summary_.duration_us, true);
+    if (has_interval_ && interval_callback_) {
+        interval_callback_(interval_);
+    }
+    has_interval_ = false;
+    for (int i = 0; i < SCBSCapture::kNumDirections; i++) {
+        lines_[i].clear();
+        is_line_too_long_[i] = false;
+    }
+}
+
+/**
+ * @brief Feeds every record in a capture from where the reader is, then calls Finish().
+ * @param[in] reader Open capture.
+ * @retval True if the whole capture was read, false if it ended in a truncated or corrupt record (everything before
+ * that is still analyzed).
+*/
+bool SCBSAnalyzer::Analyze(SCBSCaptureReader & reader) {
+    SCBSCaptureReader::RecordView_t record;
+    while (reader.NextView(record)) {
+        Feed(record.direction, record.time_us, record.chars, record.num_chars);
+    }
+    Finish();
+    if (reader.GetOffset() != reader.GetSize()) {
+        printf("SCBSAnalyzer::Analyze(): Stopped at a bad record %lu bytes into a %lu byte capture.\r\n",
+            reader.GetOffset(), reader.GetSize());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the totals so far. The number of cells is filled in once it's known.
+*/
+const SCBSAnalyzer::Summary_t & SCBSAnalyzer::GetSummary() {
+    return summary_;
+}
+
+/**
+ * @brief Writes a summary for people to read.
+ * @param[in] file File to write to.
+ * @param[in] summary Totals from an analysis.
+ * @param[in] baud Baud rate of the link, from the capture header, for working out how busy it was. 0 to leave out.
+*/
+void SCBSAnalyzer::WriteSummary(FILE * file, const Summary_t & summary, uint32_t baud) {
+    uint64_t num_requests = 0;
+    for (int i = 0; i < BSPacket::kNumPacketTypes; i++) {
+        num_requests += summary.num_requests[i];
+    }
+    fprintf(file, "Analyzed %.3f s of traffic on a chain of %u cells: %lu requests, %lu packets back.\r\n",
+        summary.duration_us / 1e6, summary.num_cells, num_requests, summary.num_packets[SCBSCapture::FROM_CHAIN]);
+    for (int i = 0; i < SCBSCapture::kNumDirections; i++) {
+        fprintf(file, "%s: %lu characters", i == SCBSCapture::TO_CHAIN ? "To chain" : "From chain",
+            summary.num_chars[i]);
+        if (baud > 0 && summary.duration_us > 0) {
+            fprintf(file, " (%.1f%% of the link)",
+                100.0 * summary.num_chars[i] * kBitsPerChar / baud / (summary.duration_us / 1e6));
+        }
+        for (int j = 0; j < kNumFlagTypes; j++) {
+            fprintf(file, ", %lu %s", summary.num_flags[i][j], kFlagTypeNames[j]);
+        }
+        fprintf(file, ".\r\n");
+    }
+    fprintf(file, "Outcomes:");
+    for (int i = 0; i < kNumOutcomes; i++) {
+        fprintf(file, "%s %s %lu", i > 0 ? "," : "", kOutcomeNames[i], summary.num_outcomes[i]);
+    }
+    fprintf(file, ".\r\n");
+    const SCBSLatencyHistogram & latency_us = summary.latency_us;
+    fprintf(file, "Latency (us): min %lu, mean %.1f, p50 %lu, p90 %lu, p99 %lu, p999 %lu, max %lu.\r\n",
+        latency_us.GetMin(), latency_us.GetMean(), latency_us.GetValueAtPercentile(50.0),
+        latency_us.GetValueAtPercentile(90.0), latency_us.GetValueAtPercentile(99.0),
+        latency_us.GetValueAtPercentile(99.9), latency_us.GetMax());
+    if (summary.per_hop_us.GetCount() > 0) {
+        fprintf(file, "Per hop latency (us): mean %.1f, p50 %lu, p99 %lu, max %lu.\r\n", summary.per_hop_us.GetMean(),
+            summary.per_hop_us.GetValueAtPercentile(50.0), summary.per_hop_us.GetValueAtPercentile(99.0),
+            summary.per_hop_us.GetMax());
+    }
+    for (int i = 0; i < BSPacket::kNumPacketTypes; i++) {
+        const SCBSLatencyHistogram & type_latency_us = summary.latency_by_type_us[i];
+        if (summary.num_requests[i] == 0) {
+            continue;
+        }
+        fprintf(file, "  %s: %lu requests, latency (us) p50 %lu, p99 %lu, max %lu.\r\n",
+            BSPacket::packet_header_strs[i] + 2, summary.num_requests[i], type_latency_us.GetValueAtPercentile(50.0),
+            type_latency_us.GetValueAtPercentile(99.0), type_latency_us.GetMax());
+    }
+}
+
+/**
+ * @brief Writes a summary as a JSON object, including every non-empty bucket of the end to end latency histogram.
+ * @param[in] file File to write to.
+ * @param[in] summary Totals from an analysis.
+*/
+void SCBSAnalyzer::WriteSummaryJSON(FILE * file, const Summary_t & summary) {
+    fprintf(file, "{\n  \"duration_us\": %lu,\n  \"num_cells\": %u,\n  \"num_chars\": {\"to_chain\": %lu, "
+        "\"from_chain\": %lu},\n  \"num_packets\": {\"to_chain\": %lu, \"from_chain\": %lu},\n  \"num_requests\": {",
+        summary.duration_us, summary.num_cells, summary.num_chars[SCBSCapture::TO_CHAIN],
+        summary.num_chars[SCBSCapture::FROM_CHAIN], summary.num_packets[SCBSCapture::TO_CHAIN],
+        summary.num_packets[SCBSCapture::FROM_CHAIN]);
+    for (int i = 0; i < BSPacket::kNumPacketTypes; i++) {
+        fprintf(file, "%s\"%s\": %lu", i > 0 ? ", " : "", BSPacket::packet_header_strs[i] + 2,
+            summary.num_requests[i]);
+    }
+    fprintf(file, "},\n  \"outcomes\": {");
+    for (int i = 0; i < kNumOutcomes; i++) {
+        fprintf(file, "%s\"%s\": %lu", i > 0 ? ", " : "", kOutcomeNames[i], summary.num_outcomes[i]);
+    }
+    fprintf(file, "},\n  \"flags\": {");
+    for (int i = 0; i < SCBSCapture::kNumDirections; i++) {
+        fprintf(file, "%s\"%s\": {", i > 0 ? ", " : "", i == SCBSCapture::TO_CHAIN ? "to_chain" : "from_chain");
+        for (int j = 0; j < kNumFlagTypes; j++) {
+            fprintf(file, "%s\"%s\": %lu", j > 0 ? ", " : "", kFlagTypeNames[j], summary.num_flags[i][j]);
+        }
+        fprintf(file, "}");
+    }
+    const SCBSLatencyHistogram & latency_us = summary.latency_us;
+    fprintf(file, "},\n  \"per_hop_us\": {\"mean\": %.1f, \"p50\": %lu, \"p99\": %lu, \"max\": %lu},\n",
+        summary.per_hop_us.GetMean(), summary.per_hop_us.GetValueAtPercentile(50.0),
+        summary.per_hop_us.GetValueAtPercentile(99.0), summary.per_hop_us.GetMax());
+    fprintf(file, "  \"latency_us\": {\"min\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, "
+        "\"p999\": %lu, \"max\": %lu,\n    \"buckets\": [", latency_us.GetMin(), latency_us.GetMean(),
+        latency_us.GetValueAtPercentile(50.0), latency_us.GetValueAtPercentile(90.0),
+        latency_us.GetValueAtPercentile(99.0), latency_us.GetValueAtPercentile(99.9), latency_us.GetMax());
+    std::vector<SCBSLatencyHistogram::Bucket_t> buckets = latency_us.GetBuckets();
+    for (size_t i = 0; i < buckets.size(); i++) {
+        fprintf(file, "%s[%lu, %lu]", i > 0 ? ", " : "", buckets[i].first, buckets[i].second);
+    }
+    fprintf(file, "]}\n}\n");
+}
+
+/**
+ * @brief Writes the column names for WriteExchangeCSV().
+*/
+void SCBSAnalyzer::WriteExchangeCSVHeader(FILE * file) {
+    fprintf(file, "request_time_us,response_time_us,type,tag,outcome,err_code,err_cell_id,latency_us,per_hop_us,"
+        "request\n");
+}
+
+/**
+ * @brief Writes one exchange as a CSV row, for a timeline of every request in a capture.
+*/
+void SCBSAnalyzer::WriteExchangeCSV(FILE * file, const Exchange_t & exchange) {
+    fprintf(file, "%lu,%lu,%s,%X,%s,%X,%u,%lu,%lu,\"%s\"\n", exchange.request_time_us, exchange.response_time_us,
+        BSPacket::packet_header_strs[exchange.packet_type] + 2, exchange.tag, kOutcomeNames[exchange.outcome],
+        exchange.err_code, exchange.err_cell_id, exchange.latency_us, exchange.per_hop_us,
+        exchange.request_str.c_str());
+}
+
+/**
+ * @brief Writes the column names for WriteIntervalCSV().
+*/
+void SCBSAnalyzer::WriteIntervalCSVHeader(FILE * file) {
+    fprintf(file, "start_time_us,num_requests,num_completed,num_errors,num_unanswered");
+    for (int i = 0; i < kNumFlagTypes; i++) {
+        fprintf(file, ",num_%s", kFlagTypeNames[i]);
+    }
+    fprintf(file, ",chars_to_chain,chars_from_chain,p50_us,p99_us,max_us\n");
+}
+
+/**
+ * @brief Writes one time series interval as a CSV row.
+*/
+void SCBSAnalyzer::WriteIntervalCSV(FILE * file, const Interval_t & interval) {
+    fprintf(file, "%lu,%u,%u,%u,%u", interval.start_time_us, interval.num_requests, interval.num_completed,
+        interval.num_errors, interval.num_unanswered);
+    for (int i = 0; i < kNumFlagTypes; i++) {
+        fprintf(file, ",%u", interval.num_flags[i]);
+    }
+    fprintf(file, ",%lu,%lu,%lu,%lu,%lu\n", interval.num_chars[SCBSCapture::TO_CHAIN],
+        interval.num_chars[SCBSCapture::FROM_CHAIN], interval.latency_us.GetValueAtPercentile(50.0),
+        interval.latency_us.GetValueAtPercentile(99.0), interval.latency_us.GetMax());
+}
+
+/**
+ * @brief Handles a complete line: flags it if it isn't a packet with a good checksum, otherwise treats it as a
+ * request or a response depending on which way it was going.
+ * @param[in] direction Which way the line was going.
+ * @param[in] time_us When its line ending was captured.
+ * @param[in] line Line, without "\r\n".
+*/
+void SCBSAnalyzer::OnLine(SCBSCapture::Direction_t direction, uint64_t time_us, const std::string & line) {
+    ExpireOutstanding(time_us);
+    BSPacket::PacketType_t packet_type;
+    uint16_t tag;
+    bool is_checksum_ok;
+    if (!ParseHeader(line, packet_type, tag, is_checksum_ok)) {
+        Flag(time_us, direction, MALFORMED, line);
+        return;
+    }
+    if (!is_checksum_ok) {
+        Flag(time_us, direction, CHECKSUM_FAILURE, line);
+        return;
+    }
+    summary_.num_packets[direction]++;
+    if (direction == SCBSCapture::TO_CHAIN) {
+        OnRequest(time_us, line, packet_type, tag);
+    } else {
+        OnResponse(time_us, line, packet_type, tag);
+    }
+}
+
+/**
+ * @brief Starts tracking a request. Sending the same request again is a retry (the first one is done, as RETRIED),
+ * and reusing the tag of a different outstanding request means the host gave up on it (done, as UNANSWERED).
+*/
+void SCBSAnalyzer::OnRequest(uint64_t time_us, const std::string & line, BSPacket::PacketType_t packet_type,
+    uint16_t tag) {
+    summary_.num_requests[packet_type]++;
+    interval_.num_requests++;
+
+    Request_t request;
+    request.exchange.request_time_us = time_us;
+    request.exchange.packet_type = packet_type;
+    request.exchange.tag = tag;
+    request.exchange.request_str = line;
+    request.key = GetRequestKey(line);
+    char packet_buf[BSPacket::kMaxPacketLen];
+    memset(packet_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(packet_buf, line.c_str(), BSPacket::kMaxPacketLen-1);
+    switch (packet_type) { // same as SCBSMaster::Send()
+        case BSPacket::SRD: {
+            SRDPacket srd = SRDPacket(packet_buf);
+            request.is_multicast = srd.IsValid() && BSPacket::IsMulticast(srd.GetCells());
+            request.is_answered_by_cell = !request.is_multicast;
+            break;
+        }
+        case BSPacket::SWR: {
+            SWRPacket swr = SWRPacket(packet_buf);
+            request.is_multicast = swr.IsValid() && BSPacket::IsMulticast(swr.GetCells());
+            request.is_answered_by_cell = !request.is_multicast;
+            break;
+        }
+        case BSPacket::BRD:
+            request.is_answered_by_cell = true;
+            break;
+        default:
+            break;
+    }
+
+    bool is_retry = false;
+    if (tag != BSPacket::kNoTag) {
+        std::map<uint16_t, Request_t>::iterator it = tagged_.find(tag);
+        if (it != tagged_.end()) {
+            is_retry = it->second.key == request.key;
+            Complete(it->second, time_us, is_retry ? RETRIED : UNANSWERED, SCBSMaster::kErrCodeTimeout);
+            tagged_.erase(it);
+        }
+    } else {
+        for (std::deque<Request_t>::iterator it = untagged_.begin(); it != untagged_.end(); it++) {
+            if (it->key == request.key) {
+                is_retry = true;
+                Complete(*it, time_us, RETRIED, SCBSMaster::kErrCodeTimeout);
+                untagged_.erase(it);
+                break;
+            }
+        }
+    }
+    for (std::deque<std::pair<uint64_t, std::string>>::iterator it = unanswered_keys_.begin();
+        !is_retry && it != unanswered_keys_.end(); it++) {
+        if (it->second == request.key) {
+            is_retry = true;
+            unanswered_keys_.erase(it);
+            break;
+        }
+    }
+    if (is_retry) {
+        Flag(time_us, SCBSCapture::TO_CHAIN, RETRY, line);
+    }
+
+    if (tag != BSPacket::kNoTag) {
+        tagged_[tag] = request;
+    } else {
+        untagged_.push_back(request);
+    }
+}
+
+/**
+ * @brief Matches a packet coming back from the chain to its request, the same way as SCBSMaster::OnPacketReceived().
+ * Untagged packets go to the oldest untagged request they could be the response to.
+*/
+void SCBSAnalyzer::OnResponse(uint64_t time_us, const std::string & line, BSPacket::PacketType_t packet_type,
+    uint16_t tag) {
+    char packet_buf[BSPacket::kMaxPacketLen];
+    memset(packet_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(packet_buf, line.c_str(), BSPacket::kMaxPacketLen-1);
+    if (packet_type == BSPacket::DIS && summary_.num_cells == 0) {
+        DISPacket dis = DISPacket(packet_buf);
+        if (dis.IsValid()) {
+            summary_.num_cells = dis.last_cell_id;
+        }
+    }
+
+    Request_t * request = NULL;
+    std::map<uint16_t, Request_t>::iterator tagged_it = tagged_.find(tag);
+    std::deque<Request_t>::iterator untagged_it = untagged_.begin();
+    if (tag != BSPacket::kNoTag) {
+        if (tagged_it != tagged_.end()) {
+            request = &tagged_it->second;
+        }
+    } else {
+        for (; untagged_it != untagged_.end(); untagged_it++) {
+            if (IsResponseTo(packet_type, untagged_it->exchange.packet_type)) {
+                request = &*untagged_it;
+                break;
+            }
+        }
+    }
+    if (request == NULL) {
+        Flag(time_us, SCBSCapture::FROM_CHAIN, UNSOLICITED, line);
+        return;
+    }
+
+    Exchange_t & exchange = request->exchange;
+    uint16_t err_code = SCBSMaster::kErrCodeNone;
+    if (packet_type == BSPacket::SRS) {
+        SRSPacket srs = SRSPacket(packet_buf);
+        bool is_err;
+        err_code = SCBSMaster::ParseErrCode(srs, is_err);
+        if (err_code != SCBSMaster::kErrCodeNone && exchange.err_code == SCBSMaster::kErrCodeNone) {
+            exchange.err_cell_id = srs.cell_id;
+        }
+        if (request->is_multicast && exchange.packet_type == BSPacket::SRD) {
+            if (exchange.err_code == SCBSMaster::kErrCodeNone) {
+                exchange.err_code = err_code;
+            }
+            return; // every selected cell answers, wait for the SRD to come back
+        }
+    } else if (request->is_answered_by_cell && packet_type == exchange.packet_type) {
+        err_code = SCBSMaster::kErrCodeNotAnswered;
+    }
+    bool is_err = err_code != SCBSMaster::kErrCodeNone || exchange.err_code != SCBSMaster::kErrCodeNone;
+    Complete(*request, time_us, is_err ? ERROR : ANSWERED, err_code);
+    if (tag != BSPacket::kNoTag) {
+        tagged_.erase(tagged_it);
+    } else {
+        untagged_.erase(untagged_it);
+    }
+}
+
+/**
+ * @brief Reports an exchange and adds it to the totals. The caller stops tracking the request afterwards.
+ * @param[in] request Request that's done.
+ * @param[in] time_us When it was answered, or when it was found to be unanswered or retried.
+ * @param[in] outcome How it went.
+ * @param[in] err_code Error code for the exchange, if it doesn't already have one.
+*/
+void SCBSAnalyzer::Complete(Request_t & request, uint64_t time_us, Outcome_t outcome, uint16_t err_code) {
+    Exchange_t & exchange = request.exchange;
+    exchange.outcome = outcome;
+    if (exchange.err_code == SCBSMaster::kErrCodeNone) {
+        exchange.err_code = err_code;
+    }
+    summary_.num_outcomes[outcome]++;
+    interval_.num_completed++;
+    if (outcome == ANSWERED || outcome == ERROR) {
+        exchange.response_time_us = time_us;
+        exchange.latency_us = time_us - exchange.request_time_us;
+        summary_.latency_us.Record(exchange.latency_us);
+        summary_.latency_by_type_us[exchange.packet_type].Record(exchange.latency_us);
+        interval_.latency_us.Record(exchange.latency_us);
+        if (summary_.num_cells > 0) {
+            exchange.per_hop_us = exchange.latency_us / (summary_.num_cells + 1u);
+            summary_.per_hop_us.Record(exchange.per_hop_us);
+        }
+    }
+    if (outcome == ERROR) {
+        interval_.num_errors++;
+    } else if (outcome == UNANSWERED) {
+        interval_.num_unanswered++;
+    }
+    if (exchange_callback_) {
+        exchange_callback_(exchange);
+    }
+}
+
+/**
+ * @brief Reports requests that have waited longer than the timeout as unanswered, and forgets timed out requests that
+ * are too old to be retried.
+ * @param[in] time_us Current capture time.
+ * @param[in] expire_all True at the end of a capture, to report every outstanding request.
+*/
+void SCBSAnalyzer::ExpireOutstanding(uint64_t time_us, bool expire_all) {
+    uint16_t err_code = expire_all ? SCBSMaster::kErrCodeDisconnected : SCBSMaster::kErrCodeTimeout;
+    while (!unanswered_keys_.empty() && unanswered_keys_.front().first + config_.timeout_us < time_us) {
+        unanswered_keys_.pop_front();
+    }
+    for (std::map<uint16_t, Request_t>::iterator it = tagged_.begin(); it != tagged_.end();) {
+        if (expire_all || it->second.exchange.request_time_us + config_.timeout_us < time_us) {
+            Complete(it->second, time_us, UNANSWERED, err_code);
+            unanswered_keys_.push_back(std::make_pair(time_us, it->second.key));
+            it = tagged_.erase(it);
+        } else {
+            it++;
+        }
+    }
+    while (!untagged_.empty()
+        && (expire_all || untagged_.front().exchange.request_time_us + config_.timeout_us < time_us)) {
+        Complete(untagged_.front(), time_us, UNANSWERED, err_code);
+        unanswered_keys_.push_back(std::make_pair(time_us, untagged_.front().key));
+        untagged_.pop_front(); // oldest first, so the rest have more time left
+    }
+}
+
+/**
+ * @brief Counts and reports a flagged line.
+*/
+void SCBSAnalyzer::Flag(uint64_t time_us, SCBSCapture::Direction_t direction, FlagType_t flag_type,
+    const std::string & line) {
+    summary_.num_flags[direction][flag_type]++;
+    interval_.num_flags[flag_type]++;
+    if (flag_callback_) {
+        Flag_t flag;
+        flag.time_us = time_us;
+        flag.direction = direction;
+        flag.flag_type = flag_type;
+        flag.line = line;
+        flag_callback_(flag);
+    }
+}
+
+/**
+ * @brief Closes time series intervals up to the one that time_us falls in, reporting each one (empty or not).
+*/
+void SCBSAnalyzer::AdvanceTo(uint64_t time_us) {
+    if (config_.interval_us == 0) {
+        return;
+    }
+    if (!has_interval_) {
+        interval_.start_time_us = time_us - time_us % config_.interval_us;
+        has_interval_ = true;
+        return;
+    }
+    while (time_us >= interval_.start_time_us + config_.interval_us) {
+        if (interval_callback_) {
+            interval_callback_(interval_);
+        }
+        interval_.start_time_us += config_.interval_us;
+        interval_.num_requests = 0;
+        interval_.num_completed = 0;
+        interval_.num_errors = 0;
+        interval_.num_unanswered = 0;
+        memset(interval_.num_flags, 0, sizeof(interval_.num_flags));
+        memset(interval_.num_chars, 0, sizeof(interval_.num_chars));
+        interval_.latency_us.Reset(); // instead of a new Interval_t, which would allocate another histogram
+    }
+}
+
+/**
+ * @brief Checks a line's framing and checksum without printing anything, unlike BSPacket::FromString(), since a
+ * capture of a noisy link can have any number of bad lines.
+ * @param[in] line Line, without "\r\n".
+ * @param[out] packet_type Packet type from the header.
+ * @param[out] tag Tag from the header, or BSPacket::kNoTag.
+ * @param[out] is_checksum_ok Whether the checksum matched. Only set if the line is a packet.
+ * @retval True if the line is framed like a packet ("$", a known header, "*") whether or not the checksum matched.
+*/
+bool SCBSAnalyzer::ParseHeader(const std::string & line, BSPacket::PacketType_t & packet_type, uint16_t & tag,
+    bool & is_checksum_ok) {
+    size_t end_token = line.find('*');
+    if (line.empty() || line[0] != '$' || end_token == std::string::npos) {
+        return false;
+    }
+    size_t header_end = line.find_first_of(",*");
+    std::string header_str = line.substr(1, header_end - 1);
+    tag = BSPacket::kNoTag;
+    size_t tag_delim = header_str.find('#');
+    if (tag_delim != std::string::npos) {
+        tag = static_cast<uint16_t>(strtoul(header_str.c_str() + tag_delim + 1, NULL, 16));
+        header_str.resize(tag_delim);
+    }
+    packet_type = BSPacket::UNKNOWN;
+    for (uint16_t i = 0; i < BSPacket::kNumPacketTypes; i++) {
+        if (header_str == BSPacket::packet_header_strs[i]) {
+            packet_type = static_cast<BSPacket::PacketType_t>(i);
+            break;
+        }
+    }
+    if (packet_type == BSPacket::UNKNOWN) {
+        return false;
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < end_token; i++) {
+        checksum ^= line[i];
+    }
+    is_checksum_ok = end_token + 1 < line.size()
+        && static_cast<uint8_t>(strtoul(line.c_str() + end_token + 1, NULL, 16)) == checksum;
+    return true;
+}
+
+/**
+ * @brief Strips the tag and checksum from a request (e.g. "$BSSRD#1A,3,2000*36" becomes "$BSSRD,3,2000"), so that the
+ * same request sent with a different tag can be recognized.
+*/
+std::string SCBSAnalyzer::GetRequestKey(const std::string & line) {
+    std::string key = line.substr(0, line.find('*'));
+    size_t header_end = key.find(',');
+    size_t tag_delim = key.find('#');
+    if (tag_delim != std::string::npos && (header_end == std::string::npos || tag_delim < header_end)) {
+        key.erase(tag_delim, header_end == std::string::npos ? std::string::npos : header_end - tag_delim);
+    }
+    return key;
+}
+
+/**
+ * @brief Checks whether a packet from the chain could be the response to a request of a given type: a request always
+ * comes back as itself if no cell claims it, SRD and SWR are answered with SRS, and BRD with BRS.
+*/
+bool SCBSAnalyzer::IsResponseTo(BSPacket::PacketType_t packet_type, BSPacket::PacketType_t request_type) {
+    if (packet_type == request_type) {
+        return true;
+    }
+    switch (request_type) {
+        case BSPacket::SRD:
+        case BSPacket::SWR:
+            return packet_type == BSPacket::SRS;
+        case BSPacket::BRD:
+            return packet_type == BSPacket::BRS;
+        default:
+            return false;
+    }
+}
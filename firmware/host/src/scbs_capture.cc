@@ -0,0 +1,278 @@
+#include "scbs_capture.hh"
+#include "reactor.hh"
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Packs an integer into a buffer, least significant byte first.
+*/
+static void PutLittleEndian(uint8_t * buf, uint64_t value, uint16_t num_bytes) {
+    for (uint16_t i = 0; i < num_bytes; i++) {
+        buf[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t GetLittleEndian(const uint8_t * buf, uint16_t num_bytes) {
+    uint64_t value = 0;
+    for (uint16_t i = 0; i < num_bytes; i++) {
+        value |= static_cast<uint64_t>(buf[i]) << (8 * i);
+    }
+    return value;
+}
+
+SCBSCaptureWriter::SCBSCaptureWriter() {
+}
+
+SCBSCaptureWriter::~SCBSCaptureWriter() {
+    Close();
+}
+
+/**
+ * @brief Creates (or truncates) a capture file and writes its header. Record timestamps count from now.
+ * @param[in] path Path of the capture file.
+ * @param[in] baud Baud rate of the link being captured, kept in the header for replaying at the same speed.
+ * @retval True if successful.
+*/
+bool SCBSCaptureWriter::Open(const char * path, uint32_t baud) {
+    Close();
+    file_ = fopen(path, "wb");
+    if (file_ == NULL) {
+        printf("SCBSCaptureWriter::Open(): Unable to open %s.\r\n", path);
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint8_t header[SCBSCapture::kHeaderLen];
+    memset(header, 0, SCBSCapture::kHeaderLen);
+    memcpy(header, SCBSCapture::kMagic, SCBSCapture::kMagicLen);
+    header[SCBSCapture::kMagicLen] = SCBSCapture::kVersion;
+    PutLittleEndian(header + 8, static_cast<uint64_t>(now.tv_sec) * 1000000ull + now.tv_nsec / 1000ull, 8);
+    PutLittleEndian(header + 16, baud, 4);
+    if (fwrite(header, 1, SCBSCapture::kHeaderLen, file_) != SCBSCapture::kHeaderLen) {
+        Close();
+        return false;
+    }
+    open_time_us_ = Reactor::GetTimeUs();
+    last_time_us_ = 0;
+    stats_ = Stats_t();
+    return true;
+}
+
+void SCBSCaptureWriter::Close() {
+    if (file_ != NULL) {
+        fclose(file_);
+        file_ = NULL;
+    }
+}
+
+bool SCBSCaptureWriter::IsOpen() {
+    return file_ != NULL;
+}
+
+/**
+ * @brief Appends characters that went over the link. Writes are buffered, call Flush() to be sure they're on disk.
+ * @param[in] direction Which way the characters went.
+ * @param[in] time_us When they went, from Reactor::GetTimeUs(). Times before the previous record's are recorded as
+ * happening at the same time as it, so records always stay in order.
+ * @param[in] chars Characters, written exactly as they are.
+ * @param[in] num_chars Number of characters. Chunks longer than SCBSCapture::kMaxRecordLen are split, and empty ones
+ * aren't recorded at all.
+ * @retval False if the file isn't open or the write failed.
+*/
+bool SCBSCaptureWriter::Write(SCBSCapture::Direction_t direction, uint64_t time_us, const char * chars,
+    size_t num_chars) {
+    if (file_ == NULL) {
+        return false;
+    }
+    if (num_chars == 0) {
+        return true;
+    }
+    uint64_t capture_time_us = time_us > open_time_us_ ? time_us - open_time_us_ : 0;
+    if (capture_time_us < last_time_us_) {
+        capture_time_us = last_time_us_;
+    }
+    do {
+        size_t record_len = num_chars < SCBSCapture::kMaxRecordLen ? num_chars : SCBSCapture::kMaxRecordLen;
+        if (!WriteVarint((capture_time_us - last_time_us_) << 1 | direction) || !WriteVarint(record_len)
+            || fwrite(chars, 1, record_len, file_) != record_len) {
+            return false;
+        }
+        last_time_us_ = capture_time_us;
+        stats_.num_records++;
+        stats_.num_chars[direction] += record_len;
+        chars += record_len;
+        num_chars -= record_len;
+    } while (num_chars > 0);
+    return true;
+}
+
+void SCBSCaptureWriter::Flush() {
+    if (file_ != NULL) {
+        fflush(file_);
+    }
+}
+
+SCBSCaptureWriter::Stats_t SCBSCaptureWriter::GetStats() {
+    return stats_;
+}
+
+/**
+ * @brief Writes an unsigned LEB128 varint: 7 bits per byte, least significant first, high bit set on all but the last.
+*/
+bool SCBSCaptureWriter::WriteVarint(uint64_t value) {
+    uint8_t buf[10];
+    uint16_t len = 0;
+    do {
+        buf[len] = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            buf[len] |= 0x80;
+        }
+        len++;
+    } while (value != 0);
+    return fwrite(buf, 1, len, file_) == len;
+}
+
+SCBSCaptureReader::SCBSCaptureReader() {
+}
+
+SCBSCaptureReader::~SCBSCaptureReader() {
+    Close();
+}
+
+/**
+ * @brief Maps a capture file and checks its header.
+ * @param[in] path Path of the capture file.
+ * @retval False if the file can't be mapped or isn't a capture this version can read.
+*/
+bool SCBSCaptureReader::Open(const char * path) {
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        printf("SCBSCaptureReader::Open(): Unable to open %s.\r\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    size_ = static_cast<uint64_t>(file_stat.st_size);
+    if (size_ >= SCBSCapture::kHeaderLen) {
+        void * data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            data_ = static_cast<const uint8_t *>(data);
+            madvise(data, size_, MADV_SEQUENTIAL); // read ahead, and pages behind can go first
+        }
+    }
+    close(fd); // the mapping holds its own reference
+    if (data_ == NULL || memcmp(data_, SCBSCapture::kMagic, SCBSCapture::kMagicLen) != 0
+        || data_[SCBSCapture::kMagicLen] != SCBSCapture::kVersion) {
+        printf("SCBSCaptureReader::Open(): %s is not a version %d capture.\r\n", path, SCBSCapture::kVersion);
+        Close();
+        return false;
+    }
+    header_.start_time_us = GetLittleEndian(data_ + 8, 8);
+    header_.baud = static_cast<uint32_t>(GetLittleEndian(data_ + 16, 4));
+    offset_ = SCBSCapture::kHeaderLen;
+    time_us_ = 0;
+    return true;
+}
+
+void SCBSCaptureReader::Close() {
+    if (data_ != NULL) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+        data_ = NULL;
+    }
+    size_ = 0;
+    offset_ = 0;
+}
+
+SCBSCapture::Header_t SCBSCaptureReader::GetHeader() {
+    return header_;
+}
+
+/**
+ * @brief Size of the capture file in bytes.
+*/
+uint64_t SCBSCaptureReader::GetSize() {
+    return size_;
+}
+
+/**
+ * @brief How far into the file the next record starts, in bytes, e.g. for showing progress through a big capture.
+*/
+uint64_t SCBSCaptureReader::GetOffset() {
+    return offset_;
+}
+
+/**
+ * @brief Reads the next record, copying its characters.
+ * @param[out] record Record that was read.
+ * @retval False at the end of the capture, or if the rest of it is truncated or corrupt (e.g. the capture tool was
+ * killed mid-write). Everything before that point is still good.
+*/
+bool SCBSCaptureReader::Next(SCBSCapture::Record_t & record) {
+    RecordView_t view;
+    if (!NextView(view)) {
+        return false;
+    }
+    record.direction = view.direction;
+    record.time_us = view.time_us;
+    record.chars.assign(view.chars, view.num_chars);
+    return true;
+}
+
+/**
+ * @brief Reads the next record without copying it.
+ * @param[out] record Record that was read, pointing into the mapped file.
+ * @retval False at the end of the capture, or if the rest of it is truncated or corrupt.
+*/
+bool SCBSCaptureReader::NextView(RecordView_t & record) {
+    if (data_ == NULL) {
+        return false;
+    }
+    uint64_t record_offset = offset_;
+    uint64_t time_and_direction;
+    uint64_t num_chars;
+    if (!ReadVarint(time_and_direction) || !ReadVarint(num_chars) || num_chars > SCBSCapture::kMaxRecordLen
+        || num_chars > size_ - offset_) {
+        offset_ = record_offset;
+        return false;
+    }
+    record.chars = reinterpret_cast<const char *>(data_ + offset_);
+    record.num_chars = num_chars;
+    offset_ += num_chars;
+    time_us_ += time_and_direction >> 1;
+    record.time_us = time_us_;
+    record.direction = static_cast<SCBSCapture::Direction_t>(time_and_direction & 1);
+    return true;
+}
+
+/**
+ * @brief Goes back to the first record.
+*/
+bool SCBSCaptureReader::Rewind() {
+    if (data_ == NULL) {
+        return false;
+    }
+    offset_ = SCBSCapture::kHeaderLen;
+    time_us_ = 0;
+    return true;
+}
+
+bool SCBSCaptureReader::ReadVarint(uint64_t & value) {
+    value = 0;
+    for (uint16_t shift = 0; shift < 64 && offset_ < size_; shift += 7) {
+        uint8_t c = data_[offset_++];
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false; // ran off the end, or too long to be a varint we wrote
+}
@@ -0,0 +1,176 @@
+#include "scbs_capture_proxy.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/**
+ * @brief Constructor.
+ * @param[in] reactor Reactor to service the chain's port and the pty from.
+ * @param[in] writer Open capture file to record the traffic in. Must outlive this object.
+*/
+SCBSCaptureProxy::SCBSCaptureProxy(Reactor & reactor, SCBSCaptureWriter & writer)
+    : reactor_(reactor)
+    , writer_(writer)
+{
+}
+
+/**
+ * @brief Destructor. Must not be destroyed while the reactor is running on another thread.
+*/
+SCBSCaptureProxy::~SCBSCaptureProxy() {
+    Close();
+}
+
+/**
+ * @brief Opens the chain's serial port and creates the pty for the host tool. Call from the reactor thread, or before
+ * the reactor is running.
+ * @param[in] chain_port_path Serial port connected to the first cell in the chain, e.g. "/dev/ttyUSB0".
+ * @param[in] baud Baud rate of the chain.
+ * @retval True if successful, GetPortPath() then returns the path for the host tool to open.
+*/
+bool SCBSCaptureProxy::Open(const char * chain_port_path, uint32_t baud) {
+    if (!chain_port_.Open(chain_port_path, baud)) {
+        return false;
+    }
+    pty_master_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master_fd_ < 0 || grantpt(pty_master_fd_) < 0 || unlockpt(pty_master_fd_) < 0) {
+        printf("SCBSCaptureProxy::Open(): Unable to create pty: %s.\r\n", strerror(errno));
+        Close();
+        return false;
+    }
+    fcntl(pty_master_fd_, F_SETFL, fcntl(pty_master_fd_, F_GETFL) | O_NONBLOCK);
+    port_path_ = ptsname(pty_master_fd_);
+    pty_slave_fd_ = open(port_path_.c_str(), O_RDWR | O_NOCTTY);
+    if (pty_slave_fd_ < 0) {
+        printf("SCBSCaptureProxy::Open(): Unable to open %s: %s.\r\n", port_path_.c_str(), strerror(errno));
+        Close();
+        return false;
+    }
+    struct termios tty;
+    tcgetattr(pty_slave_fd_, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(pty_slave_fd_, TCSANOW, &tty);
+
+    reactor_.AddFD(chain_port_.GetFD(), EPOLLIN, [this](uint32_t events) { OnChainEvents(events); });
+    reactor_.AddFD(pty_master_fd_, EPOLLIN, [this](uint32_t events) { OnPtyEvents(events); });
+    return true;
+}
+
+/**
+ * @brief Closes the pty and the chain's port. Call from the reactor thread, or while the reactor isn't running.
+*/
+void SCBSCaptureProxy::Close() {
+    if (chain_port_.IsOpen()) {
+        reactor_.RemoveFD(chain_port_.GetFD());
+        chain_port_.Close();
+    }
+    if (pty_master_fd_ >= 0) {
+        reactor_.RemoveFD(pty_master_fd_);
+        close(pty_master_fd_);
+        pty_master_fd_ = -1;
+    }
+    if (pty_slave_fd_ >= 0) {
+        close(pty_slave_fd_);
+        pty_slave_fd_ = -1;
+    }
+    writer_.Flush();
+}
+
+/**
+ * @brief Sets a callback for when the chain's port hangs up. The proxy has closed everything by the time it's called.
+ * Call before the reactor is running.
+*/
+void SCBSCaptureProxy::SetHangUpCallback(HangUpCallback_t callback) {
+    hang_up_callback_ = callback;
+}
+
+/**
+ * @brief Returns the path of the pty for the host tool to open, e.g. "/dev/pts/3".
+*/
+const char * SCBSCaptureProxy::GetPortPath() {
+    return port_path_.c_str();
+}
+
+/**
+ * @brief Returns how many characters have gone each way. Call from the reactor thread.
+*/
+SCBSCaptureProxy::Stats_t SCBSCaptureProxy::GetStats() {
+    return stats_;
+}
+
+/**
+ * @brief Records what the chain sent and passes it on to the host tool, and finishes writing to the chain if the
+ * last write didn't all fit. Closes everything if the chain's port goes away (e.g. the adapter was unplugged).
+*/
+void SCBSCaptureProxy::OnChainEvents(uint32_t events) {
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        printf("SCBSCaptureProxy::OnChainEvents(): Chain port hung up, closing.\r\n");
+        Close();
+        if (hang_up_callback_) {
+            hang_up_callback_();
+        }
+        return;
+    }
+    if (events & EPOLLIN) {
+        char chars_buf[kChunkLen];
+        ssize_t num_read;
+        while ((num_read = chain_port_.Read(chars_buf, kChunkLen)) > 0) {
+            writer_.Write(SCBSCapture::FROM_CHAIN, Reactor::GetTimeUs(), chars_buf, num_read);
+            stats_.num_chars_from_chain += num_read;
+            from_chain_pending_.append(chars_buf, num_read);
+        }
+        FlushPending(pty_master_fd_, from_chain_pending_);
+    }
+    if (events & EPOLLOUT) {
+        FlushPending(chain_port_.GetFD(), to_chain_pending_);
+    }
+    UpdateEvents();
+}
+
+/**
+ * @brief Records what the host tool sent and passes it on to the chain, and finishes writing to the host tool if the
+ * last write didn't all fit. Stops reading once the chain's port backs up, leaving the rest in the pty so that the host
+ * tool's writes block instead of piling up here.
+*/
+void SCBSCaptureProxy::OnPtyEvents(uint32_t events) {
+    if (events & EPOLLIN) {
+        char chars_buf[kChunkLen];
+        ssize_t num_read;
+        while (to_chain_pending_.empty() && (num_read = read(pty_master_fd_, chars_buf, kChunkLen)) > 0) {
+            writer_.Write(SCBSCapture::TO_CHAIN, Reactor::GetTimeUs(), chars_buf, num_read);
+            stats_.num_chars_to_chain += num_read;
+            to_chain_pending_.append(chars_buf, num_read);
+            FlushPending(chain_port_.GetFD(), to_chain_pending_);
+        }
+    }
+    if (events & EPOLLOUT) {
+        FlushPending(pty_master_fd_, from_chain_pending_);
+    }
+    UpdateEvents();
+}
+
+void SCBSCaptureProxy::FlushPending(int fd, std::string & pending) {
+    if (pending.empty()) {
+        return;
+    }
+    ssize_t num_written = write(fd, pending.data(), pending.size());
+    if (num_written > 0) {
+        pending.erase(0, num_written);
+    }
+}
+
+/**
+ * @brief Only asks for EPOLLOUT on a side that has something waiting to be written to it, and only reads from the pty
+ * while nothing is waiting to go to the chain. Once the chain's port drains, the pty is read again.
+*/
+void SCBSCaptureProxy::UpdateEvents() {
+    reactor_.ModifyFD(chain_port_.GetFD(), EPOLLIN | (to_chain_pending_.empty() ? 0 : EPOLLOUT));
+    reactor_.ModifyFD(pty_master_fd_, (to_chain_pending_.empty() ? EPOLLIN : 0)
+        | (from_chain_pending_.empty() ? 0 : EPOLLOUT));
+}
@@ -0,0 +1,175 @@
+#include "scbs_coalescer.hh"
+
+#include <string.h>
+#include <algorithm>
+
+/**
+ * @brief Constructor.
+ * @param[in] reactor Reactor that the master runs on. Batches are kept and sent from the reactor thread.
+ * @param[in] master Master to send the MRD and SRD packets through.
+ * @param[in] hold_us How long the first read of a register waits for others to join it, in microseconds.
+ * @param[in] sweep_retry_us How long to go without sweeping after a sweep was too long for the chain, in microseconds.
+*/
+SCBSCoalescer::SCBSCoalescer(Reactor & reactor, SCBSMaster & master, uint32_t hold_us, uint32_t sweep_retry_us)
+    : reactor_(reactor)
+    , master_(master)
+    , hold_us_(hold_us)
+    , sweep_retry_us_(sweep_retry_us)
+{
+}
+
+/**
+ * @brief Destructor. Reads still being held fail with SCBSMaster::kErrCodeDisconnected. Must not be destroyed while
+ * the reactor is running on another thread.
+*/
+SCBSCoalescer::~SCBSCoalescer() {
+    for (std::map<uint32_t, Batch_t>::iterator it = batches_.begin(); it != batches_.end(); it++) {
+        reactor_.CancelTimer(it->second.timer_id);
+        for (size_t i = 0; i < it->second.reads.size(); i++) {
+            ReadResult_t result;
+            result.err_code = SCBSMaster::kErrCodeDisconnected;
+            it->second.reads[i].callback(result);
+        }
+    }
+}
+
+/**
+ * @brief Reads a register from one cell, sharing the trip down the chain with any other reads of the same register
+ * that show up within the hold window. Safe to call from any thread.
+ * @param[in] cell_id Cell to read from.
+ * @param[in] reg_addr Register to read.
+ * @param[in] callback Called on the reactor thread with the value or error.
+*/
+void SCBSCoalescer::Read(uint16_t cell_id, uint32_t reg_addr, ReadCallback_t callback) {
+    reactor_.Post([this, cell_id, reg_addr, callback]() { AddRead(cell_id, reg_addr, callback); });
+}
+
+/**
+ * @brief Reads a register from one cell, see the callback version. Don't wait on the future from the reactor thread.
+ * @param[in] cell_id Cell to read from.
+ * @param[in] reg_addr Register to read.
+ * @retval Future that is set with the value or error.
+*/
+std::future<SCBSCoalescer::ReadResult_t> SCBSCoalescer::Read(uint16_t cell_id, uint32_t reg_addr) {
+    std::shared_ptr<std::promise<ReadResult_t>> promise = std::make_shared<std::promise<ReadResult_t>>();
+    Read(cell_id, reg_addr, [promise](ReadResult_t & result) { promise->set_value(result); });
+    return promise->get_future();
+}
+
+SCBSCoalescer::Stats_t SCBSCoalescer::GetStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+/**
+ * @brief Adds a read to the batch for its register, opening the batch (and starting its hold window) if this is the
+ * first read of that register.
+ * @param[in] cell_id Cell to read from.
+ * @param[in] reg_addr Register to read.
+ * @param[in] callback Called with the value or error.
+*/
+void SCBSCoalescer::AddRead(uint16_t cell_id, uint32_t reg_addr, ReadCallback_t callback) {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.num_reads++;
+    }
+    Batch_t & batch = batches_[reg_addr];
+    PendingRead_t read = {cell_id, callback};
+    batch.reads.push_back(read);
+    if (batch.timer_id == Reactor::kNoTimer) {
+        batch.timer_id = reactor_.AddTimer(hold_us_, [this, reg_addr]() { SendBatch(reg_addr); });
+    }
+}
+
+/**
+ * @brief Closes the batch for a register and sends it, as one MRD if enough different cells want the register,
+ * otherwise (or while sweeps are too long for the chain) as SRDs.
+ * @param[in] reg_addr Register of the batch.
+*/
+void SCBSCoalescer::SendBatch(uint32_t reg_addr) {
+    std::vector<PendingRead_t> reads;
+    reads.swap(batches_[reg_addr].reads);
+    batches_.erase(reg_addr);
+
+    std::vector<uint16_t> cell_ids;
+    for (size_t i = 0; i < reads.size(); i++) {
+        if (std::find(cell_ids.begin(), cell_ids.end(), reads[i].cell_id) == cell_ids.end()) {
+            cell_ids.push_back(reads[i].cell_id);
+        }
+    }
+    bool sweep_too_long = sweep_too_long_ && Reactor::GetTimeUs() - sweep_too_long_time_us_ < sweep_retry_us_;
+    if (cell_ids.size() < kMinNumCellsForSweep || sweep_too_long) {
+        for (size_t i = 0; i < reads.size(); i++) {
+            SendSingleRead(reg_addr, reads[i]);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.num_sweeps++;
+    }
+    char no_values[1][BSPacket::kMaxPacketFieldLen];
+    MRDPacket mrd = MRDPacket(reg_addr, no_values, 0);
+    master_.Send(mrd, [this, reg_addr, reads](SCBSMaster::Response_t & response) mutable {
+        OnSweepResponse(reg_addr, reads, response);
+    });
+}
+
+/**
+ * @brief Hands each read in a batch its cell's value from an MRD response. Reads the MRD couldn't answer are retried
+ * as SRDs, so that a bad register or a long chain still gets a per-cell answer.
+ * @param[in] reg_addr Register that was swept.
+ * @param[in] reads Reads in the batch.
+ * @param[in] response Response to the MRD.
+*/
+void SCBSCoalescer::OnSweepResponse(uint32_t reg_addr, std::vector<PendingRead_t> & reads,
+    SCBSMaster::Response_t & response) {
+    uint16_t num_values = 0;
+    MRDPacket mrd = MRDPacket(response.packet_str);
+    if (response.err_code == SCBSMaster::kErrCodeNone && mrd.IsValid() && mrd.GetPacketType() == BSPacket::MRD) {
+        num_values = mrd.num_values;
+        sweep_too_long_ = false;
+    } else if (response.err_code == kErrCodePacketLengthExceeded) {
+        sweep_too_long_ = true;
+        sweep_too_long_time_us_ = Reactor::GetTimeUs();
+    }
+
+    for (size_t i = 0; i < reads.size(); i++) {
+        uint16_t cell_id = reads[i].cell_id;
+        if (cell_id == 0 || cell_id > num_values) {
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.num_fallbacks++;
+            }
+            SendSingleRead(reg_addr, reads[i]);
+            continue;
+        }
+        ReadResult_t result;
+        strncpy(result.value, mrd.values[cell_id-1], BSPacket::kMaxPacketFieldLen);
+        reads[i].callback(result);
+    }
+}
+
+/**
+ * @brief Reads a register from one cell with an SRD.
+ * @param[in] reg_addr Register to read.
+ * @param[in] read Read to answer.
+*/
+void SCBSCoalescer::SendSingleRead(uint32_t reg_addr, PendingRead_t & read) {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.num_single_reads++;
+    }
+    SRDPacket srd = SRDPacket(read.cell_id, reg_addr);
+    ReadCallback_t callback = read.callback;
+    master_.Send(srd, [callback](SCBSMaster::Response_t & response) {
+        ReadResult_t result;
+        result.err_code = response.err_code;
+        if (response.err_code == SCBSMaster::kErrCodeNone) {
+            SRSPacket srs = SRSPacket(response.packet_str);
+            strncpy(result.value, srs.values[0], BSPacket::kMaxPacketFieldLen);
+        }
+        callback(result);
+    });
+}
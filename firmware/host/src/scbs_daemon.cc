@@ -0,0 +1,365 @@
+#include "scbs_daemon.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SCBS_EOL "\r\n"
+#define SCBS_COMMAND_DELIM ","
+#define SCBS_COMMAND_PRIORITY "PRIORITY"
+#define SCBS_COMMAND_SUBSCRIBE "SUBSCRIBE"
+#define SCBS_COMMAND_OK "OK"
+#define SCBS_COMMAND_ERR "ERR"
+
+/**
+ * @brief Constructor. Takes over the master's unsolicited packet callback, so call before the reactor is running.
+ * @param[in] reactor Reactor that the master runs on. Client sockets are serviced from it too.
+ * @param[in] master Master for the chain being shared, already started.
+*/
+SCBSDaemon::SCBSDaemon(Reactor & reactor, SCBSMaster & master)
+    : reactor_(reactor)
+    , master_(master)
+{
+    master_.SetUnsolicitedPacketCallback([this](const char * packet_str) { OnUnsolicitedPacket(packet_str); });
+}
+
+/**
+ * @brief Destructor, drops every client and removes the socket.
+*/
+SCBSDaemon::~SCBSDaemon() {
+    Close();
+}
+
+/**
+ * @brief Starts listening for clients. Any stale socket file at the path is removed first.
+ * @param[in] socket_path Path for the Unix domain socket, e.g. "/tmp/scbsd.sock".
+ * @retval True if successful.
+*/
+bool SCBSDaemon::Listen(const char * socket_path) {
+    if (strlen(socket_path) > kMaxSocketPathLen) {
+        printf("SCBSDaemon::Listen(): Socket path %s is too long, max is %d characters.\r\n", socket_path, kMaxSocketPathLen);
+        return false;
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        printf("SCBSDaemon::Listen(): Unable to create socket: %s.\r\n", strerror(errno));
+        return false;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, kMaxSocketPathLen);
+    unlink(socket_path);
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0
+        || listen(listen_fd_, kListenBacklog) < 0) {
+        printf("SCBSDaemon::Listen(): Unable to listen on %s: %s.\r\n", socket_path, strerror(errno));
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    socket_path_ = socket_path;
+    return reactor_.AddFD(listen_fd_, EPOLLIN, [this](uint32_t events) { OnAccept(); });
+}
+
+/**
+ * @brief Stops listening, drops every client and removes the socket file. Call from the reactor thread, or while the
+ * reactor isn't running.
+*/
+void SCBSDaemon::Close() {
+    while (!clients_.empty()) {
+        DropClient(clients_.begin()->first);
+    }
+    if (listen_fd_ >= 0) {
+        reactor_.RemoveFD(listen_fd_);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(socket_path_.c_str());
+    }
+}
+
+uint16_t SCBSDaemon::GetNumClients() {
+    return clients_.size();
+}
+
+/**
+ * @brief Accepts every client that's waiting. Clients past kMaxNumClients are turned away.
+*/
+void SCBSDaemon::OnAccept() {
+    int fd;
+    while ((fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (clients_.size() >= kMaxNumClients) {
+            printf("SCBSDaemon::OnAccept(): Turning away client, already serving %d.\r\n", kMaxNumClients);
+            close(fd);
+            continue;
+        }
+        Client_t * client = new Client_t();
+        client->client_id = ++last_client_id_;
+        client->fd = fd;
+        uint32_t client_id = client->client_id;
+        if (!reactor_.AddFD(fd, EPOLLIN, [this, client_id](uint32_t events) { OnClientEvents(client_id, events); })) {
+            printf("SCBSDaemon::OnAccept(): Turning away client, unable to watch its socket.\r\n");
+            close(fd);
+            delete client;
+            continue;
+        }
+        clients_[client_id] = client;
+    }
+}
+
+/**
+ * @brief Reactor callback for a client socket. Reads and handles whole lines, and finishes writing anything that
+ * didn't fit in the socket last time.
+ * @param[in] client_id ID of the client.
+ * @param[in] events epoll events reported for the socket.
+*/
+void SCBSDaemon::OnClientEvents(uint32_t client_id, uint32_t events) {
+    std::map<uint32_t, Client_t *>::iterator it = clients_.find(client_id);
+    if (it == clients_.end()) {
+        return;
+    }
+    Client_t * client = it->second;
+    if (client->is_dropping) {
+        return;
+    }
+    if (events & EPOLLIN) {
+        char chunk[kChunkLen];
+        ssize_t num_read;
+        while ((num_read = read(client->fd, chunk, kChunkLen)) > 0) {
+            client->rx_buf.append(chunk, num_read);
+        }
+        if (num_read == 0 || (num_read < 0 && errno != EAGAIN && errno != EINTR)) {
+            DropClient(client_id); // hung up
+            return;
+        }
+        size_t line_start = 0; // lines are erased all at once after, a big read would be quadratic one by one
+        size_t eol;
+        while (!client->is_dropping && (eol = client->rx_buf.find('\n', line_start)) != std::string::npos) {
+            std::string line = client->rx_buf.substr(line_start, eol - line_start);
+            line_start = eol + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                OnClientLine(client, line);
+            }
+        }
+        client->rx_buf.erase(0, line_start);
+        if (client->is_dropping) {
+            return;
+        }
+        if (client->rx_buf.size() >= BSPacket::kMaxPacketLen) {
+            printf("SCBSDaemon::OnClientEvents(): Dropping %d characters without a line ending.\r\n", client->rx_buf.size());
+            client->rx_buf.clear();
+        }
+        SendRequests(client);
+    }
+    if (events & EPOLLOUT) {
+        FlushClient(client);
+    }
+}
+
+/**
+ * @brief Handles one line from a client: a packet to send to the chain, or a daemon command.
+ * @param[in] client Client that sent the line.
+ * @param[in] line Line without its line ending.
+*/
+void SCBSDaemon::OnClientLine(Client_t * client, std::string & line) {
+    if (line[0] != '$') {
+        OnCommand(client, line);
+        return;
+    }
+    if (client->backlog.size() >= kMaxClientBacklog) {
+        BSPacket * request = SCBSMaster::ParsePacket(line.c_str());
+        SendError(client, request ? request->GetTag() : BSPacket::kNoTag, SCBSMaster::kErrCodeQueueFull);
+        delete request;
+        return;
+    }
+    client->backlog.push_back(line);
+}
+
+/**
+ * @brief Handles a daemon command line.
+ * @param[in] client Client that sent the command.
+ * @param[in] line Command, e.g. "PRIORITY,0".
+*/
+void SCBSDaemon::OnCommand(Client_t * client, std::string & line) {
+    size_t delim = line.find(SCBS_COMMAND_DELIM);
+    std::string command = line.substr(0, delim);
+    long value = -1;
+    if (delim != std::string::npos) {
+        char * end_ptr;
+        value = strtol(line.c_str() + delim + 1, &end_ptr, 10);
+        if (*end_ptr != '\0') {
+            value = -1;
+        }
+    }
+    if (command == SCBS_COMMAND_PRIORITY && value >= 0 && value < SCBSMaster::kNumPriorities) {
+        client->priority = static_cast<uint8_t>(value);
+    } else if (command == SCBS_COMMAND_SUBSCRIBE && (value == 0 || value == 1)) {
+        client->is_subscribed = (value == 1);
+    } else {
+        printf("SCBSDaemon::OnCommand(): Unrecognized command %s.\r\n", line.c_str());
+        WriteLine(client, SCBS_COMMAND_ERR);
+        return;
+    }
+    WriteLine(client, SCBS_COMMAND_OK);
+}
+
+/**
+ * @brief Forwards a packet that isn't a response to anything (streamed telemetry, events) to subscribed clients.
+ * @param[in] packet_str Packet string, without "\r\n".
+*/
+void SCBSDaemon::OnUnsolicitedPacket(const char * packet_str) {
+    for (std::map<uint32_t, Client_t *>::iterator it = clients_.begin(); it != clients_.end(); it++) {
+        if (it->second->is_subscribed) {
+            WriteLine(it->second, packet_str);
+        }
+    }
+}
+
+/**
+ * @brief Hands requests from a client's backlog to the master until the client has kMaxClientInFlight outstanding.
+ * @param[in] client Client to send requests for.
+*/
+void SCBSDaemon::SendRequests(Client_t * client) {
+    while (!client->is_dropping && !client->backlog.empty() && client->num_in_flight < kMaxClientInFlight) {
+        std::string line = client->backlog.front();
+        client->backlog.pop_front();
+        BSPacket * request = SCBSMaster::ParsePacket(line.c_str());
+        if (request == NULL) {
+            SendError(client, BSPacket::kNoTag, SCBSMaster::kErrCodeInvalidRequest);
+            continue;
+        }
+        uint32_t client_id = client->client_id;
+        uint16_t client_tag = request->GetTag();
+        client->num_in_flight++;
+        master_.Send(*request, [this, client_id, client_tag](SCBSMaster::Response_t & response) {
+            OnResponse(client_id, client_tag, response);
+        }, client->priority);
+        delete request;
+    }
+}
+
+/**
+ * @brief Hands a response back to the client that sent the request, under the client's tag. SRS packets collected by
+ * a multicast request go first, in the order they came off the chain, then the packet that completed it.
+ * @param[in] client_id ID of the client, which may have disconnected since.
+ * @param[in] client_tag Tag the client put on the request.
+ * @param[in] response Response from the master.
+*/
+void SCBSDaemon::OnResponse(uint32_t client_id, uint16_t client_tag, SCBSMaster::Response_t & response) {
+    std::map<uint32_t, Client_t *>::iterator it = clients_.find(client_id);
+    if (it == clients_.end()) {
+        return; // client hung up while the request was on the chain
+    }
+    Client_t * client = it->second;
+    client->num_in_flight--;
+    char packet_str[BSPacket::kMaxPacketLen];
+    for (size_t i = 0; i < response.srs_strs.size(); i++) {
+        strncpy(packet_str, response.srs_strs[i].c_str(), BSPacket::kMaxPacketLen);
+        SCBSMaster::RetagPacketString(packet_str, client_tag);
+        WriteLine(client, packet_str);
+    }
+    if (response.packet_str[0] != '\0') {
+        strncpy(packet_str, response.packet_str, BSPacket::kMaxPacketLen);
+        SCBSMaster::RetagPacketString(packet_str, client_tag);
+        WriteLine(client, packet_str);
+    } else {
+        SendError(client, client_tag, response.err_code); // failed without anything coming back from the chain
+    }
+    SendRequests(client);
+}
+
+/**
+ * @brief Answers a client with an SRS from cell 0 carrying an error code, like a cell would.
+ * @param[in] client Client to answer.
+ * @param[in] client_tag Tag the client put on the request.
+ * @param[in] err_code Error code, printed in hex.
+*/
+void SCBSDaemon::SendError(Client_t * client, uint16_t client_tag, uint16_t err_code) {
+    char err_str[BSPacket::kMaxPacketFieldLen];
+    snprintf(err_str, BSPacket::kMaxPacketFieldLen-1, "ERR:%X", err_code);
+    SRSPacket srs = SRSPacket(0, err_str);
+    srs.SetTag(client_tag);
+    char packet_str[BSPacket::kMaxPacketLen];
+    srs.ToString(packet_str);
+    WriteLine(client, packet_str);
+}
+
+/**
+ * @brief Queues a line to be written to a client and tries to write it right away. A client with kMaxClientTxBufLen
+ * characters already waiting has stopped reading, and is dropped instead.
+ * @param[in] client Client to write to.
+ * @param[in] line Line to write, "\r\n" is added.
+*/
+void SCBSDaemon::WriteLine(Client_t * client, const char * line) {
+    if (client->is_dropping) {
+        return;
+    }
+    if (client->tx_buf.size() >= kMaxClientTxBufLen) {
+        printf("SCBSDaemon::WriteLine(): Dropping client %u, %u characters waiting for it to read.\r\n",
+            client->client_id, static_cast<uint32_t>(client->tx_buf.size()));
+        DropClientLater(client);
+        return;
+    }
+    client->tx_buf.append(line);
+    client->tx_buf.append(SCBS_EOL);
+    FlushClient(client);
+}
+
+/**
+ * @brief Writes as much of a client's tx_buf as the socket will take, and watches for EPOLLOUT if there's anything
+ * left over. A client whose socket fails (e.g. it hung up) is dropped.
+ * @param[in] client Client to write to.
+*/
+void SCBSDaemon::FlushClient(Client_t * client) {
+    if (client->is_dropping) {
+        return;
+    }
+    if (!client->tx_buf.empty()) {
+        ssize_t num_written = send(client->fd, client->tx_buf.data(), client->tx_buf.size(), MSG_NOSIGNAL);
+        if (num_written > 0) {
+            client->tx_buf.erase(0, num_written);
+        } else if (num_written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            printf("SCBSDaemon::FlushClient(): Dropping client %u: %s.\r\n", client->client_id, strerror(errno));
+            DropClientLater(client);
+            return;
+        }
+    }
+    reactor_.ModifyFD(client->fd, client->tx_buf.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT));
+}
+
+/**
+ * @brief Closes a client's connection. Its requests that are already on the chain finish there, and their responses
+ * are thrown away.
+ * @param[in] client_id ID of the client.
+*/
+void SCBSDaemon::DropClient(uint32_t client_id) {
+    std::map<uint32_t, Client_t *>::iterator it = clients_.find(client_id);
+    if (it == clients_.end()) {
+        return;
+    }
+    reactor_.RemoveFD(it->second->fd);
+    close(it->second->fd);
+    delete it->second;
+    clients_.erase(it);
+}
+
+/**
+ * @brief Drops a client from the reactor thread once the current callback is done, for places that still have the
+ * client (or an iterator over clients_) in hand. Until then, nothing more is read from or written to it.
+ * @param[in] client Client to drop.
+*/
+void SCBSDaemon::DropClientLater(Client_t * client) {
+    client->is_dropping = true;
+    client->backlog.clear();
+    client->tx_buf.clear();
+    uint32_t client_id = client->client_id;
+    reactor_.Post([this, client_id]() { DropClient(client_id); });
+}
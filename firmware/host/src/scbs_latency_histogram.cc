@@ -0,0 +1,147 @@
+#include "scbs_latency_histogram.hh"
+
+#include <math.h>
+
+SCBSLatencyHistogram::SCBSLatencyHistogram()
+    : counts_(kNumBuckets, 0)
+{
+}
+
+/**
+ * @brief Records a value.
+ * @param[in] value Value to record, e.g. a latency in microseconds.
+ * @param[in] count Number of times to record it.
+*/
+void SCBSLatencyHistogram::Record(uint64_t value, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    counts_[GetBucketIndex(value)] += count;
+    count_ += count;
+    sum_ += static_cast<double>(value) * count;
+    if (value < min_) {
+        min_ = value;
+    }
+    if (value > max_) {
+        max_ = value;
+    }
+}
+
+/**
+ * @brief Adds every value recorded in another histogram to this one, e.g. to combine per-chain runs.
+*/
+void SCBSLatencyHistogram::Merge(const SCBSLatencyHistogram & other) {
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.min_ < min_) {
+        min_ = other.min_;
+    }
+    if (other.max_ > max_) {
+        max_ = other.max_;
+    }
+}
+
+void SCBSLatencyHistogram::Reset() {
+    counts_.assign(kNumBuckets, 0);
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0.0;
+}
+
+uint64_t SCBSLatencyHistogram::GetCount() const {
+    return count_;
+}
+
+/**
+ * @brief Smallest value recorded, exactly. 0 if nothing has been recorded.
+*/
+uint64_t SCBSLatencyHistogram::GetMin() const {
+    return count_ > 0 ? min_ : 0;
+}
+
+/**
+ * @brief Largest value recorded, exactly. 0 if nothing has been recorded.
+*/
+uint64_t SCBSLatencyHistogram::GetMax() const {
+    return max_;
+}
+
+double SCBSLatencyHistogram::GetMean() const {
+    return count_ > 0 ? sum_ / count_ : 0.0;
+}
+
+/**
+ * @brief Finds the value that the given percentage of recorded values are at or below.
+ * @param[in] percentile Percentile between 0 and 100, e.g. 99.9.
+ * @retval Highest value in the bucket holding that sample, capped at the largest value recorded. 0 if nothing has been
+ * recorded.
+*/
+uint64_t SCBSLatencyHistogram::GetValueAtPercentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100.0 * count_));
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t num_seen = 0;
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+        num_seen += counts_[i];
+        if (num_seen >= rank) {
+            uint64_t value = GetBucketHighestValue(i);
+            return value < max_ ? value : max_;
+        }
+    }
+    return max_;
+}
+
+/**
+ * @brief Lists the buckets that have anything in them, lowest first, for dumping the whole distribution.
+*/
+std::vector<SCBSLatencyHistogram::Bucket_t> SCBSLatencyHistogram::GetBuckets() const {
+    std::vector<Bucket_t> buckets;
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+        if (counts_[i] > 0) {
+            buckets.push_back(Bucket_t(GetBucketHighestValue(i), counts_[i]));
+        }
+    }
+    return buckets;
+}
+
+/**
+ * @brief Maps a value to its bucket. Values below 2^kSubBucketBits map to themselves. Above that, a value with its
+ * highest set bit at position m is shifted right by s = m - kSubBucketBits + 1, which leaves it in the top half of the
+ * sub-bucket range, and each shift amount gets its own run of 2^(kSubBucketBits-1) buckets.
+*/
+uint32_t SCBSLatencyHistogram::GetBucketIndex(uint64_t value) {
+    const uint64_t num_sub_buckets = 1ull << kSubBucketBits;
+    const uint64_t half_num_sub_buckets = num_sub_buckets >> 1;
+    if (value < num_sub_buckets) {
+        return static_cast<uint32_t>(value);
+    }
+    uint16_t highest_bit = 63 - __builtin_clzll(value);
+    uint16_t shift = highest_bit - kSubBucketBits + 1;
+    return static_cast<uint32_t>(num_sub_buckets + (shift - 1) * half_num_sub_buckets
+        + ((value >> shift) - half_num_sub_buckets));
+}
+
+/**
+ * @brief Inverse of GetBucketIndex(): the highest value that maps to a bucket.
+*/
+uint64_t SCBSLatencyHistogram::GetBucketHighestValue(uint32_t index) {
+    const uint64_t num_sub_buckets = 1ull << kSubBucketBits;
+    const uint64_t half_num_sub_buckets = num_sub_buckets >> 1;
+    if (index < num_sub_buckets) {
+        return index;
+    }
+    uint64_t shift = (index - num_sub_buckets) / half_num_sub_buckets + 1;
+    uint64_t sub_bucket = (index - num_sub_buckets) % half_num_sub_buckets + half_num_sub_buckets;
+    return (sub_bucket << shift) + ((1ull << shift) - 1);
+}
@@ -0,0 +1,349 @@
+#include "scbs_load_generator.hh"
+
+#include <string.h>
+#include <strings.h> // for strncasecmp
+#include <stdlib.h>
+
+/**
+ * @brief Constructor.
+ * @param[in] reactor Reactor that the master runs on. Requests are issued and counted on the reactor thread.
+ * @param[in] master Master to send the load through.
+*/
+SCBSLoadGenerator::SCBSLoadGenerator(Reactor & reactor, SCBSMaster & master)
+    : reactor_(reactor)
+    , master_(master)
+{
+}
+
+/**
+ * @brief Destructor. Must not be destroyed while a run is in progress, since the master still holds callbacks for
+ * its outstanding requests.
+*/
+SCBSLoadGenerator::~SCBSLoadGenerator() {
+    reactor_.CancelTimer(rate_timer_id_);
+}
+
+/**
+ * @brief Starts a run. Safe to call from any thread.
+ * @param[in] config Mix, rate and limits for the run.
+ * @param[in] callback Called on the reactor thread with the report once the run has stopped sending and every request
+ * it sent has completed. Called straight away with an empty report if the config is unusable or a run is already in
+ * progress.
+*/
+void SCBSLoadGenerator::Run(Config_t config, DoneCallback_t callback) {
+    reactor_.Post([this, config, callback]() { Start(config, callback); });
+}
+
+/**
+ * @brief Starts a run, see the callback version. Don't wait on the future from the reactor thread.
+ * @param[in] config Mix, rate and limits for the run.
+ * @retval Future that is set with the report once the run is over.
+*/
+std::future<SCBSLoadGenerator::Report_t> SCBSLoadGenerator::Run(Config_t config) {
+    std::shared_ptr<std::promise<Report_t>> promise = std::make_shared<std::promise<Report_t>>();
+    Run(config, [promise](Report_t & report) { promise->set_value(report); });
+    return promise->get_future();
+}
+
+/**
+ * @brief Stops sending. The run finishes, and its callback is called, once everything already sent has completed.
+ * Safe to call from any thread, e.g. a signal handler's thread in a tool that runs without a limit.
+*/
+void SCBSLoadGenerator::Stop() {
+    reactor_.Post([this]() {
+        stop_requested_ = true;
+        FinishIfDone();
+    });
+}
+
+/**
+ * @brief Parses a request mix like "mrd=4,srd=4,swr=1". Types that aren't listed get a weight of 0.
+ * @param[in] mix_str Comma separated type=weight pairs. Type names are the packet headers without "BS", any case.
+ * @param[out] mix Weight for each RequestType_t.
+ * @retval False if a type isn't recognized, a pair is malformed, or every weight is 0.
+*/
+bool SCBSLoadGenerator::ParseMix(const char * mix_str, uint16_t mix[kNumRequestTypes]) {
+    uint16_t parsed_mix[kNumRequestTypes] = {0};
+    uint32_t total_weight = 0;
+    const char * pair_ptr = mix_str;
+    while (pair_ptr != NULL && *pair_ptr != '\0') {
+        const char * equals_ptr = strchr(pair_ptr, '=');
+        if (equals_ptr == NULL) {
+            return false;
+        }
+        int type_index = -1;
+        for (int i = 0; i < kNumRequestTypes; i++) {
+            if (static_cast<size_t>(equals_ptr - pair_ptr) == strlen(kRequestTypeNames[i])
+                && strncasecmp(pair_ptr, kRequestTypeNames[i], equals_ptr - pair_ptr) == 0) {
+                type_index = i;
+            }
+        }
+        char * end_ptr;
+        unsigned long weight = strtoul(equals_ptr + 1, &end_ptr, 10);
+        if (type_index < 0 || end_ptr == equals_ptr + 1 || (*end_ptr != ',' && *end_ptr != '\0') || weight > UINT16_MAX) {
+            return false;
+        }
+        parsed_mix[type_index] = static_cast<uint16_t>(weight);
+        total_weight += weight;
+        pair_ptr = *end_ptr == ',' ? end_ptr + 1 : end_ptr;
+    }
+    if (total_weight == 0) {
+        return false;
+    }
+    memcpy(mix, parsed_mix, sizeof(parsed_mix));
+    return true;
+}
+
+uint32_t SCBSLoadGenerator::GetNumSent(const Report_t & report) {
+    uint32_t num_sent = 0;
+    for (int i = 0; i < kNumRequestTypes; i++) {
+        num_sent += report.num_sent[i];
+    }
+    return num_sent;
+}
+
+/**
+ * @brief Requests completed without an error, per second of the run.
+*/
+double SCBSLoadGenerator::GetThroughput(const Report_t & report) {
+    if (report.elapsed_us == 0) {
+        return 0.0;
+    }
+    return (report.num_completed - report.num_errors) * 1e6 / report.elapsed_us;
+}
+
+/**
+ * @brief Fraction of completed requests that completed with an error, between 0 and 1.
+*/
+double SCBSLoadGenerator::GetErrorRate(const Report_t & report) {
+    return report.num_completed > 0 ? static_cast<double>(report.num_errors) / report.num_completed : 0.0;
+}
+
+void SCBSLoadGenerator::WriteCSVHeader(FILE * file) {
+    fprintf(file, "label,rate,num_sent,num_completed,num_errors,num_timeouts,elapsed_us,throughput,error_rate,"
+        "min_us,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+}
+
+/**
+ * @brief Writes a report as one CSV row, to go under WriteCSVHeader(). Appending a row per run to the same file keeps
+ * a history to spot regressions in.
+ * @param[in] file File to write to.
+ * @param[in] report Report from a run.
+ * @param[in] label Name for the run, e.g. a commit hash. Shouldn't contain commas.
+*/
+void SCBSLoadGenerator::WriteCSV(FILE * file, const Report_t & report, const char * label) {
+    const SCBSLatencyHistogram & latency_us = report.latency_us;
+    fprintf(file, "%s,%.1f,%u,%u,%u,%u,%lu,%.1f,%.6f,%lu,%.1f,%lu,%lu,%lu,%lu,%lu\n",
+        label, report.config.rate, GetNumSent(report), report.num_completed, report.num_errors, report.num_timeouts,
+        report.elapsed_us, GetThroughput(report), GetErrorRate(report),
+        latency_us.GetMin(), latency_us.GetMean(), latency_us.GetValueAtPercentile(50.0),
+        latency_us.GetValueAtPercentile(90.0), latency_us.GetValueAtPercentile(99.0),
+        latency_us.GetValueAtPercentile(99.9), latency_us.GetMax());
+}
+
+/**
+ * @brief Writes a report as a JSON object, including the config it was run with and every non-empty histogram bucket,
+ * so that the whole distribution can be plotted or compared later.
+ * @param[in] file File to write to.
+ * @param[in] report Report from a run.
+ * @param[in] label Name for the run, e.g. a commit hash. Written as is, so it shouldn't need escaping.
+*/
+void SCBSLoadGenerator::WriteJSON(FILE * file, const Report_t & report, const char * label) {
+    const SCBSLatencyHistogram & latency_us = report.latency_us;
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"config\": {\"rate\": %.1f, \"num_requests\": %u, \"duration_ms\": %u, "
+        "\"max_in_flight\": %u, \"num_cells\": %u, \"mix\": {", label, report.config.rate, report.config.num_requests,
+        report.config.duration_ms, report.config.max_in_flight, report.config.num_cells);
+    for (int i = 0; i < kNumRequestTypes; i++) {
+        fprintf(file, "%s\"%s\": %u", i > 0 ? ", " : "", kRequestTypeNames[i], report.config.mix[i]);
+    }
+    fprintf(file, "}},\n  \"num_sent\": {");
+    for (int i = 0; i < kNumRequestTypes; i++) {
+        fprintf(file, "%s\"%s\": %u", i > 0 ? ", " : "", kRequestTypeNames[i], report.num_sent[i]);
+    }
+    fprintf(file, "},\n  \"num_completed\": %u,\n  \"num_errors\": %u,\n  \"num_timeouts\": %u,\n  \"elapsed_us\": %lu,\n"
+        "  \"throughput\": %.1f,\n  \"error_rate\": %.6f,\n", report.num_completed, report.num_errors, report.num_timeouts,
+        report.elapsed_us, GetThroughput(report), GetErrorRate(report));
+    fprintf(file, "  \"latency_us\": {\"min\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, "
+        "\"p999\": %lu, \"max\": %lu,\n    \"buckets\": [", latency_us.GetMin(), latency_us.GetMean(),
+        latency_us.GetValueAtPercentile(50.0), latency_us.GetValueAtPercentile(90.0),
+        latency_us.GetValueAtPercentile(99.0), latency_us.GetValueAtPercentile(99.9), latency_us.GetMax());
+    std::vector<SCBSLatencyHistogram::Bucket_t> buckets = latency_us.GetBuckets();
+    for (size_t i = 0; i < buckets.size(); i++) {
+        fprintf(file, "%s[%lu, %lu]", i > 0 ? ", " : "", buckets[i].first, buckets[i].second);
+    }
+    fprintf(file, "]}\n}\n");
+}
+
+/**
+ * @brief Writes a report for people to read.
+*/
+void SCBSLoadGenerator::WriteSummary(FILE * file, const Report_t & report) {
+    const SCBSLatencyHistogram & latency_us = report.latency_us;
+    fprintf(file, "Sent %u requests (", GetNumSent(report));
+    for (int i = 0; i < kNumRequestTypes; i++) {
+        fprintf(file, "%s%s %u", i > 0 ? ", " : "", kRequestTypeNames[i], report.num_sent[i]);
+    }
+    fprintf(file, ") in %.3f s.\r\n", report.elapsed_us / 1e6);
+    fprintf(file, "Throughput: %.1f requests/s, %u errors (%.3f%%), %u timeouts.\r\n", GetThroughput(report),
+        report.num_errors, GetErrorRate(report) * 100.0, report.num_timeouts);
+    fprintf(file, "Latency (us): min %lu, mean %.1f, p50 %lu, p90 %lu, p99 %lu, p999 %lu, max %lu.\r\n",
+        latency_us.GetMin(), latency_us.GetMean(), latency_us.GetValueAtPercentile(50.0),
+        latency_us.GetValueAtPercentile(90.0), latency_us.GetValueAtPercentile(99.0),
+        latency_us.GetValueAtPercentile(99.9), latency_us.GetMax());
+}
+
+/**
+ * @brief Sets up a run and sends the first requests.
+*/
+void SCBSLoadGenerator::Start(Config_t config, DoneCallback_t callback) {
+    uint32_t total_weight = 0;
+    for (int i = 0; i < kNumRequestTypes; i++) {
+        total_weight += config.mix[i];
+    }
+    if (running_ || total_weight == 0 || config.num_cells == 0 || (config.rate <= 0.0 && config.max_in_flight == 0)) {
+        printf("SCBSLoadGenerator::Start(): %s.\r\n", running_ ? "Already running" : "Invalid config");
+        Report_t empty_report;
+        empty_report.config = config;
+        callback(empty_report);
+        return;
+    }
+    running_ = true;
+    stop_requested_ = false;
+    config_ = config;
+    callback_ = callback;
+    report_ = Report_t();
+    report_.config = config;
+    rng_.seed(config.seed);
+    type_dist_ = std::discrete_distribution<int>(config.mix, config.mix + kNumRequestTypes);
+    num_issued_ = 0;
+    num_outstanding_ = 0;
+    start_time_us_ = Reactor::GetTimeUs();
+    last_completed_time_us_ = start_time_us_;
+
+    if (config_.rate > 0.0) {
+        next_due_time_us_ = static_cast<double>(start_time_us_);
+        OnRateTimer();
+    } else {
+        FillWindow();
+        FinishIfDone();
+    }
+}
+
+/**
+ * @brief Sends every request that is due by now (more than one if the reactor was held up), then waits for the next.
+*/
+void SCBSLoadGenerator::OnRateTimer() {
+    rate_timer_id_ = Reactor::kNoTimer;
+    uint64_t time_us = Reactor::GetTimeUs();
+    while (!IsDoneSending() && next_due_time_us_ <= time_us) {
+        SendNext(static_cast<uint64_t>(next_due_time_us_));
+        next_due_time_us_ += 1e6 / config_.rate;
+    }
+    if (!IsDoneSending()) {
+        uint64_t delay_us = next_due_time_us_ > time_us ? static_cast<uint64_t>(next_due_time_us_) - time_us : 0;
+        rate_timer_id_ = reactor_.AddTimer(delay_us, [this]() { OnRateTimer(); });
+    }
+    FinishIfDone();
+}
+
+/**
+ * @brief Tops the number of requests outstanding back up to max_in_flight, when running without a target rate.
+*/
+void SCBSLoadGenerator::FillWindow() {
+    if (filling_window_) {
+        return;
+    }
+    filling_window_ = true;
+    while (num_outstanding_ < config_.max_in_flight && !IsDoneSending()) {
+        SendNext(Reactor::GetTimeUs());
+    }
+    filling_window_ = false;
+}
+
+/**
+ * @brief Picks a request type (and a cell, for SRD and SWR) and sends it.
+ * @param[in] due_time_us When the request was meant to go out, which its latency is measured from.
+*/
+void SCBSLoadGenerator::SendNext(uint64_t due_time_us) {
+    RequestType_t type = static_cast<RequestType_t>(type_dist_(rng_));
+    uint16_t cell_id = static_cast<uint16_t>(rng_() % config_.num_cells + 1);
+    char value[BSPacket::kMaxPacketFieldLen];
+    strncpy(value, config_.write_value, BSPacket::kMaxPacketFieldLen - 1);
+    value[BSPacket::kMaxPacketFieldLen - 1] = '\0';
+    char no_values[1][BSPacket::kMaxPacketFieldLen];
+
+    num_issued_++;
+    num_outstanding_++;
+    report_.num_sent[type]++;
+    SCBSMaster::ResponseCallback_t callback = [this, due_time_us](SCBSMaster::Response_t & response) {
+        OnResponse(due_time_us, response);
+    };
+    switch (type) {
+        case DIS: {
+            DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+            master_.Send(dis, callback, config_.priority);
+            break;
+        }
+        case MRD: {
+            MRDPacket mrd = MRDPacket(config_.read_reg_addr, no_values, 0);
+            master_.Send(mrd, callback, config_.priority);
+            break;
+        }
+        case MWR: {
+            MWRPacket mwr = MWRPacket(config_.write_reg_addr, value);
+            master_.Send(mwr, callback, config_.priority);
+            break;
+        }
+        case SRD: {
+            SRDPacket srd = SRDPacket(cell_id, config_.read_reg_addr);
+            master_.Send(srd, callback, config_.priority);
+            break;
+        }
+        case SWR: {
+            SWRPacket swr = SWRPacket(cell_id, config_.write_reg_addr, value);
+            master_.Send(swr, callback, config_.priority);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Records a completed request, sends another in its place when running without a target rate, and finishes
+ * the run if that was the last one.
+*/
+void SCBSLoadGenerator::OnResponse(uint64_t due_time_us, SCBSMaster::Response_t & response) {
+    uint64_t time_us = Reactor::GetTimeUs();
+    report_.latency_us.Record(time_us > due_time_us ? time_us - due_time_us : 0);
+    report_.num_completed++;
+    if (response.err_code != SCBSMaster::kErrCodeNone) {
+        report_.num_errors++;
+    }
+    if (response.err_code == SCBSMaster::kErrCodeTimeout) {
+        report_.num_timeouts++;
+    }
+    num_outstanding_--;
+    last_completed_time_us_ = time_us;
+    if (config_.rate <= 0.0) {
+        FillWindow();
+    }
+    FinishIfDone();
+}
+
+bool SCBSLoadGenerator::IsDoneSending() {
+    return stop_requested_
+        || (config_.num_requests > 0 && num_issued_ >= config_.num_requests)
+        || (config_.duration_ms > 0 && Reactor::GetTimeUs() - start_time_us_ >= config_.duration_ms * 1000ull);
+}
+
+void SCBSLoadGenerator::FinishIfDone() {
+    if (!running_ || filling_window_ || num_outstanding_ > 0 || !IsDoneSending()) {
+        return;
+    }
+    running_ = false;
+    reactor_.CancelTimer(rate_timer_id_);
+    rate_timer_id_ = Reactor::kNoTimer;
+    report_.elapsed_us = last_completed_time_us_ - start_time_us_;
+    callback_(report_);
+}
@@ -0,0 +1,574 @@
+#include "scbs_master.hh"
+#include "scbs_register_cache.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h> // for strtoul
+#include <sys/epoll.h>
+
+#define SCBS_ERR_PREFIX "ERR:"
+#define SCBS_ERR_BASE 16
+#define SCBS_EOL "\r\n"
+
+/**
+ * @brief Constructor with the default configuration.
+ * @param[in] reactor Reactor that the port is serviced from.
+ * @param[in] port Serial port connected to the first cell in the chain, already open.
+*/
+SCBSMaster::SCBSMaster(Reactor & reactor, SerialPort & port)
+    : SCBSMaster(reactor, port, SCBSMasterConfig_t())
+{
+}
+
+/**
+ * @brief Constructor.
+ * @param[in] reactor Reactor that the port is serviced from.
+ * @param[in] port Serial port connected to the first cell in the chain, already open.
+ * @param[in] config Pipeline window and timeout. A window of 0 is treated as 1.
+*/
+SCBSMaster::SCBSMaster(Reactor & reactor, SerialPort & port, SCBSMasterConfig_t config)
+    : reactor_(reactor)
+    , port_(port)
+    , config_(config)
+{
+    if (config_.window == 0) {
+        config_.window = 1;
+    }
+    memset(rx_buf_, '\0', kRxBufLen);
+}
+
+/**
+ * @brief Destructor. Anything still outstanding fails with kErrCodeDisconnected. Must not be destroyed while the
+ * reactor is running on another thread.
+*/
+SCBSMaster::~SCBSMaster() {
+    Stop();
+}
+
+/**
+ * @brief Registers the serial port with the reactor. Call from the reactor thread, or before the reactor is running.
+ * @retval True if successful.
+*/
+bool SCBSMaster::Start() {
+    if (is_started_) {
+        return true;
+    }
+    if (!port_.IsOpen()) {
+        printf("SCBSMaster::Start(): Serial port is not open.\r\n");
+        return false;
+    }
+    is_started_ = reactor_.AddFD(port_.GetFD(), EPOLLIN, [this](uint32_t events) { OnPortEvents(events); });
+    is_stopped_ = !is_started_;
+    if (is_started_) {
+        reactor_.Post([this]() { TransmitQueued(); }); // anything sent before Start() has been waiting
+    }
+    return is_started_;
+}
+
+/**
+ * @brief Unregisters the serial port and fails everything that's outstanding with kErrCodeDisconnected. Call from the
+ * reactor thread, or while the reactor isn't running.
+*/
+void SCBSMaster::Stop() {
+    if (is_started_) {
+        reactor_.RemoveFD(port_.GetFD());
+        is_started_ = false;
+    }
+    is_stopped_ = true;
+    FailAll(kErrCodeDisconnected);
+}
+
+/**
+ * @brief Queues a request to be tagged and sent. Safe to call from any thread. The request's tag is overwritten.
+ * @param[in] request Packet to send. Copied, so it can go out of scope as soon as this returns.
+ * @param[in] callback Called on the reactor thread when the response comes back or the request fails.
+ * @param[in] priority Queue to wait in while the window is full, 0 is the highest. Railed to kNumPriorities-1.
+*/
+void SCBSMaster::Send(BSPacket & request, ResponseCallback_t callback, uint8_t priority) {
+    Request_t * pending = new Request_t();
+    pending->packet_type = request.GetPacketType();
+    pending->callback = callback;
+    SRDPacket * srd = dynamic_cast<SRDPacket *>(&request);
+    SWRPacket * swr = dynamic_cast<SWRPacket *>(&request);
+    switch (pending->packet_type) {
+        case BSPacket::SRD:
+            pending->is_multicast = srd != NULL && BSPacket::IsMulticast(srd->GetCells());
+            pending->is_answered_by_cell = !pending->is_multicast;
+            break;
+        case BSPacket::SWR:
+            pending->is_multicast = swr != NULL && BSPacket::IsMulticast(swr->GetCells());
+            pending->is_answered_by_cell = !pending->is_multicast;
+            break;
+        case BSPacket::BRD:
+            pending->is_answered_by_cell = true;
+            break;
+        default:
+            break; // everything else is forwarded by every cell and comes back as the same packet type
+    }
+    if (cache_ != NULL && srd != NULL && pending->packet_type == BSPacket::SRD && !pending->is_multicast
+        && AnswerFromCache(*srd, pending)) {
+        return;
+    }
+
+    bool post_kick = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint16_t err_code = kErrCodeNone;
+        if (tags_in_use_.size() >= kMaxTag) {
+            err_code = kErrCodeQueueFull;
+        } else {
+            uint16_t tag = ClaimTag();
+            request.SetTag(tag);
+            request.ToString(pending->packet_str);
+            pending->response.tag = tag;
+            // Packets built from fields aren't marked valid, so check that what goes out on the wire parses.
+            char check_str[BSPacket::kMaxPacketLen];
+            strncpy(check_str, pending->packet_str, BSPacket::kMaxPacketLen);
+            if (pending->packet_type == BSPacket::UNKNOWN || !BSPacket(check_str).IsValid()) {
+                tags_in_use_.erase(tag);
+                err_code = kErrCodeInvalidRequest;
+            }
+        }
+        if (err_code != kErrCodeNone) {
+            pending->response.err_code = err_code;
+            stats_.num_completed++;
+            stats_.num_errors++;
+            reactor_.Post([pending]() {
+                pending->callback(pending->response);
+                delete pending;
+            });
+            return;
+        }
+        queued_[priority < kNumPriorities ? priority : kNumPriorities-1].push_back(pending);
+        post_kick = !kick_posted_;
+        kick_posted_ = true;
+    }
+    if (cache_ != NULL) {
+        cache_->OnRequest(pending->packet_str);
+    }
+    if (post_kick) {
+        reactor_.Post([this]() { TransmitQueued(); });
+    }
+}
+
+/**
+ * @brief Queues a request to be tagged and sent. Safe to call from any thread except the reactor thread, where waiting
+ * on the future would deadlock.
+ * @param[in] request Packet to send. Its tag is overwritten.
+ * @param[in] priority Queue to wait in while the window is full, 0 is the highest.
+ * @retval Future that is set when the response comes back or the request fails.
+*/
+std::future<SCBSMaster::Response_t> SCBSMaster::Send(BSPacket & request, uint8_t priority) {
+    std::shared_ptr<std::promise<Response_t>> promise = std::make_shared<std::promise<Response_t>>();
+    Send(request, [promise](Response_t & response) { promise->set_value(response); }, priority);
+    return promise->get_future();
+}
+
+/**
+ * @brief Sets the function called for packets that aren't a response to anything outstanding (streamed telemetry,
+ * events, late responses to requests that already timed out). Call before Start().
+ * @param[in] callback Called on the reactor thread with the packet string, without "\r\n".
+*/
+void SCBSMaster::SetUnsolicitedPacketCallback(PacketCallback_t callback) {
+    unsolicited_packet_callback_ = callback;
+}
+
+/**
+ * @brief Attaches a register cache. Single cell SRDs are answered from it when it has every register they ask for, and
+ * every completed request keeps it up to date. Call before Start().
+ * @param[in] cache Register cache, or NULL to stop using one. Must outlive the master.
+*/
+void SCBSMaster::SetRegisterCache(SCBSRegisterCache * cache) {
+    cache_ = cache;
+}
+
+/**
+ * @brief Returns the number of requests that have been sent or queued but haven't completed yet.
+*/
+uint32_t SCBSMaster::GetNumOutstanding() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tags_in_use_.size();
+}
+
+SCBSMaster::Stats_t SCBSMaster::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+/**
+ * @brief Checks whether an SRS packet carries an error code (e.g. "ERR:3") rather than register values. A successful
+ * SWR is answered with "OK", which isn't an error.
+ * @param[in] srs Parsed SRS packet.
+ * @param[out] is_err Set to true if the first value is an error code.
+ * @retval Error code, or kErrCodeNone if is_err is false.
+*/
+uint16_t SCBSMaster::ParseErrCode(SRSPacket & srs, bool & is_err) {
+    is_err = srs.num_values > 0 && strncmp(srs.values[0], SCBS_ERR_PREFIX, strlen(SCBS_ERR_PREFIX)) == 0;
+    if (!is_err) {
+        return kErrCodeNone;
+    }
+    return static_cast<uint16_t>(strtoul(srs.values[0] + strlen(SCBS_ERR_PREFIX), NULL, SCBS_ERR_BASE));
+}
+
+/**
+ * @brief Parses a packet string into the BSPacket subclass for its type, so that it can be passed to Send() (which
+ * needs the fields of SRD and SWR packets to tell whether they're multicast).
+ * @param[in] packet_str Packet string, without "\r\n".
+ * @retval Newly allocated packet that the caller must delete, or NULL if the string isn't a valid packet.
+*/
+BSPacket * SCBSMaster::ParsePacket(const char * packet_str) {
+    char packet_buf[BSPacket::kMaxPacketLen];
+    memset(packet_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(packet_buf, packet_str, BSPacket::kMaxPacketLen-1);
+    BSPacket * packet = NULL;
+    switch (BSPacket(packet_buf).GetPacketType()) {
+        case BSPacket::DIS: packet = new DISPacket(packet_buf); break;
+        case BSPacket::MRD: packet = new MRDPacket(packet_buf); break;
+        case BSPacket::MWR: packet = new MWRPacket(packet_buf); break;
+        case BSPacket::SRD: packet = new SRDPacket(packet_buf); break;
+        case BSPacket::SWR: packet = new SWRPacket(packet_buf); break;
+        case BSPacket::SRS: packet = new SRSPacket(packet_buf); break;
+        case BSPacket::VWR: packet = new VWRPacket(packet_buf); break;
+        case BSPacket::SYN: packet = new SYNPacket(packet_buf); break;
+        case BSPacket::PRF: packet = new PRFPacket(packet_buf); break;
+        case BSPacket::BRD: packet = new BRDPacket(packet_buf); break;
+        case BSPacket::BRS: packet = new BRSPacket(packet_buf); break;
+        case BSPacket::EVT: packet = new EVTPacket(packet_buf); break;
+        default: return NULL;
+    }
+    if (!packet->IsValid()) {
+        delete packet;
+        return NULL;
+    }
+    return packet;
+}
+
+/**
+ * @brief Swaps the tag on a packet string in place and fixes up the checksum, leaving everything else exactly as it
+ * was. Used to hand responses back to whoever sent the request under their own tag.
+ * @param[in,out] packet_str Packet string, without "\r\n".
+ * @param[in] tag New tag, or BSPacket::kNoTag to remove the tag.
+ * @retval Length of the new packet string, or 0 if it wasn't a packet string (left untouched).
+*/
+uint16_t SCBSMaster::RetagPacketString(char packet_str[BSPacket::kMaxPacketLen], uint16_t tag) {
+    char * start_token_ptr = strchr(packet_str, '$');
+    char * header_end_ptr = strpbrk(packet_str, ",*");
+    char * end_token_ptr = strchr(packet_str, '*');
+    if (!start_token_ptr || !header_end_ptr || !end_token_ptr || header_end_ptr < start_token_ptr) {
+        return 0;
+    }
+    char header_str[BSPacket::kPacketHeaderLen+1];
+    memset(header_str, '\0', BSPacket::kPacketHeaderLen+1);
+    strncpy(header_str, start_token_ptr, BSPacket::kPacketHeaderLen); // "$BSSRD", tag is dropped here
+    char body_str[BSPacket::kMaxPacketLen];
+    memset(body_str, '\0', BSPacket::kMaxPacketLen);
+    strncpy(body_str, header_end_ptr, end_token_ptr - header_end_ptr); // ",3,2000" up to but not including '*'
+
+    char retagged_str[BSPacket::kMaxPacketLen];
+    uint16_t len;
+    if (tag == BSPacket::kNoTag) {
+        len = snprintf(retagged_str, BSPacket::kMaxPacketLen, "%s%s*", header_str, body_str);
+    } else {
+        len = snprintf(retagged_str, BSPacket::kMaxPacketLen, "%s#%X%s*", header_str, tag, body_str);
+    }
+    if (len + BSPacket::kPacketTailLen > BSPacket::kMaxPacketLen) {
+        return 0; // new tag doesn't fit
+    }
+    uint8_t checksum = 0;
+    for (uint16_t i = 1; i + 1 < len; i++) { // between '$' and '*'
+        checksum ^= retagged_str[i];
+    }
+    // len was checked above, the precision just lets the compiler see that the checksum fits.
+    snprintf(packet_str, BSPacket::kMaxPacketLen, "%.*s%02X", BSPacket::kMaxPacketLen - BSPacket::kPacketTailLen,
+        retagged_str, checksum);
+    return strlen(packet_str);
+}
+
+/**
+ * @brief Reactor callback for the serial port. Splits what was received into lines and handles each one as a packet,
+ * and finishes writing anything that didn't fit in the port last time.
+ * @param[in] events epoll events reported for the port.
+*/
+void SCBSMaster::OnPortEvents(uint32_t events) {
+    if (events & EPOLLIN) {
+        while (true) {
+            ssize_t num_read = port_.Read(rx_buf_ + rx_buf_len_, kRxBufLen - rx_buf_len_ - 1);
+            if (num_read < 0) {
+                printf("SCBSMaster::OnPortEvents(): Serial port closed.\r\n");
+                Stop();
+                return;
+            }
+            if (num_read == 0) {
+                break;
+            }
+            rx_buf_len_ += num_read;
+            rx_buf_[rx_buf_len_] = '\0';
+
+            char * line_start = rx_buf_;
+            char * eol;
+            while ((eol = strchr(line_start, '\n')) != NULL) {
+                *eol = '\0';
+                char * line = line_start;
+                size_t line_len = eol - line;
+                line_start = eol + 1;
+                if (line_len >= BSPacket::kMaxPacketLen) {
+                    stats_.num_invalid_packets++; // too long to be a packet, rather than cut short into one
+                    continue;
+                }
+                char packet_str[BSPacket::kMaxPacketLen];
+                memset(packet_str, '\0', BSPacket::kMaxPacketLen);
+                memcpy(packet_str, line, line_len);
+                char * cr = strchr(packet_str, '\r');
+                if (cr) {
+                    *cr = '\0';
+                }
+                if (packet_str[0] != '\0') {
+                    OnPacketReceived(packet_str);
+                }
+            }
+            rx_buf_len_ -= (line_start - rx_buf_);
+            memmove(rx_buf_, line_start, rx_buf_len_ + 1); // keep partial line and EOS
+            if (rx_buf_len_ >= BSPacket::kMaxPacketLen) {
+                printf("SCBSMaster::OnPortEvents(): Dropping %d characters without a line ending.\r\n", rx_buf_len_);
+                rx_buf_len_ = 0;
+                rx_buf_[0] = '\0';
+            }
+        }
+    }
+    if (events & EPOLLOUT) {
+        FlushTx();
+    }
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        printf("SCBSMaster::OnPortEvents(): Serial port hung up.\r\n");
+        Stop();
+    }
+}
+
+/**
+ * @brief Matches a received packet to its request by tag. Requests normally complete on the first packet with their
+ * tag; multicast SRD and SWR requests collect SRS packets until the request itself makes it back around the chain.
+ * @param[in] packet_str Received packet string, without "\r\n".
+*/
+void SCBSMaster::OnPacketReceived(char packet_str[BSPacket::kMaxPacketLen]) {
+    BSPacket packet = BSPacket(packet_str);
+    if (!packet.IsValid()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.num_invalid_packets++;
+        return;
+    }
+    std::map<uint16_t, Request_t *>::iterator it = in_flight_.find(packet.GetTag());
+    if (packet.GetTag() == BSPacket::kNoTag || it == in_flight_.end()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.num_unsolicited_packets++;
+        }
+        if (unsolicited_packet_callback_) {
+            unsolicited_packet_callback_(packet_str);
+        }
+        return;
+    }
+
+    Request_t * request = it->second;
+    Response_t & response = request->response;
+    uint16_t err_code = kErrCodeNone;
+    if (packet.GetPacketType() == BSPacket::SRS) {
+        SRSPacket srs = SRSPacket(packet_str);
+        bool is_err;
+        err_code = ParseErrCode(srs, is_err);
+        if (err_code != kErrCodeNone && response.err_code == kErrCodeNone) {
+            response.err_cell_id = srs.cell_id;
+        }
+        if (request->is_multicast) {
+            response.srs_strs.push_back(packet_str);
+            if (request->packet_type == BSPacket::SRD) {
+                if (response.err_code == kErrCodeNone) {
+                    response.err_code = err_code;
+                }
+                return; // every selected cell answers, wait for the SRD to come back
+            }
+            // A multicast SWR only gets an SRS from a cell whose write failed, and that cell drops the request.
+        }
+    } else if (request->is_answered_by_cell && packet.GetPacketType() == request->packet_type) {
+        err_code = kErrCodeNotAnswered;
+    }
+    strncpy(response.packet_str, packet_str, BSPacket::kMaxPacketLen-1);
+    response.packet_str[BSPacket::kMaxPacketLen-1] = '\0';
+    Complete(packet.GetTag(), err_code);
+}
+
+/**
+ * @brief Moves queued requests onto the chain until the window is full.
+*/
+void SCBSMaster::TransmitQueued() {
+    if (is_stopped_) {
+        FailAll(kErrCodeDisconnected); // nothing sent after Stop() is ever going to be answered
+        return;
+    }
+    std::vector<Request_t *> to_send;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        kick_posted_ = false;
+        if (!is_started_) {
+            return; // sent once Start() is called
+        }
+        for (uint8_t priority = 0; priority < kNumPriorities; priority++) {
+            while (!queued_[priority].empty() && in_flight_.size() + to_send.size() < config_.window) {
+                to_send.push_back(queued_[priority].front());
+                queued_[priority].pop_front();
+            }
+        }
+        stats_.num_sent += to_send.size();
+    }
+    uint64_t now_us = Reactor::GetTimeUs();
+    for (size_t i = 0; i < to_send.size(); i++) {
+        Request_t * request = to_send[i];
+        uint16_t tag = request->response.tag;
+        in_flight_[tag] = request;
+        tx_buf_.append(request->packet_str);
+        tx_buf_.append(SCBS_EOL);
+        request->sent_time_us = now_us;
+        request->timer_id = reactor_.AddTimer(1000ull * config_.timeout_ms, [this, tag]() {
+            Complete(tag, kErrCodeTimeout);
+        });
+    }
+    FlushTx();
+}
+
+/**
+ * @brief Writes as much of tx_buf_ as the port will take, and watches for EPOLLOUT if there's anything left over.
+*/
+void SCBSMaster::FlushTx() {
+    if (!is_started_) {
+        return;
+    }
+    if (!tx_buf_.empty()) {
+        ssize_t num_written = port_.Write(tx_buf_.data(), tx_buf_.size());
+        if (num_written < 0) {
+            printf("SCBSMaster::FlushTx(): Unable to write to serial port.\r\n");
+            Stop();
+            return;
+        }
+        tx_buf_.erase(0, num_written);
+    }
+    reactor_.ModifyFD(port_.GetFD(), tx_buf_.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT));
+}
+
+/**
+ * @brief Finishes an in-flight request: runs its callback, frees its tag and makes room in the window for the next one.
+ * @param[in] tag Tag of the request.
+ * @param[in] err_code Error to complete the request with, if the response doesn't already carry one.
+*/
+void SCBSMaster::Complete(uint16_t tag, uint16_t err_code) {
+    std::map<uint16_t, Request_t *>::iterator it = in_flight_.find(tag);
+    if (it == in_flight_.end()) {
+        return;
+    }
+    Request_t * request = it->second;
+    in_flight_.erase(it);
+    reactor_.CancelTimer(request->timer_id);
+
+    Response_t & response = request->response;
+    if (response.err_code == kErrCodeNone) {
+        response.err_code = err_code;
+    }
+    response.latency_us = Reactor::GetTimeUs() - request->sent_time_us;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tags_in_use_.erase(tag);
+        stats_.num_completed++;
+        if (response.err_code != kErrCodeNone) {
+            stats_.num_errors++;
+        }
+        if (response.err_code == kErrCodeTimeout) {
+            stats_.num_timeouts++;
+        }
+    }
+    if (cache_ != NULL) {
+        cache_->OnResponse(request->packet_str, response);
+    }
+    request->callback(response);
+    delete request;
+    TransmitQueued();
+}
+
+/**
+ * @brief Fails every queued and in-flight request.
+ * @param[in] err_code Error code to fail them with.
+*/
+void SCBSMaster::FailAll(uint16_t err_code) {
+    std::vector<Request_t *> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint8_t priority = 0; priority < kNumPriorities; priority++) {
+            failed.insert(failed.end(), queued_[priority].begin(), queued_[priority].end());
+            queued_[priority].clear();
+        }
+        for (std::map<uint16_t, Request_t *>::iterator it = in_flight_.begin(); it != in_flight_.end(); it++) {
+            reactor_.CancelTimer(it->second->timer_id);
+            failed.push_back(it->second);
+        }
+        in_flight_.clear();
+        tags_in_use_.clear();
+        kick_posted_ = false;
+        stats_.num_completed += failed.size();
+        stats_.num_errors += failed.size();
+    }
+    tx_buf_.clear();
+    rx_buf_len_ = 0;
+    if (cache_ != NULL && !failed.empty()) {
+        cache_->Clear(); // writes that were on the chain may or may not have happened
+    }
+    for (size_t i = 0; i < failed.size(); i++) {
+        failed[i]->response.err_code = err_code;
+        failed[i]->callback(failed[i]->response);
+        delete failed[i];
+    }
+}
+
+/**
+ * @brief Completes a single cell SRD straight from the register cache, with an SRS made up the way the cell would have
+ * sent it. The request gets a tag like any other, which is free again as soon as it's handed out.
+ * @param[in] srd SRD being sent. Its tag is overwritten if it's answered.
+ * @param[in] pending Request for the SRD, queued to complete on the reactor thread if it's answered.
+ * @retval True if the cache had every register, false if the SRD has to go to the cell.
+*/
+bool SCBSMaster::AnswerFromCache(SRDPacket & srd, Request_t * pending) {
+    char values[SRSPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+    if (!cache_->Lookup(srd.cell_id, srd.reg_addrs, srd.num_reg_addrs, values)) {
+        return false;
+    }
+    uint16_t tag;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tags_in_use_.size() >= kMaxTag) {
+            return false; // fails with kErrCodeQueueFull the usual way
+        }
+        tag = ClaimTag();
+        tags_in_use_.erase(tag);
+        stats_.num_completed++;
+        stats_.num_cache_hits++;
+    }
+    srd.SetTag(tag);
+    SRSPacket srs = SRSPacket(srd.cell_id, values, srd.num_reg_addrs);
+    srs.SetTag(tag);
+    srs.ToString(pending->response.packet_str);
+    pending->response.tag = tag;
+    reactor_.Post([pending]() {
+        pending->callback(pending->response);
+        delete pending;
+    });
+    return true;
+}
+
+/**
+ * @brief Picks the next tag that isn't already outstanding, skipping kNoTag when wrapping around. Call with mutex_ held
+ * and at least one tag free.
+ * @retval Tag for a new request.
+*/
+uint16_t SCBSMaster::ClaimTag() {
+    do {
+        last_tag_ = (last_tag_ == kMaxTag) ? 1 : last_tag_ + 1;
+    } while (tags_in_use_.count(last_tag_) > 0);
+    tags_in_use_.insert(last_tag_);
+    return last_tag_;
+}
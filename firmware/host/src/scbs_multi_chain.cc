@@ -0,0 +1,111 @@
+#include "scbs_multi_chain.hh"
+
+/**
+ * @brief Constructor.
+ * @param[in] reactor Reactor that every chain's serial port is serviced from.
+*/
+SCBSMultiChain::SCBSMultiChain(Reactor & reactor)
+    : reactor_(reactor)
+{
+}
+
+/**
+ * @brief Destructor. Anything still outstanding on any chain fails with SCBSMaster::kErrCodeDisconnected. Must not be
+ * destroyed while the reactor is running on another thread.
+*/
+SCBSMultiChain::~SCBSMultiChain() {
+    Stop();
+}
+
+/**
+ * @brief Opens a chain's serial port and starts a master on it. Call from the reactor thread, or before the reactor is
+ * running.
+ * @param[in] port_path Serial port connected to the first cell in the chain, e.g. "/dev/ttyUSB1".
+ * @param[in] baud Baud rate.
+ * @param[in] config Pipeline window and timeout for this chain.
+ * @retval Index of the new chain, or -1 if the port couldn't be opened.
+*/
+int SCBSMultiChain::AddChain(const char * port_path, uint32_t baud, SCBSMaster::SCBSMasterConfig_t config) {
+    Chain_t chain;
+    chain.port.reset(new SerialPort());
+    if (!chain.port->Open(port_path, baud)) {
+        return -1;
+    }
+    chain.master.reset(new SCBSMaster(reactor_, *chain.port, config));
+    if (!chain.master->Start()) {
+        return -1;
+    }
+    chains_.push_back(std::move(chain));
+    return static_cast<int>(chains_.size() - 1);
+}
+
+/**
+ * @brief Stops every chain's master, failing anything outstanding. Call from the reactor thread, or while the reactor
+ * isn't running.
+*/
+void SCBSMultiChain::Stop() {
+    for (size_t i = 0; i < chains_.size(); i++) {
+        chains_[i].master->Stop();
+    }
+}
+
+uint16_t SCBSMultiChain::GetNumChains() {
+    return static_cast<uint16_t>(chains_.size());
+}
+
+/**
+ * @brief Returns the master for one chain, for requests that only go to that chain.
+ * @param[in] chain_index Index returned by AddChain().
+*/
+SCBSMaster & SCBSMultiChain::GetMaster(uint16_t chain_index) {
+    return *chains_[chain_index].master;
+}
+
+/**
+ * @brief Sends a request to every chain at once and gathers the responses. Safe to call from any thread once the chains
+ * have been added.
+ * @param[in] request Packet to send. Its tag is overwritten.
+ * @param[in] callback Called on the reactor thread once every chain has answered (or failed), with one response per
+ * chain in chain index order.
+ * @param[in] priority Queue to wait in on each chain, 0 is the highest.
+*/
+void SCBSMultiChain::Scatter(BSPacket & request, GatherCallback_t callback, uint8_t priority) {
+    if (chains_.empty()) {
+        std::vector<SCBSMaster::Response_t> no_responses;
+        reactor_.Post([callback, no_responses]() mutable { callback(no_responses); });
+        return;
+    }
+    // Callbacks all run on the reactor thread, so the gather needs no lock.
+    struct Gather_t {
+        std::vector<SCBSMaster::Response_t> responses;
+        size_t num_left;
+        GatherCallback_t callback;
+    };
+    std::shared_ptr<Gather_t> gather = std::make_shared<Gather_t>();
+    gather->responses.resize(chains_.size());
+    gather->num_left = chains_.size();
+    gather->callback = callback;
+    for (size_t i = 0; i < chains_.size(); i++) {
+        chains_[i].master->Send(request, [gather, i](SCBSMaster::Response_t & response) {
+            gather->responses[i] = response;
+            if (--gather->num_left == 0) {
+                gather->callback(gather->responses);
+            }
+        }, priority);
+    }
+}
+
+/**
+ * @brief Sends a request to every chain at once, see the callback version. Don't wait on the future from the reactor
+ * thread.
+ * @param[in] request Packet to send. Its tag is overwritten.
+ * @param[in] priority Queue to wait in on each chain, 0 is the highest.
+ * @retval Future that is set with one response per chain once every chain has answered or failed.
+*/
+std::future<std::vector<SCBSMaster::Response_t>> SCBSMultiChain::Scatter(BSPacket & request, uint8_t priority) {
+    std::shared_ptr<std::promise<std::vector<SCBSMaster::Response_t>>> promise =
+        std::make_shared<std::promise<std::vector<SCBSMaster::Response_t>>>();
+    Scatter(request, [promise](std::vector<SCBSMaster::Response_t> & responses) { promise->set_value(responses); },
+        priority);
+    return promise->get_future();
+}
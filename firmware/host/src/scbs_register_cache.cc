@@ -0,0 +1,248 @@
+#include "scbs_register_cache.hh"
+
+#include <string.h>
+#include <iterator>
+
+/**
+ * @brief Constructor. Starts out with TTLs for the registers that are safe to cache on a standard SCBS (same addresses
+ * as SCBS::kRegAddr*); everything else is read from the cell every time until SetTTL() says otherwise.
+*/
+SCBSRegisterCache::SCBSRegisterCache() {
+    // Fixed for the life of the board.
+    ttls_us_[0x3000] = kTTLForever; // kRegAddrReadFirmwareVersion
+    ttls_us_[0x3002] = kTTLForever; // kRegAddrUniqueID
+
+    // Settings that only change when they're written, or when the cell reboots and loads whatever it last saved (it
+    // keeps its cell ID through that, so no DIS follows to empty the cache).
+    ttls_us_[0x1002] = kDefaultSettingTTLUs; // kRegAddrRampRate
+    ttls_us_[0x3001] = kDefaultSettingTTLUs; // kRegAddrGroupID
+    for (uint32_t reg_addr = 0x3100; reg_addr <= 0x310A; reg_addr++) {
+        ttls_us_[reg_addr] = kDefaultSettingTTLUs; // kRegAddrVoltageCalTable
+    }
+    ttls_us_[0x3110] = kDefaultSettingTTLUs; // kRegAddrCurrentCalOffset
+    ttls_us_[0x3111] = kDefaultSettingTTLUs; // kRegAddrCurrentCalGain
+    ttls_us_[0x4000] = kDefaultSettingTTLUs; // kRegAddrStreamPeriodMs
+    ttls_us_[0x4001] = kDefaultSettingTTLUs; // kRegAddrStreamRegAddr
+
+    // Setpoints that the cell can also move on its own.
+    ttls_us_[0x1000] = kDefaultSetpointTTLUs; // kRegAddrSetOutputVoltage
+    ttls_us_[0x1001] = kDefaultSetpointTTLUs; // kRegAddrRampTargetVoltage
+}
+
+/**
+ * @brief Sets how long values read from a register stay fresh. Values already cached are judged by the new TTL.
+ * @param[in] reg_addr Register address.
+ * @param[in] ttl_us Time to live in microseconds, kTTLNone to stop caching the register, kTTLForever to keep it until
+ * it's written.
+*/
+void SCBSRegisterCache::SetTTL(uint32_t reg_addr, uint64_t ttl_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ttl_us == kTTLNone) {
+        ttls_us_.erase(reg_addr);
+        InvalidateRegisterLocked(reg_addr);
+    } else {
+        ttls_us_[reg_addr] = ttl_us;
+    }
+}
+
+uint64_t SCBSRegisterCache::GetTTL(uint32_t reg_addr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<uint32_t, uint64_t>::iterator it = ttls_us_.find(reg_addr);
+    return it == ttls_us_.end() ? kTTLNone : it->second;
+}
+
+/**
+ * @brief Looks up the values of one or more registers on a cell. All or nothing, so that a multi-register SRD is either
+ * answered entirely from the cache or sent to the cell.
+ * @param[in] cell_id Cell ID.
+ * @param[in] reg_addrs Register addresses.
+ * @param[in] num_reg_addrs Number of register addresses.
+ * @param[out] values Filled with the cached value of each register, in order. Only valid if true is returned.
+ * @retval True if every register had a fresh value.
+*/
+bool SCBSRegisterCache::Lookup(uint16_t cell_id, uint32_t reg_addrs[], uint16_t num_reg_addrs,
+    char values[][BSPacket::kMaxPacketFieldLen]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t now_us = Reactor::GetTimeUs();
+    for (uint16_t i = 0; i < num_reg_addrs; i++) {
+        std::map<uint32_t, uint64_t>::iterator ttl_it = ttls_us_.find(reg_addrs[i]);
+        std::map<uint64_t, Entry_t>::iterator entry_it = entries_.find(GetKey(cell_id, reg_addrs[i]));
+        if (ttl_it == ttls_us_.end() || entry_it == entries_.end()
+            || (ttl_it->second != kTTLForever && now_us - entry_it->second.stored_time_us >= ttl_it->second)) {
+            stats_.num_misses++;
+            return false;
+        }
+        strncpy(values[i], entry_it->second.value, BSPacket::kMaxPacketFieldLen);
+    }
+    stats_.num_hits++;
+    return num_reg_addrs > 0;
+}
+
+/**
+ * @brief Stores a register value read from a cell. Ignored if the register isn't cached.
+ * @param[in] cell_id Cell ID.
+ * @param[in] reg_addr Register address.
+ * @param[in] value Value as the cell sent it.
+*/
+void SCBSRegisterCache::Store(uint16_t cell_id, uint32_t reg_addr, const char * value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StoreLocked(cell_id, reg_addr, value, Reactor::GetTimeUs());
+}
+
+void SCBSRegisterCache::Invalidate(uint16_t cell_id, uint32_t reg_addr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    InvalidateLocked(cell_id, reg_addr);
+}
+
+/**
+ * @brief Drops a register's value on every cell.
+ * @param[in] reg_addr Register address.
+*/
+void SCBSRegisterCache::InvalidateRegister(uint32_t reg_addr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    InvalidateRegisterLocked(reg_addr);
+}
+
+void SCBSRegisterCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.num_invalidations += entries_.size();
+    entries_.clear();
+}
+
+/**
+ * @brief Called by the master as a request is queued. Drops whatever the request is about to write, so that reads
+ * sent after it aren't answered with the old value while it's still on its way.
+ * @param[in] request_str Request packet string.
+*/
+void SCBSRegisterCache::OnRequest(const char * request_str) {
+    BSPacket * request = SCBSMaster::ParsePacket(request_str);
+    if (request == NULL) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (request->GetPacketType()) {
+        case BSPacket::SWR: {
+            SWRPacket * swr = static_cast<SWRPacket *>(request);
+            if (BSPacket::IsMulticast(swr->GetCells())) {
+                InvalidateRegisterLocked(swr->reg_addr);
+            } else {
+                InvalidateLocked(swr->cell_id, swr->reg_addr);
+            }
+            break;
+        }
+        case BSPacket::MWR:
+            InvalidateRegisterLocked(static_cast<MWRPacket *>(request)->reg_addr);
+            break;
+        case BSPacket::VWR:
+            InvalidateRegisterLocked(static_cast<VWRPacket *>(request)->reg_addr);
+            break;
+        case BSPacket::DIS:
+        case BSPacket::SYN:
+            stats_.num_invalidations += entries_.size();
+            entries_.clear();
+            break;
+        default:
+            break;
+    }
+    delete request;
+}
+
+/**
+ * @brief Called by the master as a request completes. Refills the cache from the register values in the response,
+ * and drops what the request wrote again, in case a read that was already on the chain refilled it with the old value.
+ * @param[in] request_str Request packet string.
+ * @param[in] response Response to the request, successful or not.
+*/
+void SCBSRegisterCache::OnResponse(const char * request_str, SCBSMaster::Response_t & response) {
+    OnRequest(request_str);
+    if (response.err_code != SCBSMaster::kErrCodeNone && response.srs_strs.empty()) {
+        return;
+    }
+    BSPacket * request = SCBSMaster::ParsePacket(request_str);
+    if (request == NULL) {
+        return;
+    }
+    if (request->GetPacketType() == BSPacket::SRD) {
+        SRDPacket * srd = static_cast<SRDPacket *>(request);
+        if (response.err_code == SCBSMaster::kErrCodeNone) {
+            StoreSRS(response.packet_str, srd->reg_addrs, srd->num_reg_addrs);
+        }
+        for (size_t i = 0; i < response.srs_strs.size(); i++) {
+            StoreSRS(response.srs_strs[i].c_str(), srd->reg_addrs, srd->num_reg_addrs); // multicast, one per cell
+        }
+    } else if (request->GetPacketType() == BSPacket::MRD && response.err_code == SCBSMaster::kErrCodeNone) {
+        StoreMRD(response.packet_str);
+    }
+    delete request;
+}
+
+SCBSRegisterCache::Stats_t SCBSRegisterCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+/**
+ * @brief Stores the values from an SRS packet answering an SRD, skipping SRS packets that carry an error.
+ * @param[in] srs_str SRS packet string.
+ * @param[in] reg_addrs Registers the SRD asked for, in the order their values come back.
+ * @param[in] num_reg_addrs Number of registers the SRD asked for.
+*/
+void SCBSRegisterCache::StoreSRS(const char * srs_str, uint32_t reg_addrs[], uint16_t num_reg_addrs) {
+    char srs_buf[BSPacket::kMaxPacketLen];
+    memset(srs_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(srs_buf, srs_str, BSPacket::kMaxPacketLen-1);
+    SRSPacket srs = SRSPacket(srs_buf);
+    bool is_err;
+    SCBSMaster::ParseErrCode(srs, is_err);
+    if (!srs.IsValid() || srs.GetPacketType() != BSPacket::SRS || is_err || srs.num_values != num_reg_addrs) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t now_us = Reactor::GetTimeUs();
+    for (uint16_t i = 0; i < num_reg_addrs; i++) {
+        StoreLocked(srs.cell_id, reg_addrs[i], srs.values[i], now_us);
+    }
+}
+
+/**
+ * @brief Stores the values from an MRD that made it back around the chain. Cell N's values are the Nth group of
+ * num_reg_addrs values, which holds as long as the cell IDs were handed out by a DIS in chain order.
+ * @param[in] mrd_str MRD packet string.
+*/
+void SCBSRegisterCache::StoreMRD(const char * mrd_str) {
+    char mrd_buf[BSPacket::kMaxPacketLen];
+    memset(mrd_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(mrd_buf, mrd_str, BSPacket::kMaxPacketLen-1);
+    MRDPacket mrd = MRDPacket(mrd_buf);
+    if (!mrd.IsValid() || mrd.GetPacketType() != BSPacket::MRD || mrd.num_reg_addrs == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t now_us = Reactor::GetTimeUs();
+    for (uint16_t i = 0; i < mrd.num_values; i++) {
+        uint16_t cell_id = i / mrd.num_reg_addrs + 1;
+        StoreLocked(cell_id, mrd.reg_addrs[i % mrd.num_reg_addrs], mrd.values[i], now_us);
+    }
+}
+
+void SCBSRegisterCache::StoreLocked(uint16_t cell_id, uint32_t reg_addr, const char * value, uint64_t now_us) {
+    if (ttls_us_.count(reg_addr) == 0) {
+        return;
+    }
+    Entry_t & entry = entries_[GetKey(cell_id, reg_addr)];
+    strncpy(entry.value, value, BSPacket::kMaxPacketFieldLen-1);
+    entry.value[BSPacket::kMaxPacketFieldLen-1] = '\0';
+    entry.stored_time_us = now_us;
+    stats_.num_stores++;
+}
+
+void SCBSRegisterCache::InvalidateLocked(uint16_t cell_id, uint32_t reg_addr) {
+    stats_.num_invalidations += entries_.erase(GetKey(cell_id, reg_addr));
+}
+
+void SCBSRegisterCache::InvalidateRegisterLocked(uint32_t reg_addr) {
+    std::map<uint64_t, Entry_t>::iterator first = entries_.lower_bound(GetKey(0, reg_addr));
+    std::map<uint64_t, Entry_t>::iterator last = entries_.upper_bound(GetKey(0xFFFF, reg_addr));
+    stats_.num_invalidations += std::distance(first, last);
+    entries_.erase(first, last);
+}
@@ -0,0 +1,759 @@
+#include "scbs_telemetry_store.hh"
+#include "reactor.hh"
+#include "scbs_comms.hh"
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+/**
+ * @brief Packs an integer into a buffer, least significant byte first.
+*/
+static void PutLittleEndian(uint8_t * buf, uint64_t value, uint16_t num_bytes) {
+    for (uint16_t i = 0; i < num_bytes; i++) {
+        buf[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t GetLittleEndian(const uint8_t * buf, uint16_t num_bytes) {
+    uint64_t value = 0;
+    for (uint16_t i = 0; i < num_bytes; i++) {
+        value |= static_cast<uint64_t>(buf[i]) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Appends an unsigned LEB128 varint: 7 bits per byte, least significant first, high bit set on all but the last.
+*/
+static void PutVarint(std::string & buf, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        buf += static_cast<char>(byte);
+    } while (value != 0);
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint.
+ * @param[in] buf Buffer to read from.
+ * @param[in] len Length of the buffer.
+ * @param[in,out] pos Where the varint starts, moved past it.
+ * @param[out] value Value that was read.
+ * @retval False if the buffer ends first or the varint is too long.
+*/
+static bool GetVarint(const uint8_t * buf, uint32_t len, uint32_t & pos, uint64_t & value) {
+    value = 0;
+    for (uint16_t shift = 0; shift < 64 && pos < len; shift += 7) {
+        uint8_t byte = buf[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Reads bits, most significant first.
+ * @param[in] buf Buffer to read from.
+ * @param[in] len Length of the buffer in bytes.
+ * @param[in,out] bit_pos Index of the first bit to read, moved past the bits that were read.
+ * @param[in] num_bits Number of bits to read, up to 64.
+ * @param[out] bits Bits that were read, in the low num_bits bits.
+ * @retval False if the buffer ends first.
+*/
+static bool GetBits(const uint8_t * buf, uint32_t len, uint64_t & bit_pos, uint16_t num_bits, uint64_t & bits) {
+    if (bit_pos + num_bits > 8ull * len) {
+        return false;
+    }
+    bits = 0;
+    for (uint16_t i = 0; i < num_bits; i++, bit_pos++) {
+        bits = (bits << 1) | ((buf[bit_pos / 8] >> (7 - bit_pos % 8)) & 1);
+    }
+    return true;
+}
+
+/**
+ * @brief Packs a cell ID and register address into one key, for maps of series.
+*/
+uint64_t SCBSTelemetryStore::GetSeriesKey(uint16_t cell_id, uint32_t reg_addr) {
+    return static_cast<uint64_t>(cell_id) << 32 | reg_addr;
+}
+
+/**
+ * @brief Constructor.
+ * @param[in] cell_id Cell the series is from.
+ * @param[in] reg_addr Register the series is of.
+*/
+SCBSTelemetryChunk::SCBSTelemetryChunk(uint16_t cell_id, uint32_t reg_addr) {
+    info_.cell_id = cell_id;
+    info_.reg_addr = reg_addr;
+}
+
+/**
+ * @brief Adds a sample to the end of the chunk.
+ * @param[in] time_us Time of the sample. Must not be before the last sample's.
+ * @param[in] value Value of the sample.
+*/
+void SCBSTelemetryChunk::Append(uint64_t time_us, double value) {
+    uint64_t value_bits;
+    memcpy(&value_bits, &value, sizeof(value_bits));
+    if (info_.num_samples == 0) {
+        info_.first_time_us = time_us;
+        WriteBits(value_bits, 64);
+    } else {
+        int64_t delta_us = static_cast<int64_t>(time_us - info_.last_time_us);
+        if (info_.num_samples == 1) {
+            PutVarint(times_, delta_us);
+        } else {
+            int64_t delta_of_delta_us = delta_us - last_delta_us_;
+            // Zigzagged so that small changes either way stay small.
+            PutVarint(times_,
+                static_cast<uint64_t>(delta_of_delta_us) << 1 ^ static_cast<uint64_t>(delta_of_delta_us >> 63));
+        }
+        last_delta_us_ = delta_us;
+
+        uint64_t xor_bits = value_bits ^ last_value_bits_;
+        if (xor_bits == 0) {
+            WriteBits(0, 1); // same value as last time
+        } else {
+            uint16_t leading_zeros = std::min(__builtin_clzll(xor_bits), 31); // stored in 5 bits
+            uint16_t trailing_zeros = __builtin_ctzll(xor_bits);
+            if (has_window_ && leading_zeros >= last_leading_zeros_ && trailing_zeros >= last_trailing_zeros_) {
+                // Changed bits fit in the last window, so only they are stored.
+                WriteBits(0b10, 2);
+                WriteBits(xor_bits >> last_trailing_zeros_, 64 - last_leading_zeros_ - last_trailing_zeros_);
+            } else {
+                uint16_t num_meaningful_bits = 64 - leading_zeros - trailing_zeros;
+                WriteBits(0b11, 2);
+                WriteBits(leading_zeros, 5);
+                WriteBits(num_meaningful_bits - 1, 6);
+                WriteBits(xor_bits >> trailing_zeros, num_meaningful_bits);
+                last_leading_zeros_ = leading_zeros;
+                last_trailing_zeros_ = trailing_zeros;
+                has_window_ = true;
+            }
+        }
+    }
+    last_value_bits_ = value_bits;
+    info_.last_time_us = time_us;
+    info_.num_samples++;
+}
+
+/**
+ * @brief Empties the chunk, so that it can be filled again for the same series.
+*/
+void SCBSTelemetryChunk::Clear() {
+    SCBSTelemetryStore::ChunkInfo_t info;
+    info.cell_id = info_.cell_id;
+    info.reg_addr = info_.reg_addr;
+    info_ = info;
+    times_.clear();
+    values_.clear();
+    num_free_bits_ = 0;
+    last_delta_us_ = 0;
+    last_value_bits_ = 0;
+    has_window_ = false;
+}
+
+SCBSTelemetryStore::ChunkInfo_t SCBSTelemetryChunk::GetInfo() {
+    info_.times_len = times_.size();
+    info_.values_len = values_.size();
+    return info_;
+}
+
+const std::string & SCBSTelemetryChunk::GetTimes() {
+    return times_;
+}
+
+const std::string & SCBSTelemetryChunk::GetValues() {
+    return values_;
+}
+
+/**
+ * @brief Decodes a chunk's columns.
+ * @param[in] info Chunk header.
+ * @param[in] times Timestamp column, info.times_len bytes.
+ * @param[in] values Value column, info.values_len bytes.
+ * @param[in] callback Called with each sample in order. Returns false to stop early.
+ * @retval False if the columns are corrupt. Samples before the corruption have already been handed to the callback.
+*/
+bool SCBSTelemetryChunk::Decode(const SCBSTelemetryStore::ChunkInfo_t & info, const uint8_t * times,
+    const uint8_t * values, std::function<bool(const SCBSTelemetryStore::Sample_t & sample)> callback) {
+    uint32_t times_pos = 0;
+    uint64_t values_bit_pos = 0;
+    int64_t delta_us = 0;
+    uint64_t value_bits = 0;
+    uint16_t leading_zeros = 0;
+    uint16_t trailing_zeros = 0;
+    SCBSTelemetryStore::Sample_t sample;
+    sample.time_us = info.first_time_us;
+    for (uint32_t i = 0; i < info.num_samples; i++) {
+        uint64_t bits;
+        if (i == 0) {
+            if (!GetBits(values, info.values_len, values_bit_pos, 64, value_bits)) {
+                return false;
+            }
+        } else {
+            uint64_t encoded_delta;
+            if (!GetVarint(times, info.times_len, times_pos, encoded_delta)) {
+                return false;
+            }
+            if (i == 1) {
+                delta_us = static_cast<int64_t>(encoded_delta);
+            } else {
+                delta_us += static_cast<int64_t>(encoded_delta >> 1) ^ -static_cast<int64_t>(encoded_delta & 1);
+            }
+            sample.time_us += delta_us;
+
+            if (!GetBits(values, info.values_len, values_bit_pos, 1, bits)) {
+                return false;
+            }
+            if (bits == 1) {
+                uint64_t control;
+                if (!GetBits(values, info.values_len, values_bit_pos, 1, control)) {
+                    return false;
+                }
+                if (control == 1) {
+                    uint64_t num_meaningful_bits;
+                    if (!GetBits(values, info.values_len, values_bit_pos, 5, bits)
+                        || !GetBits(values, info.values_len, values_bit_pos, 6, num_meaningful_bits)) {
+                        return false;
+                    }
+                    leading_zeros = bits;
+                    num_meaningful_bits++;
+                    if (leading_zeros + num_meaningful_bits > 64) {
+                        return false;
+                    }
+                    trailing_zeros = 64 - leading_zeros - num_meaningful_bits;
+                }
+                if (!GetBits(values, info.values_len, values_bit_pos, 64 - leading_zeros - trailing_zeros, bits)) {
+                    return false;
+                }
+                value_bits ^= bits << trailing_zeros;
+            }
+        }
+        memcpy(&sample.value, &value_bits, sizeof(sample.value));
+        if (!callback(sample)) {
+            return true;
+        }
+    }
+    return sample.time_us == info.last_time_us;
+}
+
+/**
+ * @brief Appends bits to the value column, most significant first.
+*/
+void SCBSTelemetryChunk::WriteBits(uint64_t bits, uint16_t num_bits) {
+    for (int16_t i = num_bits - 1; i >= 0; i--) {
+        if (num_free_bits_ == 0) {
+            values_ += '\0';
+            num_free_bits_ = 8;
+        }
+        num_free_bits_--;
+        if ((bits >> i) & 1) {
+            values_.back() |= static_cast<char>(1 << num_free_bits_);
+        }
+    }
+}
+
+SCBSTelemetryWriter::SCBSTelemetryWriter() {
+}
+
+SCBSTelemetryWriter::~SCBSTelemetryWriter() {
+    Close();
+}
+
+/**
+ * @brief Creates (or truncates) a telemetry file and writes its header. Sample timestamps count from now.
+ * @param[in] path Path of the telemetry file.
+ * @param[in] chunk_len Samples per chunk. Bigger chunks compress a little better, smaller ones make short queries read
+ * less and lose less in a crash. A chunk_len of 0 is treated as 1.
+ * @retval True if successful.
+*/
+bool SCBSTelemetryWriter::Open(const char * path, uint32_t chunk_len) {
+    Close();
+    file_ = fopen(path, "wb");
+    if (file_ == NULL) {
+        printf("SCBSTelemetryWriter::Open(): Unable to open %s.\r\n", path);
+        return false;
+    }
+    chunk_len_ = chunk_len > 0 ? chunk_len : 1;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint8_t header[SCBSTelemetryStore::kHeaderLen];
+    memset(header, 0, SCBSTelemetryStore::kHeaderLen);
+    memcpy(header, SCBSTelemetryStore::kMagic, SCBSTelemetryStore::kMagicLen);
+    header[SCBSTelemetryStore::kMagicLen] = SCBSTelemetryStore::kVersion;
+    PutLittleEndian(header + 8, static_cast<uint64_t>(now.tv_sec) * 1000000ull + now.tv_nsec / 1000ull, 8);
+    PutLittleEndian(header + 16, chunk_len_, 4);
+    if (fwrite(header, 1, SCBSTelemetryStore::kHeaderLen, file_) != SCBSTelemetryStore::kHeaderLen) {
+        fclose(file_);
+        file_ = NULL;
+        return false;
+    }
+    open_time_us_ = Reactor::GetTimeUs();
+    stats_ = Stats_t();
+    stats_.num_bytes = SCBSTelemetryStore::kHeaderLen;
+    tail_offset_ = SCBSTelemetryStore::kHeaderLen;
+    return true;
+}
+
+/**
+ * @brief Finishes every partly filled chunk, writes the index, and closes the file.
+*/
+void SCBSTelemetryWriter::Close() {
+    if (file_ == NULL) {
+        return;
+    }
+    for (std::map<uint64_t, SCBSTelemetryChunk>::iterator it = chunks_.begin(); it != chunks_.end(); it++) {
+        WriteChunk(it->second);
+    }
+    uint64_t index_offset = stats_.num_bytes;
+    fseek(file_, index_offset, SEEK_SET);
+    for (size_t i = 0; i < chunk_offsets_.size(); i++) {
+        uint8_t offset_buf[8];
+        PutLittleEndian(offset_buf, chunk_offsets_[i], 8);
+        fwrite(offset_buf, 1, 8, file_);
+    }
+    uint8_t trailer[SCBSTelemetryStore::kTrailerLen];
+    PutLittleEndian(trailer, index_offset, 8);
+    PutLittleEndian(trailer + 8, chunk_offsets_.size(), 8);
+    memcpy(trailer + 16, SCBSTelemetryStore::kIndexMagic, SCBSTelemetryStore::kIndexMagicLen);
+    fwrite(trailer, 1, SCBSTelemetryStore::kTrailerLen, file_);
+    // Cut off anything left of a flushed tail that was longer than what replaced it, which only happens if a write
+    // failed.
+    if (fflush(file_) != 0 || ftruncate(fileno(file_), ftell(file_)) != 0) {
+        printf("SCBSTelemetryWriter::Close(): Unable to finish the file.\r\n");
+    }
+    fclose(file_);
+    file_ = NULL;
+    chunks_.clear();
+    last_times_us_.clear();
+    chunk_offsets_.clear();
+}
+
+bool SCBSTelemetryWriter::IsOpen() {
+    return file_ != NULL;
+}
+
+/**
+ * @brief Adds a sample to a series, writing out the series' chunk if that fills it.
+ * @param[in] cell_id Cell the sample is from.
+ * @param[in] reg_addr Register the sample is of.
+ * @param[in] time_us When the sample was taken, from Reactor::GetTimeUs(). Times before the series' last sample are
+ * recorded as happening at the same time as it, so series always stay in order.
+ * @param[in] value Value of the sample.
+ * @retval False if the file isn't open or a chunk couldn't be written.
+*/
+bool SCBSTelemetryWriter::Append(uint16_t cell_id, uint32_t reg_addr, uint64_t time_us, double value) {
+    if (file_ == NULL) {
+        return false;
+    }
+    uint64_t key = SCBSTelemetryStore::GetSeriesKey(cell_id, reg_addr);
+    uint64_t store_time_us = time_us > open_time_us_ ? time_us - open_time_us_ : 0;
+    uint64_t & last_time_us = last_times_us_[key];
+    if (store_time_us < last_time_us) {
+        store_time_us = last_time_us;
+    }
+    last_time_us = store_time_us;
+
+    std::map<uint64_t, SCBSTelemetryChunk>::iterator it = chunks_.find(key);
+    if (it == chunks_.end()) {
+        it = chunks_.emplace(key, SCBSTelemetryChunk(cell_id, reg_addr)).first;
+    }
+    it->second.Append(store_time_us, value);
+    stats_.num_samples++;
+    if (it->second.GetInfo().num_samples >= chunk_len_) {
+        // The finished chunk goes where the flushed tail started, so the rest of the tail is written again after it.
+        bool has_tail = stats_.num_bytes > tail_offset_;
+        return WriteChunk(it->second) && (!has_tail || WriteTail());
+    }
+    return true;
+}
+
+/**
+ * @brief Adds a sample for every value in an MRD that made it back around the chain. Cell N's values are the Nth group
+ * of num_reg_addrs values, which holds as long as the cell IDs were handed out by a DIS in chain order.
+ * @param[in] time_us When the sweep was taken, from Reactor::GetTimeUs(). Using the time the MRD was sent on a fixed
+ * period, rather than when it came back, keeps the timestamps regular and so almost free to store.
+ * @param[in] mrd_str MRD packet string.
+ * @retval Number of samples added. Values that aren't numbers are skipped.
+*/
+uint16_t SCBSTelemetryWriter::AppendMRD(uint64_t time_us, const char * mrd_str) {
+    char mrd_buf[BSPacket::kMaxPacketLen];
+    memset(mrd_buf, '\0', BSPacket::kMaxPacketLen);
+    strncpy(mrd_buf, mrd_str, BSPacket::kMaxPacketLen-1);
+    MRDPacket mrd = MRDPacket(mrd_buf);
+    if (!mrd.IsValid() || mrd.GetPacketType() != BSPacket::MRD || mrd.num_reg_addrs == 0) {
+        return 0;
+    }
+    uint16_t num_appended = 0;
+    for (uint16_t i = 0; i < mrd.num_values; i++) {
+        char * value_end;
+        double value = strtod(mrd.values[i], &value_end);
+        if (value_end == mrd.values[i] || *value_end != '\0') {
+            stats_.num_skipped++;
+            continue;
+        }
+        uint16_t cell_id = i / mrd.num_reg_addrs + 1;
+        if (Append(cell_id, mrd.reg_addrs[i % mrd.num_reg_addrs], time_us, value)) {
+            num_appended++;
+        }
+    }
+    return num_appended;
+}
+
+/**
+ * @brief Writes out every partly filled chunk and flushes the file, so that everything appended so far survives a
+ * crash. The chunks keep filling afterwards, so flushing often costs the rewrites but doesn't make the file any bigger.
+ * @retval False if the file isn't open or a write failed.
+*/
+bool SCBSTelemetryWriter::Flush() {
+    if (file_ == NULL) {
+        return false;
+    }
+    return WriteTail();
+}
+
+SCBSTelemetryWriter::Stats_t SCBSTelemetryWriter::GetStats() {
+    return stats_;
+}
+
+/**
+ * @brief Writes a chunk's header and columns at the current position in the file.
+ * @param[in] chunk Chunk to write.
+ * @param[out] chunk_len Number of bytes written, 0 for an empty chunk.
+ * @retval False if the write failed.
+*/
+bool SCBSTelemetryWriter::PutChunk(SCBSTelemetryChunk & chunk, uint64_t & chunk_len) {
+    SCBSTelemetryStore::ChunkInfo_t info = chunk.GetInfo();
+    chunk_len = 0;
+    if (info.num_samples == 0) {
+        return true;
+    }
+    uint8_t header[SCBSTelemetryStore::kChunkHeaderLen];
+    memset(header, 0, SCBSTelemetryStore::kChunkHeaderLen);
+    PutLittleEndian(header, SCBSTelemetryStore::kChunkMagic, 4);
+    PutLittleEndian(header + 4, info.cell_id, 2);
+    PutLittleEndian(header + 8, info.reg_addr, 4);
+    PutLittleEndian(header + 12, info.num_samples, 4);
+    PutLittleEndian(header + 16, info.first_time_us, 8);
+    PutLittleEndian(header + 24, info.last_time_us, 8);
+    PutLittleEndian(header + 32, info.times_len, 4);
+    PutLittleEndian(header + 36, info.values_len, 4);
+    if (fwrite(header, 1, SCBSTelemetryStore::kChunkHeaderLen, file_) != sizeof(header)
+        || fwrite(chunk.GetTimes().data(), 1, info.times_len, file_) != info.times_len
+        || fwrite(chunk.GetValues().data(), 1, info.values_len, file_) != info.values_len) {
+        return false;
+    }
+    chunk_len = SCBSTelemetryStore::kChunkHeaderLen + info.times_len + info.values_len;
+    return true;
+}
+
+/**
+ * @brief Writes a chunk after the finished ones, over the flushed tail if there is one, and empties it. That leaves the
+ * tail out of date, so callers that keep writing put it back with WriteTail().
+*/
+bool SCBSTelemetryWriter::WriteChunk(SCBSTelemetryChunk & chunk) {
+    if (chunk.GetInfo().num_samples == 0) {
+        return true;
+    }
+    if (stats_.num_bytes != tail_offset_ && fseek(file_, tail_offset_, SEEK_SET) != 0) {
+        return false;
+    }
+    uint64_t chunk_len;
+    bool is_written = PutChunk(chunk, chunk_len);
+    chunk.Clear();
+    stats_.num_bytes = tail_offset_;
+    if (!is_written) {
+        return false;
+    }
+    chunk_offsets_.push_back(tail_offset_);
+    stats_.num_chunks++;
+    tail_offset_ += chunk_len;
+    stats_.num_bytes = tail_offset_;
+    return true;
+}
+
+/**
+ * @brief Writes every partly filled chunk after the finished ones, over what the last flush left there, flushes the
+ * file, and cuts it off after them. A reader walking the chunks after a crash sees them as ordinary chunks.
+ * @retval False if a write failed.
+*/
+bool SCBSTelemetryWriter::WriteTail() {
+    if (fseek(file_, tail_offset_, SEEK_SET) != 0) {
+        return false;
+    }
+    bool is_ok = true;
+    uint64_t tail_len = 0;
+    for (std::map<uint64_t, SCBSTelemetryChunk>::iterator it = chunks_.begin(); it != chunks_.end(); it++) {
+        uint64_t chunk_len;
+        is_ok = PutChunk(it->second, chunk_len) && is_ok;
+        tail_len += chunk_len;
+    }
+    stats_.num_bytes = tail_offset_ + tail_len;
+    return fflush(file_) == 0 && ftruncate(fileno(file_), stats_.num_bytes) == 0 && is_ok;
+}
+
+SCBSTelemetryReader::SCBSTelemetryReader() {
+}
+
+SCBSTelemetryReader::~SCBSTelemetryReader() {
+    Close();
+}
+
+/**
+ * @brief Maps a telemetry file, checks its header, and loads the chunk headers from the index (or by walking the chunks
+ * if the file wasn't closed cleanly).
+ * @param[in] path Path of the telemetry file.
+ * @retval False if the file can't be mapped or isn't a telemetry file this version can read.
+*/
+bool SCBSTelemetryReader::Open(const char * path) {
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        printf("SCBSTelemetryReader::Open(): Unable to open %s.\r\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    size_ = static_cast<uint64_t>(file_stat.st_size);
+    if (size_ >= SCBSTelemetryStore::kHeaderLen) {
+        void * data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            data_ = static_cast<const uint8_t *>(data);
+            madvise(data, size_, MADV_RANDOM); // queries jump between chunks, read ahead would mostly be wasted
+        }
+    }
+    close(fd); // the mapping holds its own reference
+    if (data_ == NULL || memcmp(data_, SCBSTelemetryStore::kMagic, SCBSTelemetryStore::kMagicLen) != 0
+        || data_[SCBSTelemetryStore::kMagicLen] != SCBSTelemetryStore::kVersion) {
+        printf("SCBSTelemetryReader::Open(): %s is not a version %d telemetry file.\r\n", path,
+            SCBSTelemetryStore::kVersion);
+        Close();
+        return false;
+    }
+    header_.start_time_us = GetLittleEndian(data_ + 8, 8);
+    header_.chunk_len = static_cast<uint32_t>(GetLittleEndian(data_ + 16, 4));
+    is_indexed_ = ReadIndex();
+    if (!is_indexed_) {
+        printf("SCBSTelemetryReader::Open(): %s has no index, reading its chunk headers instead.\r\n", path);
+        ScanChunks();
+    }
+    return true;
+}
+
+void SCBSTelemetryReader::Close() {
+    if (data_ != NULL) {
+        munmap(const_cast<uint8_t *>(data_), size_);
+        data_ = NULL;
+    }
+    size_ = 0;
+    is_indexed_ = false;
+    num_chunks_ = 0;
+    chunks_.clear();
+}
+
+SCBSTelemetryStore::Header_t SCBSTelemetryReader::GetHeader() {
+    return header_;
+}
+
+/**
+ * @brief Whether the file had an index, i.e. the writer closed it cleanly.
+*/
+bool SCBSTelemetryReader::IsIndexed() {
+    return is_indexed_;
+}
+
+uint32_t SCBSTelemetryReader::GetNumChunks() {
+    return num_chunks_;
+}
+
+/**
+ * @brief Lists every series in the file, ordered by cell ID and then register address.
+*/
+std::vector<SCBSTelemetryStore::Series_t> SCBSTelemetryReader::GetSeries() {
+    std::vector<SCBSTelemetryStore::Series_t> series;
+    std::map<uint64_t, std::vector<SCBSTelemetryStore::ChunkInfo_t>>::iterator it;
+    for (it = chunks_.begin(); it != chunks_.end(); it++) {
+        SCBSTelemetryStore::Series_t one_series;
+        one_series.cell_id = it->second.front().cell_id;
+        one_series.reg_addr = it->second.front().reg_addr;
+        one_series.num_chunks = it->second.size();
+        one_series.first_time_us = it->second.front().first_time_us;
+        one_series.last_time_us = it->second.back().last_time_us;
+        for (size_t i = 0; i < it->second.size(); i++) {
+            one_series.num_samples += it->second[i].num_samples;
+        }
+        series.push_back(one_series);
+    }
+    return series;
+}
+
+/**
+ * @brief Hands every sample of a series in a time range to a callback, in time order. Only the chunks that overlap the
+ * range are decoded.
+ * @param[in] cell_id Cell the series is from.
+ * @param[in] reg_addr Register the series is of.
+ * @param[in] start_time_us Start of the range, inclusive, us since the file was created.
+ * @param[in] end_time_us End of the range, exclusive.
+ * @param[in] callback Called with each sample.
+ * @retval Number of samples handed to the callback.
+*/
+uint64_t SCBSTelemetryReader::Query(uint16_t cell_id, uint32_t reg_addr, uint64_t start_time_us,
+    uint64_t end_time_us, SampleCallback_t callback) {
+    std::map<uint64_t, std::vector<SCBSTelemetryStore::ChunkInfo_t>>::iterator series_it =
+        chunks_.find(SCBSTelemetryStore::GetSeriesKey(cell_id, reg_addr));
+    if (series_it == chunks_.end()) {
+        return 0;
+    }
+    std::vector<SCBSTelemetryStore::ChunkInfo_t> & chunks = series_it->second;
+    std::vector<SCBSTelemetryStore::ChunkInfo_t>::iterator it = std::lower_bound(chunks.begin(), chunks.end(),
+        start_time_us, [](const SCBSTelemetryStore::ChunkInfo_t & info, uint64_t time_us) {
+            return info.last_time_us < time_us;
+        });
+    uint64_t num_samples = 0;
+    for (; it != chunks.end() && it->first_time_us < end_time_us; it++) {
+        const uint8_t * times = data_ + it->offset + SCBSTelemetryStore::kChunkHeaderLen;
+        bool is_ok = SCBSTelemetryChunk::Decode(*it, times, times + it->times_len,
+            [&](const SCBSTelemetryStore::Sample_t & sample) {
+                if (sample.time_us >= end_time_us) {
+                    return false;
+                }
+                if (sample.time_us >= start_time_us) {
+                    callback(sample);
+                    num_samples++;
+                }
+                return true;
+            });
+        if (!is_ok) {
+            printf("SCBSTelemetryReader::Query(): Chunk at offset %lu is corrupt.\r\n", it->offset);
+        }
+    }
+    return num_samples;
+}
+
+/**
+ * @brief Appends every sample of a series in a time range to a vector. See the callback version.
+*/
+uint64_t SCBSTelemetryReader::Query(uint16_t cell_id, uint32_t reg_addr, uint64_t start_time_us,
+    uint64_t end_time_us, std::vector<SCBSTelemetryStore::Sample_t> & samples) {
+    return Query(cell_id, reg_addr, start_time_us, end_time_us,
+        [&samples](const SCBSTelemetryStore::Sample_t & sample) { samples.push_back(sample); });
+}
+
+/**
+ * @brief Boils a series down to the count, min, max and mean of each fixed length bucket of time in a range, e.g. one
+ * point per minute for plotting a whole soak test.
+ * @param[in] cell_id Cell the series is from.
+ * @param[in] reg_addr Register the series is of.
+ * @param[in] start_time_us Start of the range, inclusive. Buckets are counted from here.
+ * @param[in] end_time_us End of the range, exclusive.
+ * @param[in] bucket_us Length of each bucket. 0 for one bucket covering the whole range.
+ * @retval One entry per bucket that has samples in it, in time order.
+*/
+std::vector<SCBSTelemetryReader::Aggregate_t> SCBSTelemetryReader::Aggregate(uint16_t cell_id, uint32_t reg_addr,
+    uint64_t start_time_us, uint64_t end_time_us, uint64_t bucket_us) {
+    std::vector<Aggregate_t> aggregates;
+    Query(cell_id, reg_addr, start_time_us, end_time_us, [&](const SCBSTelemetryStore::Sample_t & sample) {
+        uint64_t bucket_start_us = start_time_us;
+        if (bucket_us > 0) {
+            bucket_start_us += (sample.time_us - start_time_us) / bucket_us * bucket_us;
+        }
+        if (aggregates.empty() || aggregates.back().start_time_us != bucket_start_us) {
+            Aggregate_t aggregate;
+            aggregate.start_time_us = bucket_start_us;
+            aggregate.min = sample.value;
+            aggregate.max = sample.value;
+            aggregates.push_back(aggregate);
+        }
+        Aggregate_t & aggregate = aggregates.back();
+        aggregate.num_samples++;
+        aggregate.min = std::min(aggregate.min, sample.value);
+        aggregate.max = std::max(aggregate.max, sample.value);
+        aggregate.mean += (sample.value - aggregate.mean) / aggregate.num_samples; // running mean
+    });
+    return aggregates;
+}
+
+/**
+ * @brief Loads the chunk headers listed in the index.
+ * @retval False if there's no index or it doesn't check out, in which case nothing is loaded.
+*/
+bool SCBSTelemetryReader::ReadIndex() {
+    if (size_ < SCBSTelemetryStore::kHeaderLen + SCBSTelemetryStore::kTrailerLen) {
+        return false;
+    }
+    const uint8_t * trailer = data_ + size_ - SCBSTelemetryStore::kTrailerLen;
+    uint64_t index_offset = GetLittleEndian(trailer, 8);
+    uint64_t num_chunks = GetLittleEndian(trailer + 8, 8);
+    if (memcmp(trailer + 16, SCBSTelemetryStore::kIndexMagic, SCBSTelemetryStore::kIndexMagicLen) != 0
+        || index_offset < SCBSTelemetryStore::kHeaderLen
+        || index_offset + 8 * num_chunks != size_ - SCBSTelemetryStore::kTrailerLen) {
+        return false;
+    }
+    for (uint64_t i = 0; i < num_chunks; i++) {
+        SCBSTelemetryStore::ChunkInfo_t info;
+        if (!ReadChunkInfo(GetLittleEndian(data_ + index_offset + 8 * i, 8), info)
+            || info.offset + SCBSTelemetryStore::kChunkHeaderLen + info.times_len + info.values_len > index_offset) {
+            chunks_.clear();
+            num_chunks_ = 0;
+            return false;
+        }
+        chunks_[SCBSTelemetryStore::GetSeriesKey(info.cell_id, info.reg_addr)].push_back(info);
+        num_chunks_++;
+    }
+    return true;
+}
+
+/**
+ * @brief Loads chunk headers by walking the chunks from the start of the file, stopping at the first one that's
+ * missing or cut short.
+*/
+void SCBSTelemetryReader::ScanChunks() {
+    uint64_t offset = SCBSTelemetryStore::kHeaderLen;
+    SCBSTelemetryStore::ChunkInfo_t info;
+    while (ReadChunkInfo(offset, info)) {
+        chunks_[SCBSTelemetryStore::GetSeriesKey(info.cell_id, info.reg_addr)].push_back(info);
+        num_chunks_++;
+        offset += SCBSTelemetryStore::kChunkHeaderLen + info.times_len + info.values_len;
+    }
+}
+
+/**
+ * @brief Reads and sanity checks a chunk header.
+ * @param[in] offset Offset of the chunk header in the file.
+ * @param[out] info Chunk header.
+ * @retval False if there's no whole chunk at the offset.
+*/
+bool SCBSTelemetryReader::ReadChunkInfo(uint64_t offset, SCBSTelemetryStore::ChunkInfo_t & info) {
+    if (offset < SCBSTelemetryStore::kHeaderLen || offset + SCBSTelemetryStore::kChunkHeaderLen > size_) {
+        return false;
+    }
+    const uint8_t * header = data_ + offset;
+    if (GetLittleEndian(header, 4) != SCBSTelemetryStore::kChunkMagic) {
+        return false;
+    }
+    info.cell_id = static_cast<uint16_t>(GetLittleEndian(header + 4, 2));
+    info.reg_addr = static_cast<uint32_t>(GetLittleEndian(header + 8, 4));
+    info.num_samples = static_cast<uint32_t>(GetLittleEndian(header + 12, 4));
+    info.first_time_us = GetLittleEndian(header + 16, 8);
+    info.last_time_us = GetLittleEndian(header + 24, 8);
+    info.times_len = static_cast<uint32_t>(GetLittleEndian(header + 32, 4));
+    info.values_len = static_cast<uint32_t>(GetLittleEndian(header + 36, 4));
+    info.offset = offset;
+    return info.num_samples > 0 && info.first_time_us <= info.last_time_us
+        && offset + SCBSTelemetryStore::kChunkHeaderLen + info.times_len + info.values_len <= size_;
+}
@@ -0,0 +1,129 @@
+#include "scbs_capture.hh"
+#include "scbs_analyzer.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+static void PrintUsage(const char * program_name) {
+    printf("Usage: %s --in <capture file> [--cells <n>] [--timeout <ms>] [--interval <ms>] [--timeline <file>]\r\n", program_name);
+    printf("       [--series <file>] [--flags <file>] [--json <file>]\r\n");
+    printf("    --in        Capture file written by scbscap.\r\n");
+    printf("    --cells     Number of cells in the chain, for per hop latency, default 0 to take it from a DIS in the capture.\r\n");
+    printf("    --timeout   How long a request waits for its response before it's unanswered, default %d.\r\n", SCBSMaster::kDefaultTimeoutMs);
+    printf("    --interval  Length of each time series interval in milliseconds, default %d.\r\n", SCBSAnalyzer::kDefaultIntervalUs / 1000);
+    printf("    --timeline  Write every request, with its outcome and latency, to this CSV file.\r\n");
+    printf("    --series    Write request rates, errors and latency percentiles for each interval to this CSV file.\r\n");
+    printf("    --flags     Write every flagged line (bad checksum, not a packet, retry, unsolicited) to this CSV file.\r\n");
+    printf("    --json      Write the summary, including the latency histogram, to this file.\r\n");
+}
+
+static FILE * OpenOutput(const char * path) {
+    if (path == NULL) {
+        return NULL;
+    }
+    FILE * file = fopen(path, "w");
+    if (file == NULL) {
+        printf("scbsanalyze: Unable to open %s.\r\n", path);
+    }
+    return file;
+}
+
+/**
+ * SCBS analyze: decodes a capture offline, matching requests to responses, and reports per request timelines, time
+ * series, flagged lines and a summary. See SCBSAnalyzer.
+*/
+int main(int argc, char * argv[]) {
+    const char * in_path = NULL;
+    const char * timeline_path = NULL;
+    const char * series_path = NULL;
+    const char * flags_path = NULL;
+    const char * json_path = NULL;
+    SCBSAnalyzer::Config_t config;
+
+    static struct option long_options[] = {
+        {"in", required_argument, NULL, 'i'},
+        {"cells", required_argument, NULL, 'c'},
+        {"timeout", required_argument, NULL, 't'},
+        {"interval", required_argument, NULL, 'I'},
+        {"timeline", required_argument, NULL, 'T'},
+        {"series", required_argument, NULL, 'S'},
+        {"flags", required_argument, NULL, 'F'},
+        {"json", required_argument, NULL, 'J'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:c:t:I:T:S:F:J:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i': in_path = optarg; break;
+            case 'c': config.num_cells = strtoul(optarg, NULL, 10); break;
+            case 't': config.timeout_us = 1000 * strtoul(optarg, NULL, 10); break;
+            case 'I': config.interval_us = 1000 * strtoul(optarg, NULL, 10); break;
+            case 'T': timeline_path = optarg; break;
+            case 'S': series_path = optarg; break;
+            case 'F': flags_path = optarg; break;
+            case 'J': json_path = optarg; break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (in_path == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    SCBSCaptureReader reader;
+    if (!reader.Open(in_path)) {
+        return 1;
+    }
+    FILE * timeline_file = OpenOutput(timeline_path);
+    FILE * series_file = OpenOutput(series_path);
+    FILE * flags_file = OpenOutput(flags_path);
+    if ((timeline_path != NULL && timeline_file == NULL) || (series_path != NULL && series_file == NULL)
+        || (flags_path != NULL && flags_file == NULL)) {
+        return 1;
+    }
+
+    // Everything but the summary is written out as it's found, so memory use doesn't grow with the capture.
+    SCBSAnalyzer analyzer(config);
+    if (timeline_file != NULL) {
+        SCBSAnalyzer::WriteExchangeCSVHeader(timeline_file);
+        analyzer.SetExchangeCallback([timeline_file](const SCBSAnalyzer::Exchange_t & exchange) {
+            SCBSAnalyzer::WriteExchangeCSV(timeline_file, exchange);
+        });
+    }
+    if (series_file != NULL) {
+        SCBSAnalyzer::WriteIntervalCSVHeader(series_file);
+        analyzer.SetIntervalCallback([series_file](const SCBSAnalyzer::Interval_t & interval) {
+            SCBSAnalyzer::WriteIntervalCSV(series_file, interval);
+        });
+    }
+    if (flags_file != NULL) {
+        fprintf(flags_file, "time_us,direction,flag,line\n");
+        analyzer.SetFlagCallback([flags_file](const SCBSAnalyzer::Flag_t & flag) {
+            fprintf(flags_file, "%lu,%s,%s,\"%s\"\n", flag.time_us,
+                flag.direction == SCBSCapture::TO_CHAIN ? "to_chain" : "from_chain",
+                SCBSAnalyzer::kFlagTypeNames[flag.flag_type], flag.line.c_str());
+        });
+    }
+    int ret = analyzer.Analyze(reader) ? 0 : 1;
+    SCBSAnalyzer::WriteSummary(stdout, analyzer.GetSummary(), reader.GetHeader().baud);
+
+    if (json_path != NULL) {
+        FILE * json_file = OpenOutput(json_path);
+        if (json_file == NULL) {
+            ret = 1;
+        } else {
+            SCBSAnalyzer::WriteSummaryJSON(json_file, analyzer.GetSummary());
+            fclose(json_file);
+        }
+    }
+    for (FILE * file : {timeline_file, series_file, flags_file}) {
+        if (file != NULL) {
+            fclose(file);
+        }
+    }
+    return ret;
+}
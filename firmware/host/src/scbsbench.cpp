@@ -0,0 +1,194 @@
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_load_generator.hh"
+#include "scbs_comms.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <thread>
+
+#define DEFAULT_LABEL "scbsbench"
+
+static void PrintUsage(const char * program_name) {
+    printf("Usage: %s --port <serial port> [--mix <type=weight,...>] [--rate <n>] [--count <n>] [--duration <ms>] [--in-flight <n>]\r\n", program_name);
+    printf("       [--cells <n>] [--reg <addr>] [--write-reg <addr>] [--write-value <value>] [--seed <n>] [--baud <rate>] [--window <n>]\r\n");
+    printf("       [--timeout <ms>] [--csv <file>] [--json <file>] [--label <name>]\r\n");
+    printf("    --port         Serial port connected to the first cell in the chain, e.g. /dev/ttyUSB0.\r\n");
+    printf("    --mix          Relative weights of DIS, MRD, MWR, SRD and SWR requests, default mrd=1,srd=1.\r\n");
+    printf("    --rate         Requests per second, default 0 for as fast as the chain will go.\r\n");
+    printf("    --count        Stop after this many requests, 0 for no limit. Default 1000, or no limit with --duration.\r\n");
+    printf("    --duration     Stop after this many milliseconds, default 0 for no limit.\r\n");
+    printf("    --in-flight    Requests kept outstanding when running as fast as possible, default %d.\r\n", SCBSMaster::kDefaultWindow);
+    printf("    --cells        SRD and SWR go to random cells up to this one, default 0 to enumerate the chain with a DIS first.\r\n");
+    printf("    --reg          Register read by MRD and SRD, default 0x2000 (output current).\r\n");
+    printf("    --write-reg    Register written by MWR and SWR, default 0x1000 (output voltage).\r\n");
+    printf("    --write-value  Value written by MWR and SWR, default 3.60.\r\n");
+    printf("    --seed         Seed for picking request types and cells, default 1.\r\n");
+    printf("    --baud         Baud rate, default %d.\r\n", SerialPort::kDefaultBaud);
+    printf("    --window       Max requests on the chain at once, default %d.\r\n", SCBSMaster::kDefaultWindow);
+    printf("    --timeout      Request timeout in milliseconds, default %d.\r\n", SCBSMaster::kDefaultTimeoutMs);
+    printf("    --csv          Append a row with the results to this file, writing the header first if it's new.\r\n");
+    printf("    --json         Write the results, including the latency histogram, to this file.\r\n");
+    printf("    --label        Name for the run in the CSV and JSON output, e.g. a commit hash, default %s.\r\n", DEFAULT_LABEL);
+}
+
+/**
+ * SCBS bench: load generator for a chain. Sends a mix of requests through a master at a target rate or as fast as
+ * possible, then reports throughput, errors and the latency distribution. See SCBSLoadGenerator.
+*/
+int main(int argc, char * argv[]) {
+    const char * port_path = NULL;
+    const char * csv_path = NULL;
+    const char * json_path = NULL;
+    const char * label = DEFAULT_LABEL;
+    uint32_t baud = SerialPort::kDefaultBaud;
+    SCBSMaster::SCBSMasterConfig_t master_config;
+    SCBSLoadGenerator::Config_t config;
+    config.num_cells = 0;
+    bool count_set = false;
+
+    static struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"mix", required_argument, NULL, 'm'},
+        {"rate", required_argument, NULL, 'r'},
+        {"count", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"in-flight", required_argument, NULL, 'f'},
+        {"cells", required_argument, NULL, 'c'},
+        {"reg", required_argument, NULL, 'g'},
+        {"write-reg", required_argument, NULL, 'G'},
+        {"write-value", required_argument, NULL, 'v'},
+        {"seed", required_argument, NULL, 'S'},
+        {"baud", required_argument, NULL, 'b'},
+        {"window", required_argument, NULL, 'w'},
+        {"timeout", required_argument, NULL, 't'},
+        {"csv", required_argument, NULL, 'C'},
+        {"json", required_argument, NULL, 'J'},
+        {"label", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:m:r:n:d:f:c:g:G:v:S:b:w:t:C:J:l:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': port_path = optarg; break;
+            case 'm':
+                if (!SCBSLoadGenerator::ParseMix(optarg, config.mix)) {
+                    printf("scbsbench: Unable to parse mix %s.\r\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r': config.rate = strtod(optarg, NULL); break;
+            case 'n': config.num_requests = strtoul(optarg, NULL, 10); count_set = true; break;
+            case 'd': config.duration_ms = strtoul(optarg, NULL, 10); break;
+            case 'f': config.max_in_flight = strtoul(optarg, NULL, 10); break;
+            case 'c': config.num_cells = strtoul(optarg, NULL, 10); break;
+            case 'g': config.read_reg_addr = strtoul(optarg, NULL, 16); break;
+            case 'G': config.write_reg_addr = strtoul(optarg, NULL, 16); break;
+            case 'v':
+                strncpy(config.write_value, optarg, BSPacket::kMaxPacketFieldLen - 1);
+                config.write_value[BSPacket::kMaxPacketFieldLen - 1] = '\0';
+                break;
+            case 'S': config.seed = strtoul(optarg, NULL, 10); break;
+            case 'b': baud = strtoul(optarg, NULL, 10); break;
+            case 'w': master_config.window = strtoul(optarg, NULL, 10); break;
+            case 't': master_config.timeout_ms = strtoul(optarg, NULL, 10); break;
+            case 'C': csv_path = optarg; break;
+            case 'J': json_path = optarg; break;
+            case 'l': label = optarg; break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (port_path == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (config.duration_ms > 0 && !count_set) {
+        config.num_requests = 0; // a duration on its own runs for the whole duration
+    }
+
+    Reactor reactor;
+    SerialPort port;
+    if (!port.Open(port_path, baud)) {
+        return 1;
+    }
+    SCBSMaster master(reactor, port, master_config);
+    SCBSLoadGenerator generator(reactor, master);
+    if (!master.Start()) {
+        return 1;
+    }
+
+    // Ctrl+C stops sending, then the run finishes and reports on what was sent. Blocked before the reactor thread
+    // starts so that it inherits the mask and the signals only ever arrive through the signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    reactor.AddFD(signal_fd, EPOLLIN, [&generator, signal_fd](uint32_t events) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+            generator.Stop();
+        }
+    });
+    std::thread reactor_thread([&reactor]() { reactor.Run(); });
+
+    int ret = 0;
+    if (config.num_cells == 0) {
+        DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+        SCBSMaster::Response_t response = master.Send(dis).get();
+        if (response.err_code == SCBSMaster::kErrCodeNone) {
+            config.num_cells = DISPacket(response.packet_str).last_cell_id;
+        }
+        if (config.num_cells == 0) {
+            printf("scbsbench: Unable to enumerate the chain on %s.\r\n", port_path);
+            ret = 1;
+        } else {
+            printf("scbsbench: Found %d cells on %s.\r\n", config.num_cells, port_path);
+        }
+    }
+
+    if (ret == 0) {
+        SCBSLoadGenerator::Report_t report = generator.Run(config).get();
+        SCBSLoadGenerator::WriteSummary(stdout, report);
+        if (csv_path != NULL) {
+            FILE * csv_file = fopen(csv_path, "a");
+            if (csv_file == NULL) {
+                printf("scbsbench: Unable to open %s.\r\n", csv_path);
+                ret = 1;
+            } else {
+                if (ftell(csv_file) == 0) {
+                    SCBSLoadGenerator::WriteCSVHeader(csv_file);
+                }
+                SCBSLoadGenerator::WriteCSV(csv_file, report, label);
+                fclose(csv_file);
+            }
+        }
+        if (json_path != NULL) {
+            FILE * json_file = fopen(json_path, "w");
+            if (json_file == NULL) {
+                printf("scbsbench: Unable to open %s.\r\n", json_path);
+                ret = 1;
+            } else {
+                SCBSLoadGenerator::WriteJSON(json_file, report, label);
+                fclose(json_file);
+            }
+        }
+    }
+
+    reactor.Stop();
+    reactor_thread.join();
+    reactor.RemoveFD(signal_fd);
+    close(signal_fd);
+    return ret;
+}
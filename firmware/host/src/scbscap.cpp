@@ -0,0 +1,116 @@
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_capture.hh"
+#include "scbs_capture_proxy.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define DEFAULT_FLUSH_INTERVAL_MS 1000
+
+static void PrintUsage(const char * program_name) {
+    printf("Usage: %s --port <serial port> --out <capture file> [--link <path>] [--baud <rate>]\r\n", program_name);
+    printf("    --port  Serial port connected to the first cell in the chain, e.g. /dev/ttyUSB0.\r\n");
+    printf("    --out   Capture file to write.\r\n");
+    printf("    --link  Also make a symlink to the pty at this path, so host tools can be pointed at a fixed name.\r\n");
+    printf("    --baud  Baud rate, default %d.\r\n", SerialPort::kDefaultBaud);
+}
+
+/**
+ * SCBS capture: records both directions of the traffic on a chain's serial port to a capture file, for replaying or
+ * analyzing offline. Host tools are pointed at the pty this creates instead of the real port. See SCBSCaptureProxy.
+*/
+int main(int argc, char * argv[]) {
+    const char * port_path = NULL;
+    const char * out_path = NULL;
+    const char * link_path = NULL;
+    uint32_t baud = SerialPort::kDefaultBaud;
+
+    static struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"out", required_argument, NULL, 'o'},
+        {"link", required_argument, NULL, 'l'},
+        {"baud", required_argument, NULL, 'b'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:o:l:b:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': port_path = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'l': link_path = optarg; break;
+            case 'b': baud = strtoul(optarg, NULL, 10); break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (port_path == NULL || out_path == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Reactor reactor;
+    SCBSCaptureWriter writer;
+    if (!writer.Open(out_path, baud)) {
+        return 1;
+    }
+    SCBSCaptureProxy proxy(reactor, writer);
+    if (!proxy.Open(port_path, baud)) {
+        return 1;
+    }
+    // Nothing more can be captured once the chain's port is gone (e.g. the adapter was unplugged), so finish up.
+    bool chain_hung_up = false;
+    proxy.SetHangUpCallback([&reactor, &chain_hung_up]() {
+        chain_hung_up = true;
+        reactor.Stop();
+    });
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(proxy.GetPortPath(), link_path) < 0) {
+            printf("scbscap: Unable to link %s to %s.\r\n", link_path, proxy.GetPortPath());
+            return 1;
+        }
+    }
+
+    // Shut down cleanly (flushing the capture) on Ctrl+C or kill, handled on the reactor thread through a signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    reactor.AddFD(signal_fd, EPOLLIN, [&reactor](uint32_t events) { reactor.Stop(); });
+
+    // Flush now and then, so that a capture cut short by a crash or power loss still has most of the session.
+    std::function<void()> flush = [&]() {
+        writer.Flush();
+        reactor.AddTimer(DEFAULT_FLUSH_INTERVAL_MS * 1000, flush);
+    };
+    reactor.AddTimer(DEFAULT_FLUSH_INTERVAL_MS * 1000, flush);
+
+    printf("scbscap: Capturing %s to %s, host tools should open %s.\r\n", port_path, out_path,
+        link_path != NULL ? link_path : proxy.GetPortPath());
+    reactor.Run();
+    proxy.Close();
+    SCBSCaptureWriter::Stats_t stats = writer.GetStats();
+    printf("scbscap: Captured %u records, %lu characters to the chain and %lu from it.\r\n", stats.num_records,
+        stats.num_chars[SCBSCapture::TO_CHAIN], stats.num_chars[SCBSCapture::FROM_CHAIN]);
+    writer.Close();
+    if (link_path != NULL) {
+        unlink(link_path);
+    }
+    reactor.RemoveFD(signal_fd);
+    close(signal_fd);
+    if (chain_hung_up) {
+        printf("scbscap: Stopped early, %s hung up.\r\n", port_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_daemon.hh"
+#include "scbs_register_cache.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define DEFAULT_SOCKET_PATH "/tmp/scbsd.sock"
+
+static void PrintUsage(const char * program_name) {
+    printf("Usage: %s --port <serial port> [--socket <path>] [--baud <rate>] [--window <n>] [--timeout <ms>] [--no-cache]\r\n", program_name);
+    printf("    --port      Serial port connected to the first cell in the chain, e.g. /dev/ttyUSB0.\r\n");
+    printf("    --socket    Unix domain socket to serve clients on, default %s.\r\n", DEFAULT_SOCKET_PATH);
+    printf("    --baud      Baud rate, default %d.\r\n", SerialPort::kDefaultBaud);
+    printf("    --window    Max requests on the chain at once, default %d.\r\n", SCBSMaster::kDefaultWindow);
+    printf("    --timeout   Request timeout in milliseconds, default %d.\r\n", SCBSMaster::kDefaultTimeoutMs);
+    printf("    --no-cache  Send every SRD to the chain instead of answering reads of settings from the register cache.\r\n");
+}
+
+/**
+ * SCBS daemon: owns the serial port for a chain and shares it between local clients over a Unix domain socket. See
+ * SCBSDaemon for the client protocol.
+*/
+int main(int argc, char * argv[]) {
+    const char * port_path = NULL;
+    const char * socket_path = DEFAULT_SOCKET_PATH;
+    uint32_t baud = SerialPort::kDefaultBaud;
+    SCBSMaster::SCBSMasterConfig_t config;
+    bool use_cache = true;
+
+    static struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"socket", required_argument, NULL, 's'},
+        {"baud", required_argument, NULL, 'b'},
+        {"window", required_argument, NULL, 'w'},
+        {"timeout", required_argument, NULL, 't'},
+        {"no-cache", no_argument, NULL, 'n'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:s:b:w:t:nh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': port_path = optarg; break;
+            case 's': socket_path = optarg; break;
+            case 'b': baud = strtoul(optarg, NULL, 10); break;
+            case 'w': config.window = strtoul(optarg, NULL, 10); break;
+            case 't': config.timeout_ms = strtoul(optarg, NULL, 10); break;
+            case 'n': use_cache = false; break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (port_path == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Reactor reactor;
+    SerialPort port;
+    if (!port.Open(port_path, baud)) {
+        return 1;
+    }
+    SCBSRegisterCache cache; // outlives the master, which still uses it while shutting down
+    SCBSMaster master(reactor, port, config);
+    if (use_cache) {
+        master.SetRegisterCache(&cache);
+    }
+    SCBSDaemon daemon(reactor, master);
+    if (!master.Start() || !daemon.Listen(socket_path)) {
+        return 1;
+    }
+
+    // Shut down cleanly (removing the socket) on Ctrl+C or kill, handled on the reactor thread through a signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    reactor.AddFD(signal_fd, EPOLLIN, [&reactor](uint32_t events) { reactor.Stop(); });
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("scbsd: Serving %s on %s.\r\n", port_path, socket_path);
+    reactor.Run();
+    printf("scbsd: Shutting down.\r\n");
+    reactor.RemoveFD(signal_fd);
+    close(signal_fd);
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_telemetry_store.hh"
+#include "scbs_comms.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <vector>
+
+#define DEFAULT_PERIOD_MS 1000
+#define DEFAULT_FLUSH_INTERVAL_MS 10000
+
+static void PrintUsage(const char * program_name) {
+    printf("Usage: %s --port <serial port> --out <telemetry file> [--regs <addr,...>] [--period <ms>] [--duration <ms>]\r\n", program_name);
+    printf("       [--flush <ms>] [--chunk <n>] [--baud <rate>]\r\n");
+    printf("       %s --in <telemetry file> [--list] [--cell <id>] [--reg <addr>] [--from <ms>] [--to <ms>] [--bucket <ms>]\r\n", program_name);
+    printf("Recording:\r\n");
+    printf("    --port      Serial port connected to the first cell in the chain, e.g. /dev/ttyUSB0.\r\n");
+    printf("    --out       Telemetry file to write.\r\n");
+    printf("    --regs      Registers to sweep with an MRD each period, default 1000,2000 (output voltage and current).\r\n");
+    printf("    --period    Sweep period in milliseconds, default %d.\r\n", DEFAULT_PERIOD_MS);
+    printf("    --duration  Stop after this many milliseconds, default 0 to run until Ctrl+C.\r\n");
+    printf("    --flush     Write partly filled chunks out this often in milliseconds (they keep filling after), "
+        "default %d.\r\n", DEFAULT_FLUSH_INTERVAL_MS);
+    printf("    --chunk     Samples per chunk, default %d.\r\n", SCBSTelemetryStore::kDefaultChunkLen);
+    printf("    --baud      Baud rate, default %d.\r\n", SerialPort::kDefaultBaud);
+    printf("Exporting, as CSV on stdout:\r\n");
+    printf("    --in        Telemetry file to read.\r\n");
+    printf("    --list      List the series in the file instead of exporting samples.\r\n");
+    printf("    --cell      Only export this cell, default all.\r\n");
+    printf("    --reg       Only export this register, default all.\r\n");
+    printf("    --from      Start of the range in milliseconds since the file was created, default the start.\r\n");
+    printf("    --to        End of the range in milliseconds since the file was created, default the end.\r\n");
+    printf("    --bucket    Export the count, min, max and mean of each bucket of this many milliseconds instead of every sample.\r\n");
+}
+
+static bool ParseRegs(char * regs_str, std::vector<uint32_t> & reg_addrs) {
+    reg_addrs.clear();
+    for (char * reg_str = strtok(regs_str, ","); reg_str != NULL; reg_str = strtok(NULL, ",")) {
+        reg_addrs.push_back(strtoul(reg_str, NULL, 16));
+    }
+    return !reg_addrs.empty();
+}
+
+/**
+ * @brief Sweeps registers on a fixed period until stopped, appending every cell's values to a telemetry file.
+*/
+static int Record(const char * port_path, const char * out_path, uint32_t baud, std::vector<uint32_t> & reg_addrs,
+    uint32_t period_ms, uint32_t duration_ms, uint32_t flush_interval_ms, uint32_t chunk_len) {
+    Reactor reactor;
+    SerialPort port;
+    if (!port.Open(port_path, baud)) {
+        return 1;
+    }
+    SCBSTelemetryWriter writer;
+    if (!writer.Open(out_path, chunk_len)) {
+        return 1;
+    }
+    SCBSMaster master(reactor, port);
+    if (!master.Start()) {
+        return 1;
+    }
+
+    // Stop cleanly (writing the index) on Ctrl+C or kill, handled on the reactor thread through a signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    reactor.AddFD(signal_fd, EPOLLIN, [&reactor](uint32_t events) { reactor.Stop(); });
+
+    // One MRD per register, so that each one has room for as many cells as possible. Sweeps are timestamped with when
+    // they were due rather than when they came back, which keeps the timestamps regular and cheap to store.
+    uint32_t num_sweeps = 0;
+    uint32_t num_errors = 0;
+    uint64_t next_due_time_us = Reactor::GetTimeUs();
+    std::function<void()> sweep = [&]() {
+        uint64_t due_time_us = next_due_time_us;
+        for (size_t i = 0; i < reg_addrs.size(); i++) {
+            char no_values[1][BSPacket::kMaxPacketFieldLen];
+            MRDPacket mrd = MRDPacket(reg_addrs[i], no_values, 0);
+            master.Send(mrd, [&writer, &num_errors, due_time_us](SCBSMaster::Response_t & response) {
+                if (response.err_code != SCBSMaster::kErrCodeNone) {
+                    num_errors++;
+                    return;
+                }
+                writer.AppendMRD(due_time_us, response.packet_str);
+            });
+        }
+        num_sweeps++;
+        next_due_time_us += 1000ull * period_ms;
+        uint64_t now_us = Reactor::GetTimeUs();
+        reactor.AddTimer(next_due_time_us > now_us ? next_due_time_us - now_us : 0, sweep);
+    };
+    reactor.AddTimer(0, sweep);
+    std::function<void()> flush = [&]() {
+        writer.Flush();
+        reactor.AddTimer(1000ull * flush_interval_ms, flush);
+    };
+    reactor.AddTimer(1000ull * flush_interval_ms, flush);
+    if (duration_ms > 0) {
+        reactor.AddTimer(1000ull * duration_ms, [&reactor]() { reactor.Stop(); });
+    }
+
+    printf("scbslog: Logging %zu registers from %s to %s every %u ms.\r\n", reg_addrs.size(), port_path, out_path,
+        period_ms);
+    reactor.Run();
+    master.Stop();
+    writer.Close();
+    SCBSTelemetryWriter::Stats_t stats = writer.GetStats(); // after Close(), so it counts the chunks it finished
+    printf("scbslog: Logged %lu samples from %u sweeps (%u failed MRDs) in %u chunks, %lu bytes.\r\n",
+        stats.num_samples, num_sweeps, num_errors, stats.num_chunks, stats.num_bytes);
+    reactor.RemoveFD(signal_fd);
+    close(signal_fd);
+    return 0;
+}
+
+/**
+ * @brief Writes samples (or aggregates) from a telemetry file as CSV.
+*/
+static int Export(const char * in_path, bool list, int32_t cell_id, int64_t reg_addr, uint64_t from_ms, uint64_t to_ms,
+    uint64_t bucket_ms) {
+    SCBSTelemetryReader reader;
+    if (!reader.Open(in_path)) {
+        return 1;
+    }
+    std::vector<SCBSTelemetryStore::Series_t> series = reader.GetSeries();
+    if (list) {
+        printf("cell_id,reg_addr,num_samples,num_chunks,first_time_us,last_time_us\n");
+        for (size_t i = 0; i < series.size(); i++) {
+            printf("%u,%X,%lu,%u,%lu,%lu\n", series[i].cell_id, series[i].reg_addr, series[i].num_samples,
+                series[i].num_chunks, series[i].first_time_us, series[i].last_time_us);
+        }
+        return 0;
+    }
+
+    uint64_t start_time_us = 1000 * from_ms;
+    uint64_t end_time_us = to_ms > 0 ? 1000 * to_ms : UINT64_MAX;
+    if (bucket_ms > 0) {
+        printf("cell_id,reg_addr,start_time_us,num_samples,min,max,mean\n");
+    } else {
+        printf("cell_id,reg_addr,time_us,value\n");
+    }
+    for (size_t i = 0; i < series.size(); i++) {
+        uint16_t series_cell_id = series[i].cell_id;
+        uint32_t series_reg_addr = series[i].reg_addr;
+        if ((cell_id >= 0 && series_cell_id != cell_id) || (reg_addr >= 0 && series_reg_addr != reg_addr)) {
+            continue;
+        }
+        if (bucket_ms > 0) {
+            std::vector<SCBSTelemetryReader::Aggregate_t> aggregates = reader.Aggregate(series_cell_id,
+                series_reg_addr, start_time_us, end_time_us, 1000 * bucket_ms);
+            for (size_t j = 0; j < aggregates.size(); j++) {
+                printf("%u,%X,%lu,%lu,%g,%g,%g\n", series_cell_id, series_reg_addr, aggregates[j].start_time_us,
+                    aggregates[j].num_samples, aggregates[j].min, aggregates[j].max, aggregates[j].mean);
+            }
+        } else {
+            reader.Query(series_cell_id, series_reg_addr, start_time_us, end_time_us,
+                [series_cell_id, series_reg_addr](const SCBSTelemetryStore::Sample_t & sample) {
+                    printf("%u,%X,%lu,%g\n", series_cell_id, series_reg_addr, sample.time_us, sample.value);
+                });
+        }
+    }
+    return 0;
+}
+
+/**
+ * SCBS log: records every cell's register values from periodic MRD sweeps into a telemetry file for soak tests, and
+ * exports ranges of it as CSV. See SCBSTelemetryWriter and SCBSTelemetryReader.
+*/
+int main(int argc, char * argv[]) {
+    const char * port_path = NULL;
+    const char * out_path = NULL;
+    const char * in_path = NULL;
+    uint32_t baud = SerialPort::kDefaultBaud;
+    std::vector<uint32_t> reg_addrs = {0x1000, 0x2000}; // output voltage and current
+    uint32_t period_ms = DEFAULT_PERIOD_MS;
+    uint32_t duration_ms = 0;
+    uint32_t flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS;
+    uint32_t chunk_len = SCBSTelemetryStore::kDefaultChunkLen;
+    bool list = false;
+    int32_t cell_id = -1;
+    int64_t reg_addr = -1;
+    uint64_t from_ms = 0;
+    uint64_t to_ms = 0;
+    uint64_t bucket_ms = 0;
+
+    static struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"out", required_argument, NULL, 'o'},
+        {"regs", required_argument, NULL, 'r'},
+        {"period", required_argument, NULL, 'P'},
+        {"duration", required_argument, NULL, 'd'},
+        {"flush", required_argument, NULL, 'f'},
+        {"chunk", required_argument, NULL, 'k'},
+        {"baud", required_argument, NULL, 'b'},
+        {"in", required_argument, NULL, 'i'},
+        {"list", no_argument, NULL, 'L'},
+        {"cell", required_argument, NULL, 'c'},
+        {"reg", required_argument, NULL, 'g'},
+        {"from", required_argument, NULL, 'F'},
+        {"to", required_argument, NULL, 'T'},
+        {"bucket", required_argument, NULL, 'B'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:o:r:P:d:f:k:b:i:Lc:g:F:T:B:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': port_path = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'r':
+                if (!ParseRegs(optarg, reg_addrs)) {
+                    printf("scbslog: Unable to parse registers %s.\r\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'P': period_ms = strtoul(optarg, NULL, 10); break;
+            case 'd': duration_ms = strtoul(optarg, NULL, 10); break;
+            case 'f': flush_interval_ms = strtoul(optarg, NULL, 10); break;
+            case 'k': chunk_len = strtoul(optarg, NULL, 10); break;
+            case 'b': baud = strtoul(optarg, NULL, 10); break;
+            case 'i': in_path = optarg; break;
+            case 'L': list = true; break;
+            case 'c': cell_id = strtol(optarg, NULL, 10); break;
+            case 'g': reg_addr = strtol(optarg, NULL, 16); break;
+            case 'F': from_ms = strtoull(optarg, NULL, 10); break;
+            case 'T': to_ms = strtoull(optarg, NULL, 10); break;
+            case 'B': bucket_ms = strtoull(optarg, NULL, 10); break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (in_path != NULL) {
+        return Export(in_path, list, cell_id, reg_addr, from_ms, to_ms, bucket_ms);
+    }
+    if (port_path == NULL || out_path == NULL || period_ms == 0 || flush_interval_ms == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    return Record(port_path, out_path, baud, reg_addrs, period_ms, duration_ms, flush_interval_ms, chunk_len);
+}
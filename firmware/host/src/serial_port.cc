@@ -0,0 +1,143 @@
+#include "serial_port.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief Looks up the termios speed constant for a baud rate.
+ * @param[in] baud Baud rate in bits per second.
+ * @retval termios speed, or B0 if the baud rate isn't one that termios supports.
+*/
+static speed_t BaudToSpeed(uint32_t baud) {
+    switch (baud) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+SerialPort::SerialPort() {
+}
+
+/**
+ * @brief Destructor, closes the port if it's still open.
+*/
+SerialPort::~SerialPort() {
+    Close();
+}
+
+/**
+ * @brief Opens a serial port in non-blocking raw mode.
+ * @param[in] path Path to the tty or pty slave, e.g. "/dev/ttyUSB0".
+ * @param[in] baud Baud rate in bits per second. Ignored by ptys but still has to be a rate that termios supports.
+ * @retval True if the port was opened and configured.
+*/
+bool SerialPort::Open(const char * path, uint32_t baud) {
+    Close();
+    fd_ = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+        printf("SerialPort::Open(): Unable to open %s: %s.\r\n", path, strerror(errno));
+        return false;
+    }
+    if (!ConfigureRaw(fd_, baud)) {
+        Close();
+        return false;
+    }
+    tcflush(fd_, TCIOFLUSH); // drop anything left over from whoever had the port last
+    return true;
+}
+
+/**
+ * @brief Closes the port. Does nothing if it isn't open.
+*/
+void SerialPort::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool SerialPort::IsOpen() {
+    return fd_ >= 0;
+}
+
+/**
+ * @brief Returns the file descriptor of the open port, or -1, for registering with a Reactor.
+*/
+int SerialPort::GetFD() {
+    return fd_;
+}
+
+/**
+ * @brief Reads whatever has been received without blocking.
+ * @param[out] buf Buffer to read into.
+ * @param[in] len Size of buf.
+ * @retval Number of characters read, 0 if nothing was waiting, or -1 on error (e.g. EIO after a hangup).
+*/
+ssize_t SerialPort::Read(char * buf, size_t len) {
+    ssize_t num_read = read(fd_, buf, len);
+    if (num_read < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    // A raw tty with VMIN = 0 reads 0 when it's empty rather than at end of file, hangups show up as EPOLLHUP or EIO.
+    return num_read;
+}
+
+/**
+ * @brief Writes as much as the port will take without blocking.
+ * @param[in] buf Characters to write.
+ * @param[in] len Number of characters in buf.
+ * @retval Number of characters written, which may be less than len (including 0), or -1 on error.
+*/
+ssize_t SerialPort::Write(const char * buf, size_t len) {
+    ssize_t num_written = write(fd_, buf, len);
+    if (num_written < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    return num_written;
+}
+
+/**
+ * @brief Puts a tty in raw 8N1 mode with no flow control, so that packets go through untouched (no echo, no CR/LF
+ * translation, no line buffering).
+ * @param[in] fd File descriptor of the tty.
+ * @param[in] baud Baud rate in bits per second.
+ * @retval True if successful.
+*/
+bool SerialPort::ConfigureRaw(int fd, uint32_t baud) {
+    speed_t speed = BaudToSpeed(baud);
+    if (speed == B0) {
+        printf("SerialPort::ConfigureRaw(): Unsupported baud rate %d.\r\n", baud);
+        return false;
+    }
+    struct termios tty;
+    if (tcgetattr(fd, &tty) < 0) {
+        printf("SerialPort::ConfigureRaw(): Unable to get attributes: %s.\r\n", strerror(errno));
+        return false;
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    tty.c_cflag |= CS8 | CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    if (tcsetattr(fd, TCSANOW, &tty) < 0) {
+        printf("SerialPort::ConfigureRaw(): Unable to set attributes: %s.\r\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
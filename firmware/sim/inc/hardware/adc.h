@@ -0,0 +1,6 @@
+#ifndef _FAKE_HARDWARE_ADC_H_
+#define _FAKE_HARDWARE_ADC_H_
+
+#include "pico/stdlib.h" // all fakes live in one header
+
+#endif /* _FAKE_HARDWARE_ADC_H_ */
@@ -0,0 +1,6 @@
+#ifndef _FAKE_HARDWARE_FLASH_H_
+#define _FAKE_HARDWARE_FLASH_H_
+
+#include "pico/stdlib.h" // all fakes live in one header
+
+#endif /* _FAKE_HARDWARE_FLASH_H_ */
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifndef _FAKE_PICO_STDLIB_H_
+#define _FAKE_PICO_STDLIB_H_
+
+/**
+ * Host stand-in for the parts of the Pico SDK used by the SCBS firmware. Lets scbs.cc be compiled for Linux so that
+ * chains of SCBS objects can be simulated and tested without hardware. Only the functions that the firmware actually
+ * calls are provided, and hardware state that matters to the simulation (UART FIFOs, PWM levels, ADC counts, time)
+ * is kept in plain structs that the simulator can poke at.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+
+typedef unsigned int uint;
+
+/** Time **/
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+typedef int32_t alarm_id_t;
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t * rt);
+
+struct repeating_timer {
+    int64_t delay_us; // negative means the period is measured from the start of the last callback, like the SDK
+    alarm_id_t alarm_id;
+    repeating_timer_callback_t callback;
+    void * user_data;
+    uint64_t fake_next_fire_us; // not part of the SDK
+};
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void * user_data, repeating_timer_t * out);
+bool cancel_repeating_timer(repeating_timer_t * timer);
+
+/** GPIO **/
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_NULL = 0x1f
+};
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+
+/** UART **/
+
+struct uart_inst {
+    std::deque<char> rx_fifo; // characters waiting to be read by the firmware
+    std::deque<char> tx_fifo; // characters written by the firmware, waiting to be collected by the simulator
+    uint baudrate = 0;
+};
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t fake_uart0_inst;
+extern uart_inst_t fake_uart1_inst;
+#define uart0 (&fake_uart0_inst)
+#define uart1 (&fake_uart1_inst)
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+uint uart_init(uart_inst_t * uart, uint baudrate);
+void uart_set_hw_flow(uart_inst_t * uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t * uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_fifo_enabled(uart_inst_t * uart, bool enabled);
+bool uart_is_readable(uart_inst_t * uart);
+char uart_getc(uart_inst_t * uart);
+void uart_putc_raw(uart_inst_t * uart, char c);
+void uart_puts(uart_inst_t * uart, const char * s);
+
+/** PWM **/
+
+enum pwm_chan {
+    PWM_CHAN_A = 0,
+    PWM_CHAN_B = 1
+};
+
+uint pwm_gpio_to_slice_num(uint gpio);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level);
+void pwm_set_enabled(uint slice_num, bool enabled);
+
+/** ADC **/
+
+void adc_init();
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint16_t adc_read();
+
+/** Flash **/
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (2u * 1024u * 1024u)
+
+// Flash is read through the XIP window like on the real chip, which here is just an array.
+extern uint8_t fake_flash_contents[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE (reinterpret_cast<uintptr_t>(fake_flash_contents))
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t * data, size_t count);
+
+/** Sync **/
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+
+/** Unique ID **/
+
+#define PICO_UNIQUE_BOARD_ID_SIZE_BYTES 8
+
+typedef struct {
+    uint8_t id[PICO_UNIQUE_BOARD_ID_SIZE_BYTES];
+} pico_unique_board_id_t;
+
+void pico_get_unique_board_id(pico_unique_board_id_t * id_out);
+
+/** Simulator Hooks (not part of the Pico SDK) **/
+
+void fake_time_advance_us(uint64_t us);
+void fake_adc_set_counts(uint input, uint16_t counts);
+uint16_t fake_pwm_get_chan_level(uint slice_num, uint chan);
+void fake_unique_board_id_set(uint64_t id);
+uint32_t fake_flash_get_num_erases(uint32_t flash_offs);
+
+#endif /* _FAKE_PICO_STDLIB_H_ */
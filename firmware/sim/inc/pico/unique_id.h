@@ -0,0 +1,6 @@
+#ifndef _FAKE_PICO_UNIQUE_ID_H_
+#define _FAKE_PICO_UNIQUE_ID_H_
+
+#include "pico/stdlib.h" // all fakes live in one header
+
+#endif /* _FAKE_PICO_UNIQUE_ID_H_ */
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef _SCBS_CHAIN_PTY_HH_
+#define _SCBS_CHAIN_PTY_HH_
+
+#include "scbs_chain_sim.hh"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Connects the host end of an SCBSChainSim to a pseudo terminal, so that host tools can open the pty's path like a
+ * real serial port and talk to a simulated chain. Start() runs the chain on its own thread, which is then the only
+ * thread allowed to touch the chain (or anything else in the fake Pico SDK) until Stop() returns.
+ *
+ * Several chains can share one SCBSChainPty, each on its own pty, for simulating a rig with a serial adapter per pack.
+ * They're all stepped on the same thread against the one fake clock, since the fake Pico SDK is global. They also share
+ * the fake flash, so boards in the same position on different chains see each other's saved settings.
+ *
+ * With real_time set, the chain's fake clock is held back to the wall clock, so with link timing modelled the pty
+ * behaves like a chain at the configured baud rate. Otherwise the chain runs as fast as it can and naps when idle.
+*/
+class SCBSChainPty {
+public:
+    static const uint16_t kChunkLen = 256; // characters moved per read or write on the pty
+    static const uint32_t kIdlePollTimeoutMs = 1;
+    static const uint32_t kMinSleepUs = 1000; // real time mode sleeps once the chain is at least this far ahead
+
+    SCBSChainPty(SCBSChainSim & chain, bool real_time = false);
+    SCBSChainPty(std::vector<SCBSChainSim *> chains, bool real_time = false);
+    ~SCBSChainPty();
+
+    bool Open();
+    const char * GetPortPath(uint16_t chain_index = 0);
+    void Start();
+    void Stop();
+
+private:
+    typedef struct {
+        SCBSChainSim * chain = NULL;
+        int master_fd = -1;
+        int slave_fd = -1; // held open so the master never sees a hangup between host connections
+        std::string port_path;
+        std::string tx_pending; // came out of the chain but didn't fit in the pty yet
+    } Link_t;
+
+    void Run();
+    bool IsIdle();
+    void ShuttleChars(Link_t & link);
+
+    std::vector<Link_t> links_; // one per chain
+    bool real_time_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+};
+
+#endif /* _SCBS_CHAIN_PTY_HH_ */
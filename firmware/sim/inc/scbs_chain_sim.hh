@@ -0,0 +1,72 @@
+#ifndef _SCBS_CHAIN_SIM_HH_
+#define _SCBS_CHAIN_SIM_HH_
+
+#include "pico/stdlib.h"
+#include "scbs.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <deque>
+
+/**
+ * Simulates a daisy chain of SCBS cells on the host. Each cell gets its own fake UART; characters transmitted by a
+ * cell are delivered to the next cell in the chain, and characters transmitted by the last cell are delivered back
+ * to the host. The host end of the chain is driven with HostTransmit() and HostReceive().
+ *
+ * Each position in the chain holds a board with its own unique ID and its own region of the fake flash, so settings
+ * saved by a cell survive PowerCycle(), and boards can be moved around with SwapBoards() like on a real rack.
+ *
+ * By default characters are delivered instantly. With model_link_timing set, each link (including the ones to and
+ * from the host) only delivers characters as fast as the configured UART baud rate allows, for testing anything that
+ * depends on how long packets take to ripple down the chain.
+*/
+class SCBSChainSim {
+public:
+    static const uint16_t kMaxNumCells = 128;
+    static const uint32_t kStepTimeUs = 100; // Fake time that elapses for each call to Step().
+    static const uint32_t kDefaultMaxSteps = 100000;
+    static const uint64_t kFirstUniqueBoardID = 0xE6605838830A0000ull; // board b gets kFirstUniqueBoardID + b
+    static const uint32_t kBoardFlashStoreLen = SCBS::kFlashStoreNumSectors * FLASH_SECTOR_SIZE;
+    static_assert(kMaxNumCells * kBoardFlashStoreLen <= PICO_FLASH_SIZE_BYTES);
+
+    SCBSChainSim(uint16_t num_cells, bool model_link_timing = false);
+    ~SCBSChainSim();
+
+    void HostTransmit(const char * packet_str);
+    uint16_t HostReceive(char packet_str_buf[BSPacket::kMaxPacketLen]);
+    void HostTransmitChars(const char * chars, uint16_t num_chars);
+    uint16_t HostReceiveChars(char * chars_buf, uint16_t max_num_chars);
+
+    void Step();
+    void StepCells();
+    uint32_t RunUntilIdle(uint32_t max_steps = kDefaultMaxSteps);
+    void RunFor(uint32_t duration_us);
+    bool IsIdle();
+
+    void PowerCycle();
+    void SwapBoards(uint16_t cell_index_a, uint16_t cell_index_b);
+
+    void SetCellADCCounts(uint16_t cell_index, uint16_t counts);
+    uint16_t GetNumCells();
+    SCBS * GetCell(uint16_t cell_index);
+
+private:
+    void PowerOn();
+    void PowerOff();
+    void DeliverChars(std::deque<char> & from_fifo, std::deque<char> & to_fifo, uint16_t link_index);
+
+    uint16_t num_cells_;
+    bool model_link_timing_;
+    float chars_per_step_ = 0.0f; // link capacity when model_link_timing_ is set
+    float link_credits_[kMaxNumCells+1]; // link i delivers to cell i, link num_cells_ delivers to the host
+    SCBS * cells_[kMaxNumCells];
+    uint16_t boards_[kMaxNumCells]; // which board is at each position in the chain
+    uart_inst_t uarts_[kMaxNumCells];
+    uint16_t adc_counts_[kMaxNumCells];
+    SCBS::SCBSConfig_t config_; // shared by all cells except for the UART
+
+    std::deque<char> host_tx_fifo_;
+    std::deque<char> host_rx_fifo_;
+};
+
+#endif /* _SCBS_CHAIN_SIM_HH_ */
@@ -0,0 +1,63 @@
+#ifndef _SCBS_REPLAY_HH_
+#define _SCBS_REPLAY_HH_
+
+#include "scbs_chain_sim.hh"
+#include "scbs_capture.hh"
+#include "scbs_latency_histogram.hh"
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Feeds the host side of a capture (see SCBSCapture) into a simulated chain, and checks what comes back against what
+ * the real chain sent. A one cell chain is a single SCBS running exactly as it does on a board, so replaying into
+ * SCBSChainSim(1) exercises one cell on its own.
+ *
+ * Everything runs on the fake clock, so a replay is deterministic: the same capture into the same chain gives the same
+ * packets at the same fake times every run, however busy the machine is. With ORIGINAL_TIMING, each chunk the host
+ * wrote is fed in when the fake clock reaches the time it was captured at (to within SCBSChainSim::kStepTimeUs).
+ * With AS_FAST_AS_POSSIBLE, the gaps are dropped and every chunk is queued up straight away, as if the host had written
+ * the whole session at once; with link timing modelled, the host link still only takes characters at the baud rate.
+ *
+ * Must be run from the thread that owns the fake Pico SDK, i.e. not while an SCBSChainPty is running.
+*/
+class SCBSReplay {
+public:
+    static const uint32_t kMaxIdleSteps = 100000; // after the last chunk, how long to wait for the chain to go quiet
+
+    typedef enum {
+        ORIGINAL_TIMING = 0,
+        AS_FAST_AS_POSSIBLE
+    } Pacing_t;
+
+    typedef struct {
+        uint32_t num_records = 0;
+        uint32_t num_packets_sent = 0; // complete lines fed to the chain
+        uint32_t num_packets_captured = 0; // complete lines the real chain sent back
+        uint32_t num_packets_received = 0; // complete lines the simulated chain sent back
+        uint32_t num_packets_matched = 0; // received lines identical to the captured line in the same position
+        uint64_t captured_duration_us = 0; // from the first chunk the host wrote until the last record
+        uint64_t replayed_duration_us = 0; // fake time from the first chunk fed in until the chain went quiet
+        SCBSLatencyHistogram latency_us; // fake time from a tagged request going in until its first response came out
+        std::vector<std::string> received_packet_strs; // without line endings, in the order they came out
+    } Result_t;
+
+    SCBSReplay(SCBSChainSim & chain);
+
+    Result_t Run(SCBSCaptureReader & reader, Pacing_t pacing = ORIGINAL_TIMING);
+
+private:
+    void Feed(const std::string & chars, Result_t & result);
+    void Step(Result_t & result);
+    static uint16_t ParseTag(const std::string & packet_str);
+
+    SCBSChainSim & chain_;
+    uint64_t replay_time_us_ = 0; // fake time since the first chunk was fed in
+    std::string tx_line_;
+    std::string rx_line_;
+    std::map<uint16_t, uint64_t> outstanding_; // replay time each tagged request went in, by tag
+};
+
+#endif /* _SCBS_REPLAY_HH_ */
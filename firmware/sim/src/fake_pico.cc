@@ -0,0 +1,267 @@
+#include "pico/stdlib.h"
+
+#include <vector>
+#include <algorithm>
+
+const uint16_t kFakeNumGPIOs = 30;
+const uint16_t kFakeNumPWMSlices = 8;
+const uint16_t kFakeNumPWMChans = 2;
+const uint16_t kFakeNumADCInputs = 5;
+const uint32_t kFakeNumFlashSectors = PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE;
+
+uart_inst_t fake_uart0_inst;
+uart_inst_t fake_uart1_inst;
+
+static uint64_t fake_time_us = 0;
+static std::vector<repeating_timer_t *> fake_timers;
+static alarm_id_t fake_last_alarm_id = 0;
+static bool fake_gpio_values[kFakeNumGPIOs];
+static uint16_t fake_pwm_levels[kFakeNumPWMSlices][kFakeNumPWMChans];
+static uint16_t fake_adc_counts[kFakeNumADCInputs];
+static uint fake_adc_selected_input = 0;
+static uint32_t fake_flash_num_erases[kFakeNumFlashSectors];
+static uint64_t fake_unique_board_id = 0;
+
+uint8_t fake_flash_contents[PICO_FLASH_SIZE_BYTES];
+
+/** Time **/
+
+uint32_t time_us_32() {
+    return static_cast<uint32_t>(fake_time_us);
+}
+
+uint64_t time_us_64() {
+    return fake_time_us;
+}
+
+/**
+ * @brief Sleeping advances the fake clock instead of blocking so that simulations run as fast as possible.
+*/
+void sleep_ms(uint32_t ms) {
+    fake_time_advance_us(1000ull * ms);
+}
+
+void sleep_us(uint64_t us) {
+    fake_time_advance_us(us);
+}
+
+/**
+ * @brief Registers a repeating timer. Callbacks are run from fake_time_advance_us() at the fake time they're due, which
+ * stands in for the timer interrupt.
+*/
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void * user_data, repeating_timer_t * out) {
+    if (delay_us == 0) {
+        return false;
+    }
+    out->delay_us = delay_us;
+    out->alarm_id = ++fake_last_alarm_id;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->fake_next_fire_us = fake_time_us + (delay_us < 0 ? -delay_us : delay_us);
+    fake_timers.push_back(out);
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t * timer) {
+    std::vector<repeating_timer_t *>::iterator it = std::find(fake_timers.begin(), fake_timers.end(), timer);
+    if (it == fake_timers.end()) {
+        return false;
+    }
+    fake_timers.erase(it);
+    timer->alarm_id = 0;
+    return true;
+}
+
+/** GPIO **/
+
+void gpio_init(uint gpio) {
+    fake_gpio_values[gpio % kFakeNumGPIOs] = false;
+}
+
+void gpio_set_dir(uint gpio, bool out) {}
+
+void gpio_put(uint gpio, bool value) {
+    fake_gpio_values[gpio % kFakeNumGPIOs] = value;
+}
+
+bool gpio_get(uint gpio) {
+    return fake_gpio_values[gpio % kFakeNumGPIOs];
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {}
+
+/** UART **/
+
+uint uart_init(uart_inst_t * uart, uint baudrate) {
+    uart->rx_fifo.clear();
+    uart->tx_fifo.clear();
+    uart->baudrate = baudrate;
+    return baudrate;
+}
+
+void uart_set_hw_flow(uart_inst_t * uart, bool cts, bool rts) {}
+
+void uart_set_format(uart_inst_t * uart, uint data_bits, uint stop_bits, uart_parity_t parity) {}
+
+void uart_set_fifo_enabled(uart_inst_t * uart, bool enabled) {}
+
+bool uart_is_readable(uart_inst_t * uart) {
+    return !uart->rx_fifo.empty();
+}
+
+/**
+ * @brief Pops a character from the RX FIFO. Unlike the real SDK this doesn't block if the FIFO is empty, it returns
+ * '\0' instead (the firmware always checks uart_is_readable() first).
+*/
+char uart_getc(uart_inst_t * uart) {
+    if (uart->rx_fifo.empty()) {
+        return '\0';
+    }
+    char c = uart->rx_fifo.front();
+    uart->rx_fifo.pop_front();
+    return c;
+}
+
+void uart_putc_raw(uart_inst_t * uart, char c) {
+    uart->tx_fifo.push_back(c);
+}
+
+void uart_puts(uart_inst_t * uart, const char * s) {
+    while (*s) {
+        uart_putc_raw(uart, *s++);
+    }
+}
+
+/** PWM **/
+
+uint pwm_gpio_to_slice_num(uint gpio) {
+    return (gpio >> 1u) & 7u; // same mapping as the RP2040
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap) {}
+
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level) {
+    fake_pwm_levels[slice_num % kFakeNumPWMSlices][chan % kFakeNumPWMChans] = level;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {}
+
+/** ADC **/
+
+void adc_init() {}
+
+void adc_gpio_init(uint gpio) {}
+
+void adc_select_input(uint input) {
+    fake_adc_selected_input = input % kFakeNumADCInputs;
+}
+
+uint16_t adc_read() {
+    return fake_adc_counts[fake_adc_selected_input];
+}
+
+/** Flash **/
+
+/**
+ * @brief Erases whole sectors back to 0xFF. Like the SDK, the offset and count must be sector aligned.
+*/
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if (flash_offs % FLASH_SECTOR_SIZE != 0 || count % FLASH_SECTOR_SIZE != 0 || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        printf("flash_range_erase(): Bad range 0x%X + 0x%X.\r\n", flash_offs, static_cast<uint32_t>(count));
+        return;
+    }
+    memset(fake_flash_contents + flash_offs, 0xFF, count);
+    for (uint32_t sector = flash_offs / FLASH_SECTOR_SIZE; sector < (flash_offs + count) / FLASH_SECTOR_SIZE; sector++) {
+        fake_flash_num_erases[sector]++;
+    }
+}
+
+/**
+ * @brief Programs whole pages. Like real NOR flash, programming can only clear bits, so writing over a page that
+ * wasn't erased first ANDs the old and new data together.
+*/
+void flash_range_program(uint32_t flash_offs, const uint8_t * data, size_t count) {
+    if (flash_offs % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0 || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        printf("flash_range_program(): Bad range 0x%X + 0x%X.\r\n", flash_offs, static_cast<uint32_t>(count));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fake_flash_contents[flash_offs + i] &= data[i];
+    }
+}
+
+/** Sync **/
+
+uint32_t save_and_disable_interrupts() {
+    return 0; // timer callbacks only run from fake_time_advance_us(), so there's nothing to hold off
+}
+
+void restore_interrupts(uint32_t status) {}
+
+/** Unique ID **/
+
+void pico_get_unique_board_id(pico_unique_board_id_t * id_out) {
+    for (uint16_t i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++) {
+        id_out->id[i] = (fake_unique_board_id >> (8 * (PICO_UNIQUE_BOARD_ID_SIZE_BYTES - 1 - i))) & 0xFF; // MSB first
+    }
+}
+
+/** Simulator Hooks **/
+
+/**
+ * @brief Moves the fake clock forward, running any repeating timer callbacks that come due along the way in time order.
+ * @param[in] us Number of microseconds to advance by.
+*/
+void fake_time_advance_us(uint64_t us) {
+    uint64_t end_time_us = fake_time_us + us;
+    while (true) {
+        repeating_timer_t * next_timer = NULL;
+        for (size_t i = 0; i < fake_timers.size(); i++) {
+            if (fake_timers[i]->fake_next_fire_us <= end_time_us
+                && (next_timer == NULL || fake_timers[i]->fake_next_fire_us < next_timer->fake_next_fire_us)) {
+                next_timer = fake_timers[i];
+            }
+        }
+        if (next_timer == NULL) {
+            break;
+        }
+        fake_time_us = next_timer->fake_next_fire_us;
+        if (next_timer->callback(next_timer)) {
+            int64_t delay_us = next_timer->delay_us;
+            next_timer->fake_next_fire_us += delay_us < 0 ? -delay_us : delay_us;
+        } else {
+            cancel_repeating_timer(next_timer);
+        }
+    }
+    fake_time_us = end_time_us;
+}
+
+/**
+ * @brief Sets the value that will be returned by adc_read() when the given input is selected.
+ * @param[in] input ADC input number.
+ * @param[in] counts Raw ADC counts (12 bit).
+*/
+void fake_adc_set_counts(uint input, uint16_t counts) {
+    fake_adc_counts[input % kFakeNumADCInputs] = counts;
+}
+
+/**
+ * @brief Returns the last level written to a PWM channel.
+*/
+uint16_t fake_pwm_get_chan_level(uint slice_num, uint chan) {
+    return fake_pwm_levels[slice_num % kFakeNumPWMSlices][chan % kFakeNumPWMChans];
+}
+
+/**
+ * @brief Sets the ID returned by pico_get_unique_board_id(), so that simulated boards can each have their own.
+*/
+void fake_unique_board_id_set(uint64_t id) {
+    fake_unique_board_id = id;
+}
+
+/**
+ * @brief Returns how many times the sector containing a flash offset has been erased, for checking wear levelling.
+*/
+uint32_t fake_flash_get_num_erases(uint32_t flash_offs) {
+    return fake_flash_num_erases[(flash_offs / FLASH_SECTOR_SIZE) % kFakeNumFlashSectors];
+}
@@ -0,0 +1,185 @@
+#include "scbs_chain_pty.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Returns the wall clock (monotonic) in microseconds, for holding the fake clock back in real time mode.
+*/
+static uint64_t GetWallTimeUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000ull + static_cast<uint64_t>(now.tv_nsec) / 1000ull;
+}
+
+/**
+ * @brief Constructor. The chain isn't touched until Start().
+ * @param[in] chain Chain to connect to the pty. Must outlive this object.
+ * @param[in] real_time Hold the chain's fake clock back to the wall clock.
+*/
+SCBSChainPty::SCBSChainPty(SCBSChainSim & chain, bool real_time)
+    : SCBSChainPty(std::vector<SCBSChainSim *>(1, &chain), real_time)
+{
+}
+
+/**
+ * @brief Constructor for several chains, each on its own pty. The chains aren't touched until Start().
+ * @param[in] chains Chains to connect, in the order of their chain index. Must outlive this object.
+ * @param[in] real_time Hold the chains' fake clock back to the wall clock.
+*/
+SCBSChainPty::SCBSChainPty(std::vector<SCBSChainSim *> chains, bool real_time)
+    : links_(chains.size())
+    , real_time_(real_time)
+    , running_(false)
+{
+    for (size_t i = 0; i < chains.size(); i++) {
+        links_[i].chain = chains[i];
+    }
+}
+
+/**
+ * @brief Destructor, stops the chain thread and closes the ptys.
+*/
+SCBSChainPty::~SCBSChainPty() {
+    Stop();
+    for (size_t i = 0; i < links_.size(); i++) {
+        if (links_[i].slave_fd >= 0) {
+            close(links_[i].slave_fd);
+        }
+        if (links_[i].master_fd >= 0) {
+            close(links_[i].master_fd);
+        }
+    }
+}
+
+/**
+ * @brief Creates a pty for each chain and puts it in raw mode so that packets go through untouched.
+ * @retval True if successful, GetPortPath() then returns the path for the host to open.
+*/
+bool SCBSChainPty::Open() {
+    for (size_t i = 0; i < links_.size(); i++) {
+        Link_t & link = links_[i];
+        link.master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (link.master_fd < 0 || grantpt(link.master_fd) < 0 || unlockpt(link.master_fd) < 0) {
+            printf("SCBSChainPty::Open(): Unable to create pty: %s.\r\n", strerror(errno));
+            return false;
+        }
+        fcntl(link.master_fd, F_SETFL, fcntl(link.master_fd, F_GETFL) | O_NONBLOCK);
+        link.port_path = ptsname(link.master_fd);
+        link.slave_fd = open(link.port_path.c_str(), O_RDWR | O_NOCTTY);
+        if (link.slave_fd < 0) {
+            printf("SCBSChainPty::Open(): Unable to open %s: %s.\r\n", link.port_path.c_str(), strerror(errno));
+            return false;
+        }
+        struct termios tty;
+        tcgetattr(link.slave_fd, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(link.slave_fd, TCSANOW, &tty);
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the path of a chain's pty slave end, e.g. "/dev/pts/3".
+ * @param[in] chain_index Index of the chain, in the order they were passed to the constructor.
+*/
+const char * SCBSChainPty::GetPortPath(uint16_t chain_index) {
+    if (chain_index >= links_.size()) {
+        return "";
+    }
+    return links_[chain_index].port_path.c_str();
+}
+
+/**
+ * @brief Starts running the chains on their own thread.
+*/
+void SCBSChainPty::Start() {
+    if (running_ || links_.empty() || links_[0].master_fd < 0) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread([this]() { Run(); });
+}
+
+/**
+ * @brief Stops the chain thread. The chains can be used from the calling thread again once this returns.
+*/
+void SCBSChainPty::Stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+/**
+ * @brief Chain thread. Moves characters between the ptys and the chains and steps every chain once per step of the
+ * fake clock, either as fast as possible or paced to the wall clock.
+*/
+void SCBSChainPty::Run() {
+    uint64_t start_time_us = GetWallTimeUs();
+    uint64_t num_steps = 0;
+    std::vector<struct pollfd> pfds(links_.size());
+    for (size_t i = 0; i < links_.size(); i++) {
+        pfds[i].fd = links_[i].master_fd;
+        pfds[i].events = POLLIN;
+    }
+    while (running_) {
+        for (size_t i = 0; i < links_.size(); i++) {
+            ShuttleChars(links_[i]);
+            links_[i].chain->StepCells();
+        }
+        fake_time_advance_us(SCBSChainSim::kStepTimeUs);
+        num_steps++;
+        if (real_time_) {
+            uint64_t chain_time_us = num_steps * SCBSChainSim::kStepTimeUs;
+            uint64_t wall_time_us = GetWallTimeUs() - start_time_us;
+            if (chain_time_us > wall_time_us + kMinSleepUs) {
+                usleep(chain_time_us - wall_time_us);
+            }
+        } else if (IsIdle()) {
+            poll(pfds.data(), pfds.size(), kIdlePollTimeoutMs);
+        }
+    }
+}
+
+/**
+ * @brief Returns true if no chain has anything in flight, in either direction.
+*/
+bool SCBSChainPty::IsIdle() {
+    for (size_t i = 0; i < links_.size(); i++) {
+        if (!links_[i].chain->IsIdle() || !links_[i].tx_pending.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Feeds whatever the host wrote to a pty into its chain, and writes whatever came out of the chain to the pty.
+ * @param[in] link Chain and its pty.
+*/
+void SCBSChainPty::ShuttleChars(Link_t & link) {
+    char chars_buf[kChunkLen];
+    ssize_t num_read;
+    while ((num_read = read(link.master_fd, chars_buf, kChunkLen)) > 0) {
+        link.chain->HostTransmitChars(chars_buf, static_cast<uint16_t>(num_read));
+    }
+
+    uint16_t num_received;
+    while ((num_received = link.chain->HostReceiveChars(chars_buf, kChunkLen)) > 0) {
+        link.tx_pending.append(chars_buf, num_received);
+    }
+    if (!link.tx_pending.empty()) {
+        ssize_t num_written = write(link.master_fd, link.tx_pending.data(), link.tx_pending.size());
+        if (num_written > 0) {
+            link.tx_pending.erase(0, num_written);
+        }
+    }
+}
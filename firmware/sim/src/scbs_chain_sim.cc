@@ -0,0 +1,275 @@
+#include "scbs_chain_sim.hh"
+
+/**
+ * @brief Constructor, creates and initializes a chain of SCBS cells on brand new boards (blank flash). Cells are not
+ * enumerated; send a DIS packet to assign cell IDs like a real chain would.
+ * @param[in] num_cells Number of cells in the chain, railed to kMaxNumCells.
+ * @param[in] model_link_timing Limit each link to the UART baud rate instead of delivering characters instantly.
+*/
+SCBSChainSim::SCBSChainSim(uint16_t num_cells, bool model_link_timing) {
+    if (num_cells > kMaxNumCells) {
+        printf("SCBSChainSim::SCBSChainSim(): Requested %d cells but max is %d.\r\n", num_cells, kMaxNumCells);
+        num_cells = kMaxNumCells;
+    }
+    num_cells_ = num_cells;
+    model_link_timing_ = model_link_timing;
+    uint32_t bits_per_char = 1 + config_.uart_data_bits + config_.uart_stop_bits
+        + (config_.uart_parity != UART_PARITY_NONE ? 1 : 0);
+    chars_per_step_ = static_cast<float>(config_.uart_baud) / bits_per_char * kStepTimeUs / 1e6f;
+    for (uint16_t i = 0; i <= num_cells_; i++) {
+        link_credits_[i] = 0.0f;
+    }
+    for (uint16_t i = 0; i < num_cells_; i++) {
+        boards_[i] = i;
+        flash_range_erase(i * kBoardFlashStoreLen, kBoardFlashStoreLen);
+        adc_counts_[i] = 0;
+    }
+    PowerOn();
+}
+
+/**
+ * @brief Destructor, frees the simulated cells.
+*/
+SCBSChainSim::~SCBSChainSim() {
+    PowerOff();
+}
+
+/**
+ * @brief Sends a packet string from the host into the first cell in the chain. The "\r\n" line ending is added here.
+ * @param[in] packet_str Packet string to send, e.g. "$BSDIS,0*53".
+*/
+void SCBSChainSim::HostTransmit(const char * packet_str) {
+    if (num_cells_ == 0) {
+        return;
+    }
+    for (const char * c = packet_str; *c != '\0'; c++) {
+        host_tx_fifo_.push_back(*c);
+    }
+    host_tx_fifo_.push_back('\r');
+    host_tx_fifo_.push_back('\n');
+}
+
+/**
+ * @brief Pops the next complete packet string that came out of the end of the chain.
+ * @param[out] packet_str_buf Buffer to write the packet string into, without the "\r\n" line ending.
+ * @retval Length of the packet string, or 0 if no complete packet has arrived at the host yet.
+*/
+uint16_t SCBSChainSim::HostReceive(char packet_str_buf[BSPacket::kMaxPacketLen]) {
+    memset(packet_str_buf, '\0', BSPacket::kMaxPacketLen);
+    std::deque<char>::iterator eol = host_rx_fifo_.begin();
+    while (eol != host_rx_fifo_.end() && *eol != '\n') {
+        eol++;
+    }
+    if (eol == host_rx_fifo_.end()) {
+        return 0; // no full line yet
+    }
+
+    uint16_t len = 0;
+    while (host_rx_fifo_.front() != '\n') {
+        char c = host_rx_fifo_.front();
+        host_rx_fifo_.pop_front();
+        if (c != '\r' && len < BSPacket::kMaxPacketLen-1) {
+            packet_str_buf[len++] = c;
+        }
+    }
+    host_rx_fifo_.pop_front(); // drop '\n'
+    return len;
+}
+
+/**
+ * @brief Sends raw characters from the host into the first cell in the chain, for feeding the chain from a byte stream
+ * (e.g. a pty) where packets can be split across reads. Nothing is added.
+ * @param[in] chars Characters to send.
+ * @param[in] num_chars Number of characters in chars.
+*/
+void SCBSChainSim::HostTransmitChars(const char * chars, uint16_t num_chars) {
+    if (num_cells_ == 0) {
+        return;
+    }
+    host_tx_fifo_.insert(host_tx_fifo_.end(), chars, chars + num_chars);
+}
+
+/**
+ * @brief Pops whatever characters came out of the end of the chain, complete packets or not, line endings included.
+ * @param[out] chars_buf Buffer to write the characters into. Not null terminated.
+ * @param[in] max_num_chars Size of chars_buf.
+ * @retval Number of characters written to chars_buf.
+*/
+uint16_t SCBSChainSim::HostReceiveChars(char * chars_buf, uint16_t max_num_chars) {
+    uint16_t num_chars = 0;
+    while (num_chars < max_num_chars && !host_rx_fifo_.empty()) {
+        chars_buf[num_chars++] = host_rx_fifo_.front();
+        host_rx_fifo_.pop_front();
+    }
+    return num_chars;
+}
+
+/**
+ * @brief Runs the chain for one step and advances the fake clock by kStepTimeUs.
+*/
+void SCBSChainSim::Step() {
+    StepCells();
+    fake_time_advance_us(kStepTimeUs);
+}
+
+/**
+ * @brief Delivers what the host sent to the first cell, then runs Update() once on every cell in chain order and moves
+ * what each cell transmitted into the receive FIFO of the next cell (or the host). Doesn't touch the fake clock, so
+ * that several chains can be stepped together and then share one fake_time_advance_us(kStepTimeUs).
+*/
+void SCBSChainSim::StepCells() {
+    DeliverChars(host_tx_fifo_, uarts_[0].rx_fifo, 0);
+    for (uint16_t i = 0; i < num_cells_; i++) {
+        fake_adc_set_counts(config_.csense_adc_input, adc_counts_[i]);
+        cells_[i]->Update();
+
+        std::deque<char> & downstream_fifo = (i+1 < num_cells_) ? uarts_[i+1].rx_fifo : host_rx_fifo_;
+        DeliverChars(uarts_[i].tx_fifo, downstream_fifo, i+1);
+    }
+}
+
+/**
+ * @brief Steps the chain until there are no characters left in flight between cells.
+ * @param[in] max_steps Maximum number of steps to run before giving up.
+ * @retval Number of steps that were run.
+*/
+uint32_t SCBSChainSim::RunUntilIdle(uint32_t max_steps) {
+    uint32_t num_steps = 0;
+    do {
+        Step();
+        num_steps++;
+    } while (!IsIdle() && num_steps < max_steps);
+    return num_steps;
+}
+
+/**
+ * @brief Steps the chain until a given amount of fake time has passed, for testing things that cells do on their own.
+ * @param[in] duration_us Amount of time to run for, rounded up to a whole number of steps.
+*/
+void SCBSChainSim::RunFor(uint32_t duration_us) {
+    for (uint32_t elapsed_us = 0; elapsed_us < duration_us; elapsed_us += kStepTimeUs) {
+        Step();
+    }
+}
+
+/**
+ * @brief Returns true if no cell has any characters waiting to be received or transmitted.
+*/
+bool SCBSChainSim::IsIdle() {
+    if (!host_tx_fifo_.empty()) {
+        return false;
+    }
+    for (uint16_t i = 0; i < num_cells_; i++) {
+        if (!uarts_[i].rx_fifo.empty() || !uarts_[i].tx_fifo.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Turns the whole chain off and back on. Anything in flight is lost and every cell starts over from Init(),
+ * keeping only what it saved to flash.
+*/
+void SCBSChainSim::PowerCycle() {
+    PowerOff();
+    PowerOn();
+}
+
+/**
+ * @brief Swaps the boards at two positions in the chain. Boards can't be moved with the power on, so the chain is
+ * power cycled.
+ * @param[in] cell_index_a Position of one board (0 is closest to the host).
+ * @param[in] cell_index_b Position of the other board.
+*/
+void SCBSChainSim::SwapBoards(uint16_t cell_index_a, uint16_t cell_index_b) {
+    if (cell_index_a >= num_cells_ || cell_index_b >= num_cells_) {
+        return;
+    }
+    PowerOff();
+    uint16_t board = boards_[cell_index_a];
+    boards_[cell_index_a] = boards_[cell_index_b];
+    boards_[cell_index_b] = board;
+    PowerOn();
+}
+
+/**
+ * @brief Sets the raw current sense ADC reading seen by a cell.
+ * @param[in] cell_index Position of the cell in the chain (0 is closest to the host).
+ * @param[in] counts Raw ADC counts (12 bit).
+*/
+void SCBSChainSim::SetCellADCCounts(uint16_t cell_index, uint16_t counts) {
+    if (cell_index < num_cells_) {
+        adc_counts_[cell_index] = counts;
+    }
+}
+
+uint16_t SCBSChainSim::GetNumCells() {
+    return num_cells_;
+}
+
+/**
+ * @brief Returns a cell in the chain by position, or NULL if out of range.
+*/
+SCBS * SCBSChainSim::GetCell(uint16_t cell_index) {
+    if (cell_index >= num_cells_) {
+        return NULL;
+    }
+    return cells_[cell_index];
+}
+
+/**
+ * @brief Creates and initializes a cell for each board, pointing each one at its own region of flash and setting up
+ * the unique ID that it reads during Init().
+*/
+void SCBSChainSim::PowerOn() {
+    for (uint16_t i = 0; i < num_cells_; i++) {
+        SCBS::SCBSConfig_t cell_config = config_;
+        cell_config.uart_id = &uarts_[i];
+        cell_config.flash_store_offset = boards_[i] * kBoardFlashStoreLen;
+        fake_unique_board_id_set(kFirstUniqueBoardID + boards_[i]);
+        cells_[i] = new SCBS(cell_config);
+        cells_[i]->Init();
+    }
+}
+
+/**
+ * @brief Frees the cells and drops anything that was in flight on the links.
+*/
+void SCBSChainSim::PowerOff() {
+    for (uint16_t i = 0; i < num_cells_; i++) {
+        delete cells_[i];
+        uarts_[i].rx_fifo.clear();
+        uarts_[i].tx_fifo.clear();
+    }
+    for (uint16_t i = 0; i <= num_cells_; i++) {
+        link_credits_[i] = 0.0f;
+    }
+    host_tx_fifo_.clear();
+    host_rx_fifo_.clear();
+}
+
+/**
+ * @brief Moves characters across one link in the chain. Without link timing everything goes across at once, otherwise
+ * the link earns chars_per_step_ worth of credit each step and spends one credit per character.
+ * @param[in] from_fifo FIFO of the transmitting end.
+ * @param[out] to_fifo FIFO of the receiving end.
+ * @param[in] link_index Index into link_credits_.
+*/
+void SCBSChainSim::DeliverChars(std::deque<char> & from_fifo, std::deque<char> & to_fifo, uint16_t link_index) {
+    if (from_fifo.empty()) {
+        link_credits_[link_index] = 0.0f; // idle line doesn't bank time for the next packet
+        return;
+    }
+    if (!model_link_timing_) {
+        to_fifo.insert(to_fifo.end(), from_fifo.begin(), from_fifo.end());
+        from_fifo.clear();
+        return;
+    }
+    link_credits_[link_index] += chars_per_step_;
+    while (!from_fifo.empty() && link_credits_[link_index] >= 1.0f) {
+        to_fifo.push_back(from_fifo.front());
+        from_fifo.pop_front();
+        link_credits_[link_index] -= 1.0f;
+    }
+}
@@ -0,0 +1,141 @@
+#include "scbs_replay.hh"
+
+#include <stdlib.h>
+
+/**
+ * @brief Constructor.
+ * @param[in] chain Chain to replay into, usually freshly constructed so that it starts out like the real one did.
+*/
+SCBSReplay::SCBSReplay(SCBSChainSim & chain)
+    : chain_(chain)
+{
+}
+
+/**
+ * @brief Replays a capture from its first record, then runs the chain until it goes quiet.
+ * @param[in] reader Open capture to replay. Rewound first.
+ * @param[in] pacing Whether to keep the gaps between the chunks the host wrote.
+ * @retval What came back and how it compares to the capture.
+*/
+SCBSReplay::Result_t SCBSReplay::Run(SCBSCaptureReader & reader, Pacing_t pacing) {
+    Result_t result;
+    replay_time_us_ = 0;
+    tx_line_.clear();
+    rx_line_.clear();
+    outstanding_.clear();
+    if (!reader.Rewind()) {
+        return result;
+    }
+
+    std::vector<std::string> captured_packet_strs;
+    std::string captured_line;
+    bool has_first_time = false;
+    uint64_t first_time_us = 0; // capture time of the first chunk the host wrote, replay time 0
+    SCBSCapture::Record_t record;
+    while (reader.Next(record)) {
+        result.num_records++;
+        if (record.direction == SCBSCapture::FROM_CHAIN) {
+            for (size_t i = 0; i < record.chars.size(); i++) {
+                char c = record.chars[i];
+                if (c == '\n') {
+                    captured_packet_strs.push_back(captured_line);
+                    captured_line.clear();
+                } else if (c != '\r') {
+                    captured_line += c;
+                }
+            }
+        } else {
+            if (!has_first_time) {
+                has_first_time = true;
+                first_time_us = record.time_us;
+            }
+            if (pacing == ORIGINAL_TIMING) {
+                while (replay_time_us_ + first_time_us < record.time_us) {
+                    Step(result);
+                }
+            }
+            Feed(record.chars, result);
+        }
+        if (has_first_time) {
+            result.captured_duration_us = record.time_us - first_time_us;
+        }
+    }
+    if (pacing == ORIGINAL_TIMING) {
+        while (replay_time_us_ < result.captured_duration_us) {
+            Step(result);
+        }
+    }
+    uint32_t num_idle_steps = 0;
+    do {
+        Step(result);
+        num_idle_steps++;
+    } while (!chain_.IsIdle() && num_idle_steps < kMaxIdleSteps);
+    result.replayed_duration_us = replay_time_us_;
+
+    result.num_packets_captured = captured_packet_strs.size();
+    for (size_t i = 0; i < result.received_packet_strs.size() && i < captured_packet_strs.size(); i++) {
+        if (result.received_packet_strs[i] == captured_packet_strs[i]) {
+            result.num_packets_matched++;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Hands characters the host wrote to the chain, and notes when each tagged request went in.
+*/
+void SCBSReplay::Feed(const std::string & chars, Result_t & result) {
+    chain_.HostTransmitChars(chars.data(), static_cast<uint16_t>(chars.size()));
+    for (size_t i = 0; i < chars.size(); i++) {
+        if (chars[i] == '\n') {
+            result.num_packets_sent++;
+            uint16_t tag = ParseTag(tx_line_);
+            if (tag != BSPacket::kNoTag) {
+                outstanding_[tag] = replay_time_us_;
+            }
+            tx_line_.clear();
+        } else if (chars[i] != '\r') {
+            tx_line_ += chars[i];
+        }
+    }
+}
+
+/**
+ * @brief Steps the chain once and collects whatever came out of it.
+*/
+void SCBSReplay::Step(Result_t & result) {
+    chain_.Step();
+    replay_time_us_ += SCBSChainSim::kStepTimeUs;
+    char chars_buf[BSPacket::kMaxPacketLen];
+    uint16_t num_chars;
+    while ((num_chars = chain_.HostReceiveChars(chars_buf, sizeof(chars_buf))) > 0) {
+        for (uint16_t i = 0; i < num_chars; i++) {
+            if (chars_buf[i] == '\n') {
+                result.num_packets_received++;
+                result.received_packet_strs.push_back(rx_line_);
+                std::map<uint16_t, uint64_t>::iterator it = outstanding_.find(ParseTag(rx_line_));
+                if (it != outstanding_.end()) {
+                    result.latency_us.Record(replay_time_us_ - it->second);
+                    outstanding_.erase(it);
+                }
+                rx_line_.clear();
+            } else if (chars_buf[i] != '\r') {
+                rx_line_ += chars_buf[i];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Pulls the tag out of a packet's header (e.g. "$BSSRD#1A,3,2000*36" is tagged 0x1A) without parsing the rest,
+ * so that garbage on the line is just untagged.
+ * @retval Tag, or BSPacket::kNoTag if the packet is untagged.
+*/
+uint16_t SCBSReplay::ParseTag(const std::string & packet_str) {
+    size_t header_end = packet_str.find_first_of(",*");
+    size_t tag_delim = packet_str.find('#');
+    if (tag_delim == std::string::npos || (header_end != std::string::npos && tag_delim > header_end)) {
+        return BSPacket::kNoTag;
+    }
+    return static_cast<uint16_t>(strtoul(packet_str.c_str() + tag_delim + 1, NULL, 16));
+}
@@ -0,0 +1,89 @@
+#ifndef _SCBS_SIMULATED_CHAIN_HH_
+#define _SCBS_SIMULATED_CHAIN_HH_
+
+#include "gtest/gtest.h"
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_chain_pty.hh"
+#include "scbs_comms.hh"
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Simulated chains behind ptys, all stepped together on one thread, and a reactor for the host side to run on its own
+ * thread. Fixtures build what they're testing on top, then call Start(). Anything a fixture adds that the reactor
+ * thread uses has to outlive it, so fixtures with their own components call Stop() first thing in their destructor.
+*/
+class SimulatedChains {
+public:
+	SimulatedChains(std::vector<uint16_t> num_cells, bool real_time = false) {
+		std::vector<SCBSChainSim *> chain_ptrs;
+		for (size_t i = 0; i < num_cells.size(); i++) {
+			chains.emplace_back(new SCBSChainSim(num_cells[i], real_time));
+			chain_ptrs.push_back(chains.back().get());
+		}
+		pty.reset(new SCBSChainPty(chain_ptrs, real_time));
+		EXPECT_TRUE(pty->Open());
+	}
+	virtual ~SimulatedChains() {
+		Stop();
+	}
+
+	void Start() {
+		pty->Start();
+		reactor_thread = std::thread([this]() { reactor.Run(); });
+	}
+	void Stop() {
+		if (reactor_thread.joinable()) {
+			reactor.Stop();
+			reactor_thread.join();
+		}
+		pty->Stop();
+	}
+
+	std::vector<std::unique_ptr<SCBSChainSim>> chains;
+	std::unique_ptr<SCBSChainPty> pty;
+	Reactor reactor;
+	std::thread reactor_thread;
+};
+
+/**
+ * One simulated chain behind a pty, with a master on the other end of it.
+*/
+class SimulatedChain : public SimulatedChains {
+public:
+	SimulatedChain(uint16_t num_cells, SCBSMaster::SCBSMasterConfig_t config = SCBSMaster::SCBSMasterConfig_t(),
+		bool real_time = false)
+		: SimulatedChains(std::vector<uint16_t>(1, num_cells), real_time)
+		, master(reactor, port, config)
+	{}
+	~SimulatedChain() {
+		Stop();
+	}
+
+	/**
+	 * Opens the master's port, on the chain's pty unless something (e.g. a capture proxy) sits in between, and starts
+	 * the master, the chain and the reactor.
+	*/
+	void Start(const char * port_path = NULL) {
+		EXPECT_TRUE(port.Open(port_path != NULL ? port_path : pty->GetPortPath()));
+		EXPECT_TRUE(master.Start());
+		SimulatedChains::Start();
+	}
+	void Enumerate() {
+		DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+		SCBSMaster::Response_t response = master.Send(dis).get();
+		ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		DISPacket dis_response = DISPacket(response.packet_str);
+		ASSERT_TRUE(dis_response.IsValid());
+		ASSERT_EQ(dis_response.last_cell_id, chains[0]->GetNumCells());
+		ASSERT_EQ(dis_response.GetTag(), response.tag);
+	}
+
+	SerialPort port;
+	SCBSMaster master;
+};
+
+#endif /* _SCBS_SIMULATED_CHAIN_HH_ */
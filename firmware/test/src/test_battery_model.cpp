@@ -0,0 +1,126 @@
+#include "gtest/gtest.h"
+#include "battery_model.hh"
+#include <math.h>
+
+static const uint32_t kStepPeriodUs = 1000;
+
+/**
+ * Double precision version of the same equivalent circuit model, to check the fixed point math against.
+*/
+class ReferenceBatteryModel {
+public:
+	ReferenceBatteryModel(BatteryModel & model) {
+		capacity_c = model.GetCapacityMAh() * 3.6;
+		charge_c = capacity_c * model.GetSOCPercent() / 100.0;
+		for (uint16_t i = 0; i < BatteryModel::kNumOCVPoints; i++) {
+			ocv_v[i] = model.GetOCVPoint(i) * 1e-6;
+		}
+		r0_ohm = model.GetR0MOhm() * 1e-3;
+		for (uint16_t i = 0; i < BatteryModel::kNumRCPairs; i++) {
+			rc_r_ohm[i] = model.GetRCPairRMOhm(i) * 1e-3;
+			rc_tau_s[i] = model.GetRCPairTauMs(i) * 1e-3;
+			rc_v[i] = 0.0;
+		}
+	}
+
+	double Step(double current_a, double dt_s) {
+		charge_c = fmin(fmax(charge_c - current_a*dt_s, 0.0), capacity_c);
+		double table_pos = charge_c / capacity_c * (BatteryModel::kNumOCVPoints-1);
+		uint16_t index = static_cast<uint16_t>(table_pos);
+		double ocv = index >= BatteryModel::kNumOCVPoints-1
+			? ocv_v[BatteryModel::kNumOCVPoints-1]
+			: ocv_v[index] + (table_pos - index) * (ocv_v[index+1] - ocv_v[index]);
+		double v = ocv - current_a*r0_ohm;
+		for (uint16_t i = 0; i < BatteryModel::kNumRCPairs; i++) {
+			double alpha = exp(-dt_s / rc_tau_s[i]);
+			rc_v[i] = rc_v[i]*alpha + current_a*rc_r_ohm[i]*(1.0-alpha);
+			v -= rc_v[i];
+		}
+		return v;
+	}
+
+	double SOCPercent() {
+		return 100.0 * charge_c / capacity_c;
+	}
+
+	double capacity_c, charge_c;
+	double ocv_v[BatteryModel::kNumOCVPoints];
+	double r0_ohm;
+	double rc_r_ohm[BatteryModel::kNumRCPairs], rc_tau_s[BatteryModel::kNumRCPairs], rc_v[BatteryModel::kNumRCPairs];
+};
+
+TEST(BatteryModel, RestingVoltageIsOCV) {
+	BatteryModel model = BatteryModel(kStepPeriodUs);
+	model.SetSOCPercent(55.0f);
+	model.Relax();
+	int32_t expected_ocv_uv = (model.GetOCVPoint(5) + model.GetOCVPoint(6)) / 2;
+	ASSERT_NEAR(model.GetOCV(), expected_ocv_uv, 10);
+	ASSERT_NEAR(model.Step(0), expected_ocv_uv, 10);
+}
+
+TEST(BatteryModel, CoulombCounting) {
+	BatteryModel model = BatteryModel(kStepPeriodUs);
+	model.SetCapacityMAh(100);
+	model.SetSOCPercent(100.0f);
+	for (uint32_t i = 0; i < 36000; i++) {
+		model.Step(1000000); // 1A for 36s is 10mAh
+	}
+	ASSERT_NEAR(model.GetSOCPercent(), 90.0f, 1e-4f);
+	for (uint32_t i = 0; i < 36000; i++) {
+		model.Step(-1000000); // charge it back up
+	}
+	ASSERT_NEAR(model.GetSOCPercent(), 100.0f, 1e-4f);
+}
+
+TEST(BatteryModel, SOCRailsAtEmpty) {
+	BatteryModel model = BatteryModel(kStepPeriodUs);
+	model.SetCapacityMAh(1);
+	model.SetSOCPercent(1.0f);
+	for (uint32_t i = 0; i < 1000; i++) {
+		model.Step(1000000);
+	}
+	ASSERT_FLOAT_EQ(model.GetSOCPercent(), 0.0f);
+	ASSERT_EQ(model.GetOCV(), model.GetOCVPoint(0));
+}
+
+TEST(BatteryModel, RCPairStepResponse) {
+	BatteryModel model = BatteryModel(kStepPeriodUs);
+	model.SetR0MOhm(0);
+	model.SetRCPair(0, 100, 1000); // 100mOhm, 1s
+	model.SetRCPair(1, 0, 0);
+	model.SetCapacityMAh(BatteryModel::kMaxCapacityMAh); // so that SOC barely moves
+	model.Relax();
+	int32_t ocv_uv = model.GetOCV();
+	int32_t v_uv = 0;
+	for (uint32_t i = 0; i < 1000; i++) {
+		v_uv = model.Step(1000000);
+	}
+	ASSERT_NEAR(ocv_uv - v_uv, 100000 * (1.0 - exp(-1.0)), 50); // 1A through 100mOhm, one time constant in
+}
+
+TEST(BatteryModel, MatchesDoubleReference) {
+	BatteryModel model = BatteryModel(kStepPeriodUs);
+	model.SetCapacityMAh(200); // small cell so that the test covers a good chunk of the OCV table
+	model.SetSOCPercent(95.0f);
+	model.Relax();
+	ReferenceBatteryModel reference = ReferenceBatteryModel(model);
+
+	// Pulsed discharge with some charge pulses and rests, ten minutes at 1kHz.
+	double max_error_v = 0.0;
+	for (uint32_t i = 0; i < 600000; i++) {
+		uint32_t t_ms = i;
+		int32_t current_ua;
+		switch ((t_ms / 20000) % 4) {
+			case 0: current_ua = 1500000; break;
+			case 1: current_ua = 0; break;
+			case 2: current_ua = 900000 + static_cast<int32_t>((t_ms % 1000) * 300); break;
+			default: current_ua = -400000; break;
+		}
+		double model_v = model.Step(current_ua) * 1e-6;
+		double reference_v = reference.Step(current_ua * 1e-6, kStepPeriodUs * 1e-6);
+		max_error_v = fmax(max_error_v, fabs(model_v - reference_v));
+	}
+	ASSERT_LT(max_error_v, 0.5e-3); // within half a millivolt the whole way
+	ASSERT_NEAR(model.GetSOCPercent(), reference.SOCPercent(), 0.01);
+	ASSERT_LT(reference.SOCPercent(), 50.0); // made it well into the table
+}
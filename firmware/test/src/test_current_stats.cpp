@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+#include "current_stats.hh"
+#include <math.h>
+
+TEST(CurrentStats, EmptyIsZero) {
+	CurrentStats stats = CurrentStats();
+	CurrentStats::Summary_t summary = stats.GetSummary();
+	ASSERT_EQ(summary.num_samples, 0u);
+	ASSERT_EQ(summary.mean_ua, 0);
+	ASSERT_EQ(summary.min_ua, 0);
+	ASSERT_EQ(summary.max_ua, 0);
+	ASSERT_EQ(summary.rms_ua, 0u);
+	ASSERT_EQ(stats.GetChargeNC(), 0);
+}
+
+TEST(CurrentStats, MatchesDoubleReference) {
+	CurrentStats stats = CurrentStats();
+	const uint32_t kNumSamples = 100000;
+	double sum = 0.0, sum_squares = 0.0;
+	int32_t min_ua = INT32_MAX, max_ua = INT32_MIN;
+	srand(1);
+	for (uint32_t i = 0; i < kNumSamples; i++) {
+		// Big offset with some noise on it, the case where a naive sum of squares loses the variance.
+		int32_t current_ua = 150000 + (rand() % 2001) - 1000;
+		stats.AddSample(current_ua, i*10);
+		sum += current_ua;
+		sum_squares += static_cast<double>(current_ua)*current_ua;
+		min_ua = current_ua < min_ua ? current_ua : min_ua;
+		max_ua = current_ua > max_ua ? current_ua : max_ua;
+	}
+	double mean = sum / kNumSamples;
+	double mean_square = sum_squares / kNumSamples;
+
+	CurrentStats::Summary_t summary = stats.GetSummary();
+	ASSERT_EQ(summary.num_samples, kNumSamples);
+	ASSERT_NEAR(summary.mean_ua, mean, 1.0);
+	ASSERT_EQ(summary.min_ua, min_ua);
+	ASSERT_EQ(summary.max_ua, max_ua);
+	ASSERT_NEAR(summary.rms_ua, sqrt(mean_square), 1.0);
+	ASSERT_NEAR(summary.stddev_ua, sqrt(mean_square - mean*mean), 1.0);
+}
+
+TEST(CurrentStats, NegativeCurrents) {
+	CurrentStats stats = CurrentStats();
+	int32_t samples[] = {-3000, -1000, 1000, 3000};
+	for (uint16_t i = 0; i < 4; i++) {
+		stats.AddSample(samples[i], i*1000);
+	}
+	CurrentStats::Summary_t summary = stats.GetSummary();
+	ASSERT_EQ(summary.mean_ua, 0);
+	ASSERT_EQ(summary.min_ua, -3000);
+	ASSERT_EQ(summary.max_ua, 3000);
+	ASSERT_NEAR(summary.rms_ua, sqrt(5e6), 1.0);
+	ASSERT_NEAR(summary.stddev_ua, sqrt(5e6), 1.0);
+	ASSERT_EQ(stats.GetChargeNC(), 3000); // first sample has no interval before it
+}
+
+TEST(CurrentStats, WindowRollover) {
+	CurrentStats stats = CurrentStats();
+	stats.SetWindowMs(10);
+	uint32_t timestamp_us = 0xFFFF0000; // make sure wrapping is handled
+	for (uint16_t i = 0; i < 100; i++, timestamp_us += 100) {
+		stats.AddSample(1000, timestamp_us);
+	}
+	ASSERT_EQ(stats.GetSummary().num_samples, 0u); // first window isn't over yet
+	for (uint16_t i = 0; i < 100; i++, timestamp_us += 100) {
+		stats.AddSample(2000 + i, timestamp_us);
+	}
+	CurrentStats::Summary_t summary = stats.GetSummary();
+	ASSERT_EQ(summary.num_samples, 100u);
+	ASSERT_EQ(summary.mean_ua, 1000);
+	ASSERT_EQ(summary.max_ua, 1000);
+	stats.AddSample(0, timestamp_us);
+	summary = stats.GetSummary();
+	ASSERT_EQ(summary.num_samples, 100u);
+	ASSERT_EQ(summary.min_ua, 2000);
+	ASSERT_EQ(summary.max_ua, 2099);
+	ASSERT_EQ(summary.mean_ua, 2050); // 2049.5 rounds up
+
+	stats.ResetWindow();
+	ASSERT_EQ(stats.GetSummary().num_samples, 0u);
+	ASSERT_EQ(stats.GetWindowMs(), 10u);
+}
+
+TEST(CurrentStats, CoulombCounting) {
+	CurrentStats stats = CurrentStats();
+	for (uint32_t i = 0; i <= 1000; i++) {
+		stats.AddSample(100000, i*1000); // 100mA for 1s
+	}
+	ASSERT_EQ(stats.GetChargeNC(), 100000000); // 0.1C
+	for (uint32_t i = 1001; i <= 1500; i++) {
+		stats.AddSample(-200000, i*1000); // charge at 200mA for 0.5s
+	}
+	ASSERT_EQ(stats.GetChargeNC(), 0);
+	stats.SetChargeNC(0);
+	ASSERT_EQ(stats.GetChargeNC(), 0);
+}
@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "flash_store.hh"
+#include "pico/stdlib.h"
+#include <string.h>
+
+// Top of flash, same place a cell keeps its settings by default.
+static const uint16_t kTestNumSectors = 4;
+static const uint32_t kTestFlashOffset = PICO_FLASH_SIZE_BYTES - kTestNumSectors * FLASH_SECTOR_SIZE;
+static const uint16_t kTestSlotsPerSector = FLASH_SECTOR_SIZE / FlashStore::kSlotLen;
+
+typedef struct {
+	uint32_t counter;
+	float value;
+} TestRecord_t;
+
+static FlashStore BlankFlashStore() {
+	flash_range_erase(kTestFlashOffset, kTestNumSectors * FLASH_SECTOR_SIZE);
+	return FlashStore(kTestFlashOffset, kTestNumSectors);
+}
+
+TEST(FlashStore, BlankRegionLoadsNothing) {
+	FlashStore store = BlankFlashStore();
+	TestRecord_t record = {123, 4.5f};
+	ASSERT_FALSE(store.Load(&record, sizeof(record)));
+	ASSERT_EQ(record.counter, 123u); // left alone
+	ASSERT_EQ(store.GetSequence(), 0u);
+}
+
+TEST(FlashStore, SurvivesReboot) {
+	FlashStore store = BlankFlashStore();
+	TestRecord_t record = {1, 3.7f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+	record = {2, 3.8f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+
+	FlashStore rebooted_store = FlashStore(kTestFlashOffset, kTestNumSectors);
+	TestRecord_t loaded_record;
+	ASSERT_TRUE(rebooted_store.Load(&loaded_record, sizeof(loaded_record)));
+	ASSERT_EQ(loaded_record.counter, 2u);
+	ASSERT_FLOAT_EQ(loaded_record.value, 3.8f);
+	ASSERT_EQ(rebooted_store.GetSequence(), 2u);
+}
+
+TEST(FlashStore, WrongLengthNotLoaded) {
+	FlashStore store = BlankFlashStore();
+	TestRecord_t record = {1, 3.7f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+	uint32_t short_record = 0;
+	ASSERT_FALSE(store.Load(&short_record, sizeof(short_record)));
+	ASSERT_FALSE(store.Save(&record, FlashStore::kMaxRecordLen+1));
+}
+
+TEST(FlashStore, WearLevelling) {
+	FlashStore store = BlankFlashStore();
+	uint32_t erases_before[kTestNumSectors];
+	for (uint16_t sector = 0; sector < kTestNumSectors; sector++) {
+		erases_before[sector] = fake_flash_get_num_erases(kTestFlashOffset + sector * FLASH_SECTOR_SIZE);
+	}
+	const uint16_t kNumLaps = 5;
+	const uint32_t kNumSaves = kNumLaps * kTestNumSectors * kTestSlotsPerSector;
+	for (uint32_t i = 1; i <= kNumSaves; i++) {
+		TestRecord_t record = {i, 0.0f};
+		ASSERT_TRUE(store.Save(&record, sizeof(record)));
+
+		// Rebooting at any point finds the newest record.
+		if (i % 7 == 0) {
+			store = FlashStore(kTestFlashOffset, kTestNumSectors);
+			TestRecord_t loaded_record;
+			ASSERT_TRUE(store.Load(&loaded_record, sizeof(loaded_record)));
+			ASSERT_EQ(loaded_record.counter, i);
+		}
+	}
+	// Every sector gets erased once per lap around the region, instead of one sector once per save.
+	for (uint16_t sector = 0; sector < kTestNumSectors; sector++) {
+		uint32_t num_erases = fake_flash_get_num_erases(kTestFlashOffset + sector * FLASH_SECTOR_SIZE) - erases_before[sector];
+		ASSERT_EQ(num_erases, kNumLaps);
+	}
+}
+
+TEST(FlashStore, TornSaveFallsBackToPreviousRecord) {
+	FlashStore store = BlankFlashStore();
+	TestRecord_t record = {1, 1.0f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+
+	// Power lost part way through programming the next record: the header made it but only some of the record did.
+	record = {2, 2.0f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+	uint8_t torn_page[FLASH_PAGE_SIZE];
+	memcpy(torn_page, reinterpret_cast<const uint8_t *>(XIP_BASE + kTestFlashOffset + FlashStore::kSlotLen), FLASH_PAGE_SIZE);
+	flash_range_erase(kTestFlashOffset, FLASH_SECTOR_SIZE);
+	record = {1, 1.0f};
+	store = FlashStore(kTestFlashOffset, kTestNumSectors);
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+	torn_page[sizeof(FlashStore::SlotHeader_t) + sizeof(TestRecord_t) - 1] = 0xFF; // never got programmed
+	flash_range_program(kTestFlashOffset + FlashStore::kSlotLen, torn_page, FLASH_PAGE_SIZE);
+
+	FlashStore rebooted_store = FlashStore(kTestFlashOffset, kTestNumSectors);
+	TestRecord_t loaded_record;
+	ASSERT_TRUE(rebooted_store.Load(&loaded_record, sizeof(loaded_record)));
+	ASSERT_EQ(loaded_record.counter, 1u);
+
+	// The torn slot can't be programmed again without an erase, so the next save skips to a fresh sector.
+	record = {3, 3.0f};
+	ASSERT_TRUE(rebooted_store.Save(&record, sizeof(record)));
+	FlashStore rebooted_again_store = FlashStore(kTestFlashOffset, kTestNumSectors);
+	ASSERT_TRUE(rebooted_again_store.Load(&loaded_record, sizeof(loaded_record)));
+	ASSERT_EQ(loaded_record.counter, 3u);
+}
+
+TEST(FlashStore, Erase) {
+	FlashStore store = BlankFlashStore();
+	TestRecord_t record = {1, 1.0f};
+	ASSERT_TRUE(store.Save(&record, sizeof(record)));
+	store.Erase();
+	ASSERT_EQ(store.GetSequence(), 0u);
+	FlashStore rebooted_store = FlashStore(kTestFlashOffset, kTestNumSectors);
+	ASSERT_FALSE(rebooted_store.Load(&record, sizeof(record)));
+}
@@ -0,0 +1,230 @@
+#include "gtest/gtest.h"
+#include "scbs_analyzer.hh"
+#include "scbs_capture.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Frames packet contents (e.g. "BSSRD#1,2,2000") into a line with a good checksum.
+*/
+static std::string MakeLine(const char * contents) {
+	uint8_t checksum = 0;
+	for (const char * c = contents; *c != '\0'; c++) {
+		checksum ^= *c;
+	}
+	char line[BSPacket::kMaxPacketLen];
+	snprintf(line, sizeof(line), "$%s*%02X\r\n", contents, checksum);
+	return line;
+}
+
+/**
+ * Analyzer with everything it reports collected, fed one line at a time.
+*/
+class AnalyzedLink {
+public:
+	AnalyzedLink(SCBSAnalyzer::Config_t config)
+		: analyzer(config)
+	{
+		analyzer.SetExchangeCallback([this](const SCBSAnalyzer::Exchange_t & exchange) {
+			exchanges.push_back(exchange);
+		});
+		analyzer.SetFlagCallback([this](const SCBSAnalyzer::Flag_t & flag) {
+			flags.push_back(flag);
+		});
+		analyzer.SetIntervalCallback([this](const SCBSAnalyzer::Interval_t & interval) {
+			intervals.push_back(interval);
+		});
+	}
+
+	void Send(uint64_t time_us, const std::string & line) {
+		analyzer.Feed(SCBSCapture::TO_CHAIN, time_us, line.data(), line.size());
+	}
+	void Receive(uint64_t time_us, const std::string & line) {
+		analyzer.Feed(SCBSCapture::FROM_CHAIN, time_us, line.data(), line.size());
+	}
+
+	SCBSAnalyzer analyzer;
+	std::vector<SCBSAnalyzer::Exchange_t> exchanges;
+	std::vector<SCBSAnalyzer::Flag_t> flags;
+	std::vector<SCBSAnalyzer::Interval_t> intervals;
+};
+
+TEST(SCBSAnalyzer, MatchesRequestsToResponses) {
+	SCBSAnalyzer::Config_t config;
+	config.num_cells = 3;
+	AnalyzedLink link(config);
+
+	// Tagged SRD answered by its cell.
+	link.Send(1000, MakeLine("BSSRD#1,2,2000"));
+	link.Receive(1500, MakeLine("BSSRS#1,2,1.25"));
+	ASSERT_EQ(link.exchanges.size(), 1u);
+	ASSERT_EQ(link.exchanges[0].outcome, SCBSAnalyzer::ANSWERED);
+	ASSERT_EQ(link.exchanges[0].packet_type, BSPacket::SRD);
+	ASSERT_EQ(link.exchanges[0].tag, 1u);
+	ASSERT_EQ(link.exchanges[0].latency_us, 500u);
+	ASSERT_EQ(link.exchanges[0].per_hop_us, 125u); // 4 links in a chain of 3 cells
+
+	// Untagged DIS, split across chunks, comes back as itself.
+	std::string dis = MakeLine("BSDIS,0");
+	link.Send(2000, dis.substr(0, 4));
+	link.Send(2100, dis.substr(4));
+	link.Receive(3100, MakeLine("BSDIS,3"));
+	ASSERT_EQ(link.exchanges.size(), 2u);
+	ASSERT_EQ(link.exchanges[1].outcome, SCBSAnalyzer::ANSWERED);
+	ASSERT_EQ(link.exchanges[1].tag, static_cast<uint16_t>(BSPacket::kNoTag));
+	ASSERT_EQ(link.exchanges[1].latency_us, 1000u);
+
+	// SRD for a cell that isn't there comes back around the chain.
+	link.Send(4000, MakeLine("BSSRD#2,9,2000"));
+	link.Receive(5000, MakeLine("BSSRD#2,9,2000"));
+	ASSERT_EQ(link.exchanges.size(), 3u);
+	ASSERT_EQ(link.exchanges[2].outcome, SCBSAnalyzer::ERROR);
+	ASSERT_EQ(link.exchanges[2].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNotAnswered));
+
+	// Multicast SRD waits for the SRD after every cell's SRS, and keeps the first error.
+	link.Send(6000, MakeLine("BSSRD#3,1-3,2000"));
+	link.Receive(6500, MakeLine("BSSRS#3,1,1.25"));
+	link.Receive(6600, MakeLine("BSSRS#3,2,ERR:1"));
+	link.Receive(6700, MakeLine("BSSRS#3,3,1.25"));
+	ASSERT_EQ(link.exchanges.size(), 3u);
+	link.Receive(7000, MakeLine("BSSRD#3,1-3,2000"));
+	ASSERT_EQ(link.exchanges.size(), 4u);
+	ASSERT_EQ(link.exchanges[3].outcome, SCBSAnalyzer::ERROR);
+	ASSERT_EQ(link.exchanges[3].err_code, 1u);
+	ASSERT_EQ(link.exchanges[3].err_cell_id, 2u);
+	ASSERT_EQ(link.exchanges[3].latency_us, 1000u);
+
+	// Nothing waiting for this one.
+	link.Receive(8000, MakeLine("BSSRS#7,1,1.25"));
+	ASSERT_EQ(link.flags.size(), 1u);
+	ASSERT_EQ(link.flags[0].flag_type, SCBSAnalyzer::UNSOLICITED);
+
+	const SCBSAnalyzer::Summary_t & summary = link.analyzer.GetSummary();
+	ASSERT_EQ(summary.num_cells, 3u);
+	ASSERT_EQ(summary.num_requests[BSPacket::SRD], 3u);
+	ASSERT_EQ(summary.num_requests[BSPacket::DIS], 1u);
+	ASSERT_EQ(summary.num_outcomes[SCBSAnalyzer::ANSWERED], 2u);
+	ASSERT_EQ(summary.num_outcomes[SCBSAnalyzer::ERROR], 2u);
+	ASSERT_EQ(summary.latency_us.GetCount(), 4u);
+	ASSERT_EQ(summary.num_packets[SCBSCapture::FROM_CHAIN], 8u);
+}
+
+TEST(SCBSAnalyzer, FlagsBadLinesRetriesAndTimeouts) {
+	SCBSAnalyzer::Config_t config;
+	config.timeout_us = 100000;
+	config.interval_us = 100000;
+	AnalyzedLink link(config);
+
+	// Number of cells comes from the DIS.
+	link.Send(1000, MakeLine("BSDIS,0"));
+	link.Receive(2000, MakeLine("BSDIS,4"));
+	ASSERT_EQ(link.analyzer.GetSummary().num_cells, 4u);
+	ASSERT_EQ(link.exchanges.back().per_hop_us, 200u);
+
+	link.Receive(3000, "$BSSRS#1,2,1.25*00\r\n");
+	link.Receive(3100, "line noise\r\n");
+	link.Send(3200, "$BSXYZ,1*00\r\n");
+	link.Receive(3300, std::string(BSPacket::kMaxPacketLen + 10, 'x') + "\r\n");
+	ASSERT_EQ(link.flags.size(), 4u);
+	ASSERT_EQ(link.flags[0].flag_type, SCBSAnalyzer::CHECKSUM_FAILURE);
+	ASSERT_EQ(link.flags[0].direction, SCBSCapture::FROM_CHAIN);
+	ASSERT_EQ(link.flags[1].flag_type, SCBSAnalyzer::MALFORMED);
+	ASSERT_EQ(link.flags[2].flag_type, SCBSAnalyzer::MALFORMED);
+	ASSERT_EQ(link.flags[2].direction, SCBSCapture::TO_CHAIN);
+	ASSERT_EQ(link.flags[3].flag_type, SCBSAnalyzer::MALFORMED);
+
+	// Untagged request sent again before it was answered.
+	link.Send(10000, MakeLine("BSSRD,2,2000"));
+	link.Send(20000, MakeLine("BSSRD,2,2000"));
+	ASSERT_EQ(link.flags.size(), 5u);
+	ASSERT_EQ(link.flags[4].flag_type, SCBSAnalyzer::RETRY);
+	ASSERT_EQ(link.exchanges.size(), 2u);
+	ASSERT_EQ(link.exchanges[1].outcome, SCBSAnalyzer::RETRIED);
+	link.Receive(25000, MakeLine("BSSRS,2,1.25"));
+	ASSERT_EQ(link.exchanges.size(), 3u);
+	ASSERT_EQ(link.exchanges[2].outcome, SCBSAnalyzer::ANSWERED);
+	ASSERT_EQ(link.exchanges[2].latency_us, 5000u);
+
+	// Tagged request that times out, then is sent again with a new tag.
+	link.Send(30000, MakeLine("BSSRD#5,3,2000"));
+	link.Send(140000, MakeLine("BSSRD#6,3,2000"));
+	ASSERT_EQ(link.exchanges.size(), 4u);
+	ASSERT_EQ(link.exchanges[3].outcome, SCBSAnalyzer::UNANSWERED);
+	ASSERT_EQ(link.exchanges[3].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeTimeout));
+	ASSERT_EQ(link.exchanges[3].tag, 5u);
+	ASSERT_EQ(link.flags.size(), 6u);
+	ASSERT_EQ(link.flags[5].flag_type, SCBSAnalyzer::RETRY);
+
+	// Same request with a different tag while the first is outstanding is pipelining, not a retry.
+	link.Send(150000, MakeLine("BSSRD#7,3,2000"));
+	ASSERT_EQ(link.flags.size(), 6u);
+
+	link.analyzer.Finish();
+	ASSERT_EQ(link.exchanges.size(), 6u);
+	ASSERT_EQ(link.exchanges[4].outcome, SCBSAnalyzer::UNANSWERED);
+	ASSERT_EQ(link.exchanges[4].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeDisconnected));
+
+	// Intervals from 0 to 100 ms and 100 to 200 ms.
+	ASSERT_EQ(link.intervals.size(), 2u);
+	ASSERT_EQ(link.intervals[0].start_time_us, 0u);
+	ASSERT_EQ(link.intervals[0].num_requests, 4u);
+	ASSERT_EQ(link.intervals[0].num_flags[SCBSAnalyzer::MALFORMED], 3u);
+	ASSERT_EQ(link.intervals[0].latency_us.GetCount(), 2u);
+	ASSERT_EQ(link.intervals[1].start_time_us, 100000u);
+	ASSERT_EQ(link.intervals[1].num_requests, 2u);
+	ASSERT_EQ(link.intervals[1].num_unanswered, 3u);
+
+	const SCBSAnalyzer::Summary_t & summary = link.analyzer.GetSummary();
+	ASSERT_EQ(summary.num_flags[SCBSCapture::TO_CHAIN][SCBSAnalyzer::RETRY], 2u);
+	ASSERT_EQ(summary.num_flags[SCBSCapture::FROM_CHAIN][SCBSAnalyzer::CHECKSUM_FAILURE], 1u);
+	ASSERT_EQ(summary.num_outcomes[SCBSAnalyzer::UNANSWERED], 3u);
+	ASSERT_EQ(summary.num_outcomes[SCBSAnalyzer::RETRIED], 1u);
+	ASSERT_EQ(summary.duration_us, 150000u);
+}
+
+TEST(SCBSAnalyzer, AnalyzeCaptureFile) {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/scbs_test_analyzer_%d.scap", getpid());
+	SCBSCaptureWriter writer;
+	ASSERT_TRUE(writer.Open(path, SerialPort::kDefaultBaud));
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	for (uint16_t tag = 1; tag <= 10; tag++) {
+		char contents[BSPacket::kMaxPacketLen];
+		snprintf(contents, sizeof(contents), "BSSRD#%X,1,2000", tag);
+		std::string request = MakeLine(contents);
+		snprintf(contents, sizeof(contents), "BSSRS#%X,1,1.25", tag);
+		std::string response = MakeLine(contents);
+		ASSERT_TRUE(writer.Write(SCBSCapture::TO_CHAIN, start_time_us + 10000 * tag, request.data(), request.size()));
+		ASSERT_TRUE(writer.Write(SCBSCapture::FROM_CHAIN, start_time_us + 10000 * tag + 2000, response.data(),
+			response.size()));
+	}
+	writer.Close();
+
+	SCBSCaptureReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	SCBSAnalyzer analyzer;
+	ASSERT_TRUE(analyzer.Analyze(reader));
+	const SCBSAnalyzer::Summary_t & summary = analyzer.GetSummary();
+	ASSERT_EQ(summary.num_requests[BSPacket::SRD], 10u);
+	ASSERT_EQ(summary.num_outcomes[SCBSAnalyzer::ANSWERED], 10u);
+	ASSERT_EQ(summary.latency_us.GetMin(), 2000u);
+	ASSERT_EQ(summary.latency_us.GetMax(), 2000u);
+	ASSERT_EQ(summary.num_cells, 0u); // no DIS to learn it from
+	ASSERT_EQ(summary.per_hop_us.GetCount(), 0u);
+	uint64_t size = reader.GetSize();
+	reader.Close();
+
+	// A capture cut off partway through a record still gives everything before it.
+	ASSERT_EQ(truncate(path, size - 5), 0);
+	ASSERT_TRUE(reader.Open(path));
+	SCBSAnalyzer truncated_analyzer;
+	ASSERT_FALSE(truncated_analyzer.Analyze(reader));
+	ASSERT_EQ(truncated_analyzer.GetSummary().num_outcomes[SCBSAnalyzer::ANSWERED], 9u);
+	ASSERT_EQ(truncated_analyzer.GetSummary().num_outcomes[SCBSAnalyzer::UNANSWERED], 1u);
+	reader.Close();
+	unlink(path);
+}
@@ -0,0 +1,288 @@
+#include "gtest/gtest.h"
+#include "scbs_capture.hh"
+#include "scbs_capture_proxy.hh"
+#include "scbs_replay.hh"
+#include "scbs_master.hh"
+#include "scbs_simulated_chain.hh"
+#include "scbs_comms.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Simulated chain with a capture proxy in front of it and the master talking to the chain through the proxy, like a
+ * host tool run under scbscap.
+*/
+class ProxiedChain : public SimulatedChain {
+public:
+	ProxiedChain(uint16_t num_cells, const char * capture_path)
+		: SimulatedChain(num_cells, SCBSMaster::SCBSMasterConfig_t(), true)
+		, proxy(reactor, writer)
+	{
+		EXPECT_TRUE(writer.Open(capture_path, SerialPort::kDefaultBaud));
+		EXPECT_TRUE(proxy.Open(pty->GetPortPath()));
+		Start(proxy.GetPortPath());
+	}
+	~ProxiedChain() {
+		Stop();
+		master.Stop();
+		proxy.Close();
+		writer.Close();
+	}
+
+	SCBSCaptureWriter writer;
+	SCBSCaptureProxy proxy;
+};
+
+/**
+ * Capture proxy in front of a bare pty standing in for the chain, so that a test can hold the chain's side back or
+ * hang it up. The test plays the host tool through host_fd.
+*/
+class ProxiedPty {
+public:
+	ProxiedPty(const char * capture_path)
+		: proxy(reactor, writer)
+	{
+		chain_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+		EXPECT_TRUE(chain_fd >= 0 && grantpt(chain_fd) == 0 && unlockpt(chain_fd) == 0);
+		EXPECT_TRUE(writer.Open(capture_path, SerialPort::kDefaultBaud));
+		EXPECT_TRUE(proxy.Open(ptsname(chain_fd)));
+		host_fd = open(proxy.GetPortPath(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+		EXPECT_GE(host_fd, 0);
+	}
+	~ProxiedPty() {
+		if (reactor_thread.joinable()) {
+			reactor.Stop();
+			reactor_thread.join();
+		}
+		proxy.Close();
+		writer.Close();
+		close(host_fd);
+		if (chain_fd >= 0) {
+			close(chain_fd);
+		}
+	}
+
+	void Start() {
+		reactor_thread = std::thread([this]() { reactor.Run(); });
+	}
+	SCBSCaptureProxy::Stats_t GetStats() {
+		std::promise<SCBSCaptureProxy::Stats_t> stats;
+		reactor.Post([this, &stats]() { stats.set_value(proxy.GetStats()); });
+		return stats.get_future().get();
+	}
+
+	Reactor reactor;
+	std::thread reactor_thread;
+	SCBSCaptureWriter writer;
+	SCBSCaptureProxy proxy;
+	int chain_fd = -1;
+	int host_fd = -1;
+};
+
+static std::string GetCapturePath(const char * name) {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/scbs_test_%s_%d.scap", name, getpid());
+	return path;
+}
+
+TEST(SCBSCapture, FileRoundTrip) {
+	std::string path = GetCapturePath("round_trip");
+	SCBSCaptureWriter writer;
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	ASSERT_TRUE(writer.Open(path.c_str(), 115200));
+	std::string long_chunk(SCBSCapture::kMaxRecordLen + 10, 'x');
+	ASSERT_TRUE(writer.Write(SCBSCapture::TO_CHAIN, start_time_us + 1000, "$BSDIS,0*53\r\n", 13));
+	ASSERT_TRUE(writer.Write(SCBSCapture::FROM_CHAIN, start_time_us + 250000, "$BSDIS,3*50\r\n", 13));
+	ASSERT_TRUE(writer.Write(SCBSCapture::FROM_CHAIN, start_time_us + 200000, "late", 4)); // stays in order
+	ASSERT_TRUE(writer.Write(SCBSCapture::FROM_CHAIN, start_time_us + 300000, "", 0)); // nothing to record
+	ASSERT_TRUE(writer.Write(SCBSCapture::TO_CHAIN, start_time_us + 5000000000ull, long_chunk.data(), long_chunk.size()));
+	SCBSCaptureWriter::Stats_t stats = writer.GetStats();
+	ASSERT_EQ(stats.num_records, 5u);
+	ASSERT_EQ(stats.num_chars[SCBSCapture::TO_CHAIN], 13u + long_chunk.size());
+	ASSERT_EQ(stats.num_chars[SCBSCapture::FROM_CHAIN], 17u);
+	writer.Close();
+
+	SCBSCaptureReader reader;
+	ASSERT_TRUE(reader.Open(path.c_str()));
+	ASSERT_EQ(reader.GetHeader().baud, 115200u);
+	ASSERT_GT(reader.GetHeader().start_time_us, 0u);
+	SCBSCapture::Record_t record;
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.direction, SCBSCapture::TO_CHAIN);
+	ASSERT_LE(record.time_us, 1000u); // counted from Open(), which was a little after start_time_us
+	ASSERT_EQ(record.chars, "$BSDIS,0*53\r\n");
+	uint64_t first_time_us = record.time_us;
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.direction, SCBSCapture::FROM_CHAIN);
+	ASSERT_EQ(record.time_us - first_time_us, 249000u);
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.time_us - first_time_us, 249000u);
+	ASSERT_EQ(record.chars, "late");
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.chars.size(), static_cast<size_t>(SCBSCapture::kMaxRecordLen));
+	ASSERT_EQ(record.time_us - first_time_us, 5000000000ull - 1000);
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.chars, std::string(10, 'x'));
+	ASSERT_FALSE(reader.Next(record));
+
+	ASSERT_TRUE(reader.Rewind());
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_EQ(record.chars, "$BSDIS,0*53\r\n");
+	reader.Close();
+
+	// A capture cut off mid-record still reads up to where it was cut off.
+	ASSERT_EQ(truncate(path.c_str(), SCBSCapture::kHeaderLen + 20), 0);
+	ASSERT_TRUE(reader.Open(path.c_str()));
+	ASSERT_TRUE(reader.Next(record));
+	ASSERT_FALSE(reader.Next(record));
+	reader.Close();
+
+	FILE * file = fopen(path.c_str(), "r+b");
+	fputs("NOTACAP", file);
+	fclose(file);
+	ASSERT_FALSE(reader.Open(path.c_str()));
+	unlink(path.c_str());
+}
+
+/**
+ * Captures a session with a real time chain, then replays it into fresh simulated chains. The chains answer with the
+ * same packets as the original, every replay is identical to the last, and dropping the gaps gets through it faster.
+*/
+TEST(SCBSCapture, CaptureAndReplay) {
+	const uint16_t num_cells = 3;
+	std::string path = GetCapturePath("replay");
+	uint32_t num_requests = 0;
+	uint64_t session_us = 0;
+	{
+		ProxiedChain sim(num_cells, path.c_str());
+		uint64_t start_time_us = Reactor::GetTimeUs();
+		DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+		ASSERT_EQ(sim.master.Send(dis).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		SWRPacket swr = SWRPacket(2, 0x1000u, (char *)"2.50");
+		ASSERT_EQ(sim.master.Send(swr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		std::vector<std::future<SCBSMaster::Response_t>> responses;
+		for (uint16_t i = 0; i < 6; i++) {
+			SRDPacket srd = SRDPacket(i % num_cells + 1, 0x1000u);
+			responses.push_back(sim.master.Send(srd));
+		}
+		for (size_t i = 0; i < responses.size(); i++) {
+			ASSERT_EQ(responses[i].get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		}
+		usleep(100000); // idle gap, kept by an original timing replay
+		char no_values[1][BSPacket::kMaxPacketFieldLen];
+		MRDPacket mrd = MRDPacket(0x1000u, no_values, 0);
+		ASSERT_EQ(sim.master.Send(mrd).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		session_us = Reactor::GetTimeUs() - start_time_us;
+		num_requests = sim.master.GetStats().num_sent;
+	}
+	ASSERT_EQ(num_requests, 9u);
+
+	SCBSCaptureReader reader;
+	ASSERT_TRUE(reader.Open(path.c_str()));
+	SCBSReplay::Result_t original;
+	{
+		SCBSChainSim chain(num_cells, true);
+		original = SCBSReplay(chain).Run(reader);
+	}
+	printf("SCBSCapture: %u records over %lu us (session took %lu us), replayed in %lu us of fake time.\r\n",
+		original.num_records, original.captured_duration_us, session_us, original.replayed_duration_us);
+	ASSERT_EQ(original.num_packets_sent, num_requests);
+	ASSERT_EQ(original.num_packets_captured, num_requests);
+	ASSERT_EQ(original.num_packets_received, num_requests);
+	ASSERT_EQ(original.num_packets_matched, num_requests);
+	ASSERT_EQ(original.latency_us.GetCount(), num_requests);
+	ASSERT_GE(original.replayed_duration_us, original.captured_duration_us);
+	ASSERT_GT(original.captured_duration_us, 100000u);
+	ASSERT_EQ(original.received_packet_strs[1].find("$BSSRS#2,2,OK*"), 0u);
+
+	SCBSReplay::Result_t again;
+	{
+		SCBSChainSim chain(num_cells, true);
+		again = SCBSReplay(chain).Run(reader);
+	}
+	ASSERT_EQ(again.received_packet_strs, original.received_packet_strs);
+	ASSERT_EQ(again.replayed_duration_us, original.replayed_duration_us);
+	ASSERT_EQ(again.latency_us.GetValueAtPercentile(50.0), original.latency_us.GetValueAtPercentile(50.0));
+	ASSERT_EQ(again.latency_us.GetMax(), original.latency_us.GetMax());
+
+	SCBSReplay::Result_t fast;
+	{
+		SCBSChainSim chain(num_cells, true);
+		fast = SCBSReplay(chain).Run(reader, SCBSReplay::AS_FAST_AS_POSSIBLE);
+	}
+	ASSERT_EQ(fast.num_packets_matched, num_requests);
+	ASSERT_LT(fast.replayed_duration_us, original.replayed_duration_us);
+	reader.Close();
+	unlink(path.c_str());
+}
+
+/**
+ * While the chain isn't taking characters, the proxy leaves what the host tool sends in the pty, so the host tool's
+ * writes back up instead of the proxy buffering without limit. Everything still gets through once the chain drains.
+*/
+TEST(SCBSCapture, ProxyPushesBackOnHostTool) {
+	std::string path = GetCapturePath("push_back");
+	ProxiedPty sim(path.c_str());
+	sim.Start();
+
+	const size_t num_chars = 1 << 20; // far more than the ptys hold between them
+	std::string sent;
+	for (size_t i = 0; i < num_chars; i++) {
+		sent += static_cast<char>('0' + i % 64);
+	}
+	size_t num_written = 0;
+	for (int i = 0; i < 50 && num_written < num_chars; i++) {
+		ssize_t ret;
+		while ((ret = write(sim.host_fd, sent.data() + num_written, num_chars - num_written)) > 0) {
+			num_written += ret;
+		}
+		usleep(2000);
+	}
+	ASSERT_LT(num_written, num_chars);
+	ASSERT_LT(sim.GetStats().num_chars_to_chain, num_written); // the rest is still in the pty
+
+	std::string received;
+	char chars_buf[4096];
+	std::chrono::steady_clock::time_point give_up_time = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (received.size() < num_chars && std::chrono::steady_clock::now() < give_up_time) {
+		ssize_t ret;
+		while ((ret = read(sim.chain_fd, chars_buf, sizeof(chars_buf))) > 0) {
+			received.append(chars_buf, ret);
+		}
+		while (num_written < num_chars && (ret = write(sim.host_fd, sent.data() + num_written,
+			num_chars - num_written)) > 0) {
+			num_written += ret;
+		}
+		usleep(1000);
+	}
+	ASSERT_EQ(received.size(), num_chars);
+	ASSERT_TRUE(received == sent);
+	ASSERT_EQ(sim.GetStats().num_chars_to_chain, num_chars);
+	unlink(path.c_str());
+}
+
+/**
+ * When the chain's port hangs up, the proxy closes everything and says so, so scbscap can stop instead of running on
+ * with nothing to capture.
+*/
+TEST(SCBSCapture, ProxyReportsChainHangUp) {
+	std::string path = GetCapturePath("hang_up");
+	ProxiedPty sim(path.c_str());
+	std::promise<void> hung_up;
+	sim.proxy.SetHangUpCallback([&hung_up]() { hung_up.set_value(); });
+	sim.Start();
+
+	ASSERT_EQ(write(sim.host_fd, "$BSDIS,0*53\r\n", 13), 13);
+	close(sim.chain_fd);
+	sim.chain_fd = -1;
+	ASSERT_EQ(hung_up.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+	unlink(path.c_str());
+}
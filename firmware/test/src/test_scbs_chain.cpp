@@ -0,0 +1,1153 @@
+#include "gtest/gtest.h"
+#include "scbs_chain_sim.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * Sends a packet into the chain, runs the chain until it settles, and reads back the first packet that comes out.
+ * Returns false if nothing came back.
+*/
+template <class PacketType>
+static bool Transact(SCBSChainSim & chain, PacketType packet, char response_buf[BSPacket::kMaxPacketLen]) {
+	char request_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(request_buf);
+	chain.HostTransmit(request_buf);
+	chain.RunUntilIdle();
+	return chain.HostReceive(response_buf) > 0;
+}
+
+static void Enumerate(SCBSChainSim & chain) {
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, DISPacket(static_cast<uint16_t>(0)), response_buf));
+	DISPacket response = DISPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.last_cell_id, chain.GetNumCells());
+}
+
+TEST(SCBSChain, Discover) {
+	SCBSChainSim chain(5);
+	Enumerate(chain);
+	for (uint16_t i = 0; i < chain.GetNumCells(); i++) {
+		ASSERT_EQ(chain.GetCell(i)->GetCellID(), i+1);
+	}
+}
+
+TEST(SCBSChain, VectorWriteSetsEachCell) {
+	const uint16_t num_cells = 4;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1.00", "2.00", "3.00", "4.00"};
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x1000u, values, num_cells), response_buf));
+
+	// All values should have been consumed by the time the packet makes it back to the host.
+	VWRPacket vwr_response = VWRPacket(response_buf);
+	ASSERT_TRUE(vwr_response.IsValid());
+	ASSERT_EQ(vwr_response.num_values, 0);
+	ASSERT_EQ(chain.HostReceive(response_buf), 0); // exactly one frame out
+
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		ASSERT_TRUE(Transact(chain, SRDPacket(cell_id, 0x1000u), response_buf));
+		SRSPacket srs_response = SRSPacket(response_buf);
+		ASSERT_TRUE(srs_response.IsValid());
+		ASSERT_EQ(srs_response.cell_id, cell_id);
+		ASSERT_FLOAT_EQ(strtof(srs_response.values[0], NULL), static_cast<float>(cell_id));
+	}
+}
+
+TEST(SCBSChain, VectorWriteShortListLeavesTailCellsAlone) {
+	SCBSChainSim chain(3);
+	Enumerate(chain);
+
+	char values[][BSPacket::kMaxPacketFieldLen] = {"2.50"};
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x1000u, values, 1), response_buf));
+	ASSERT_TRUE(VWRPacket(response_buf).IsValid());
+
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x1000u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "2.50");
+	ASSERT_TRUE(Transact(chain, SRDPacket(3, 0x1000u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0.00");
+}
+
+TEST(SCBSChain, VectorWriteBadRegisterReturnsError) {
+	SCBSChainSim chain(3);
+	Enumerate(chain);
+
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1", "2", "3"};
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x2000u, values, 3), response_buf)); // current is read only
+	SRSPacket response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.cell_id, 1);
+	ASSERT_STREQ(response.values[0], "ERR:3");
+}
+
+TEST(SCBSChain, MultiRegisterMultiRead) {
+	const uint16_t num_cells = 3;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1.50", "2.50", "3.50"};
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x1000u, values, num_cells), response_buf));
+	chain.SetCellADCCounts(1, 1<<11); // half scale
+	chain.Step(); // let the cells sample the new current
+
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u};
+	char no_values[][BSPacket::kMaxPacketFieldLen] = {""};
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 2, no_values, 0), response_buf));
+	MRDPacket response = MRDPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.num_reg_addrs, 2);
+	ASSERT_EQ(response.num_values, 2*num_cells); // one (voltage, current) tuple per cell
+	ASSERT_STREQ(response.values[0], "1.50");
+	ASSERT_STREQ(response.values[1], "0.00");
+	ASSERT_STREQ(response.values[2], "2.50");
+	ASSERT_STREQ(response.values[3], "100.00");
+	ASSERT_STREQ(response.values[4], "3.50");
+}
+
+TEST(SCBSChain, MultiRegisterMultiReadTooManyCells) {
+	SCBSChainSim chain(3);
+	Enumerate(chain);
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u, 0x3000u, 0x1000u};
+	char values[MRDPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+	uint16_t num_values = MRDPacket::kMaxNumValues - 4; // room for exactly one more cell
+	for (uint16_t i = 0; i < num_values; i++) {
+		strcpy(values[i], "x");
+	}
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 4, values, num_values), response_buf));
+	SRSPacket response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.cell_id, 2); // cell 1 filled the packet, cell 2 had no room
+	ASSERT_STREQ(response.values[0], "ERR:2");
+}
+
+TEST(SCBSChain, MultiRegisterSingleRead) {
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+	uint32_t reg_addrs[] = {0x3000u, 0x1000u};
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, reg_addrs, 2), response_buf));
+	SRSPacket response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.cell_id, 2);
+	ASSERT_EQ(response.num_values, 2);
+	ASSERT_STREQ(response.values[0], SCBS_FIRMWARE_VERSION);
+	ASSERT_STREQ(response.values[1], "0.00");
+
+	uint32_t bad_reg_addrs[] = {0x1000u, 0x9999u};
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, bad_reg_addrs, 2), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:1");
+}
+
+TEST(SCBSChain, StreamingTelemetry) {
+	const uint16_t num_cells = 3;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		chain.SetCellADCCounts(i, (i+1)*(1<<10)); // 50mA, 100mA, 150mA
+	}
+
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4000u, (char *)"250"), response_buf)); // 250ms period
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+
+	// Should get one frame per period without sending anything.
+	for (uint16_t frame = 0; frame < 3; frame++) {
+		chain.RunFor(250000);
+		chain.RunUntilIdle();
+		ASSERT_GT(chain.HostReceive(response_buf), 0);
+		MRDPacket telemetry = MRDPacket(response_buf);
+		ASSERT_TRUE(telemetry.IsValid());
+		ASSERT_EQ(telemetry.reg_addrs[0], 0x2000u);
+		ASSERT_EQ(telemetry.num_values, num_cells);
+		ASSERT_STREQ(telemetry.values[0], "50.00");
+		ASSERT_STREQ(telemetry.values[1], "100.00");
+		ASSERT_STREQ(telemetry.values[2], "150.00");
+		ASSERT_EQ(chain.HostReceive(response_buf), 0);
+	}
+
+	// Turn streaming back off.
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4000u, (char *)"0"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	chain.RunFor(50000);
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+}
+
+TEST(SCBSChain, StreamingTelemetryOtherRegister) {
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4001u, (char *)"1000"), response_buf));
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4000u, (char *)"250"), response_buf));
+	chain.RunFor(250000);
+	chain.RunUntilIdle();
+	ASSERT_GT(chain.HostReceive(response_buf), 0);
+	MRDPacket telemetry = MRDPacket(response_buf);
+	ASSERT_TRUE(telemetry.IsValid());
+	ASSERT_EQ(telemetry.reg_addrs[0], 0x1000u);
+	ASSERT_EQ(telemetry.num_values, 2);
+}
+
+TEST(SCBSChain, StreamingTelemetryLimits) {
+	// Faster than a full length frame can get down the link at 9600 baud.
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4000u, (char *)"100"), response_buf));
+	SRSPacket response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.cell_id, 1);
+	ASSERT_STREQ(response.values[0], "ERR:4");
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x4000u, (char *)"209"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+
+	// Frames only have room for 20 cells, so the cell after that refuses.
+	SCBSChainSim long_chain(MRDPacket::kMaxNumValues + 1);
+	Enumerate(long_chain);
+	ASSERT_TRUE(Transact(long_chain, MWRPacket(0x4000u, (char *)"1000"), response_buf));
+	response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.cell_id, MRDPacket::kMaxNumValues + 1);
+	ASSERT_STREQ(response.values[0], "ERR:2");
+	ASSERT_TRUE(Transact(long_chain, MWRPacket(0x4000u, (char *)"0"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+}
+
+TEST(SCBSChain, PipelinedTaggedRequests) {
+	const uint16_t num_cells = 6;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+
+	for (uint16_t i = 0; i < num_cells; i++) {
+		chain.SetCellADCCounts(i, 1000);
+	}
+	chain.Step(); // let the cells sample the new ADC counts
+
+	// Put a read for every cell on the wire back to back without waiting for responses.
+	char request_buf[BSPacket::kMaxPacketLen];
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		SRDPacket request = SRDPacket(cell_id, 0x2000u);
+		request.SetTag(0x100 + cell_id);
+		request.ToString(request_buf);
+		chain.HostTransmit(request_buf);
+	}
+	// Tagged writes get tagged OK responses.
+	SWRPacket write_request = SWRPacket(3, 0x1000u, (char *)"2.50");
+	write_request.SetTag(0x200);
+	write_request.ToString(request_buf);
+	chain.HostTransmit(request_buf);
+	chain.RunUntilIdle();
+
+	bool seen[num_cells+1] = {false};
+	bool seen_write = false;
+	char response_buf[BSPacket::kMaxPacketLen];
+	while (chain.HostReceive(response_buf) > 0) {
+		SRSPacket response = SRSPacket(response_buf);
+		ASSERT_TRUE(response.IsValid());
+		if (response.GetTag() == 0x200) {
+			ASSERT_EQ(response.cell_id, 3);
+			ASSERT_STREQ(response.values[0], "OK");
+			seen_write = true;
+			continue;
+		}
+		uint16_t cell_id = response.GetTag() - 0x100;
+		ASSERT_GE(cell_id, 1);
+		ASSERT_LE(cell_id, num_cells);
+		ASSERT_EQ(response.cell_id, cell_id); // response matches the request with the same tag
+		ASSERT_STREQ(response.values[0], "48.83"); // 1000 counts
+		seen[cell_id] = true;
+	}
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		ASSERT_TRUE(seen[cell_id]);
+	}
+	ASSERT_TRUE(seen_write);
+}
+
+TEST(SCBSChain, TaggedErrorResponse) {
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+
+	SWRPacket request = SWRPacket(2, 0x2000u, (char *)"1.00"); // current register is read only
+	request.SetTag(0xBEEF);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, request, response_buf));
+	SRSPacket response = SRSPacket(response_buf);
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.GetTag(), 0xBEEF);
+	ASSERT_STREQ(response.values[0], "ERR:3");
+}
+
+TEST(SCBSChain, SyncSampleIsCoherent) {
+	const uint16_t num_cells = 5;
+	SCBSChainSim chain(num_cells, true); // hop compensation only matters if packets take time to get down the chain
+	Enumerate(chain);
+
+	char request_buf[BSPacket::kMaxPacketLen];
+	SYNPacket(200000u).ToString(request_buf); // plenty of time to reach the end of the chain at 9600 baud
+	chain.HostTransmit(request_buf);
+
+	// Ramp every cell's ADC one count per step, so the latched value shows when each cell took its sample.
+	for (uint16_t step = 0; step < 3000; step++) {
+		for (uint16_t i = 0; i < num_cells; i++) {
+			chain.SetCellADCCounts(i, step);
+		}
+		chain.Step();
+	}
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_GT(chain.HostReceive(response_buf), 0);
+	SYNPacket sync_response = SYNPacket(response_buf);
+	ASSERT_TRUE(sync_response.IsValid());
+	ASSERT_GT(sync_response.delay_us, 0u); // got to the end of the chain before the sample time
+
+	char no_values[1][BSPacket::kMaxPacketFieldLen] = {""};
+	uint32_t reg_addrs[] = {0x2001u, 0x5001u};
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 2, no_values, 0), response_buf));
+	MRDPacket snapshot = MRDPacket(response_buf);
+	ASSERT_TRUE(snapshot.IsValid());
+	ASSERT_EQ(snapshot.num_values, 2*num_cells);
+	float first_cell_current = strtof(snapshot.values[0], NULL);
+	// Sampled 200ms after the SYN reached the first cell, which took ~20ms to come in from the host.
+	ASSERT_GT(first_cell_current, 2000*200.0f/4096);
+	ASSERT_LT(first_cell_current, 2300*200.0f/4096);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		// Uncompensated, each hop would be ~20ms (200 counts) later than the last.
+		ASSERT_NEAR(strtof(snapshot.values[2*i], NULL), first_cell_current, 3*200.0f/4096);
+		ASSERT_STREQ(snapshot.values[2*i+1], "1");
+	}
+}
+
+/**
+ * A SYN that shows up while an earlier one is still waiting for its time is turned away by the first cell, and the
+ * earlier sync happens when it was meant to.
+*/
+TEST(SCBSChain, SyncWhileOneIsPendingIsRejected) {
+	const uint16_t num_cells = 3;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	char no_values[1][BSPacket::kMaxPacketFieldLen] = {""};
+	uint32_t reg_addrs[] = {0x5001u}; // latch count
+
+	ASSERT_TRUE(Transact(chain, SYNPacket(200000u), response_buf));
+	ASSERT_TRUE(SYNPacket(response_buf).IsValid());
+	SYNPacket second = SYNPacket(500000u);
+	second.SetTag(2);
+	ASSERT_TRUE(Transact(chain, second, response_buf));
+	SRSPacket rejected = SRSPacket(response_buf);
+	ASSERT_TRUE(rejected.IsValid());
+	ASSERT_EQ(rejected.GetTag(), 2);
+	ASSERT_EQ(rejected.cell_id, 1);
+	ASSERT_STREQ(rejected.values[0], "ERR:5");
+	ASSERT_EQ(chain.HostReceive(response_buf), 0); // never forwarded
+
+	chain.RunFor(300000);
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 1, no_values, 0), response_buf));
+	MRDPacket latch_counts = MRDPacket(response_buf);
+	ASSERT_EQ(latch_counts.num_values, num_cells);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_STREQ(latch_counts.values[i], "1");
+	}
+
+	// Once it's happened, the next SYN is taken.
+	ASSERT_TRUE(Transact(chain, SYNPacket(100000u), response_buf));
+	ASSERT_TRUE(SYNPacket(response_buf).IsValid());
+	chain.RunFor(200000);
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 1, no_values, 0), response_buf));
+	latch_counts = MRDPacket(response_buf);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_STREQ(latch_counts.values[i], "2");
+	}
+}
+
+TEST(SCBSChain, SyncLatchedCurrentIsReadOnly) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x2001u, (char *)"1.00"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:3");
+}
+
+static void LoadProfile(SCBSChainSim & chain, char points[][BSPacket::kMaxPacketFieldLen], uint16_t num_points) {
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, PRFPacket(BSPacket::kBroadcastCellID, 0, points, num_points), response_buf));
+	PRFPacket response = PRFPacket(response_buf); // broadcast gets forwarded all the way through
+	ASSERT_TRUE(response.IsValid());
+	ASSERT_EQ(response.num_points, num_points);
+}
+
+TEST(SCBSChain, ProfilePlayback) {
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00", "100:2.00", "200:2.00", "200:3.00", "300:3.00"};
+	LoadProfile(chain, points, 5);
+
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x6000u, (char *)"1"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	chain.RunFor(50000);
+	for (uint16_t i = 0; i < chain.GetNumCells(); i++) {
+		ASSERT_NEAR(chain.GetCell(i)->GetOutputVoltage(), 1.5f, 0.02f); // halfway up the ramp
+	}
+	chain.RunFor(100000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 2.0f, 1e-3f); // flat segment
+	chain.RunFor(100000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 3.0f, 1e-3f); // after the step
+
+	// Holds the last point and stops once the profile runs out.
+	chain.RunFor(100000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x6000u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0");
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 3.0f, 1e-3f);
+}
+
+TEST(SCBSChain, OutputVoltageWriteBusyWhileProfileOrModelInControl) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00", "1000:1.00"};
+	LoadProfile(chain, points, 2);
+	char response_buf[BSPacket::kMaxPacketLen];
+
+	// Armed or playing, the profile owns the setpoint.
+	const char * profile_states[] = {"2", "1"};
+	for (uint16_t i = 0; i < 2; i++) {
+		ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)profile_states[i]), response_buf));
+		ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+		ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1000u, (char *)"2.50"), response_buf));
+		ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+	}
+	chain.RunFor(10000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 1.0f, 1e-3f);
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)"0"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1000u, (char *)"2.50"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 2.5f, 1e-3f);
+
+	// So does the battery model.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x7000u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x1000u, (char *)"2.50"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x7000u, (char *)"0"), response_buf));
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x1000u, (char *)"1.50"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+}
+
+TEST(SCBSChain, ProfileLoopAndStop) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00", "100:3.00"};
+	LoadProfile(chain, points, 2);
+
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6001u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	chain.RunFor(1025000); // ten and a quarter loops
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 1.5f, 0.05f);
+
+	// Can't load points while playing.
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 0, points, 2), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+
+	// Stop holds wherever the profile was.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	float stopped_voltage = chain.GetCell(0)->GetOutputVoltage();
+	chain.RunFor(50000);
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), stopped_voltage);
+}
+
+TEST(SCBSChain, ProfileUploadErrors) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00", "100:2.00"};
+	char backwards_points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00", "50:2.00", "40:2.00"};
+	char bad_points[][BSPacket::kMaxPacketFieldLen] = {"hello"};
+
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // nothing to play
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 1, points, 2), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // gap before index 1
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 0, backwards_points, 3), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 0, bad_points, 1), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, SCBS::kMaxNumProfilePoints-1, points, 2), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // still a gap, checked before capacity
+
+	// Chunks append, and the number of points can be read back.
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 0, points, 2), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	char more_points[][BSPacket::kMaxPacketFieldLen] = {"200:1.00"};
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 2, more_points, 1), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x6002u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "3");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6002u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x6002u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0");
+}
+
+TEST(SCBSChain, ProfileArmedStartsOnSync) {
+	const uint16_t num_cells = 4;
+	SCBSChainSim chain(num_cells, true);
+	Enumerate(chain);
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:0.00", "1000:4.00"};
+	LoadProfile(chain, points, 2);
+
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x6000u, (char *)"2"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	chain.RunFor(100000);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_FLOAT_EQ(chain.GetCell(i)->GetOutputVoltage(), 0.0f); // waiting for the SYN
+	}
+
+	char request_buf[BSPacket::kMaxPacketLen];
+	SYNPacket(200000u).ToString(request_buf);
+	chain.HostTransmit(request_buf);
+	chain.RunFor(400000); // ~20ms to get to the first cell, 200ms until start, then ~180ms in
+	float first_cell_voltage = chain.GetCell(0)->GetOutputVoltage();
+	ASSERT_GT(first_cell_voltage, 0.6f);
+	ASSERT_LT(first_cell_voltage, 0.8f);
+	for (uint16_t i = 1; i < num_cells; i++) {
+		ASSERT_NEAR(chain.GetCell(i)->GetOutputVoltage(), first_cell_voltage, 0.01f); // in lockstep
+	}
+}
+
+TEST(SCBSChain, BatteryModelFollowsCurrent) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	const char * writes[][2] = {
+		{"7002", "50"}, // SOC [%], OCV is 3.72V
+		{"7003", "1000"}, // R0 [mOhm]
+		{"7004", "0"}, // RC pairs off
+		{"7006", "0"},
+		{"7000", "1"}
+	};
+	for (uint16_t i = 0; i < 5; i++) {
+		ASSERT_TRUE(Transact(chain, SWRPacket(1, strtoul(writes[i][0], NULL, 16), (char *)writes[i][1]), response_buf));
+		ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	}
+
+	chain.RunFor(10000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 3.72f, 1e-3f); // no load
+	chain.SetCellADCCounts(0, 2048); // 100mA
+	chain.RunFor(10000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 3.62f, 1e-3f); // 100mA through 1 Ohm
+
+	// Parameters are locked while the model is running, and the profile can't take over.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x7002u, (char *)"80"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+	char points[][BSPacket::kMaxPacketFieldLen] = {"0:1.00"};
+	ASSERT_TRUE(Transact(chain, PRFPacket(1, 0, points, 1), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x6000u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x7105u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "3.720");
+}
+
+TEST(SCBSChain, CurrentStatsRegisters) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	chain.SetCellADCCounts(0, 2048); // 100mA
+	chain.Step();
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x2100u, (char *)"0"), response_buf)); // restart, no window
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x2110u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	chain.RunFor(100000);
+
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2102u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "100.000");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2105u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "100.000");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2106u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0.000");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2101u), response_buf));
+	ASSERT_GT(strtoul(SRSPacket(response_buf).values[0], NULL, 10), 0u);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2110u), response_buf));
+	float charge_mah = strtof(SRSPacket(response_buf).values[0], NULL);
+	ASSERT_GT(charge_mah, 100.0f * 0.1f / 3600.0f); // at least 100ms at 100mA
+	ASSERT_LT(charge_mah, 100.0f * 0.2f / 3600.0f);
+
+	// Statistics are read-only, the charge counter can be reset.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x2102u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:3");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x2110u, (char *)"0"), response_buf));
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x2110u), response_buf));
+	ASSERT_LT(strtof(SRSPacket(response_buf).values[0], NULL), 100.0f * 0.01f / 3600.0f);
+}
+
+/**
+ * Reads a finished capture out of a cell with BRD packets, one BRS packet's worth at a time.
+*/
+static void ReadCapture(SCBSChainSim & chain, uint16_t cell_id, uint16_t samples_out[], uint16_t num_samples) {
+	char response_buf[BSPacket::kMaxPacketLen];
+	for (uint16_t offset = 0; offset < num_samples; ) {
+		ASSERT_TRUE(Transact(chain, BRDPacket(cell_id, offset, BRSPacket::kMaxNumSamples), response_buf));
+		BRSPacket response = BRSPacket(response_buf);
+		ASSERT_TRUE(response.IsValid());
+		ASSERT_EQ(response.cell_id, cell_id);
+		ASSERT_EQ(response.offset, offset);
+		ASSERT_GT(response.num_samples, 0);
+		ASSERT_LE(offset + response.num_samples, num_samples);
+		memcpy(samples_out + offset, response.samples, response.num_samples*sizeof(uint16_t));
+		offset += response.num_samples;
+	}
+}
+
+/**
+ * Fake time to run for so that a capture triggered now is sure to have filled the buffer.
+*/
+static uint32_t CaptureRunTimeUs(uint32_t num_samples, uint32_t sample_period_us) {
+	return (num_samples + 10) * sample_period_us;
+}
+
+TEST(SCBSChain, CaptureRisingTrigger) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	const char * writes[][2] = {
+		{"8001", "50"}, // sample period [us]
+		{"8002", "100"}, // pre-trigger samples
+		{"8003", "1"}, // rising edge
+		{"8004", "100"}, // trigger level [mA]
+		{"8000", "1"} // arm
+	};
+	for (uint16_t i = 0; i < 5; i++) {
+		ASSERT_TRUE(Transact(chain, SWRPacket(1, strtoul(writes[i][0], NULL, 16), (char *)writes[i][1]), response_buf));
+		ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	}
+
+	// Can't change the setup or read the buffer while the capture is running.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x8002u, (char *)"10"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+	ASSERT_TRUE(Transact(chain, BRDPacket(1, 0, 10), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+
+	chain.SetCellADCCounts(0, 1024); // 50mA
+	chain.RunFor(20000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x8000u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1"); // still armed
+	chain.SetCellADCCounts(0, 3072); // 150mA
+	chain.RunFor(CaptureRunTimeUs(SCBS::kCaptureBufLen, 50));
+
+	uint32_t reg_addrs[] = {0x8000u, 0x8005u, 0x8006u};
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, reg_addrs, 3), response_buf));
+	SRSPacket status = SRSPacket(response_buf);
+	ASSERT_STREQ(status.values[0], "3"); // done
+	ASSERT_EQ(strtoul(status.values[1], NULL, 10), static_cast<uint32_t>(SCBS::kCaptureBufLen));
+	ASSERT_STREQ(status.values[2], "100");
+
+	static uint16_t samples[SCBS::kCaptureBufLen];
+	ReadCapture(chain, 1, samples, static_cast<uint16_t>(SCBS::kCaptureBufLen));
+	for (uint16_t i = 0; i < SCBS::kCaptureBufLen; i++) {
+		ASSERT_EQ(samples[i], i < 100 ? 1024 : 3072) << "sample " << i;
+	}
+	ASSERT_TRUE(Transact(chain, BRDPacket(1, static_cast<uint16_t>(SCBS::kCaptureBufLen), 10), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // past the end
+
+	// Triggering a finished capture fails, it has to be armed again first.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x8000u, (char *)"2"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x8000u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "3");
+}
+
+TEST(SCBSChain, CaptureBroadcastTrigger) {
+	SCBSChainSim chain(3);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, BRDPacket(2, 0, 10), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // nothing captured yet
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x8000u, (char *)"2"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4"); // not armed
+
+	for (uint16_t i = 0; i < chain.GetNumCells(); i++) {
+		chain.SetCellADCCounts(i, 2048); // the fake ADC is shared, capture timers all see the last cell's counts
+	}
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x8000u, (char *)"1"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x8000u, (char *)"2"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	chain.RunFor(CaptureRunTimeUs(SCBS::kCaptureBufLen, 100));
+
+	for (uint16_t cell_id = 1; cell_id <= chain.GetNumCells(); cell_id++) {
+		uint32_t reg_addrs[] = {0x8000u, 0x8005u, 0x8006u};
+		ASSERT_TRUE(Transact(chain, SRDPacket(cell_id, reg_addrs, 3), response_buf));
+		SRSPacket status = SRSPacket(response_buf);
+		ASSERT_STREQ(status.values[0], "3");
+		// The capture is short if the trigger came in before the pre-trigger history filled up.
+		uint16_t trigger_index = strtoul(status.values[2], NULL, 10);
+		const uint16_t pre_trigger_samples = SCBS::kCaptureBufLen/4; // default
+		ASSERT_LE(trigger_index, pre_trigger_samples);
+		ASSERT_EQ(strtoul(status.values[1], NULL, 10), static_cast<uint32_t>(SCBS::kCaptureBufLen - pre_trigger_samples + trigger_index));
+	}
+	uint16_t samples[BRSPacket::kMaxNumSamples];
+	ReadCapture(chain, 3, samples, BRSPacket::kMaxNumSamples);
+	ASSERT_EQ(samples[0], 2048);
+}
+
+/**
+ * Runs the chain until it settles and checks that the next packet out is an event from the expected cell.
+*/
+static void ExpectEvent(SCBSChainSim & chain, uint16_t cell_id, uint16_t event_code, const char * value) {
+	char response_buf[BSPacket::kMaxPacketLen];
+	chain.RunUntilIdle();
+	ASSERT_GT(chain.HostReceive(response_buf), 0);
+	EVTPacket event = EVTPacket(response_buf);
+	ASSERT_TRUE(event.IsValid());
+	ASSERT_EQ(event.cell_id, cell_id);
+	ASSERT_EQ(event.event_code, event_code);
+	ASSERT_STREQ(event.value, value);
+}
+
+TEST(SCBSChain, ComparatorEvents) {
+	SCBSChainSim chain(3);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	const char * writes[][2] = {
+		{"2201", "100"}, // high level [mA]
+		{"2202", "20"}, // low level [mA]
+		{"2203", "10"}, // hysteresis [mA]
+		{"2200", "3"} // both comparators on
+	};
+	for (uint16_t i = 0; i < 4; i++) {
+		ASSERT_TRUE(Transact(chain, SWRPacket(2, strtoul(writes[i][0], NULL, 16), (char *)writes[i][1]), response_buf));
+		ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	}
+	// Current starts out at 0, which is past the low level.
+	ExpectEvent(chain, 2, SCBS::EVENT_CURRENT_LOW, "0.00");
+
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+
+	// Events from the same sample go out in event code order.
+	chain.SetCellADCCounts(1, 2048); // 100mA
+	ExpectEvent(chain, 2, SCBS::EVENT_CURRENT_HIGH, "100.00");
+	ExpectEvent(chain, 2, SCBS::EVENT_CURRENT_LOW_CLEARED, "100.00");
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, 0x2204u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1");
+
+	chain.SetCellADCCounts(1, 1946); // 95mA, inside the hysteresis
+	chain.RunFor(10000);
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+	chain.SetCellADCCounts(1, 1741); // 85mA
+	ExpectEvent(chain, 2, SCBS::EVENT_CURRENT_HIGH_CLEARED, "85.01");
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, 0x2205u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "4");
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x2204u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:3");
+}
+
+TEST(SCBSChain, VoltageRamp) {
+	SCBSChainSim chain(1);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1000u, (char *)"1.00"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1002u, (char *)"2"), response_buf)); // 2V/s
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1001u, (char *)"2.00"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x1003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0");
+
+	chain.RunFor(250000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 1.5f, 0.02f);
+	chain.RunFor(300000);
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), 2.0f);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x1003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1");
+
+	// Ramps down too, and a direct write cancels the ramp.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1001u, (char *)"1.00"), response_buf));
+	chain.RunFor(100000);
+	ASSERT_NEAR(chain.GetCell(0)->GetOutputVoltage(), 1.8f, 0.02f);
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1000u, (char *)"3.00"), response_buf));
+	chain.RunFor(100000);
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), 3.0f);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x1003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1");
+
+	// No ramp rate means jump straight there.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1002u, (char *)"0"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1001u, (char *)"3.70"), response_buf));
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), 3.7f);
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1002u, (char *)"-1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+
+	// The battery model owns the output while it's running.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x7000u, (char *)"1"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1001u, (char *)"2.00"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:5");
+}
+
+TEST(SCBSChain, StagedWritesCommitTogether) {
+	const uint16_t num_cells = 5;
+	SCBSChainSim chain(num_cells, true); // writes only smear down the chain if packets take time to get there
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x5002u, (char *)"1"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1.00", "1.50", "2.00", "2.50", "3.00"};
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x1000u, values, num_cells), response_buf));
+	ASSERT_TRUE(VWRPacket(response_buf).IsValid());
+	ASSERT_TRUE(Transact(chain, SWRPacket(3, 0x1000u, (char *)"3.50"), response_buf)); // replaces the staged 2.00
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(4, 0x6000u, (char *)"1"), response_buf)); // no profile, fails at commit
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_FLOAT_EQ(chain.GetCell(i)->GetOutputVoltage(), 0.0f);
+	}
+	ASSERT_TRUE(Transact(chain, SRDPacket(4, 0x5003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "2");
+
+	char request_buf[BSPacket::kMaxPacketLen];
+	SYNPacket(200000u).ToString(request_buf);
+	chain.HostTransmit(request_buf);
+	int32_t commit_steps[num_cells];
+	for (uint16_t i = 0; i < num_cells; i++) {
+		commit_steps[i] = -1;
+	}
+	for (int32_t step = 0; step < 3000; step++) {
+		chain.Step();
+		for (uint16_t i = 0; i < num_cells; i++) {
+			if (commit_steps[i] < 0 && chain.GetCell(i)->GetOutputVoltage() != 0.0f) {
+				commit_steps[i] = step;
+			}
+		}
+	}
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_GE(commit_steps[i], 0);
+		// Uncompensated, each hop would be ~20ms (200 steps) later than the last.
+		ASSERT_NEAR(commit_steps[i], commit_steps[0], 3);
+	}
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), 1.0f);
+	ASSERT_FLOAT_EQ(chain.GetCell(2)->GetOutputVoltage(), 3.5f);
+	ASSERT_FLOAT_EQ(chain.GetCell(4)->GetOutputVoltage(), 3.0f);
+	ASSERT_GT(chain.HostReceive(response_buf), 0); // SYN made it out the end
+
+	char no_values[1][BSPacket::kMaxPacketFieldLen] = {""};
+	uint32_t reg_addrs[] = {0x5003u, 0x5004u};
+	ASSERT_TRUE(Transact(chain, MRDPacket(reg_addrs, 2, no_values, 0), response_buf));
+	MRDPacket status = MRDPacket(response_buf);
+	ASSERT_EQ(status.num_values, 2*num_cells);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_STREQ(status.values[2*i], "0");
+		ASSERT_STREQ(status.values[2*i+1], i == 3 ? "4" : "0"); // invalid value, no profile points loaded
+	}
+
+	// Staging registers themselves aren't staged, and staged writes can be thrown away.
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x1000u, (char *)"2.50"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x5003u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x5002u, (char *)"0"), response_buf));
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x5002u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0");
+	ASSERT_FLOAT_EQ(chain.GetCell(0)->GetOutputVoltage(), 1.0f);
+}
+
+TEST(SCBSChain, CellRangeAndGroupAddressing) {
+	const uint16_t num_cells = 6;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+
+	// A range write is performed by every cell in the range and comes back to the host once they're all done.
+	ASSERT_TRUE(Transact(chain, SWRPacket(BSPacket::CellRange(2, 4), 0x1000u, (char *)"2.00"), response_buf));
+	SWRPacket swr_response = SWRPacket(response_buf);
+	ASSERT_TRUE(swr_response.IsValid());
+	ASSERT_EQ(swr_response.last_cell_id, 4);
+	ASSERT_EQ(chain.HostReceive(response_buf), 0); // exactly one frame out
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_FLOAT_EQ(chain.GetCell(i)->GetOutputVoltage(), (i >= 1 && i <= 3) ? 2.0f : 0.0f);
+	}
+
+	// Put cells 2 and 5 in a group and write to it.
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3001u, (char *)"9"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(5, 0x3001u, (char *)"9"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(BSPacket::CellGroup(9), 0x1000u, (char *)"3.00"), response_buf));
+	ASSERT_TRUE(SWRPacket(response_buf).IsValid());
+	ASSERT_FLOAT_EQ(chain.GetCell(1)->GetOutputVoltage(), 3.0f);
+	ASSERT_FLOAT_EQ(chain.GetCell(2)->GetOutputVoltage(), 2.0f);
+	ASSERT_FLOAT_EQ(chain.GetCell(4)->GetOutputVoltage(), 3.0f);
+
+	// A group read gets a tagged SRS from each cell in the group, then the SRD itself once the chain is done.
+	uint32_t reg_addrs[] = {0x1000u, 0x3001u};
+	SRDPacket request = SRDPacket(BSPacket::CellGroup(9), reg_addrs, 2);
+	request.SetTag(0x42);
+	ASSERT_TRUE(Transact(chain, request, response_buf));
+	uint16_t expected_cell_ids[] = {2, 5};
+	for (uint16_t i = 0; i < 2; i++) {
+		if (i > 0) {
+			ASSERT_GT(chain.HostReceive(response_buf), 0);
+		}
+		SRSPacket srs_response = SRSPacket(response_buf);
+		ASSERT_TRUE(srs_response.IsValid());
+		ASSERT_EQ(srs_response.GetTag(), 0x42);
+		ASSERT_EQ(srs_response.cell_id, expected_cell_ids[i]);
+		ASSERT_FLOAT_EQ(strtof(srs_response.values[0], NULL), 3.0f);
+		ASSERT_STREQ(srs_response.values[1], "9");
+	}
+	ASSERT_GT(chain.HostReceive(response_buf), 0);
+	SRDPacket srd_response = SRDPacket(response_buf);
+	ASSERT_TRUE(srd_response.IsValid());
+	ASSERT_EQ(srd_response.GetTag(), 0x42);
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+
+	// A failed multicast write stops at the first cell that fails, like an MWR.
+	ASSERT_TRUE(Transact(chain, SWRPacket(BSPacket::CellGroup(9), 0x2000u, (char *)"1.00"), response_buf));
+	SRSPacket err_response = SRSPacket(response_buf);
+	ASSERT_EQ(err_response.cell_id, 2);
+	ASSERT_STREQ(err_response.values[0], "ERR:3");
+	ASSERT_EQ(chain.HostReceive(response_buf), 0);
+}
+
+/**
+ * Reads every cell's unique ID with one SRD to the whole cell ID range, like a host checking the chain at boot.
+ * Fills in the cell ID and unique ID string reported by each cell in chain order, returns the number of cells.
+*/
+static uint16_t SweepUniqueIDs(SCBSChainSim & chain, uint16_t cell_ids_out[], char unique_ids_out[][BSPacket::kMaxPacketFieldLen]) {
+	char response_buf[BSPacket::kMaxPacketLen];
+	uint32_t reg_addr = 0x3002u;
+	EXPECT_TRUE(Transact(chain, SRDPacket(BSPacket::CellRange(0, UINT16_MAX), &reg_addr, 1), response_buf));
+	uint16_t num_cells = 0;
+	while (strncmp(response_buf, "$BSSRD", 6) != 0) {
+		SRSPacket response = SRSPacket(response_buf);
+		EXPECT_TRUE(response.IsValid());
+		cell_ids_out[num_cells] = response.cell_id;
+		strncpy(unique_ids_out[num_cells], response.values[0], BSPacket::kMaxPacketFieldLen);
+		num_cells++;
+		if (chain.HostReceive(response_buf) == 0) {
+			ADD_FAILURE() << "SRD never came back around the chain";
+			break;
+		}
+	}
+	return num_cells;
+}
+
+TEST(SCBSChain, SettingsSurvivePowerCycle) {
+	const uint16_t num_cells = 4;
+	SCBSChainSim chain(num_cells);
+	char response_buf[BSPacket::kMaxPacketLen];
+
+	// Brand new boards come up without cell IDs.
+	uint16_t cell_ids[num_cells+1];
+	char unique_ids[num_cells+1][BSPacket::kMaxPacketFieldLen];
+	ASSERT_EQ(SweepUniqueIDs(chain, cell_ids, unique_ids), num_cells);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_EQ(cell_ids[i], 0);
+		char expected_unique_id[BSPacket::kMaxPacketFieldLen];
+		snprintf(expected_unique_id, sizeof(expected_unique_id), "%016llX",
+			static_cast<unsigned long long>(SCBSChainSim::kFirstUniqueBoardID + i));
+		ASSERT_STREQ(unique_ids[i], expected_unique_id);
+	}
+
+	// Cell IDs are saved by discovery once the line goes quiet, everything else only when asked (also once it's quiet).
+	Enumerate(chain);
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3001u, (char *)"7"), response_buf));
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x2201u, (char *)"150.00"), response_buf));
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x1002u, (char *)"0.5"), response_buf));
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x3003u, (char *)"1"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x1002u, (char *)"1.0"), response_buf)); // not saved
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "2"); // one save from discovery, one from the register
+
+	// After a power cycle the chain is ready to go with a single sweep, no rediscovery or reconfiguration needed.
+	chain.PowerCycle();
+	ASSERT_EQ(SweepUniqueIDs(chain, cell_ids, unique_ids), num_cells);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_EQ(cell_ids[i], i+1);
+		ASSERT_EQ(chain.GetCell(i)->GetCellID(), i+1);
+	}
+	uint32_t reg_addrs[] = {0x3001u, 0x2201u, 0x1002u};
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, reg_addrs, 3), response_buf));
+	SRSPacket settings = SRSPacket(response_buf);
+	ASSERT_STREQ(settings.values[0], "7");
+	ASSERT_STREQ(settings.values[1], "150.00");
+	ASSERT_FLOAT_EQ(strtof(settings.values[2], NULL), 0.5f);
+
+	// Forgetting the settings takes effect at the next power cycle.
+	ASSERT_TRUE(Transact(chain, SWRPacket(3, 0x3003u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(3, 0x3003u, (char *)"2"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+	chain.RunFor(50000);
+	chain.PowerCycle();
+	ASSERT_EQ(chain.GetCell(1)->GetCellID(), 2);
+	ASSERT_EQ(chain.GetCell(2)->GetCellID(), 0);
+}
+
+TEST(SCBSChain, SettingsSaveWaitsForQuietLine) {
+	SCBSChainSim chain(2);
+	char response_buf[BSPacket::kMaxPacketLen];
+
+	// The flash write holds off interrupts, so it waits for the host to stop talking.
+	Enumerate(chain);
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "0");
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1");
+
+	// And for a capture to finish.
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x8000u, (char *)"1"), response_buf)); // arm, manual trigger
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	ASSERT_TRUE(Transact(chain, DISPacket(static_cast<uint16_t>(4)), response_buf));
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "1");
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x8000u, (char *)"0"), response_buf));
+	ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "2");
+
+	// Saving the settings isn't done while the write is handled either, and waits for the battery model to stop.
+	ASSERT_TRUE(Transact(chain, SWRPacket(6, 0x3003u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "2");
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "3");
+	ASSERT_TRUE(Transact(chain, SWRPacket(6, 0x7000u, (char *)"1"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(6, 0x3003u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "3");
+	ASSERT_TRUE(Transact(chain, SWRPacket(6, 0x7000u, (char *)"0"), response_buf));
+	chain.RunFor(50000);
+	ASSERT_TRUE(Transact(chain, SRDPacket(6, 0x3003u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "4");
+}
+
+TEST(SCBSChain, ForgottenSettingsStayForgotten) {
+	SCBSChainSim chain(2);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3001u, (char *)"7"), response_buf));
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3003u, (char *)"1"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3003u, (char *)"0"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "OK");
+
+	// Rediscovering saves the cell ID again, but on top of the defaults rather than the settings that were forgotten.
+	ASSERT_TRUE(Transact(chain, DISPacket(static_cast<uint16_t>(0)), response_buf));
+	chain.RunFor(50000);
+	chain.PowerCycle();
+	ASSERT_EQ(chain.GetCell(1)->GetCellID(), 2);
+	char default_group_id[BSPacket::kMaxPacketFieldLen];
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, 0x3001u), response_buf));
+	strncpy(default_group_id, SRSPacket(response_buf).values[0], BSPacket::kMaxPacketFieldLen);
+	ASSERT_TRUE(Transact(chain, SRDPacket(2, 0x3001u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], default_group_id);
+}
+
+TEST(SCBSChain, SweepSpotsMovedBoards) {
+	const uint16_t num_cells = 5;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	chain.RunFor(50000); // let the cell IDs get saved
+	uint16_t cell_ids[num_cells+1];
+	char unique_ids[num_cells+1][BSPacket::kMaxPacketFieldLen];
+	ASSERT_EQ(SweepUniqueIDs(chain, cell_ids, unique_ids), num_cells);
+	char saved_unique_ids[num_cells][BSPacket::kMaxPacketFieldLen];
+	memcpy(saved_unique_ids, unique_ids, sizeof(saved_unique_ids));
+
+	// Boards keep their saved cell IDs when moved, so the sweep shows them out of order.
+	chain.SwapBoards(1, 3);
+	ASSERT_EQ(SweepUniqueIDs(chain, cell_ids, unique_ids), num_cells);
+	ASSERT_EQ(cell_ids[1], 4);
+	ASSERT_EQ(cell_ids[3], 2);
+	ASSERT_STREQ(unique_ids[1], saved_unique_ids[3]);
+
+	// Rediscovering fixes it up for good.
+	Enumerate(chain);
+	chain.RunFor(50000);
+	chain.PowerCycle();
+	ASSERT_EQ(SweepUniqueIDs(chain, cell_ids, unique_ids), num_cells);
+	for (uint16_t i = 0; i < num_cells; i++) {
+		ASSERT_EQ(cell_ids[i], i+1);
+	}
+	ASSERT_STREQ(unique_ids[3], saved_unique_ids[1]);
+}
+
+TEST(SCBSChain, CalibrationUpload) {
+	const uint16_t num_cells = 3;
+	SCBSChainSim chain(num_cells);
+	Enumerate(chain);
+	char response_buf[BSPacket::kMaxPacketLen];
+
+	// The whole rack gets calibrated with one VWR per register.
+	char offsets[][BSPacket::kMaxPacketFieldLen] = {"0", "10", "-20"};
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x3110u, offsets, num_cells), response_buf));
+	ASSERT_TRUE(VWRPacket(response_buf).IsValid());
+	char gains[][BSPacket::kMaxPacketFieldLen] = {"1.0", "1.1", "0.9"};
+	ASSERT_TRUE(Transact(chain, VWRPacket(0x3111u, gains, num_cells), response_buf));
+	ASSERT_TRUE(VWRPacket(response_buf).IsValid());
+	ASSERT_TRUE(Transact(chain, SWRPacket(2, 0x3111u, (char *)"2.5"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+
+	for (uint16_t i = 0; i < num_cells; i++) {
+		chain.SetCellADCCounts(i, 1024); // 50mA uncalibrated
+	}
+	chain.Step();
+	char no_values[1][BSPacket::kMaxPacketFieldLen] = {""};
+	ASSERT_TRUE(Transact(chain, MRDPacket(0x2000u, no_values, 0), response_buf));
+	MRDPacket currents = MRDPacket(response_buf);
+	ASSERT_EQ(currents.num_values, num_cells);
+	ASSERT_STREQ(currents.values[0], "50.00");
+	ASSERT_STREQ(currents.values[1], "54.46"); // (1024 - 10) * 1.1 counts
+	ASSERT_STREQ(currents.values[2], "45.88"); // (1024 + 20) * 0.9 counts
+
+	// Voltage calibration is interpolated between the table points. Every cell drives the same fake PWM, so they all
+	// get the same table here.
+	for (uint32_t reg_addr = 0x3100u; reg_addr <= 0x310Au; reg_addr++) {
+		ASSERT_TRUE(Transact(chain, MWRPacket(reg_addr, (char *)"0"), response_buf));
+		ASSERT_TRUE(MWRPacket(response_buf).IsValid());
+	}
+	uint slice_num = pwm_gpio_to_slice_num(SCBS::SCBSConfig_t().pwm_pin);
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x1000u, (char *)"2.5"), response_buf));
+	chain.RunFor(2000); // let the control tick pick it up
+	ASSERT_EQ(fake_pwm_get_chan_level(slice_num, PWM_CHAN_A), 500); // inverted, 2.5V of 5V
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x3105u, (char *)"0.1"), response_buf)); // 2.25V
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x3106u, (char *)"0.2"), response_buf)); // 2.7V
+	chain.RunFor(2000);
+	ASSERT_EQ(fake_pwm_get_chan_level(slice_num, PWM_CHAN_A), 532); // 2.5V - 0.1556V = 2.344V
+	ASSERT_TRUE(Transact(chain, SWRPacket(1, 0x3100u, (char *)"1.5"), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "ERR:4");
+
+	// Calibration is saved with the rest of the settings.
+	ASSERT_TRUE(Transact(chain, MWRPacket(0x3003u, (char *)"1"), response_buf));
+	chain.RunFor(50000);
+	chain.PowerCycle();
+	uint32_t reg_addrs[] = {0x3106u, 0x3110u, 0x3111u};
+	ASSERT_TRUE(Transact(chain, SRDPacket(1, reg_addrs, 3), response_buf));
+	SRSPacket cal = SRSPacket(response_buf);
+	ASSERT_STREQ(cal.values[0], "0.2000");
+	ASSERT_STREQ(cal.values[1], "0");
+	ASSERT_STREQ(cal.values[2], "1.00000");
+	ASSERT_TRUE(Transact(chain, SRDPacket(3, 0x3110u), response_buf));
+	ASSERT_STREQ(SRSPacket(response_buf).values[0], "-20");
+}
@@ -0,0 +1,280 @@
+#include "gtest/gtest.h"
+#include "scbs_simulated_chain.hh"
+#include "scbs_coalescer.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Simulated chain with a master for a coalescer to run on. The chain is enumerated and each cell's output voltage is
+ * set to 1V plus 0.1V per cell ID before the test starts.
+*/
+class CoalescedChain : public SimulatedChain {
+public:
+	static float CellVoltage(uint16_t cell_id) {
+		return 1.0f + 0.1f * cell_id;
+	}
+
+	CoalescedChain(uint16_t num_cells, bool real_time = false)
+		: SimulatedChain(num_cells, SCBSMaster::SCBSMasterConfig_t(), real_time)
+	{
+		Start();
+		Enumerate();
+		for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+			char value[BSPacket::kMaxPacketFieldLen];
+			snprintf(value, sizeof(value), "%.2f", CellVoltage(cell_id));
+			SWRPacket swr = SWRPacket(cell_id, 0x1000u, value);
+			EXPECT_EQ(master.Send(swr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		}
+	}
+};
+
+TEST(SCBSCoalescer, ReadsOfTheSameRegisterShareOneSweep) {
+	const uint16_t num_cells = 5;
+	CoalescedChain sim(num_cells);
+	SCBSCoalescer coalescer(sim.reactor, sim.master, 20000); // long hold so every read lands in the same window
+
+	std::vector<std::future<SCBSCoalescer::ReadResult_t>> results;
+	for (uint16_t cell_id = num_cells; cell_id >= 1; cell_id--) {
+		results.push_back(coalescer.Read(cell_id, 0x1000u));
+	}
+	results.push_back(coalescer.Read(2, 0x1000u)); // same cell twice is answered from the same sweep
+	for (uint16_t i = 0; i < num_cells; i++) {
+		SCBSCoalescer::ReadResult_t result = results[i].get();
+		ASSERT_EQ(result.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		ASSERT_NEAR(strtof(result.value, NULL), CoalescedChain::CellVoltage(num_cells - i), 0.001f);
+	}
+	ASSERT_NEAR(strtof(results[num_cells].get().value, NULL), CoalescedChain::CellVoltage(2), 0.001f);
+
+	SCBSCoalescer::Stats_t stats = coalescer.GetStats();
+	ASSERT_EQ(stats.num_reads, num_cells + 1u);
+	ASSERT_EQ(stats.num_sweeps, 1u);
+	ASSERT_EQ(stats.num_single_reads, 0u);
+}
+
+TEST(SCBSCoalescer, LoneReadIsSentAsSRD) {
+	CoalescedChain sim(3);
+	SCBSCoalescer coalescer(sim.reactor, sim.master);
+
+	SCBSCoalescer::ReadResult_t result = coalescer.Read(3, 0x1000u).get();
+	ASSERT_EQ(result.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_NEAR(strtof(result.value, NULL), CoalescedChain::CellVoltage(3), 0.001f);
+
+	SCBSCoalescer::Stats_t stats = coalescer.GetStats();
+	ASSERT_EQ(stats.num_sweeps, 0u);
+	ASSERT_EQ(stats.num_single_reads, 1u);
+}
+
+TEST(SCBSCoalescer, FailedSweepFallsBackToSRDs) {
+	CoalescedChain sim(3);
+	SCBSCoalescer coalescer(sim.reactor, sim.master, 20000);
+
+	// No such register, the sweep fails and each cell reports its own error.
+	std::future<SCBSCoalescer::ReadResult_t> result_a = coalescer.Read(1, 0x9999u);
+	std::future<SCBSCoalescer::ReadResult_t> result_b = coalescer.Read(3, 0x9999u);
+	ASSERT_EQ(result_a.get().err_code, 0x01); // SCBS::kErrCodeAddrNotRecognized
+	ASSERT_EQ(result_b.get().err_code, 0x01);
+
+	// Cell past the end of the chain isn't in the sweep, its own SRD comes back unanswered.
+	std::future<SCBSCoalescer::ReadResult_t> result_c = coalescer.Read(2, 0x1000u);
+	std::future<SCBSCoalescer::ReadResult_t> result_d = coalescer.Read(9, 0x1000u);
+	ASSERT_NEAR(strtof(result_c.get().value, NULL), CoalescedChain::CellVoltage(2), 0.001f);
+	ASSERT_EQ(result_d.get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNotAnswered));
+
+	SCBSCoalescer::Stats_t stats = coalescer.GetStats();
+	ASSERT_EQ(stats.num_sweeps, 2u);
+	ASSERT_EQ(stats.num_fallbacks, 3u);
+	ASSERT_EQ(stats.num_single_reads, 3u);
+}
+
+TEST(SCBSCoalescer, ChainTooLongForOneSweep) {
+	const uint16_t num_cells = MRDPacket::kMaxNumValues + 1;
+	CoalescedChain sim(num_cells);
+	SCBSCoalescer coalescer(sim.reactor, sim.master, 20000);
+
+	for (uint16_t round = 0; round < 2; round++) {
+		std::future<SCBSCoalescer::ReadResult_t> result_a = coalescer.Read(1, 0x1000u);
+		std::future<SCBSCoalescer::ReadResult_t> result_b = coalescer.Read(num_cells, 0x1000u);
+		ASSERT_NEAR(strtof(result_a.get().value, NULL), CoalescedChain::CellVoltage(1), 0.001f);
+		ASSERT_NEAR(strtof(result_b.get().value, NULL), CoalescedChain::CellVoltage(num_cells), 0.001f);
+	}
+
+	// First round found out the sweep doesn't fit, second round didn't try.
+	SCBSCoalescer::Stats_t stats = coalescer.GetStats();
+	ASSERT_EQ(stats.num_sweeps, 1u);
+	ASSERT_EQ(stats.num_fallbacks, 2u);
+	ASSERT_EQ(stats.num_single_reads, 4u);
+}
+
+/**
+ * Master on one end of a bare pty, with a thread on the other end playing a chain of kNumCells, for answers the
+ * simulator can't give. The first MRD is answered as if the chain were too long for one sweep, and every MRD after it
+ * with every cell's value, as if cells had been taken off the end of the chain in between. SRDs get the cell's value.
+*/
+class ScriptedChain {
+public:
+	static const uint16_t kNumCells = 3;
+
+	ScriptedChain()
+		: master(reactor, port)
+	{
+		chain_fd = posix_openpt(O_RDWR | O_NOCTTY);
+		EXPECT_TRUE(chain_fd >= 0 && grantpt(chain_fd) == 0 && unlockpt(chain_fd) == 0);
+		EXPECT_TRUE(port.Open(ptsname(chain_fd)));
+		EXPECT_TRUE(master.Start());
+		reactor_thread = std::thread([this]() { reactor.Run(); });
+		chain_thread = std::thread([this]() { RunChain(); });
+	}
+	~ScriptedChain() {
+		running = false;
+		chain_thread.join();
+		reactor.Stop();
+		reactor_thread.join();
+		master.Stop();
+		close(chain_fd);
+	}
+
+	void RunChain() {
+		std::string rx_buf;
+		while (running) {
+			struct pollfd pfd = {chain_fd, POLLIN, 0};
+			char chunk[256];
+			ssize_t num_read;
+			if (poll(&pfd, 1, 10) <= 0 || (num_read = read(chain_fd, chunk, sizeof(chunk))) <= 0) {
+				continue;
+			}
+			rx_buf.append(chunk, num_read);
+			size_t eol;
+			while ((eol = rx_buf.find('\n')) != std::string::npos) {
+				char packet_str[BSPacket::kMaxPacketLen] = "";
+				strncpy(packet_str, rx_buf.c_str(), std::min(eol, static_cast<size_t>(BSPacket::kMaxPacketLen - 1)));
+				rx_buf.erase(0, eol + 1);
+				Answer(packet_str);
+			}
+		}
+	}
+	void Answer(char packet_str[BSPacket::kMaxPacketLen]) {
+		char reply_str[BSPacket::kMaxPacketLen];
+		switch (BSPacket(packet_str).GetPacketType()) {
+			case BSPacket::MRD: {
+				MRDPacket mrd = MRDPacket(packet_str);
+				if (num_mrds++ == 0) {
+					SRSPacket srs = SRSPacket(kNumCells, (char *)"ERR:2"); // kErrCodePacketLengthExceeded
+					srs.SetTag(mrd.GetTag());
+					srs.ToString(reply_str);
+					break;
+				}
+				char values[kNumCells][BSPacket::kMaxPacketFieldLen];
+				for (uint16_t i = 0; i < kNumCells; i++) {
+					snprintf(values[i], BSPacket::kMaxPacketFieldLen, "%.2f", CoalescedChain::CellVoltage(i + 1));
+				}
+				MRDPacket mrd_response = MRDPacket(mrd.reg_addrs[0], values, kNumCells);
+				mrd_response.SetTag(mrd.GetTag());
+				mrd_response.ToString(reply_str);
+				break;
+			} case BSPacket::SRD: {
+				SRDPacket srd = SRDPacket(packet_str);
+				char value[BSPacket::kMaxPacketFieldLen];
+				snprintf(value, BSPacket::kMaxPacketFieldLen, "%.2f", CoalescedChain::CellVoltage(srd.cell_id));
+				SRSPacket srs = SRSPacket(srd.cell_id, value);
+				srs.SetTag(srd.GetTag());
+				srs.ToString(reply_str);
+				break;
+			} default:
+				return;
+		}
+		std::string out = std::string(reply_str) + "\r\n";
+		EXPECT_EQ(write(chain_fd, out.data(), out.size()), static_cast<ssize_t>(out.size()));
+	}
+
+	Reactor reactor;
+	SerialPort port;
+	SCBSMaster master;
+	int chain_fd = -1;
+	std::atomic<bool> running{true};
+	std::atomic<uint16_t> num_mrds{0};
+	std::thread reactor_thread;
+	std::thread chain_thread;
+};
+
+/**
+ * After a sweep that was too long, reads go out as SRDs until the retry interval is up, then a sweep is tried again.
+ * Once one fits, every window is swept again.
+*/
+TEST(SCBSCoalescer, SweepsAgainOnceTheChainFits) {
+	const uint32_t sweep_retry_us = 300000;
+	ScriptedChain chain;
+	SCBSCoalescer coalescer(chain.reactor, chain.master, 5000, sweep_retry_us);
+	uint32_t expected_num_sweeps[] = {1, 1, 2, 3}; // too long, skipped, retried and fits, back to sweeping
+	uint32_t expected_num_single_reads[] = {2, 4, 4, 4};
+
+	for (uint16_t round = 0; round < 4; round++) {
+		if (round == 2) {
+			std::this_thread::sleep_for(std::chrono::microseconds(2 * sweep_retry_us));
+		}
+		std::future<SCBSCoalescer::ReadResult_t> result_a = coalescer.Read(1, 0x1000u);
+		std::future<SCBSCoalescer::ReadResult_t> result_b = coalescer.Read(ScriptedChain::kNumCells, 0x1000u);
+		ASSERT_NEAR(strtof(result_a.get().value, NULL), CoalescedChain::CellVoltage(1), 0.001f);
+		ASSERT_NEAR(strtof(result_b.get().value, NULL), CoalescedChain::CellVoltage(ScriptedChain::kNumCells), 0.001f);
+		SCBSCoalescer::Stats_t stats = coalescer.GetStats();
+		ASSERT_EQ(stats.num_sweeps, expected_num_sweeps[round]);
+		ASSERT_EQ(stats.num_single_reads, expected_num_single_reads[round]);
+	}
+	ASSERT_EQ(chain.num_mrds, 3);
+}
+
+/**
+ * With the chain paced to the wall clock at the real baud rate, polling a few registers from every cell as fast as the
+ * chain will take it should get through many more reads with the coalescer than with one SRD per cell and register.
+ * Rounds are started a little further apart than the hold window so that each round gets its own sweeps.
+*/
+static uint64_t TimePolling(bool coalesce, uint16_t num_cells, uint16_t num_rounds) {
+	const uint32_t reg_addrs[] = {0x1000u, 0x1003u, 0x2000u, 0x2205u};
+	const uint16_t num_reg_addrs = sizeof(reg_addrs) / sizeof(reg_addrs[0]);
+	CoalescedChain sim(num_cells, true);
+	SCBSCoalescer coalescer(sim.reactor, sim.master);
+
+	std::vector<std::future<SCBSCoalescer::ReadResult_t>> results;
+	std::vector<std::future<SCBSMaster::Response_t>> responses;
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	for (uint16_t round = 0; round < num_rounds; round++) {
+		for (uint16_t i = 0; i < num_reg_addrs; i++) {
+			for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+				if (coalesce) {
+					results.push_back(coalescer.Read(cell_id, reg_addrs[i]));
+				} else {
+					SRDPacket srd = SRDPacket(cell_id, reg_addrs[i]);
+					responses.push_back(sim.master.Send(srd));
+				}
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(2 * SCBSCoalescer::kDefaultHoldUs));
+	}
+	for (size_t i = 0; i < results.size(); i++) {
+		EXPECT_EQ(results[i].get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	}
+	for (size_t i = 0; i < responses.size(); i++) {
+		EXPECT_EQ(responses[i].get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	}
+	return Reactor::GetTimeUs() - start_time_us;
+}
+
+TEST(SCBSCoalescer, SweepsBeatPipelinedSRDs) {
+	const uint16_t num_cells = 8;
+	const uint16_t num_rounds = 4;
+	uint64_t srd_us = TimePolling(false, num_cells, num_rounds);
+	uint64_t coalesced_us = TimePolling(true, num_cells, num_rounds);
+	printf("SCBSCoalescer: %d rounds of %d cells took %lu us with SRDs, %lu us coalesced.\r\n", num_rounds, num_cells,
+		srd_us, coalesced_us);
+	ASSERT_LT(coalesced_us * 2, srd_us);
+}
@@ -148,7 +148,7 @@ TEST(MWRPacketConstructor, StringTooLong) {
 TEST(MRDPacketConstructor, FromValues) {
 	char values_in[MRDPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen] = {"beefcakes", "twelve", "toodles"};
 	MRDPacket packet = MRDPacket(0x843u, values_in, 3);
-	ASSERT_EQ(packet.reg_addr, 0x843u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x843u);
 	ASSERT_EQ(packet.num_values, 3);
 	ASSERT_STREQ(packet.values[0], "beefcakes");
 	ASSERT_STREQ(packet.values[1], "twelve");
@@ -159,7 +159,7 @@ TEST(MRDPacketConstructor, NoValues) {
 	char values_in[][BSPacket::kMaxPacketFieldLen] = {
 	};
 	MRDPacket packet = MRDPacket(0x843u, values_in, 3);
-	ASSERT_EQ(packet.reg_addr, 0x843u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x843u);
 	ASSERT_EQ(packet.num_values, 3);
 	ASSERT_STREQ(packet.values[0], "");
 	ASSERT_STREQ(packet.values[1], "");
@@ -203,7 +203,7 @@ TEST(MRDPacketConstructor, FromStringBasic) {
 	"I,work,in,a,button,factory,yessiree,I,got,a,wife,three,kids,and*58";
 	MRDPacket packet = MRDPacket(str_buf);
 	ASSERT_TRUE(packet.IsValid());
-	ASSERT_EQ(packet.reg_addr, 0x843u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x843u);
 	ASSERT_EQ(packet.num_values, 20);
 	ASSERT_STREQ(packet.values[0], "hi");
 	ASSERT_STREQ(packet.values[1], "my");
@@ -232,7 +232,7 @@ TEST(MRDPacketConstructor, FromStringTooMany) {
 	"I,work,in,a,button,factory,yessiree,I,got,a,wife,three,kids,and,a,family*2F";
 	MRDPacket packet = MRDPacket(str_buf);
 	ASSERT_FALSE(packet.IsValid());
-	ASSERT_EQ(packet.reg_addr, 0x843u); // ok, gets to this before failing out
+	ASSERT_EQ(packet.reg_addrs[0], 0x843u); // ok, gets to this before failing out
 	ASSERT_EQ(packet.num_values, 20); // should rail to kMaxNumValues
 }
 
@@ -241,7 +241,7 @@ TEST(MRDPacketConstructor, FromStringInvalid) {
 	"I,work,in,a,button,factory,yessiree,I,got,a,wife,three,kids,and,a,family*33";
 	MRDPacket packet = MRDPacket(str_buf);
 	ASSERT_FALSE(packet.IsValid());
-	ASSERT_EQ(packet.reg_addr, 0x00u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x00u);
 	ASSERT_EQ(packet.num_values, 0);
 	for (uint16_t i = 0; i < MRDPacket::kMaxNumValues; i++) {
 		ASSERT_STREQ(packet.values[i], "");
@@ -254,7 +254,7 @@ TEST(MRDPacketConstructor, FromStringLong) {
 		"strn,thisisaverylongstrn,thisisaverylongstrn,thisisaverylongstrn*01";
 	MRDPacket packet = MRDPacket(str_buf);
 	ASSERT_TRUE(packet.IsValid());
-	ASSERT_EQ(packet.reg_addr, 0x843u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x843u);
 	ASSERT_EQ(packet.num_values, 9);
 	for (uint16_t i = 0; i < 9; i++) {
 		ASSERT_STREQ(packet.values[i], "thisisaverylongstrn");
@@ -268,7 +268,7 @@ TEST(MRDPacketConstructor, FromStringTooLong) {
 		"averylongstrn*01";
 	MRDPacket packet = MRDPacket(str_buf);
 	ASSERT_FALSE(packet.IsValid());
-	ASSERT_EQ(packet.reg_addr, 0x00u);
+	ASSERT_EQ(packet.reg_addrs[0], 0x00u);
 	ASSERT_EQ(packet.num_values, 0);
 }
 
@@ -291,7 +291,7 @@ TEST(SWRPacketConstructor, FromStringValid) {
 TEST(SRDPacketConstructor, ValuesToString) {
 	SRDPacket packet = SRDPacket(67, 0xBEEFBEFA);
 	ASSERT_EQ(packet.cell_id, 67);
-	ASSERT_EQ(packet.reg_addr, 0xBEEFBEFA);
+	ASSERT_EQ(packet.reg_addrs[0], 0xBEEFBEFA);
 	char str_buf[BSPacket::kMaxPacketLen];
 	packet.ToString(str_buf);
 	ASSERT_STREQ(str_buf, "$BSSRD,67,BEEFBEFA*51");
@@ -302,14 +302,389 @@ TEST(SRDPacketConstructor, FromStringValid) {
 	SRDPacket packet = SRDPacket(str_buf);
 	ASSERT_TRUE(packet.IsValid());
 	ASSERT_EQ(packet.cell_id, 67);
-	ASSERT_EQ(packet.reg_addr, 0xBEEFBEFA);
+	ASSERT_EQ(packet.reg_addrs[0], 0xBEEFBEFA);
+}
+
+TEST(SWRPacketConstructor, CellRangeStringToString) {
+	SWRPacket packet = SWRPacket(BSPacket::CellRange(3, 14), 0x1000u, (char *)"2.50");
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSWR,3-14,1000,2.50*", 22), 0);
+
+	SWRPacket parsed_packet = SWRPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.cell_id, 3);
+	ASSERT_EQ(parsed_packet.last_cell_id, 14);
+	ASSERT_EQ(parsed_packet.group_id, static_cast<uint16_t>(BSPacket::kNoGroupID));
+	ASSERT_TRUE(BSPacket::IsMulticast(parsed_packet.GetCells()));
+	ASSERT_FALSE(BSPacket::SelectsCell(parsed_packet.GetCells(), 2, BSPacket::kNoGroupID));
+	ASSERT_TRUE(BSPacket::SelectsCell(parsed_packet.GetCells(), 3, BSPacket::kNoGroupID));
+	ASSERT_TRUE(BSPacket::SelectsCell(parsed_packet.GetCells(), 14, BSPacket::kNoGroupID));
+	ASSERT_FALSE(BSPacket::SelectsCell(parsed_packet.GetCells(), 15, BSPacket::kNoGroupID));
+}
+
+TEST(SWRPacketConstructor, SingleCellIsNotMulticast) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSSWR,53,DEADBEEF,hi there sir what i*09";
+	SWRPacket packet = SWRPacket(str_buf);
+	ASSERT_TRUE(packet.IsValid());
+	ASSERT_EQ(packet.last_cell_id, 53);
+	ASSERT_FALSE(BSPacket::IsMulticast(packet.GetCells()));
+}
+
+TEST(SWRPacketConstructor, BackwardsCellRangeInvalid) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSSWR,14-3,1000,2.50*00";
+	// Fix up the checksum so only the cell range is wrong.
+	BSPacket raw_packet = BSPacket(str_buf);
+	snprintf(strchr(str_buf, '*'), 4, "*%02X", raw_packet.CalculateChecksum());
+	ASSERT_FALSE(SWRPacket(str_buf).IsValid());
+}
+
+TEST(SRDPacketConstructor, CellGroupStringToString) {
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u};
+	SRDPacket packet = SRDPacket(BSPacket::CellGroup(7), reg_addrs, 2);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSRD,G7,1000|2000*", 20), 0);
+
+	SRDPacket parsed_packet = SRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.group_id, 7);
+	ASSERT_EQ(parsed_packet.num_reg_addrs, 2);
+	ASSERT_TRUE(BSPacket::IsMulticast(parsed_packet.GetCells()));
+	ASSERT_TRUE(BSPacket::SelectsCell(parsed_packet.GetCells(), 1, 7));
+	ASSERT_FALSE(BSPacket::SelectsCell(parsed_packet.GetCells(), 1, 6));
+	ASSERT_FALSE(BSPacket::SelectsCell(parsed_packet.GetCells(), 1, BSPacket::kNoGroupID));
+}
+
+TEST(SRDPacketConstructor, NoGroupInvalid) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSSRD,G0,1000*00";
+	// Fix up the checksum so only the group is wrong.
+	BSPacket raw_packet = BSPacket(str_buf);
+	snprintf(strchr(str_buf, '*'), 4, "*%02X", raw_packet.CalculateChecksum());
+	ASSERT_FALSE(SRDPacket(str_buf).IsValid());
 }
 
 TEST(SRSPacketConstructor, ValuesToString) {
 	SRSPacket packet = SRSPacket(36, (char *)"test message 123");
 	ASSERT_EQ(packet.cell_id, 36);
-	ASSERT_STREQ(packet.value, "test message 123");
+	ASSERT_STREQ(packet.values[0], "test message 123");
 	char str_buf[BSPacket::kMaxPacketLen];
 	packet.ToString(str_buf);
 	ASSERT_STREQ(str_buf, "$BSSRS,36,test message 123*0B");
-}
\ No newline at end of file
+}
+TEST(VWRPacketConstructor, FromValues) {
+	char values_in[][BSPacket::kMaxPacketFieldLen] = {"3.70", "3.65", "4.10"};
+	VWRPacket packet = VWRPacket(0x1000u, values_in, 3);
+	ASSERT_EQ(packet.reg_addr, 0x1000u);
+	ASSERT_EQ(packet.num_values, 3);
+	ASSERT_STREQ(packet.values[0], "3.70");
+	ASSERT_STREQ(packet.values[2], "4.10");
+
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	VWRPacket parsed_packet = VWRPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.GetPacketType(), BSPacket::VWR);
+	ASSERT_EQ(parsed_packet.reg_addr, 0x1000u);
+	ASSERT_EQ(parsed_packet.num_values, 3);
+	ASSERT_STREQ(parsed_packet.values[0], "3.70");
+	ASSERT_STREQ(parsed_packet.values[1], "3.65");
+	ASSERT_STREQ(parsed_packet.values[2], "4.10");
+}
+
+TEST(VWRPacketConstructor, NoValues) {
+	char values_in[][BSPacket::kMaxPacketFieldLen] = {"unused"};
+	VWRPacket packet = VWRPacket(0x1000u, values_in, 0);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+
+	VWRPacket parsed_packet = VWRPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.reg_addr, 0x1000u);
+	ASSERT_EQ(parsed_packet.num_values, 0);
+}
+
+TEST(VWRPacketConstructor, FromStringInvalid) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSVWR,1000,3.70,3.65*00";
+	VWRPacket packet = VWRPacket(str_buf);
+	ASSERT_FALSE(packet.IsValid());
+	ASSERT_EQ(packet.num_values, 0);
+}
+
+TEST(VWRPacketToString, FitsInMaxPacketLen) {
+	char values_in[VWRPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+	for (uint16_t i = 0; i < VWRPacket::kMaxNumValues; i++) {
+		strcpy(values_in[i], "4.50");
+	}
+	VWRPacket packet = VWRPacket(0xFFFFFFFFu, values_in, VWRPacket::kMaxNumValues);
+	char str_buf[BSPacket::kMaxPacketLen];
+	ASSERT_LT(packet.ToString(str_buf), static_cast<uint16_t>(BSPacket::kMaxPacketLen));
+
+	VWRPacket parsed_packet = VWRPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_values, static_cast<uint16_t>(VWRPacket::kMaxNumValues));
+}
+
+TEST(MRDPacketConstructor, MultiRegisterStringToString) {
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u, 0x3000u};
+	char values_in[][BSPacket::kMaxPacketFieldLen] = {"3.70", "12.50", "fw"};
+	MRDPacket packet = MRDPacket(reg_addrs, 3, values_in, 3);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSMRD,1000|2000|3000,3.70,12.50,fw*", 36), 0);
+
+	MRDPacket parsed_packet = MRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_reg_addrs, 3);
+	ASSERT_EQ(parsed_packet.reg_addrs[0], 0x1000u);
+	ASSERT_EQ(parsed_packet.reg_addrs[1], 0x2000u);
+	ASSERT_EQ(parsed_packet.reg_addrs[2], 0x3000u);
+	ASSERT_EQ(parsed_packet.num_values, 3);
+	ASSERT_STREQ(parsed_packet.values[1], "12.50");
+}
+
+TEST(MRDPacketConstructor, TooManyRegisters) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSMRD,1|2|3|4|5*00";
+	// Fix up the checksum so only the register list is wrong.
+	BSPacket raw_packet = BSPacket(str_buf);
+	snprintf(strchr(str_buf, '*'), 4, "*%02X", raw_packet.CalculateChecksum());
+	MRDPacket packet = MRDPacket(str_buf);
+	ASSERT_FALSE(packet.IsValid());
+}
+
+TEST(MRDPacketMaxNumCells, Limits) {
+	// Existing single register behavior: 9 cells with 19 character values fit (see MRDPacketToString.ValuesTooLong).
+	ASSERT_EQ(MRDPacket::MaxNumCells(1, 19), 7); // conservative, assumes a full register list
+	ASSERT_EQ(MRDPacket::MaxNumCells(1, 4), 20); // capped by kMaxNumValues
+	ASSERT_EQ(MRDPacket::MaxNumCells(3, 6), 6);
+	ASSERT_EQ(MRDPacket::MaxNumCells(0, 4), 0);
+	ASSERT_EQ(MRDPacket::MaxNumCells(BSPacket::kMaxNumRegAddrs+1, 4), 0);
+
+	// A packet filled to the limit must survive ToString() without dropping values.
+	uint16_t num_reg_addrs = BSPacket::kMaxNumRegAddrs;
+	uint32_t reg_addrs[] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
+	uint16_t num_values = MRDPacket::MaxNumCells(num_reg_addrs, 8) * num_reg_addrs;
+	char values_in[MRDPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+	for (uint16_t i = 0; i < num_values; i++) {
+		strcpy(values_in[i], "12345678");
+	}
+	MRDPacket packet = MRDPacket(reg_addrs, num_reg_addrs, values_in, num_values);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	MRDPacket parsed_packet = MRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_values, num_values);
+}
+
+TEST(SRDPacketConstructor, MultiRegisterStringToString) {
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u};
+	SRDPacket packet = SRDPacket(4, reg_addrs, 2);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSRD,4,1000|2000*", 19), 0);
+
+	SRDPacket parsed_packet = SRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.cell_id, 4);
+	ASSERT_EQ(parsed_packet.num_reg_addrs, 2);
+	ASSERT_EQ(parsed_packet.reg_addrs[0], 0x1000u);
+	ASSERT_EQ(parsed_packet.reg_addrs[1], 0x2000u);
+}
+
+TEST(SRSPacketConstructor, MultipleValues) {
+	char values_in[][BSPacket::kMaxPacketFieldLen] = {"3.70", "12.50", "scbs_pico-0.1.0"};
+	SRSPacket packet = SRSPacket(9, values_in, 3);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSRS,9,3.70,12.50,scbs_pico-0.1.0*", 36), 0);
+
+	SRSPacket parsed_packet = SRSPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_values, 3);
+	ASSERT_STREQ(parsed_packet.values[0], "3.70");
+	ASSERT_STREQ(parsed_packet.values[2], "scbs_pico-0.1.0");
+}
+
+TEST(BSPacketTag, UntaggedByDefault) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSSRD,67,BEEFBEFA*51";
+	BSPacket packet = BSPacket(str_buf);
+	ASSERT_TRUE(packet.IsValid());
+	ASSERT_EQ(packet.GetTag(), static_cast<uint16_t>(BSPacket::kNoTag));
+}
+
+TEST(BSPacketTag, TaggedStringToString) {
+	SRDPacket packet = SRDPacket(67, 0xBEEFBEFA);
+	packet.SetTag(0x1A);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSRD#1A,67,BEEFBEFA*", 22), 0);
+
+	BSPacket generic_packet = BSPacket(str_buf);
+	ASSERT_TRUE(generic_packet.IsValid());
+	ASSERT_EQ(generic_packet.GetPacketType(), BSPacket::SRD);
+	ASSERT_EQ(generic_packet.GetTag(), 0x1A);
+
+	SRDPacket parsed_packet = SRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.GetTag(), 0x1A);
+	ASSERT_EQ(parsed_packet.cell_id, 67);
+	ASSERT_EQ(parsed_packet.reg_addrs[0], 0xBEEFBEFA);
+
+	// Clearing the tag goes back to the untagged format.
+	parsed_packet.SetTag(BSPacket::kNoTag);
+	parsed_packet.ToString(str_buf);
+	ASSERT_STREQ(str_buf, "$BSSRD,67,BEEFBEFA*51");
+}
+
+TEST(BSPacketTag, MaxTagFitsInMaxPacketLen) {
+	char values_in[MRDPacket::kMaxNumValues][BSPacket::kMaxPacketFieldLen];
+	for (uint16_t i = 0; i < MRDPacket::kMaxNumValues; i++) {
+		strcpy(values_in[i], "thisisaverylongstrn");
+	}
+	uint32_t reg_addrs[] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
+	MRDPacket packet = MRDPacket(reg_addrs, 4, values_in, MRDPacket::kMaxNumValues);
+	packet.SetTag(0xFFFF);
+	char str_buf[BSPacket::kMaxPacketLen];
+	ASSERT_LT(packet.ToString(str_buf), static_cast<uint16_t>(BSPacket::kMaxPacketLen));
+
+	MRDPacket parsed_packet = MRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.GetTag(), 0xFFFF);
+}
+
+TEST(SYNPacketConstructor, StringToString) {
+	SYNPacket packet = SYNPacket(200000u);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSSYN,200000*", 14), 0);
+
+	SYNPacket parsed_packet = SYNPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.GetPacketType(), BSPacket::SYN);
+	ASSERT_EQ(parsed_packet.delay_us, 200000u);
+}
+
+TEST(SYNPacketConstructor, FromStringMissingDelay) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSSYN*1E";
+	SYNPacket packet = SYNPacket(str_buf);
+	ASSERT_FALSE(packet.IsValid());
+}
+
+TEST(PRFPacketConstructor, StringToString) {
+	char points_in[][BSPacket::kMaxPacketFieldLen] = {"0:3.700", "1000:3.650", "2500:3.600"};
+	PRFPacket packet = PRFPacket(2, 16, points_in, 3);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSPRF,2,16,0:3.700,1000:3.650,2500:3.600*", 42), 0);
+
+	PRFPacket parsed_packet = PRFPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.cell_id, 2);
+	ASSERT_EQ(parsed_packet.first_point_index, 16);
+	ASSERT_EQ(parsed_packet.num_points, 3);
+	ASSERT_STREQ(parsed_packet.points[0], "0:3.700");
+	ASSERT_STREQ(parsed_packet.points[2], "2500:3.600");
+}
+
+TEST(PRFPacketToString, FitsInMaxPacketLen) {
+	char points_in[PRFPacket::kMaxNumPoints][BSPacket::kMaxPacketFieldLen];
+	for (uint16_t i = 0; i < PRFPacket::kMaxNumPoints; i++) {
+		strcpy(points_in[i], "123456:3.700");
+	}
+	PRFPacket packet = PRFPacket(65535, 65535, points_in, PRFPacket::kMaxNumPoints);
+	packet.SetTag(0xFFFF);
+	char str_buf[BSPacket::kMaxPacketLen];
+	ASSERT_LT(packet.ToString(str_buf), static_cast<uint16_t>(BSPacket::kMaxPacketLen));
+
+	PRFPacket parsed_packet = PRFPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_points, static_cast<uint16_t>(PRFPacket::kMaxNumPoints));
+}
+
+TEST(BRDPacketConstructor, StringToString) {
+	BRDPacket packet = BRDPacket(3, 112, 56);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSBRD,3,112,56*", 16), 0);
+
+	BRDPacket parsed_packet = BRDPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.cell_id, 3);
+	ASSERT_EQ(parsed_packet.offset, 112);
+	ASSERT_EQ(parsed_packet.num_samples, 56);
+}
+
+TEST(BRSPacketConstructor, StringToString) {
+	uint16_t samples_in[] = {0x7FF, 0x800, 0x00A, 0xFFF};
+	BRSPacket packet = BRSPacket(2, 112, samples_in, 4);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSBRS,2,112,7FF80000AFFF*", 26), 0);
+
+	BRSPacket parsed_packet = BRSPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.cell_id, 2);
+	ASSERT_EQ(parsed_packet.offset, 112);
+	ASSERT_EQ(parsed_packet.num_samples, 4);
+	for (uint16_t i = 0; i < 4; i++) {
+		ASSERT_EQ(parsed_packet.samples[i], samples_in[i]);
+	}
+}
+
+TEST(BRSPacketConstructor, NoSamples) {
+	BRSPacket packet = BRSPacket(2, 0, NULL, 0);
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSBRS,2,0,*", 12), 0);
+
+	BRSPacket parsed_packet = BRSPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_samples, 0);
+}
+
+TEST(BRSPacketConstructor, RejectsPartialSample) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSBRS,2,0,7FF8*00";
+	// Fix up the checksum so only the samples field is wrong.
+	BSPacket raw_packet = BSPacket(str_buf);
+	snprintf(strchr(str_buf, '*'), 4, "*%02X", raw_packet.CalculateChecksum());
+	ASSERT_TRUE(BSPacket(str_buf).IsValid());
+	ASSERT_FALSE(BRSPacket(str_buf).IsValid());
+}
+
+TEST(BRSPacketToString, FitsInMaxPacketLen) {
+	uint16_t samples_in[BRSPacket::kMaxNumSamples];
+	for (uint16_t i = 0; i < BRSPacket::kMaxNumSamples; i++) {
+		samples_in[i] = 0xFFF - i;
+	}
+	BRSPacket packet = BRSPacket(65535, 65535, samples_in, BRSPacket::kMaxNumSamples);
+	packet.SetTag(0xFFFF);
+	char str_buf[BSPacket::kMaxPacketLen];
+	ASSERT_LT(packet.ToString(str_buf), static_cast<uint16_t>(BSPacket::kMaxPacketLen));
+
+	BRSPacket parsed_packet = BRSPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.num_samples, static_cast<uint16_t>(BRSPacket::kMaxNumSamples));
+	ASSERT_EQ(parsed_packet.samples[BRSPacket::kMaxNumSamples-1], 0xFFF - (BRSPacket::kMaxNumSamples-1));
+}
+
+TEST(EVTPacketConstructor, StringToString) {
+	EVTPacket packet = EVTPacket(3, 1, (char *)"152.34");
+	char str_buf[BSPacket::kMaxPacketLen];
+	packet.ToString(str_buf);
+	ASSERT_EQ(strncmp(str_buf, "$BSEVT,3,1,152.34*", 18), 0);
+
+	EVTPacket parsed_packet = EVTPacket(str_buf);
+	ASSERT_TRUE(parsed_packet.IsValid());
+	ASSERT_EQ(parsed_packet.GetPacketType(), BSPacket::EVT);
+	ASSERT_EQ(parsed_packet.cell_id, 3);
+	ASSERT_EQ(parsed_packet.event_code, 1);
+	ASSERT_STREQ(parsed_packet.value, "152.34");
+}
+
+TEST(EVTPacketConstructor, MissingValue) {
+	char str_buf[BSPacket::kMaxPacketLen] = "$BSEVT,3,1*00";
+	// Fix up the checksum so only the missing field is wrong.
+	BSPacket raw_packet = BSPacket(str_buf);
+	snprintf(strchr(str_buf, '*'), 4, "*%02X", raw_packet.CalculateChecksum());
+	ASSERT_FALSE(EVTPacket(str_buf).IsValid());
+}
@@ -0,0 +1,271 @@
+#include "gtest/gtest.h"
+#include "scbs_simulated_chain.hh"
+#include "scbs_daemon.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+
+/**
+ * Simulated chain shared by a daemon listening on a socket in /tmp. The chain is enumerated before the daemon starts
+ * taking clients.
+*/
+class SimulatedDaemon : public SimulatedChain {
+public:
+	SimulatedDaemon(uint16_t num_cells, SCBSMaster::SCBSMasterConfig_t config, bool real_time = false)
+		: SimulatedChain(num_cells, config, real_time)
+		, daemon(reactor, master)
+	{
+		snprintf(socket_path, sizeof(socket_path), "/tmp/scbs_test_%d.sock", getpid());
+		EXPECT_TRUE(daemon.Listen(socket_path));
+		Start();
+		Enumerate();
+	}
+	~SimulatedDaemon() {
+		Stop();
+		daemon.Close();
+	}
+
+	char socket_path[64];
+	SCBSDaemon daemon;
+};
+
+/**
+ * Blocking client for the daemon's line protocol.
+*/
+class TestClient {
+public:
+	TestClient(const char * socket_path) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+		EXPECT_EQ(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)), 0);
+	}
+	~TestClient() {
+		close(fd);
+	}
+
+	template <class PacketType>
+	void WritePacket(PacketType packet, uint16_t tag) {
+		char packet_str[BSPacket::kMaxPacketLen];
+		packet.SetTag(tag);
+		packet.ToString(packet_str);
+		WriteLine(packet_str);
+	}
+	void WriteLine(const char * line) {
+		std::string out = std::string(line) + "\r\n";
+		ASSERT_EQ(write(fd, out.data(), out.size()), static_cast<ssize_t>(out.size()));
+	}
+	/**
+	 * Reads one line, without "\r\n". Returns false if nothing came within timeout_ms.
+	*/
+	bool ReadLine(char line_buf[BSPacket::kMaxPacketLen], int timeout_ms = 2000) {
+		size_t eol;
+		while ((eol = rx_buf.find('\n')) == std::string::npos) {
+			struct pollfd pfd = {fd, POLLIN, 0};
+			if (poll(&pfd, 1, timeout_ms) <= 0) {
+				return false;
+			}
+			char chunk[256];
+			ssize_t num_read = read(fd, chunk, sizeof(chunk));
+			if (num_read <= 0) {
+				return false;
+			}
+			rx_buf.append(chunk, num_read);
+		}
+		std::string line = rx_buf.substr(0, eol);
+		rx_buf.erase(0, eol + 1);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		strncpy(line_buf, line.c_str(), BSPacket::kMaxPacketLen);
+		return true;
+	}
+
+	int fd;
+	std::string rx_buf;
+};
+
+TEST(SCBSDaemon, RoutesResponsesToTheClientThatAsked) {
+	SimulatedDaemon sim(3, SCBSMaster::SCBSMasterConfig_t());
+	TestClient client_a(sim.socket_path);
+	TestClient client_b(sim.socket_path);
+
+	// Both clients use the same tag, the daemon keeps them apart.
+	client_a.WritePacket(SRDPacket(1, 0x3002u), 5);
+	client_b.WritePacket(SRDPacket(3, 0x3002u), 5);
+
+	char line_buf[BSPacket::kMaxPacketLen];
+	ASSERT_TRUE(client_a.ReadLine(line_buf));
+	SRSPacket srs_a = SRSPacket(line_buf);
+	ASSERT_TRUE(srs_a.IsValid());
+	ASSERT_EQ(srs_a.GetTag(), 5);
+	ASSERT_EQ(srs_a.cell_id, 1);
+
+	ASSERT_TRUE(client_b.ReadLine(line_buf));
+	SRSPacket srs_b = SRSPacket(line_buf);
+	ASSERT_TRUE(srs_b.IsValid());
+	ASSERT_EQ(srs_b.GetTag(), 5);
+	ASSERT_EQ(srs_b.cell_id, 3);
+	ASSERT_NE(strcmp(srs_a.values[0], srs_b.values[0]), 0); // unique IDs of different boards
+
+	ASSERT_FALSE(client_a.ReadLine(line_buf, 50)); // nothing else for either client
+	ASSERT_FALSE(client_b.ReadLine(line_buf, 50));
+}
+
+TEST(SCBSDaemon, UntaggedRequestsAndCommands) {
+	SimulatedDaemon sim(2, SCBSMaster::SCBSMasterConfig_t());
+	TestClient client(sim.socket_path);
+	char line_buf[BSPacket::kMaxPacketLen];
+
+	client.WritePacket(SRDPacket(2, 0x1000u), BSPacket::kNoTag);
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	SRSPacket srs = SRSPacket(line_buf);
+	ASSERT_TRUE(srs.IsValid());
+	ASSERT_EQ(srs.GetTag(), static_cast<uint16_t>(BSPacket::kNoTag));
+	ASSERT_EQ(srs.cell_id, 2);
+
+	client.WriteLine("PRIORITY,0");
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_STREQ(line_buf, "OK");
+	client.WriteLine("PRIORITY,9");
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_STREQ(line_buf, "ERR");
+
+	client.WriteLine("$BSSRD#3,1,1000*00"); // bad checksum
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	SRSPacket err = SRSPacket(line_buf);
+	ASSERT_TRUE(err.IsValid());
+	ASSERT_STREQ(err.values[0], "ERR:102"); // SCBSMaster::kErrCodeInvalidRequest
+}
+
+TEST(SCBSDaemon, HigherPriorityJumpsTheQueue) {
+	SCBSMaster::SCBSMasterConfig_t config;
+	config.window = 1; // one request on the chain at a time, so the order they go out in is easy to see
+	SimulatedDaemon sim(4, config);
+	TestClient bulk_client(sim.socket_path);
+	TestClient urgent_client(sim.socket_path);
+	char line_buf[BSPacket::kMaxPacketLen];
+
+	bulk_client.WriteLine("PRIORITY,3");
+	ASSERT_TRUE(bulk_client.ReadLine(line_buf));
+	urgent_client.WriteLine("PRIORITY,0");
+	ASSERT_TRUE(urgent_client.ReadLine(line_buf));
+
+	const uint16_t num_bulk_requests = 60;
+	for (uint16_t i = 1; i <= num_bulk_requests; i++) {
+		bulk_client.WritePacket(SRDPacket(4, 0x1000u), i);
+	}
+	urgent_client.WritePacket(SRDPacket(1, 0x1000u), 1);
+	ASSERT_TRUE(urgent_client.ReadLine(line_buf));
+	ASSERT_EQ(SRSPacket(line_buf).cell_id, 1);
+
+	// Urgent request went out ahead of almost all of the bulk requests.
+	uint16_t num_bulk_done = 0;
+	while (bulk_client.ReadLine(line_buf, 0)) {
+		num_bulk_done++;
+	}
+	ASSERT_LT(num_bulk_done, 10);
+
+	// Bulk requests all still complete, in order.
+	for (uint16_t i = num_bulk_done + 1; i <= num_bulk_requests; i++) {
+		ASSERT_TRUE(bulk_client.ReadLine(line_buf));
+		SRSPacket srs = SRSPacket(line_buf);
+		ASSERT_EQ(srs.GetTag(), i);
+		ASSERT_EQ(srs.cell_id, 4);
+	}
+}
+
+TEST(SCBSDaemon, MulticastAndSubscriptions) {
+	SimulatedDaemon sim(3, SCBSMaster::SCBSMasterConfig_t(), true); // frames are paced in chain time
+	TestClient client(sim.socket_path);
+	TestClient listener(sim.socket_path);
+	char line_buf[BSPacket::kMaxPacketLen];
+
+	uint32_t reg_addrs[] = {0x1000u};
+	client.WritePacket(SRDPacket(BSPacket::CellRange(1, 3), reg_addrs, 1), 0x42);
+	for (uint16_t cell_id = 1; cell_id <= 3; cell_id++) {
+		ASSERT_TRUE(client.ReadLine(line_buf));
+		SRSPacket srs = SRSPacket(line_buf);
+		ASSERT_EQ(srs.GetTag(), 0x42);
+		ASSERT_EQ(srs.cell_id, cell_id);
+	}
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_EQ(BSPacket(line_buf).GetPacketType(), BSPacket::SRD);
+
+	listener.WriteLine("SUBSCRIBE,1");
+	ASSERT_TRUE(listener.ReadLine(line_buf));
+	ASSERT_STREQ(line_buf, "OK");
+	client.WritePacket(MWRPacket(0x4000u, (char *)"250"), 1); // stream every 250ms
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_TRUE(listener.ReadLine(line_buf));
+	BSPacket streamed = BSPacket(line_buf);
+	ASSERT_EQ(streamed.GetPacketType(), BSPacket::MRD);
+	ASSERT_EQ(streamed.GetTag(), static_cast<uint16_t>(BSPacket::kNoTag));
+	client.WritePacket(MWRPacket(0x4000u, (char *)"0"), 2);
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_EQ(BSPacket(line_buf).GetTag(), 2); // client never sees streamed packets, not subscribed
+}
+
+TEST(SCBSDaemon, ClientHangingUpDoesNotDisturbOthers) {
+	SimulatedDaemon sim(2, SCBSMaster::SCBSMasterConfig_t());
+	TestClient client(sim.socket_path);
+	char line_buf[BSPacket::kMaxPacketLen];
+	{
+		TestClient quitter(sim.socket_path);
+		for (uint16_t i = 1; i <= 20; i++) {
+			quitter.WritePacket(SRDPacket(2, 0x1000u), i);
+		}
+	}
+	client.WritePacket(SRDPacket(1, 0x1000u), 7);
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_EQ(SRSPacket(line_buf).GetTag(), 7);
+}
+
+/**
+ * A client that keeps sending but never reads is disconnected once its answers back up past kMaxClientTxBufLen, instead
+ * of the daemon holding on to them without limit, and the other clients carry on.
+*/
+TEST(SCBSDaemon, ClientThatStopsReadingIsDropped) {
+	SimulatedDaemon sim(2, SCBSMaster::SCBSMasterConfig_t());
+	TestClient client(sim.socket_path);
+	TestClient stuck(sim.socket_path);
+	char line_buf[BSPacket::kMaxPacketLen];
+
+	// Commands are answered by the daemon itself, so the answers pile up as fast as they can be sent.
+	std::string commands;
+	for (int i = 0; i < 1000; i++) {
+		commands += "SUBSCRIBE,0\r\n";
+	}
+	size_t num_sent = 0;
+	while (num_sent < 16 * 1024 * 1024) { // more answers than the socket and kMaxClientTxBufLen hold between them
+		ssize_t ret = send(stuck.fd, commands.data(), commands.size(), MSG_NOSIGNAL);
+		if (ret <= 0) {
+			break; // dropped
+		}
+		num_sent += ret;
+	}
+	ASSERT_LT(num_sent, 16u * 1024 * 1024);
+
+	// Whatever was already in the socket can still be read, then the connection ends.
+	char chunk[4096];
+	ssize_t num_read;
+	size_t num_answered = 0;
+	while ((num_read = read(stuck.fd, chunk, sizeof(chunk))) > 0) {
+		num_answered += num_read;
+	}
+	ASSERT_EQ(num_read, 0);
+	ASSERT_LT(num_answered, num_sent);
+
+	client.WritePacket(SRDPacket(1, 0x1000u), 7);
+	ASSERT_TRUE(client.ReadLine(line_buf));
+	ASSERT_EQ(SRSPacket(line_buf).GetTag(), 7);
+}
@@ -0,0 +1,69 @@
+#include "gtest/gtest.h"
+#include "scbs_latency_histogram.hh"
+#include <stdint.h>
+
+TEST(SCBSLatencyHistogram, SmallValuesAreExact) {
+	SCBSLatencyHistogram histogram;
+	ASSERT_EQ(histogram.GetValueAtPercentile(50.0), 0u);
+	ASSERT_EQ(histogram.GetMin(), 0u);
+	for (uint64_t value = 1; value <= 200; value++) {
+		histogram.Record(value);
+	}
+	ASSERT_EQ(histogram.GetCount(), 200u);
+	ASSERT_EQ(histogram.GetMin(), 1u);
+	ASSERT_EQ(histogram.GetMax(), 200u);
+	ASSERT_DOUBLE_EQ(histogram.GetMean(), 100.5);
+	ASSERT_EQ(histogram.GetValueAtPercentile(0.0), 1u);
+	ASSERT_EQ(histogram.GetValueAtPercentile(50.0), 100u);
+	ASSERT_EQ(histogram.GetValueAtPercentile(99.0), 198u);
+	ASSERT_EQ(histogram.GetValueAtPercentile(100.0), 200u);
+}
+
+TEST(SCBSLatencyHistogram, BucketsKeepTheirPrecisionAtEveryScale) {
+	for (uint64_t value = 1; value != 0 && value < UINT64_MAX / 3; value = value * 3 + 1) {
+		for (uint64_t offset = 0; offset < 4; offset++) {
+			uint64_t v = value + offset * (value / 7);
+			uint32_t index = SCBSLatencyHistogram::GetBucketIndex(v);
+			ASSERT_LT(index, static_cast<uint32_t>(SCBSLatencyHistogram::kNumBuckets));
+			uint64_t highest_value = SCBSLatencyHistogram::GetBucketHighestValue(index);
+			ASSERT_GE(highest_value, v);
+			ASSERT_LE(highest_value - v, v / 128);
+			ASSERT_EQ(SCBSLatencyHistogram::GetBucketIndex(highest_value), index);
+		}
+	}
+	ASSERT_EQ(SCBSLatencyHistogram::GetBucketIndex(UINT64_MAX), SCBSLatencyHistogram::kNumBuckets - 1);
+	ASSERT_EQ(SCBSLatencyHistogram::GetBucketHighestValue(SCBSLatencyHistogram::kNumBuckets - 1), UINT64_MAX);
+}
+
+TEST(SCBSLatencyHistogram, PercentilesOfAWideDistribution) {
+	SCBSLatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 100000; value++) {
+		histogram.Record(value * 10); // 10 us to 1 s
+	}
+	ASSERT_NEAR(histogram.GetValueAtPercentile(50.0), 500000.0, 500000.0 / 128);
+	ASSERT_NEAR(histogram.GetValueAtPercentile(99.0), 990000.0, 990000.0 / 128);
+	ASSERT_NEAR(histogram.GetValueAtPercentile(99.9), 999000.0, 999000.0 / 128);
+	ASSERT_EQ(histogram.GetValueAtPercentile(100.0), 1000000u); // capped at the real max, not the top of its bucket
+
+	// A slow tail only shows up in the high percentiles.
+	SCBSLatencyHistogram tail;
+	tail.Record(1000, 995);
+	tail.Record(50000, 5);
+	ASSERT_NEAR(tail.GetValueAtPercentile(99.0), 1000.0, 1000.0 / 128);
+	ASSERT_NEAR(tail.GetValueAtPercentile(99.9), 50000.0, 50000.0 / 128);
+
+	uint64_t total_count = 0;
+	std::vector<SCBSLatencyHistogram::Bucket_t> buckets = tail.GetBuckets();
+	ASSERT_EQ(buckets.size(), 2u);
+	for (size_t i = 0; i < buckets.size(); i++) {
+		total_count += buckets[i].second;
+	}
+	ASSERT_EQ(total_count, 1000u);
+
+	histogram.Merge(tail);
+	ASSERT_EQ(histogram.GetCount(), 101000u);
+	ASSERT_EQ(histogram.GetMin(), 10u);
+	histogram.Reset();
+	ASSERT_EQ(histogram.GetCount(), 0u);
+	ASSERT_EQ(histogram.GetMax(), 0u);
+}
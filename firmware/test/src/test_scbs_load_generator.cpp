@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+#include "scbs_load_generator.hh"
+#include "scbs_master.hh"
+#include "scbs_simulated_chain.hh"
+#include "scbs_comms.hh"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+/**
+ * Simulated chain with a load generator on the master's end of it. The chain is enumerated before the test starts.
+*/
+class LoadedChain : public SimulatedChain {
+public:
+	LoadedChain(uint16_t num_cells)
+		: SimulatedChain(num_cells)
+		, generator(reactor, master)
+	{
+		Start();
+		Enumerate();
+	}
+	~LoadedChain() {
+		Stop();
+	}
+
+	SCBSLoadGenerator generator;
+};
+
+static std::string ReadFile(FILE * file) {
+	std::string contents;
+	char buf[256];
+	rewind(file);
+	while (fgets(buf, sizeof(buf), file) != NULL) {
+		contents += buf;
+	}
+	return contents;
+}
+
+TEST(SCBSLoadGenerator, ParseMix) {
+	uint16_t mix[SCBSLoadGenerator::kNumRequestTypes];
+	ASSERT_TRUE(SCBSLoadGenerator::ParseMix("mrd=4,SRD=2,swr=1", mix));
+	ASSERT_EQ(mix[SCBSLoadGenerator::DIS], 0);
+	ASSERT_EQ(mix[SCBSLoadGenerator::MRD], 4);
+	ASSERT_EQ(mix[SCBSLoadGenerator::MWR], 0);
+	ASSERT_EQ(mix[SCBSLoadGenerator::SRD], 2);
+	ASSERT_EQ(mix[SCBSLoadGenerator::SWR], 1);
+
+	ASSERT_FALSE(SCBSLoadGenerator::ParseMix("mrd=0", mix)); // nothing to send
+	ASSERT_FALSE(SCBSLoadGenerator::ParseMix("brd=1", mix));
+	ASSERT_FALSE(SCBSLoadGenerator::ParseMix("mrd", mix));
+	ASSERT_FALSE(SCBSLoadGenerator::ParseMix("mrd=x", mix));
+	ASSERT_FALSE(SCBSLoadGenerator::ParseMix("mrdx=1", mix));
+	ASSERT_EQ(mix[SCBSLoadGenerator::MRD], 4); // left alone on failure
+}
+
+TEST(SCBSLoadGenerator, AsFastAsPossibleSendsTheWholeMix) {
+	const uint16_t num_cells = 4;
+	LoadedChain sim(num_cells);
+	SCBSLoadGenerator::Config_t config;
+	ASSERT_TRUE(SCBSLoadGenerator::ParseMix("dis=1,mrd=2,mwr=1,srd=4,swr=2", config.mix));
+	config.num_requests = 300;
+	config.num_cells = num_cells;
+
+	SCBSLoadGenerator::Report_t report = sim.generator.Run(config).get();
+	ASSERT_EQ(SCBSLoadGenerator::GetNumSent(report), 300u);
+	ASSERT_EQ(report.num_completed, 300u);
+	ASSERT_EQ(report.num_errors, 0u);
+	ASSERT_EQ(report.latency_us.GetCount(), 300u);
+	for (int i = 0; i < SCBSLoadGenerator::kNumRequestTypes; i++) {
+		ASSERT_GT(report.num_sent[i], 0u);
+	}
+	ASSERT_GT(report.num_sent[SCBSLoadGenerator::SRD], report.num_sent[SCBSLoadGenerator::DIS]);
+	ASSERT_GT(SCBSLoadGenerator::GetThroughput(report), 0.0);
+	ASSERT_LE(report.latency_us.GetValueAtPercentile(50.0), report.latency_us.GetValueAtPercentile(99.9));
+	ASSERT_EQ(sim.master.GetNumOutstanding(), 0u);
+
+	// Same seed, same requests.
+	SCBSLoadGenerator::Report_t again = sim.generator.Run(config).get();
+	for (int i = 0; i < SCBSLoadGenerator::kNumRequestTypes; i++) {
+		ASSERT_EQ(again.num_sent[i], report.num_sent[i]);
+	}
+}
+
+TEST(SCBSLoadGenerator, TargetRateIsHeld) {
+	LoadedChain sim(3);
+	SCBSLoadGenerator::Config_t config;
+	config.rate = 200.0;
+	config.num_requests = 0;
+	config.duration_ms = 500;
+	config.num_cells = 3;
+
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	SCBSLoadGenerator::Report_t report = sim.generator.Run(config).get();
+	uint64_t elapsed_us = Reactor::GetTimeUs() - start_time_us;
+	uint32_t num_sent = SCBSLoadGenerator::GetNumSent(report);
+	printf("SCBSLoadGenerator: Sent %u requests at %.0f/s in %lu us, p99 %lu us.\r\n", num_sent, config.rate,
+		elapsed_us, report.latency_us.GetValueAtPercentile(99.0));
+	ASSERT_GE(num_sent, 90u);
+	ASSERT_LE(num_sent, 101u);
+	ASSERT_EQ(report.num_completed, num_sent);
+	ASSERT_GE(elapsed_us, 490000u);
+	ASSERT_NEAR(SCBSLoadGenerator::GetThroughput(report), config.rate, config.rate * 0.1);
+}
+
+TEST(SCBSLoadGenerator, ErrorsAndStop) {
+	LoadedChain sim(2);
+	SCBSLoadGenerator::Config_t config;
+	ASSERT_TRUE(SCBSLoadGenerator::ParseMix("srd=1", config.mix));
+	config.num_requests = 0; // runs until stopped
+	config.num_cells = 4; // cells 3 and 4 aren't there
+
+	std::future<SCBSLoadGenerator::Report_t> future = sim.generator.Run(config);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	sim.generator.Stop();
+	SCBSLoadGenerator::Report_t report = future.get();
+	ASSERT_GT(report.num_completed, 20u);
+	ASSERT_EQ(report.num_completed, SCBSLoadGenerator::GetNumSent(report));
+	ASSERT_GT(report.num_errors, 0u);
+	ASSERT_LT(report.num_errors, report.num_completed);
+	ASSERT_EQ(report.num_timeouts, 0u);
+	double error_rate = SCBSLoadGenerator::GetErrorRate(report);
+	ASSERT_GT(error_rate, 0.25);
+	ASSERT_LT(error_rate, 0.75);
+
+	// Reports go out as CSV rows and JSON for tracking over time.
+	FILE * csv_file = tmpfile();
+	SCBSLoadGenerator::WriteCSVHeader(csv_file);
+	SCBSLoadGenerator::WriteCSV(csv_file, report, "run1");
+	std::string csv = ReadFile(csv_file);
+	fclose(csv_file);
+	ASSERT_EQ(csv.find("label,rate,num_sent,"), 0u);
+	ASSERT_NE(csv.find("\nrun1,0.0,"), std::string::npos);
+
+	FILE * json_file = tmpfile();
+	SCBSLoadGenerator::WriteJSON(json_file, report, "run1");
+	std::string json = ReadFile(json_file);
+	fclose(json_file);
+	ASSERT_NE(json.find("\"label\": \"run1\""), std::string::npos);
+	ASSERT_NE(json.find("\"SRD\": 1"), std::string::npos);
+	char num_errors_str[32];
+	snprintf(num_errors_str, sizeof(num_errors_str), "\"num_errors\": %u", report.num_errors);
+	ASSERT_NE(json.find(num_errors_str), std::string::npos);
+	ASSERT_NE(json.find("\"p999\": "), std::string::npos);
+	ASSERT_NE(json.find("\"buckets\": [["), std::string::npos);
+}
@@ -0,0 +1,178 @@
+#include "gtest/gtest.h"
+#include "scbs_simulated_chain.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(SCBSMaster, DiscoverWriteAndReadBack) {
+	const uint16_t num_cells = 3;
+	SimulatedChain sim(num_cells);
+	sim.Start();
+	sim.Enumerate();
+
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1.00", "2.00", "3.00"};
+	VWRPacket vwr = VWRPacket(0x1000u, values, num_cells);
+	ASSERT_EQ(sim.master.Send(vwr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		SRDPacket srd = SRDPacket(cell_id, 0x1000u);
+		SCBSMaster::Response_t response = sim.master.Send(srd).get();
+		ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		SRSPacket srs = SRSPacket(response.packet_str);
+		ASSERT_EQ(srs.cell_id, cell_id);
+		ASSERT_FLOAT_EQ(strtof(srs.values[0], NULL), static_cast<float>(cell_id));
+	}
+
+	char no_values[1][BSPacket::kMaxPacketFieldLen];
+	MRDPacket mrd = MRDPacket(0x1000u, no_values, 0);
+	SCBSMaster::Response_t response = sim.master.Send(mrd).get();
+	ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	MRDPacket mrd_response = MRDPacket(response.packet_str);
+	ASSERT_EQ(mrd_response.num_values, num_cells);
+	ASSERT_FLOAT_EQ(strtof(mrd_response.values[2], NULL), 3.0f);
+}
+
+TEST(SCBSMaster, ErrorsAndUnansweredRequests) {
+	const uint16_t num_cells = 2;
+	SimulatedChain sim(num_cells);
+	sim.Start();
+	sim.Enumerate();
+
+	SWRPacket swr = SWRPacket(2, 0x2000u, (char *)"1.00"); // current is read only
+	SCBSMaster::Response_t response = sim.master.Send(swr).get();
+	ASSERT_EQ(response.err_code, 0x03); // SCBS::kErrCodeWriteNotSupported
+	ASSERT_EQ(response.err_cell_id, 2);
+
+	SRDPacket srd = SRDPacket(7, 0x1000u); // no cell 7, comes back around unanswered
+	response = sim.master.Send(srd).get();
+	ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNotAnswered));
+
+	SCBSMaster::Stats_t stats = sim.master.GetStats();
+	ASSERT_EQ(stats.num_completed, 3u);
+	ASSERT_EQ(stats.num_errors, 2u);
+}
+
+TEST(SCBSMaster, MulticastReadCollectsEveryCell) {
+	const uint16_t num_cells = 4;
+	SimulatedChain sim(num_cells);
+	sim.Start();
+	sim.Enumerate();
+
+	uint32_t reg_addrs[] = {0x1000u};
+	SRDPacket srd = SRDPacket(BSPacket::CellRange(2, 4), reg_addrs, 1);
+	SCBSMaster::Response_t response = sim.master.Send(srd).get();
+	ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_EQ(BSPacket(response.packet_str).GetPacketType(), BSPacket::SRD);
+	ASSERT_EQ(response.srs_strs.size(), 3u);
+	for (uint16_t i = 0; i < response.srs_strs.size(); i++) {
+		char srs_str[BSPacket::kMaxPacketLen];
+		strncpy(srs_str, response.srs_strs[i].c_str(), BSPacket::kMaxPacketLen);
+		ASSERT_EQ(SRSPacket(srs_str).cell_id, i+2);
+	}
+}
+
+TEST(SCBSMaster, ManyOutstandingRequestsAllMatched) {
+	const uint16_t num_cells = 4;
+	const uint16_t num_requests = 200;
+	SimulatedChain sim(num_cells);
+	sim.Start();
+	sim.Enumerate();
+
+	char values[][BSPacket::kMaxPacketFieldLen] = {"1.00", "2.00", "3.00", "4.00"};
+	VWRPacket vwr = VWRPacket(0x1000u, values, num_cells);
+	ASSERT_EQ(sim.master.Send(vwr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+
+	// Queue everything up front from another thread, far more than fits in the window.
+	std::atomic<uint16_t> num_matched(0);
+	for (uint16_t i = 0; i < num_requests; i++) {
+		uint16_t cell_id = i % num_cells + 1;
+		SRDPacket srd = SRDPacket(cell_id, 0x1000u);
+		sim.master.Send(srd, [cell_id, &num_matched](SCBSMaster::Response_t & response) {
+			SRSPacket srs = SRSPacket(response.packet_str);
+			if (response.err_code == SCBSMaster::kErrCodeNone && srs.cell_id == cell_id
+				&& strtof(srs.values[0], NULL) == static_cast<float>(cell_id)) {
+				num_matched++;
+			}
+		});
+	}
+	MWRPacket mwr = MWRPacket(0x1000u, (char *)"1.00"); // completes after everything ahead of it
+	ASSERT_EQ(sim.master.Send(mwr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_EQ(num_matched, num_requests);
+	ASSERT_EQ(sim.master.GetNumOutstanding(), 0u);
+}
+
+TEST(SCBSMaster, Timeout) {
+	SCBSMaster::SCBSMasterConfig_t config;
+	config.timeout_ms = 50;
+	SimulatedChain sim(0, config); // nothing on the other end of the port
+	sim.Start();
+
+	DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+	SCBSMaster::Response_t response = sim.master.Send(dis).get();
+	ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeTimeout));
+	ASSERT_GE(response.latency_us, 50000u);
+	ASSERT_EQ(sim.master.GetStats().num_timeouts, 1u);
+}
+
+TEST(SCBSMaster, UnsolicitedPackets) {
+	const uint16_t num_cells = 2;
+	SimulatedChain sim(num_cells, SCBSMaster::SCBSMasterConfig_t(), true); // frames are paced in chain time
+	sim.Start();
+	std::atomic<uint16_t> num_streamed(0);
+	sim.reactor.Post([&sim, &num_streamed]() {
+		sim.master.SetUnsolicitedPacketCallback([&num_streamed](const char * packet_str) {
+			char streamed_str[BSPacket::kMaxPacketLen];
+			strncpy(streamed_str, packet_str, BSPacket::kMaxPacketLen);
+			BSPacket streamed = BSPacket(streamed_str);
+			if (streamed.GetPacketType() == BSPacket::MRD && streamed.GetTag() == BSPacket::kNoTag) {
+				num_streamed++;
+			}
+		});
+	});
+	sim.Enumerate();
+
+	MWRPacket start = MWRPacket(0x4000u, (char *)"250"); // stream every 250ms
+	ASSERT_EQ(sim.master.Send(start).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	uint64_t deadline_us = Reactor::GetTimeUs() + 2000000;
+	while (num_streamed < 3 && Reactor::GetTimeUs() < deadline_us) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	ASSERT_GE(num_streamed, 3);
+	MWRPacket stop = MWRPacket(0x4000u, (char *)"0");
+	ASSERT_EQ(sim.master.Send(stop).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+}
+
+/**
+ * With the chain paced to the wall clock at the real baud rate, keeping several requests on the chain at once should
+ * take much less time than waiting for each round trip.
+*/
+static uint64_t TimeSingleReads(uint16_t window, uint16_t num_cells, uint16_t num_requests) {
+	SCBSMaster::SCBSMasterConfig_t config;
+	config.window = window;
+	SimulatedChain sim(num_cells, config, true);
+	sim.Start();
+	sim.Enumerate();
+
+	std::vector<std::future<SCBSMaster::Response_t>> responses;
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	for (uint16_t i = 0; i < num_requests; i++) {
+		SRDPacket srd = SRDPacket(num_cells, 0x1000u); // last cell, longest trip
+		responses.push_back(sim.master.Send(srd));
+	}
+	for (uint16_t i = 0; i < num_requests; i++) {
+		EXPECT_EQ(responses[i].get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	}
+	return Reactor::GetTimeUs() - start_time_us;
+}
+
+TEST(SCBSMaster, PipeliningKeepsLinkBusy) {
+	const uint16_t num_cells = 3;
+	const uint16_t num_requests = 12;
+	uint64_t one_at_a_time_us = TimeSingleReads(1, num_cells, num_requests);
+	uint64_t pipelined_us = TimeSingleReads(SCBSMaster::kDefaultWindow, num_cells, num_requests);
+	ASSERT_LT(pipelined_us * 2, one_at_a_time_us);
+}
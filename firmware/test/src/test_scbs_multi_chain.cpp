@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+#include "scbs_multi_chain.hh"
+#include "scbs_master.hh"
+#include "scbs_simulated_chain.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+#include <future>
+#include <vector>
+
+/**
+ * Several simulated chains driven from one reactor through an SCBSMultiChain. Every chain is enumerated before the
+ * test starts.
+*/
+class SimulatedRig : public SimulatedChains {
+public:
+	SimulatedRig(std::vector<uint16_t> num_cells, bool real_time = false)
+		: SimulatedChains(num_cells, real_time)
+		, multi_chain(reactor)
+	{
+		for (size_t i = 0; i < num_cells.size(); i++) {
+			EXPECT_EQ(multi_chain.AddChain(pty->GetPortPath(i)), static_cast<int>(i));
+		}
+		Start();
+
+		DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+		std::vector<SCBSMaster::Response_t> responses = multi_chain.Scatter(dis).get();
+		for (size_t i = 0; i < responses.size(); i++) {
+			EXPECT_EQ(responses[i].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+			EXPECT_EQ(DISPacket(responses[i].packet_str).last_cell_id, num_cells[i]);
+		}
+	}
+	~SimulatedRig() {
+		Stop();
+		multi_chain.Stop();
+	}
+
+	SCBSMultiChain multi_chain;
+};
+
+TEST(SCBSMultiChain, ScatterGathersOneResponsePerChain) {
+	std::vector<uint16_t> num_cells = {2, 4, 3};
+	SimulatedRig rig(num_cells);
+	ASSERT_EQ(rig.multi_chain.GetNumChains(), 3);
+
+	// Give each chain its own output voltage through its own master.
+	for (uint16_t i = 0; i < rig.multi_chain.GetNumChains(); i++) {
+		char value[BSPacket::kMaxPacketFieldLen];
+		snprintf(value, sizeof(value), "%d.00", i + 1);
+		MWRPacket mwr = MWRPacket(0x1000u, value);
+		ASSERT_EQ(rig.multi_chain.GetMaster(i).Send(mwr).get().err_code,
+			static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	}
+
+	char no_values[1][BSPacket::kMaxPacketFieldLen];
+	MRDPacket mrd = MRDPacket(0x1000u, no_values, 0);
+	std::vector<SCBSMaster::Response_t> responses = rig.multi_chain.Scatter(mrd).get();
+	ASSERT_EQ(responses.size(), 3u);
+	for (size_t i = 0; i < responses.size(); i++) {
+		ASSERT_EQ(responses[i].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		MRDPacket mrd_response = MRDPacket(responses[i].packet_str);
+		ASSERT_EQ(mrd_response.num_values, num_cells[i]);
+		for (uint16_t j = 0; j < mrd_response.num_values; j++) {
+			ASSERT_FLOAT_EQ(strtof(mrd_response.values[j], NULL), static_cast<float>(i + 1));
+		}
+	}
+}
+
+TEST(SCBSMultiChain, ErrorOnOneChainDoesNotHoldUpTheOthers) {
+	SimulatedRig rig({2, 5});
+
+	SRDPacket srd = SRDPacket(4, 0x1000u); // only the second chain has a cell 4
+	std::vector<SCBSMaster::Response_t> responses = rig.multi_chain.Scatter(srd).get();
+	ASSERT_EQ(responses[0].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNotAnswered));
+	ASSERT_EQ(responses[1].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_EQ(SRSPacket(responses[1].packet_str).cell_id, 4);
+
+	ASSERT_EQ(rig.multi_chain.AddChain("/dev/scbs_no_such_port"), -1);
+	ASSERT_EQ(rig.multi_chain.GetNumChains(), 2);
+}
+
+/**
+ * Scatter() puts the request in flight on every chain before any of them can answer, rather than working through the
+ * chains one at a time. Checked on the reactor thread straight after scattering, where nothing can complete yet.
+*/
+TEST(SCBSMultiChain, ScatterHasEveryChainBusyAtOnce) {
+	const uint16_t num_chains = 4;
+	const uint16_t num_cells = 6;
+	SimulatedRig rig(std::vector<uint16_t>(num_chains, num_cells));
+	char no_values[1][BSPacket::kMaxPacketFieldLen];
+	MRDPacket mrd = MRDPacket(0x2000u, no_values, 0);
+
+	std::promise<std::vector<uint32_t>> num_outstanding;
+	std::promise<std::vector<SCBSMaster::Response_t>> gathered;
+	rig.reactor.Post([&]() {
+		rig.multi_chain.Scatter(mrd, [&gathered](std::vector<SCBSMaster::Response_t> & responses) {
+			gathered.set_value(responses);
+		});
+		std::vector<uint32_t> counts;
+		for (uint16_t i = 0; i < num_chains; i++) {
+			counts.push_back(rig.multi_chain.GetMaster(i).GetNumOutstanding());
+		}
+		num_outstanding.set_value(counts);
+	});
+	ASSERT_EQ(num_outstanding.get_future().get(), std::vector<uint32_t>(num_chains, 1));
+
+	std::vector<SCBSMaster::Response_t> responses = gathered.get_future().get();
+	ASSERT_EQ(responses.size(), static_cast<size_t>(num_chains));
+	for (uint16_t i = 0; i < num_chains; i++) {
+		ASSERT_EQ(responses[i].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		ASSERT_EQ(MRDPacket(responses[i].packet_str).num_values, num_cells);
+		ASSERT_EQ(rig.multi_chain.GetMaster(i).GetNumOutstanding(), 0u);
+	}
+}
+
+/**
+ * Benchmark, not run by default since it goes by the wall clock (see the README). With every chain paced to the real
+ * baud rate, reading the current from every pack at once should take about as long as reading one pack, not as long as
+ * reading them one after the other.
+*/
+TEST(SCBSMultiChain, DISABLED_ScatterVersusOneByOne) {
+	const uint16_t num_chains = 4;
+	const uint16_t num_rounds = 3;
+	SimulatedRig rig(std::vector<uint16_t>(num_chains, 6), true);
+	char no_values[1][BSPacket::kMaxPacketFieldLen];
+	MRDPacket mrd = MRDPacket(0x2000u, no_values, 0);
+
+	uint64_t start_time_us = Reactor::GetTimeUs();
+	for (uint16_t round = 0; round < num_rounds; round++) {
+		for (uint16_t i = 0; i < num_chains; i++) {
+			ASSERT_EQ(rig.multi_chain.GetMaster(i).Send(mrd).get().err_code,
+				static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		}
+	}
+	uint64_t one_by_one_us = Reactor::GetTimeUs() - start_time_us;
+
+	start_time_us = Reactor::GetTimeUs();
+	for (uint16_t round = 0; round < num_rounds; round++) {
+		std::vector<SCBSMaster::Response_t> responses = rig.multi_chain.Scatter(mrd).get();
+		for (uint16_t i = 0; i < num_chains; i++) {
+			ASSERT_EQ(responses[i].err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		}
+	}
+	uint64_t scattered_us = Reactor::GetTimeUs() - start_time_us;
+
+	printf("SCBSMultiChain: %d rounds on %d chains took %lu us one by one, %lu us scattered.\r\n", num_rounds,
+		num_chains, one_by_one_us, scattered_us);
+}
@@ -0,0 +1,150 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h> // has to come first
+#include "gtest/gtest.h"
+#include "scbs_simulated_chain.hh"
+
+PyMODINIT_FUNC PyInit__scbs(void);
+
+/**
+ * Runs a Python snippet against the _scbs extension, linked straight into the test binary, with the chain's port path
+ * in `port`. The interpreter is started on first use and kept for the rest of the run. Failed asserts and uncaught
+ * exceptions are printed with their traceback.
+ * @param[in] code Python source to run.
+ * @param[in] port_path Pty the snippet's Master should open.
+ * @retval True if the snippet ran to the end, false if it raised.
+*/
+static bool RunPython(const char * code, const char * port_path) {
+	if (!Py_IsInitialized()) {
+		PyImport_AppendInittab("_scbs", PyInit__scbs);
+		Py_InitializeEx(0);
+	}
+	PyObject * globals = PyDict_New();
+	PyObject * port = PyUnicode_FromString(port_path);
+	PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+	PyDict_SetItemString(globals, "port", port);
+	Py_DECREF(port);
+	PyObject * result = PyRun_String(code, Py_file_input, globals, globals);
+	bool ran = result != NULL;
+	if (!ran) {
+		PyErr_Print();
+	}
+	Py_XDECREF(result);
+	PyDict_Clear(globals); // closes the snippet's Masters before the chain goes away
+	Py_DECREF(globals);
+	return ran;
+}
+
+TEST(SCBSPython, SubmitWaitAndCollect) {
+	SimulatedChains sim(std::vector<uint16_t>(1, 3));
+	sim.Start();
+
+	ASSERT_TRUE(RunPython(R"(
+import select
+import threading
+import _scbs
+
+def raises(func, *args):
+    try:
+        func(*args)
+    except ValueError:
+        return True
+    return False
+
+master = _scbs.Master(port)
+
+response = master.wait(master.submit(_scbs.packetize("BSDIS,0")))
+assert response.err_code == _scbs.ERR_NONE, response.err_code
+assert _scbs.parse_packet(response.packet_str)[2] == ["3"], response.packet_str
+
+# Pipelined reads, all picked up by collect().
+request_ids = set(master.submit(_scbs.packetize("BSSRD,%d,3000" % cell_id)) for cell_id in range(1, 4))
+collected = []
+for _ in range(100):
+    collected += master.collect(1.0)
+    if len(collected) == len(request_ids):
+        break
+assert set(response.request_id for response in collected) == request_ids
+assert all(response.err_code == _scbs.ERR_NONE for response in collected)
+
+# fileno() is readable while something is waiting to be collected.
+request_id = master.submit(_scbs.packetize("BSDIS,0"))
+assert select.select([master.fileno()], [], [], 5.0)[0]
+assert master.collect(0)[0].request_id == request_id
+assert master.collect(0) == []
+
+# Waiting on a request that's already been picked up, or was never submitted, raises instead of hanging.
+assert raises(master.wait, request_id)
+assert raises(master.wait, request_id + 1000)
+assert raises(master.wait, 0)
+
+# Only one of two waiters on the same request gets it, the other is told it's gone.
+request_id = master.submit(_scbs.packetize("BSDIS,0"))
+results = []
+def Wait():
+    try:
+        results.append(master.wait(request_id, 5.0))
+    except ValueError as e:
+        results.append(e)
+threads = [threading.Thread(target=Wait) for _ in range(2)]
+for thread in threads:
+    thread.start()
+for thread in threads:
+    thread.join(10.0)
+    assert not thread.is_alive()
+assert sum(isinstance(result, _scbs.Response) for result in results) == 1, results
+assert sum(isinstance(result, ValueError) for result in results) == 1, results
+
+assert raises(master.submit, _scbs.packetize("BSDIS,0"), _scbs.NUM_PRIORITIES)
+assert raises(master.submit, _scbs.packetize("BSDIS,0"), 255)
+assert raises(master.submit, "$BSDIS,0*00")
+
+master.close()
+master.close()
+assert raises(master.submit, _scbs.packetize("BSDIS,0"))
+assert raises(master.collect, 0)
+)", sim.pty->GetPortPath()));
+}
+
+TEST(SCBSPython, CloseWakesWaiters) {
+	SimulatedChains sim(std::vector<uint16_t>(1, 2)); // never started, so nothing gets answered
+
+	ASSERT_TRUE(RunPython(R"(
+import threading
+import time
+import _scbs
+
+master = _scbs.Master(port, timeout_ms=60000)
+request_id = master.submit(_scbs.packetize("BSDIS,0"))
+assert master.wait(request_id, 0.05) is None
+
+results = []
+def Wait():
+    try:
+        results.append(master.wait(request_id))
+    except ValueError as e:
+        results.append(e)
+thread = threading.Thread(target=Wait)
+thread.start()
+time.sleep(0.2)
+master.close()
+thread.join(10.0)
+assert not thread.is_alive()
+assert len(results) == 1
+assert isinstance(results[0], ValueError) or results[0].err_code == _scbs.ERR_DISCONNECTED, results
+
+master = _scbs.Master(port)
+results = []
+def Collect():
+    try:
+        results.append(master.collect())
+    except ValueError as e:
+        results.append(e)
+thread = threading.Thread(target=Collect)
+thread.start()
+time.sleep(0.2)
+master.close()
+thread.join(10.0)
+assert not thread.is_alive()
+assert len(results) == 1 and isinstance(results[0], ValueError), results
+)", sim.pty->GetPortPath()));
+}
@@ -0,0 +1,172 @@
+#include "gtest/gtest.h"
+#include "scbs_simulated_chain.hh"
+#include "scbs_register_cache.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+/**
+ * Simulated chain with a master using a register cache. The chain is enumerated before the test starts.
+*/
+class CachedChain : public SimulatedChain {
+public:
+	CachedChain(uint16_t num_cells)
+		: SimulatedChain(num_cells)
+	{
+		master.SetRegisterCache(&cache);
+		Start();
+		Enumerate();
+	}
+	~CachedChain() {
+		Stop();
+	}
+
+	uint32_t GetNumSent() {
+		return master.GetStats().num_sent;
+	}
+	SRSPacket Read(uint16_t cell_id, uint32_t reg_addr) {
+		SRDPacket srd = SRDPacket(cell_id, reg_addr);
+		SCBSMaster::Response_t response = master.Send(srd).get();
+		EXPECT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+		EXPECT_EQ(BSPacket(response.packet_str).GetTag(), response.tag);
+		return SRSPacket(response.packet_str);
+	}
+
+	SCBSRegisterCache cache;
+};
+
+TEST(SCBSRegisterCache, StoreAndLookup) {
+	SCBSRegisterCache cache;
+	char values[2][BSPacket::kMaxPacketFieldLen];
+	uint32_t version_addr[] = {0x3000u};
+	uint32_t current_addr[] = {0x2000u};
+
+	ASSERT_FALSE(cache.Lookup(1, version_addr, 1, values));
+	cache.Store(1, 0x3000u, "1.2.3");
+	ASSERT_TRUE(cache.Lookup(1, version_addr, 1, values));
+	ASSERT_STREQ(values[0], "1.2.3");
+	ASSERT_FALSE(cache.Lookup(2, version_addr, 1, values)); // other cells aren't affected
+
+	// Only what's fixed for the life of the board is kept forever by default, settings come back from flash on a reboot.
+	ASSERT_EQ(cache.GetTTL(0x3002u), static_cast<uint64_t>(SCBSRegisterCache::kTTLForever));
+	ASSERT_EQ(cache.GetTTL(0x3001u), static_cast<uint64_t>(SCBSRegisterCache::kDefaultSettingTTLUs));
+	ASSERT_EQ(cache.GetTTL(0x310Au), static_cast<uint64_t>(SCBSRegisterCache::kDefaultSettingTTLUs));
+	ASSERT_EQ(cache.GetTTL(0x4000u), static_cast<uint64_t>(SCBSRegisterCache::kDefaultSettingTTLUs));
+
+	// Current isn't cached by default.
+	ASSERT_EQ(cache.GetTTL(0x2000u), static_cast<uint64_t>(SCBSRegisterCache::kTTLNone));
+	cache.Store(1, 0x2000u, "12.00");
+	ASSERT_FALSE(cache.Lookup(1, current_addr, 1, values));
+
+	// Multi-register lookups are all or nothing.
+	uint32_t both_addrs[] = {0x3000u, 0x2000u};
+	ASSERT_FALSE(cache.Lookup(1, both_addrs, 2, values));
+	cache.SetTTL(0x2000u, SCBSRegisterCache::kTTLForever);
+	cache.Store(1, 0x2000u, "12.00");
+	ASSERT_TRUE(cache.Lookup(1, both_addrs, 2, values));
+	ASSERT_STREQ(values[1], "12.00");
+
+	SCBSRegisterCache::Stats_t stats = cache.GetStats();
+	ASSERT_EQ(stats.num_hits, 2u);
+	ASSERT_EQ(stats.num_misses, 4u);
+	ASSERT_EQ(stats.num_stores, 2u);
+}
+
+TEST(SCBSRegisterCache, ExpiryAndInvalidation) {
+	SCBSRegisterCache cache;
+	char values[1][BSPacket::kMaxPacketFieldLen];
+	uint32_t reg_addr[] = {0x2100u};
+
+	cache.SetTTL(0x2100u, 20000);
+	cache.Store(1, 0x2100u, "1000");
+	ASSERT_TRUE(cache.Lookup(1, reg_addr, 1, values));
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	ASSERT_FALSE(cache.Lookup(1, reg_addr, 1, values));
+
+	// Dropping a register drops it on every cell and nothing else.
+	uint32_t version_addr[] = {0x3000u};
+	for (uint16_t cell_id = 1; cell_id <= 3; cell_id++) {
+		cache.Store(cell_id, 0x2100u, "1000");
+		cache.Store(cell_id, 0x3000u, "1.2.3");
+	}
+	cache.InvalidateRegister(0x2100u);
+	for (uint16_t cell_id = 1; cell_id <= 3; cell_id++) {
+		ASSERT_FALSE(cache.Lookup(cell_id, reg_addr, 1, values));
+		ASSERT_TRUE(cache.Lookup(cell_id, version_addr, 1, values));
+	}
+	cache.Invalidate(2, 0x3000u);
+	ASSERT_FALSE(cache.Lookup(2, version_addr, 1, values));
+	ASSERT_TRUE(cache.Lookup(3, version_addr, 1, values));
+
+	cache.SetTTL(0x3000u, SCBSRegisterCache::kTTLNone);
+	ASSERT_FALSE(cache.Lookup(3, version_addr, 1, values));
+}
+
+TEST(SCBSRegisterCache, RepeatedReadsStayOffTheLink) {
+	CachedChain sim(3);
+	uint32_t num_sent = sim.GetNumSent();
+
+	SRSPacket first = sim.Read(2, 0x3000u); // firmware version
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 1);
+	for (uint16_t i = 0; i < 5; i++) {
+		SRSPacket again = sim.Read(2, 0x3000u);
+		ASSERT_EQ(again.cell_id, 2);
+		ASSERT_STREQ(again.values[0], first.values[0]);
+	}
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 1);
+	ASSERT_EQ(sim.master.GetStats().num_cache_hits, 5u);
+
+	// Current is always read from the cell.
+	for (uint16_t i = 0; i < 3; i++) {
+		sim.Read(2, 0x2000u);
+	}
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 4);
+}
+
+TEST(SCBSRegisterCache, WritesGoThroughToTheCell) {
+	CachedChain sim(3);
+	ASSERT_STREQ(sim.Read(1, 0x1002u).values[0], sim.Read(1, 0x1002u).values[0]);
+	uint32_t num_sent = sim.GetNumSent();
+
+	// Write and read back without waiting for the write, the read must see the new value.
+	SWRPacket swr = SWRPacket(1, 0x1002u, (char *)"0.5");
+	std::future<SCBSMaster::Response_t> write_response = sim.master.Send(swr);
+	ASSERT_FLOAT_EQ(strtof(sim.Read(1, 0x1002u).values[0], NULL), 0.5f);
+	ASSERT_EQ(write_response.get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 2);
+
+	// Cached again after that, with whatever the cell actually kept.
+	ASSERT_FLOAT_EQ(strtof(sim.Read(1, 0x1002u).values[0], NULL), 0.5f);
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 2);
+
+	// MWR drops the register on every cell.
+	sim.Read(2, 0x1002u);
+	MWRPacket mwr = MWRPacket(0x1002u, (char *)"0.25");
+	ASSERT_EQ(sim.master.Send(mwr).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	ASSERT_FLOAT_EQ(strtof(sim.Read(2, 0x1002u).values[0], NULL), 0.25f);
+	ASSERT_FLOAT_EQ(strtof(sim.Read(1, 0x1002u).values[0], NULL), 0.25f);
+}
+
+TEST(SCBSRegisterCache, SweepsFillAndDiscoveryEmpties) {
+	const uint16_t num_cells = 4;
+	CachedChain sim(num_cells);
+
+	char no_values[1][BSPacket::kMaxPacketFieldLen];
+	MRDPacket mrd = MRDPacket(0x3002u, no_values, 0); // unique IDs
+	SCBSMaster::Response_t response = sim.master.Send(mrd).get();
+	ASSERT_EQ(response.err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	MRDPacket mrd_response = MRDPacket(response.packet_str);
+	uint32_t num_sent = sim.GetNumSent();
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		ASSERT_STREQ(sim.Read(cell_id, 0x3002u).values[0], mrd_response.values[cell_id-1]);
+	}
+	ASSERT_EQ(sim.GetNumSent(), num_sent);
+
+	DISPacket dis = DISPacket(static_cast<uint16_t>(0));
+	ASSERT_EQ(sim.master.Send(dis).get().err_code, static_cast<uint16_t>(SCBSMaster::kErrCodeNone));
+	sim.Read(1, 0x3002u);
+	ASSERT_EQ(sim.GetNumSent(), num_sent + 2);
+}
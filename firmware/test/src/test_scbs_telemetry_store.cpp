@@ -0,0 +1,275 @@
+#include "gtest/gtest.h"
+#include "scbs_telemetry_store.hh"
+#include "scbs_comms.hh"
+#include "reactor.hh"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+static void MakeStorePath(char * path, size_t path_len, const char * name) {
+	snprintf(path, path_len, "/tmp/scbs_test_%s_%d.stlm", name, getpid());
+}
+
+/**
+ * Cell voltage sweeps as a soak test would log them: a slow discharge with a bit of noise in the last digit, and a
+ * current that sits at one value with the occasional step.
+*/
+static double GetVoltage(uint16_t cell_id, uint32_t i) {
+	return round((4.2 - 0.0001 * i - 0.01 * cell_id + 0.001 * ((i * 7 + cell_id) % 3)) * 1000.0) / 1000.0;
+}
+
+static double GetCurrent(uint32_t i) {
+	return i < 500 ? 0.0 : -12.5;
+}
+
+TEST(SCBSTelemetryStore, RoundTripAcrossChunks) {
+	char path[100];
+	MakeStorePath(path, sizeof(path), "round_trip");
+	const uint16_t num_cells = 4;
+	const uint32_t num_sweeps = 1000;
+	const uint64_t period_us = 100000;
+
+	SCBSTelemetryWriter writer;
+	ASSERT_TRUE(writer.Open(path, 256));
+	uint64_t base_time_us = Reactor::GetTimeUs();
+	for (uint32_t i = 0; i < num_sweeps; i++) {
+		// Sweeps come back a little late now and then; the jitter should survive the round trip exactly.
+		uint64_t time_us = base_time_us + i * period_us + (i % 17 == 0 ? 1234 : 0);
+		for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+			ASSERT_TRUE(writer.Append(cell_id, 0x1000, time_us, GetVoltage(cell_id, i)));
+			ASSERT_TRUE(writer.Append(cell_id, 0x2000, time_us, GetCurrent(i)));
+		}
+	}
+	SCBSTelemetryWriter::Stats_t stats = writer.GetStats();
+	ASSERT_EQ(stats.num_samples, 2ull * num_cells * num_sweeps);
+	writer.Close();
+
+	SCBSTelemetryReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	ASSERT_TRUE(reader.IsIndexed());
+	ASSERT_EQ(reader.GetHeader().chunk_len, 256u);
+	ASSERT_EQ(reader.GetNumChunks(), 2u * num_cells * 4); // 1000 samples in chunks of 256
+
+	std::vector<SCBSTelemetryStore::Series_t> series = reader.GetSeries();
+	ASSERT_EQ(series.size(), 2u * num_cells);
+	for (size_t i = 0; i < series.size(); i++) {
+		ASSERT_EQ(series[i].num_samples, num_sweeps);
+		ASSERT_EQ(series[i].num_chunks, 4u);
+	}
+
+	for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+		std::vector<SCBSTelemetryStore::Sample_t> voltages;
+		ASSERT_EQ(reader.Query(cell_id, 0x1000, 0, UINT64_MAX, voltages), num_sweeps);
+		std::vector<SCBSTelemetryStore::Sample_t> currents;
+		ASSERT_EQ(reader.Query(cell_id, 0x2000, 0, UINT64_MAX, currents), num_sweeps);
+		uint64_t first_time_us = voltages[0].time_us - 1234;
+		for (uint32_t i = 0; i < num_sweeps; i++) {
+			ASSERT_EQ(voltages[i].time_us - first_time_us, i * period_us + (i % 17 == 0 ? 1234 : 0));
+			ASSERT_EQ(voltages[i].value, GetVoltage(cell_id, i));
+			ASSERT_EQ(currents[i].time_us, voltages[i].time_us);
+			ASSERT_EQ(currents[i].value, GetCurrent(i));
+		}
+	}
+	reader.Close();
+	unlink(path);
+}
+
+/**
+ * Writes sweeps first_sweep to end_sweep - 1 of every cell's voltage and current, a second apart as scbslog does by
+ * default, flushing after every flush_interval sweeps (0 for never).
+*/
+static void WriteSweeps(SCBSTelemetryWriter & writer, uint64_t base_time_us, uint16_t num_cells, uint32_t first_sweep,
+	uint32_t end_sweep, uint32_t flush_interval) {
+	for (uint32_t i = first_sweep; i < end_sweep; i++) {
+		for (uint16_t cell_id = 1; cell_id <= num_cells; cell_id++) {
+			ASSERT_TRUE(writer.Append(cell_id, 0x1000, base_time_us + i * 1000000ull, GetVoltage(cell_id, i)));
+			ASSERT_TRUE(writer.Append(cell_id, 0x2000, base_time_us + i * 1000000ull, GetCurrent(i)));
+		}
+		if (flush_interval > 0 && i % flush_interval == flush_interval - 1) {
+			ASSERT_TRUE(writer.Flush());
+		}
+	}
+}
+
+static uint64_t GetFileSize(const char * path) {
+	struct stat file_stat;
+	return stat(path, &file_stat) == 0 ? static_cast<uint64_t>(file_stat.st_size) : 0;
+}
+
+TEST(SCBSTelemetryStore, FlushingKeepsChunksOpen) {
+	char path[100];
+	MakeStorePath(path, sizeof(path), "flush");
+	const uint16_t num_cells = 4;
+
+	char unflushed_path[100];
+	MakeStorePath(unflushed_path, sizeof(unflushed_path), "no_flush");
+	SCBSTelemetryWriter writer;
+	ASSERT_TRUE(writer.Open(path));
+	SCBSTelemetryWriter unflushed_writer;
+	ASSERT_TRUE(unflushed_writer.Open(unflushed_path));
+	uint64_t base_time_us = Reactor::GetTimeUs();
+
+	// Flushed every ten sweeps, everything so far can be read back as if the writer had been killed.
+	WriteSweeps(writer, base_time_us, num_cells, 0, 1500, 10);
+	SCBSTelemetryReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	ASSERT_FALSE(reader.IsIndexed());
+	ASSERT_EQ(reader.GetNumChunks(), 2u * 2 * num_cells); // one finished and one still filling per series
+	std::vector<SCBSTelemetryStore::Sample_t> samples;
+	ASSERT_EQ(reader.Query(3, 0x1000, 0, UINT64_MAX, samples), 1500u);
+	ASSERT_EQ(samples[1499].value, GetVoltage(3, 1499));
+	reader.Close();
+	WriteSweeps(writer, base_time_us, num_cells, 1500, 2000, 10);
+	writer.Close();
+	ASSERT_EQ(writer.GetStats().num_chunks, 2u * 2 * num_cells);
+	ASSERT_TRUE(reader.Open(path));
+	ASSERT_TRUE(reader.IsIndexed());
+	samples.clear();
+	ASSERT_EQ(reader.Query(4, 0x2000, 0, UINT64_MAX, samples), 2000u);
+	reader.Close();
+
+	// Flushes don't cut chunks short, so on disk it's as small as if it had never been flushed.
+	WriteSweeps(unflushed_writer, base_time_us, num_cells, 0, 2000, 0);
+	unflushed_writer.Close();
+	ASSERT_EQ(GetFileSize(path), GetFileSize(unflushed_path));
+	ASSERT_LT(GetFileSize(path), 4.5 * 2 * num_cells * 2000); // bytes per sample, mostly the noisy voltages
+	unlink(path);
+	unlink(unflushed_path);
+}
+
+TEST(SCBSTelemetryStore, CompressesPeriodicSamples) {
+	SCBSTelemetryChunk voltage_chunk(1, 0x1000);
+	SCBSTelemetryChunk current_chunk(1, 0x2000);
+	const uint32_t num_samples = 1000;
+	for (uint32_t i = 0; i < num_samples; i++) {
+		voltage_chunk.Append(i * 1000000ull, GetVoltage(1, i));
+		current_chunk.Append(i * 1000000ull, GetCurrent(i));
+	}
+
+	// Against 8 bytes a sample each stored raw: a fixed period costs a byte a sample for the timestamp, a value that
+	// doesn't change costs a bit, and a noisy decimal one still saves its sign, exponent and top of its mantissa.
+	ASSERT_LE(voltage_chunk.GetTimes().size(), num_samples + 8);
+	ASSERT_LE(current_chunk.GetValues().size(), num_samples / 8 + 16);
+	ASSERT_LT(voltage_chunk.GetValues().size(), num_samples * 6);
+
+	std::vector<double> values;
+	SCBSTelemetryStore::ChunkInfo_t info = voltage_chunk.GetInfo();
+	ASSERT_EQ(info.num_samples, num_samples);
+	ASSERT_EQ(info.last_time_us, (num_samples - 1) * 1000000ull);
+	ASSERT_TRUE(SCBSTelemetryChunk::Decode(info, reinterpret_cast<const uint8_t *>(voltage_chunk.GetTimes().data()),
+		reinterpret_cast<const uint8_t *>(voltage_chunk.GetValues().data()),
+		[&values](const SCBSTelemetryStore::Sample_t & sample) {
+			values.push_back(sample.value);
+			return true;
+		}));
+	ASSERT_EQ(values.size(), num_samples);
+	for (uint32_t i = 0; i < num_samples; i++) {
+		ASSERT_EQ(values[i], GetVoltage(1, i));
+	}
+}
+
+TEST(SCBSTelemetryStore, QueryAndAggregateRanges) {
+	char path[100];
+	MakeStorePath(path, sizeof(path), "query");
+	SCBSTelemetryWriter writer;
+	ASSERT_TRUE(writer.Open(path, 100));
+	uint64_t base_time_us = Reactor::GetTimeUs();
+	for (uint32_t i = 0; i < 1000; i++) {
+		ASSERT_TRUE(writer.Append(3, 0x1000, base_time_us + i * 1000, static_cast<double>(i)));
+	}
+	writer.Close();
+
+	SCBSTelemetryReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	std::vector<SCBSTelemetryStore::Series_t> series = reader.GetSeries();
+	ASSERT_EQ(series.size(), 1u);
+	ASSERT_EQ(series[0].cell_id, 3);
+	ASSERT_EQ(series[0].reg_addr, 0x1000u);
+	ASSERT_EQ(series[0].last_time_us - series[0].first_time_us, 999000u);
+	uint64_t first_time_us = series[0].first_time_us;
+
+	// Ranges are [start, end), and may start and end in the middle of chunks.
+	std::vector<SCBSTelemetryStore::Sample_t> samples;
+	ASSERT_EQ(reader.Query(3, 0x1000, first_time_us + 150000, first_time_us + 420000, samples), 270u);
+	ASSERT_EQ(samples.front().value, 150.0);
+	ASSERT_EQ(samples.back().value, 419.0);
+	samples.clear();
+	ASSERT_EQ(reader.Query(3, 0x1000, first_time_us + 2000000, UINT64_MAX, samples), 0u);
+	ASSERT_EQ(reader.Query(4, 0x1000, 0, UINT64_MAX, samples), 0u);
+	ASSERT_EQ(reader.Query(3, 0x2000, 0, UINT64_MAX, samples), 0u);
+
+	uint32_t num_calls = 0;
+	ASSERT_EQ(reader.Query(3, 0x1000, first_time_us, first_time_us + 5000,
+		[&num_calls](const SCBSTelemetryStore::Sample_t & sample) { num_calls++; }), 5u);
+	ASSERT_EQ(num_calls, 5u);
+
+	std::vector<SCBSTelemetryReader::Aggregate_t> aggregates = reader.Aggregate(3, 0x1000, first_time_us,
+		first_time_us + 300000, 100000);
+	ASSERT_EQ(aggregates.size(), 3u);
+	ASSERT_EQ(aggregates[1].start_time_us, first_time_us + 100000);
+	ASSERT_EQ(aggregates[1].num_samples, 100u);
+	ASSERT_EQ(aggregates[1].min, 100.0);
+	ASSERT_EQ(aggregates[1].max, 199.0);
+	ASSERT_NEAR(aggregates[1].mean, 149.5, 1e-9);
+	reader.Close();
+	unlink(path);
+}
+
+TEST(SCBSTelemetryStore, ReadsFileWithoutIndex) {
+	char path[100];
+	MakeStorePath(path, sizeof(path), "no_index");
+	SCBSTelemetryWriter writer;
+	ASSERT_TRUE(writer.Open(path, 50));
+	uint64_t base_time_us = Reactor::GetTimeUs();
+	for (uint32_t i = 0; i < 120; i++) {
+		ASSERT_TRUE(writer.Append(1, 0x1000, base_time_us + i * 1000, 3.3));
+	}
+	ASSERT_TRUE(writer.Flush());
+	uint64_t num_bytes = writer.GetStats().num_bytes;
+	writer.Close();
+
+	// Cut off the index, and half of another chunk after the last complete one, as if the writer had been killed.
+	ASSERT_EQ(truncate(path, num_bytes + SCBSTelemetryStore::kChunkHeaderLen / 2), 0);
+	SCBSTelemetryReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	ASSERT_FALSE(reader.IsIndexed());
+	ASSERT_EQ(reader.GetNumChunks(), 3u);
+	std::vector<SCBSTelemetryStore::Sample_t> samples;
+	ASSERT_EQ(reader.Query(1, 0x1000, 0, UINT64_MAX, samples), 120u);
+	ASSERT_EQ(samples[119].value, 3.3);
+	reader.Close();
+	unlink(path);
+}
+
+TEST(SCBSTelemetryStore, AppendMRD) {
+	char path[100];
+	MakeStorePath(path, sizeof(path), "mrd");
+	SCBSTelemetryWriter writer;
+	ASSERT_TRUE(writer.Open(path));
+
+	uint32_t reg_addrs[] = {0x1000u, 0x2000u};
+	char values[][BSPacket::kMaxPacketFieldLen] = {"4.101", "-1.5", "4.099", "ERR:1", "4.1", "-1.5"};
+	MRDPacket mrd = MRDPacket(reg_addrs, 2, values, 6);
+	char mrd_str[BSPacket::kMaxPacketLen];
+	mrd.ToString(mrd_str);
+	ASSERT_EQ(writer.AppendMRD(Reactor::GetTimeUs(), mrd_str), 5);
+	ASSERT_EQ(writer.AppendMRD(Reactor::GetTimeUs(), "$BSSRD,1000*00"), 0);
+	ASSERT_EQ(writer.GetStats().num_skipped, 1u);
+	writer.Close();
+
+	SCBSTelemetryReader reader;
+	ASSERT_TRUE(reader.Open(path));
+	ASSERT_EQ(reader.GetSeries().size(), 5u);
+	std::vector<SCBSTelemetryStore::Sample_t> samples;
+	ASSERT_EQ(reader.Query(2, 0x1000, 0, UINT64_MAX, samples), 1u);
+	ASSERT_EQ(samples[0].value, 4.099);
+	ASSERT_EQ(reader.Query(2, 0x2000, 0, UINT64_MAX, samples), 0u);
+	samples.clear();
+	ASSERT_EQ(reader.Query(3, 0x2000, 0, UINT64_MAX, samples), 1u);
+	ASSERT_EQ(samples[0].value, -1.5);
+	reader.Close();
+	unlink(path);
+}
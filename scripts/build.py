@@ -0,0 +1,42 @@
+"""
+Poetry build script for the scbs_master._scbs extension. Compiles the firmware's packet codec and the host library
+straight from the firmware tree, so the Python bindings always match the firmware they're talking to.
+"""
+import os
+
+from setuptools import Extension
+from setuptools.command.build_ext import build_ext
+
+FIRMWARE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "firmware")
+
+def firmware_path(*parts):
+    return os.path.relpath(os.path.join(FIRMWARE_DIR, *parts))
+
+scbs_extension = Extension(
+    "scbs_master._scbs",
+    sources=[
+        "scbs_master/scbs_module.cc",
+        firmware_path("firmware", "src", "app", "scbs_comms.cc"),
+        firmware_path("host", "src", "reactor.cc"),
+        firmware_path("host", "src", "serial_port.cc"),
+        firmware_path("host", "src", "scbs_master.cc"),
+        firmware_path("host", "src", "scbs_register_cache.cc"),
+    ],
+    include_dirs=[
+        firmware_path("firmware", "inc", "app"),
+        firmware_path("host", "inc"),
+    ],
+    extra_compile_args=["-std=c++17", "-O2"],
+    extra_link_args=["-pthread"],
+    language="c++",
+)
+
+def build(setup_kwargs):
+    setup_kwargs.update({
+        "ext_modules": [scbs_extension],
+        "cmdclass": {"build_ext": build_ext},
+    })
+
+if __name__ == "__main__":
+    from setuptools import setup
+    setup(name="scbs-master", packages=["scbs_master"], ext_modules=[scbs_extension])
@@ -0,0 +1,108 @@
+"""
+Native SCBS packet codec and pipelined master, for scripts that need more speed than scbs_utils.py gives them.
+
+The codec functions take and return the same strings as the ones in scbs_utils.py, except that packetize() writes the
+checksum in uppercase like the firmware does. Master talks to a chain through the host library's SCBSMaster, which
+tags and pipelines requests on a thread of its own; AsyncMaster wraps it for asyncio.
+"""
+import asyncio
+
+from ._scbs import (
+    calculate_checksum,
+    packetize,
+    parse_packet,
+    retag,
+    Master,
+    Response,
+    DEFAULT_WINDOW,
+    DEFAULT_TIMEOUT_MS,
+    DEFAULT_PRIORITY,
+    NUM_PRIORITIES,
+    MAX_PACKET_LEN,
+    ERR_NONE,
+    ERR_TIMEOUT,
+    ERR_DISCONNECTED,
+    ERR_INVALID_REQUEST,
+    ERR_NOT_ANSWERED,
+    ERR_QUEUE_FULL,
+)
+
+def parse_tag(packet_str):
+    """
+    @brief Pulls the tag out of a received packet string.
+    @param[in] packet_str Received packet string (e.g. $BSSRS#1A,3,OK*5F).
+    @retval Tag (integer), or None if the packet is untagged or invalid.
+    """
+    parsed = parse_packet(packet_str)
+    return parsed[1] if parsed else None
+
+def request(master, contents_str, timeout=None, priority=DEFAULT_PRIORITY):
+    """
+    @brief Sends one request and waits for its response.
+    @param[in] master Master to send it with.
+    @param[in] contents_str Request string including header and contents (what would go between $ and *).
+    @param[in] timeout Seconds to wait in all, counted from when the request is submitted, or None to wait until the
+    master completes it, which it does with a timeout error once its own timeout_ms runs out.
+    @retval Response, or None if it didn't come back in time.
+    """
+    return master.wait(master.submit(packetize(contents_str), priority), timeout)
+
+def request_many(master, contents_strs, priority=DEFAULT_PRIORITY):
+    """
+    @brief Sends a batch of requests, all pipelined, and waits for every one of them.
+    @param[in] master Master to send them with.
+    @param[in] contents_strs Request strings including header and contents (what would go between $ and *).
+    @retval List of Responses, in the same order as contents_strs.
+    """
+    request_ids = [master.submit(packetize(contents_str), priority) for contents_str in contents_strs]
+    return [master.wait(request_id) for request_id in request_ids]
+
+class AsyncMaster:
+    """
+    @brief Master for asyncio. Completed requests are picked up from the event loop through Master.fileno(), so
+    awaiting a response never blocks the loop.
+    """
+    def __init__(self, port, baud=9600, window=DEFAULT_WINDOW, timeout_ms=DEFAULT_TIMEOUT_MS, loop=None):
+        self.master = Master(port, baud, window, timeout_ms)
+        self.loop = loop or asyncio.get_event_loop()
+        self.pending = {} # request ID -> future
+        self.loop.add_reader(self.master.fileno(), self._on_ready)
+
+    def _on_ready(self):
+        for response in self.master.collect(0):
+            future = self.pending.pop(response.request_id, None)
+            if future is not None and not future.done():
+                future.set_result(response)
+
+    def submit(self, contents_str, priority=DEFAULT_PRIORITY):
+        """
+        @brief Sends a request without waiting for it.
+        @param[in] contents_str Request string including header and contents (what would go between $ and *).
+        @retval Future that resolves to the Response.
+        """
+        future = self.loop.create_future()
+        self.pending[self.master.submit(packetize(contents_str), priority)] = future
+        return future
+
+    async def request(self, contents_str, priority=DEFAULT_PRIORITY):
+        """
+        @brief Sends a request and waits for its Response.
+        """
+        return await self.submit(contents_str, priority)
+
+    async def request_many(self, contents_strs, priority=DEFAULT_PRIORITY):
+        """
+        @brief Sends a batch of requests, all pipelined, and waits for every one of them.
+        @retval List of Responses, in the same order as contents_strs.
+        """
+        return await asyncio.gather(*[self.submit(contents_str, priority) for contents_str in contents_strs])
+
+    def stats(self):
+        return self.master.stats()
+
+    def close(self):
+        self.loop.remove_reader(self.master.fileno())
+        self.master.close()
+        for future in self.pending.values():
+            future.cancel()
+        self.pending.clear()
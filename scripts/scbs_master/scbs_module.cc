@@ -0,0 +1,738 @@
+/**
+ * Python extension module scbs_master._scbs. Wraps the firmware's packet codec (scbs_comms) and the host library's
+ * SCBSMaster, so that Python scripts get native packet encoding and decoding and pipelined, non-blocking serial I/O.
+ *
+ * The codec functions work on packet strings the same way the functions in scbs_utils.py do. Master runs a Reactor on
+ * its own thread; submit() hands a request to it and returns straight away, and completed requests are picked up with
+ * wait() or collect(). fileno() is readable whenever there are completed requests, for asyncio's add_reader().
+*/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include "reactor.hh"
+#include "serial_port.hh"
+#include "scbs_master.hh"
+#include "scbs_comms.hh"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+/** Codec **/
+
+/**
+ * Gives the codec functions access to the parts of BSPacket that build and check packet strings.
+*/
+class PacketString : public BSPacket {
+public:
+    /**
+     * @brief Builds a packet string from everything that goes between the '$' and '*' tokens.
+     * @param[in] contents_str Header and fields, e.g. "BSSRD,3,2000". A tag in the header is kept unless tag is set.
+     * @param[in] tag Tag to put in the header, or kNoTag to keep whatever contents_str has.
+     * @param[out] to_str_buf Complete packet string, without "\r\n".
+     * @retval False if the header isn't a known packet type or the packet is too long.
+    */
+    bool Packetize(const char * contents_str, uint16_t tag, char to_str_buf[kMaxPacketLen]) {
+        char header_str[kMaxPacketFieldLen];
+        memset(header_str, '\0', kMaxPacketFieldLen);
+        const char * fields_str = strchr(contents_str, ',');
+        size_t header_len = fields_str ? static_cast<size_t>(fields_str - contents_str) : strlen(contents_str);
+        if (header_len >= kMaxPacketFieldLen || (fields_str && strlen(fields_str + 1) >= kMaxPacketContentsLen)) {
+            return false;
+        }
+        strncpy(header_str, contents_str, header_len);
+        char * tag_str = SplitTag(header_str);
+        // Tags are hex, same as SCBS_TAG_BASE in scbs_comms.cc.
+        tag_ = tag != kNoTag ? tag : (tag_str ? static_cast<uint16_t>(strtoul(tag_str, NULL, 16)) : kNoTag);
+        packet_type_ = UNKNOWN;
+        for (uint16_t i = 0; i < kNumPacketTypes; i++) {
+            if (strcmp(header_str, packet_header_strs[i]) == 0) {
+                packet_type_ = static_cast<PacketType_t>(i);
+            }
+        }
+        if (packet_type_ == UNKNOWN) {
+            return false;
+        }
+        char fields_buf[kMaxPacketContentsLen];
+        memset(fields_buf, '\0', kMaxPacketContentsLen);
+        if (fields_str) {
+            strncpy(fields_buf, fields_str + 1, kMaxPacketContentsLen - 1);
+        }
+        return PacketizeContents(fields_buf, to_str_buf) + kPacketTailLen < kMaxPacketLen;
+    }
+
+    /**
+     * @brief Calculates the checksum of everything that goes between the '$' and '*' tokens.
+     * @param[in] contents_str Header and fields, e.g. "BSSRD,3,2000".
+    */
+    uint8_t Checksum(const char * contents_str) {
+        snprintf(packet_str_, kMaxPacketLen, "$%s*", contents_str);
+        return CalculateChecksum();
+    }
+
+    /**
+     * @brief Checks a received packet string's tokens and checksum without printing anything, so that scripts can
+     * throw away garbage quietly.
+     * @param[in] packet_str Packet string, with or without "\r\n".
+    */
+    bool HasValidChecksum(const char * packet_str) {
+        const char * start_token_ptr = strchr(packet_str, '$');
+        const char * end_token_ptr = start_token_ptr ? strchr(start_token_ptr, '*') : NULL;
+        if (!end_token_ptr || end_token_ptr[1] == '\0') {
+            return false;
+        }
+        uint8_t checksum = 0;
+        for (const char * c = start_token_ptr + 1; c < end_token_ptr; c++) {
+            checksum ^= *c;
+        }
+        return checksum == static_cast<uint8_t>(strtoul(end_token_ptr + 1, NULL, 16));
+    }
+};
+
+/**
+ * @brief Copies a Python string into a packet buffer, dropping the "\r\n" line ending if there is one.
+ * @retval False (with a Python exception set) if it doesn't fit.
+*/
+static bool CopyPacketStr(const char * str, Py_ssize_t len, char packet_buf[BSPacket::kMaxPacketLen]) {
+    while (len > 0 && (str[len-1] == '\n' || str[len-1] == '\r')) {
+        len--;
+    }
+    if (len >= BSPacket::kMaxPacketLen) {
+        PyErr_Format(PyExc_ValueError, "Packet is %zd characters long, max is %d.", len, BSPacket::kMaxPacketLen - 1);
+        return false;
+    }
+    memset(packet_buf, '\0', BSPacket::kMaxPacketLen);
+    memcpy(packet_buf, str, len);
+    return true;
+}
+
+PyDoc_STRVAR(calculate_checksum_doc,
+"calculate_checksum(contents_str) -> int\n\n"
+"XOR checksum of everything between the '$' and '*' tokens, e.g. \"BSSRD,3,2000\".");
+
+static PyObject * CalculateChecksum(PyObject * self, PyObject * args) {
+    const char * contents_str;
+    Py_ssize_t contents_len;
+    if (!PyArg_ParseTuple(args, "s#", &contents_str, &contents_len)) {
+        return NULL;
+    }
+    if (contents_len + 2 >= BSPacket::kMaxPacketLen) {
+        PyErr_SetString(PyExc_ValueError, "Contents are too long for a packet.");
+        return NULL;
+    }
+    PacketString packet;
+    return PyLong_FromLong(packet.Checksum(contents_str));
+}
+
+PyDoc_STRVAR(packetize_doc,
+"packetize(contents_str, tag=0) -> str\n\n"
+"Adds the '$' and '*' tokens, the checksum and \"\\r\\n\" to a packet's contents, e.g. \"BSSRD,3,2000\". A non-zero\n"
+"tag is put in the header, replacing any tag that's already there. Raises ValueError for an unknown packet type.");
+
+static PyObject * Packetize(PyObject * self, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] = {"contents_str", "tag", NULL};
+    const char * contents_str;
+    unsigned int tag = BSPacket::kNoTag;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|I", const_cast<char **>(keywords), &contents_str, &tag)) {
+        return NULL;
+    }
+    if (tag > SCBSMaster::kMaxTag) {
+        PyErr_Format(PyExc_ValueError, "Tag %u is out of range, max is %u.", tag, SCBSMaster::kMaxTag);
+        return NULL;
+    }
+    PacketString packet;
+    char packet_str[BSPacket::kMaxPacketLen];
+    if (!packet.Packetize(contents_str, static_cast<uint16_t>(tag), packet_str)) {
+        PyErr_Format(PyExc_ValueError, "Unable to packetize \"%s\".", contents_str);
+        return NULL;
+    }
+    return PyUnicode_FromFormat("%s\r\n", packet_str);
+}
+
+PyDoc_STRVAR(parse_packet_doc,
+"parse_packet(packet_str) -> (packet_type, tag, fields) or None\n\n"
+"Splits a received packet string into its type (e.g. \"SRS\"), tag (None if untagged) and list of fields. Returns\n"
+"None if the checksum is bad or the packet type isn't recognized.");
+
+static PyObject * ParsePacket(PyObject * self, PyObject * args) {
+    const char * str;
+    Py_ssize_t len;
+    if (!PyArg_ParseTuple(args, "s#", &str, &len)) {
+        return NULL;
+    }
+    char packet_buf[BSPacket::kMaxPacketLen];
+    if (!CopyPacketStr(str, len, packet_buf)) {
+        return NULL;
+    }
+    PacketString checker;
+    if (!checker.HasValidChecksum(packet_buf)) {
+        Py_RETURN_NONE;
+    }
+    BSPacket packet = BSPacket(packet_buf);
+    if (!packet.IsValid()) {
+        Py_RETURN_NONE;
+    }
+
+    const char * header_ptr = strchr(packet_buf, '$') + 1 + strlen("BS");
+    const char * end_token_ptr = strchr(header_ptr, '*');
+    PyObject * fields = PyList_New(0);
+    if (fields == NULL) {
+        return NULL;
+    }
+    const char * field_ptr = strchr(header_ptr, ',');
+    while (field_ptr != NULL && field_ptr < end_token_ptr) {
+        field_ptr++;
+        const char * next_ptr = strchr(field_ptr, ',');
+        const char * field_end_ptr = (next_ptr != NULL && next_ptr < end_token_ptr) ? next_ptr : end_token_ptr;
+        PyObject * field = PyUnicode_FromStringAndSize(field_ptr, field_end_ptr - field_ptr);
+        if (field == NULL || PyList_Append(fields, field) < 0) {
+            Py_XDECREF(field);
+            Py_DECREF(fields);
+            return NULL;
+        }
+        Py_DECREF(field);
+        field_ptr = field_end_ptr;
+    }
+
+    PyObject * tag;
+    if (packet.GetTag() == BSPacket::kNoTag) {
+        tag = Py_None;
+        Py_INCREF(tag);
+    } else {
+        tag = PyLong_FromLong(packet.GetTag());
+    }
+    const char * type_str = BSPacket::packet_header_strs[packet.GetPacketType()] + strlen("BS");
+    return Py_BuildValue("(sNN)", type_str, tag, fields);
+}
+
+PyDoc_STRVAR(retag_doc,
+"retag(packet_str, tag) -> str\n\n"
+"Swaps the tag on a packet string (0 removes it) and fixes up the checksum, leaving everything else as it was.");
+
+static PyObject * Retag(PyObject * self, PyObject * args) {
+    const char * str;
+    Py_ssize_t len;
+    unsigned int tag;
+    if (!PyArg_ParseTuple(args, "s#I", &str, &len, &tag)) {
+        return NULL;
+    }
+    char packet_buf[BSPacket::kMaxPacketLen];
+    if (!CopyPacketStr(str, len, packet_buf)) {
+        return NULL;
+    }
+    if (tag > SCBSMaster::kMaxTag || SCBSMaster::RetagPacketString(packet_buf, static_cast<uint16_t>(tag)) == 0) {
+        PyErr_SetString(PyExc_ValueError, "Unable to retag packet.");
+        return NULL;
+    }
+    return PyUnicode_FromFormat("%s\r\n", packet_buf);
+}
+
+/** Master **/
+
+static PyStructSequence_Field response_fields[] = {
+    {"request_id", "ID returned by submit()"},
+    {"err_code", "0 if successful, an error from a cell, or one of the ERR_* master errors"},
+    {"err_cell_id", "cell that sent the error, if it came from a cell"},
+    {"latency_us", "from being written to the port until the response came back"},
+    {"packet_str", "packet that completed the request, without \"\\r\\n\""},
+    {"srs_strs", "SRS packets collected by a multicast SRD or SWR"},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc response_desc = {
+    "scbs_master._scbs.Response",
+    "Response to a request sent with Master.submit().",
+    response_fields,
+    6
+};
+
+static PyTypeObject * response_type = NULL;
+
+/**
+ * A master and the reactor thread it runs on, plus completed requests waiting for Python to pick them up. Python
+ * threads that wait with the GIL released register with Enter() and Leave(), so that Shutdown() can wake them and
+ * hold off deleting the client until they're gone.
+*/
+class PyMasterClient {
+public:
+    typedef struct {
+        uint64_t request_id;
+        SCBSMaster::Response_t response;
+    } Completion_t;
+
+    typedef enum {
+        TAKE_OK = 0,
+        TAKE_UNKNOWN_REQUEST,
+        TAKE_SHUT_DOWN
+    } TakeResult_t;
+
+    PyMasterClient(SCBSMaster::SCBSMasterConfig_t config)
+        : master(reactor, port, config)
+    {
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    ~PyMasterClient() {
+        Close();
+        close(event_fd);
+    }
+
+    bool Open(const char * port_path, uint32_t baud) {
+        if (!port.Open(port_path, baud) || !master.Start()) {
+            return false;
+        }
+        reactor_thread = std::thread([this]() { reactor.Run(); });
+        return true;
+    }
+
+    void Close() {
+        if (reactor_thread.joinable()) {
+            reactor.Stop();
+            reactor_thread.join();
+        }
+        master.Stop(); // fails anything outstanding, so waiters wake up
+        port.Close();
+    }
+
+    /**
+     * @brief Closes the master, then wakes everything waiting in Take() and waits for it to Leave(), so that the client
+     * can be deleted. Called without the GIL.
+    */
+    void Shutdown() {
+        Close();
+        std::unique_lock<std::mutex> lock(mutex);
+        is_shut_down = true;
+        completed_cv.notify_all();
+        users_cv.wait(lock, [this]() { return num_users == 0; });
+    }
+
+    /**
+     * @brief Marks the client as in use by a thread that's about to release the GIL. Called with the GIL held, so it
+     * can't race with MasterClose() taking the client away.
+    */
+    void Enter() {
+        std::lock_guard<std::mutex> lock(mutex);
+        num_users++;
+    }
+
+    /**
+     * @brief Done with the client. It may be deleted as soon as this returns.
+    */
+    void Leave() {
+        std::lock_guard<std::mutex> lock(mutex);
+        num_users--;
+        users_cv.notify_all(); // with the mutex held, Shutdown() can't return and the client be deleted before this
+    }
+
+    uint64_t Submit(BSPacket & request, uint8_t priority) {
+        uint64_t request_id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request_id = ++last_request_id;
+            outstanding.insert(request_id);
+        }
+        master.Send(request, [this, request_id](SCBSMaster::Response_t & response) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                outstanding.erase(request_id);
+                completed[request_id] = response;
+            }
+            uint64_t one = 1;
+            ssize_t num_written = write(event_fd, &one, sizeof(one));
+            (void)num_written;
+            completed_cv.notify_all();
+        }, priority);
+        return request_id;
+    }
+
+    /**
+     * @brief Waits for completed requests, with the GIL released.
+     * @param[in] request_id Request to wait for, or 0 for any.
+     * @param[in] timeout_s Seconds to wait, negative to wait forever.
+     * @param[out] out Completed requests, taken out of completed.
+     * @retval TAKE_UNKNOWN_REQUEST if request_id was never submitted or has already been taken (maybe by another
+     * thread while this one waited), TAKE_SHUT_DOWN if Shutdown() was called with nothing left to take, otherwise
+     * TAKE_OK, with out empty if the timeout ran out.
+    */
+    TakeResult_t Take(uint64_t request_id, double timeout_s, std::vector<Completion_t> & out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto is_ready = [this, request_id]() {
+            if (request_id == 0) {
+                return !completed.empty() || is_shut_down;
+            }
+            return completed.count(request_id) > 0 || outstanding.count(request_id) == 0 || is_shut_down;
+        };
+        if (timeout_s < 0) {
+            completed_cv.wait(lock, is_ready);
+        } else {
+            completed_cv.wait_for(lock, std::chrono::duration<double>(timeout_s), is_ready);
+        }
+        TakeResult_t result = TAKE_OK;
+        if (request_id == 0) {
+            for (auto it = completed.begin(); it != completed.end(); it++) {
+                out.push_back({it->first, it->second});
+            }
+            completed.clear();
+            if (out.empty() && is_shut_down) {
+                result = TAKE_SHUT_DOWN;
+            }
+        } else if (completed.count(request_id) > 0) {
+            out.push_back({request_id, completed[request_id]});
+            completed.erase(request_id);
+        } else if (outstanding.count(request_id) == 0) {
+            result = TAKE_UNKNOWN_REQUEST;
+        } else if (is_shut_down) {
+            result = TAKE_SHUT_DOWN;
+        }
+        if (!out.empty()) {
+            completed_cv.notify_all(); // anyone else waiting for these has to find out they're gone
+        }
+        if (completed.empty()) {
+            uint64_t count;
+            ssize_t num_read = read(event_fd, &count, sizeof(count)); // nothing left, fileno() stops being readable
+            (void)num_read;
+        }
+        return result;
+    }
+
+    Reactor reactor;
+    SerialPort port;
+    SCBSMaster master;
+    std::thread reactor_thread;
+    int event_fd;
+
+    std::mutex mutex;
+    std::condition_variable completed_cv;
+    std::condition_variable users_cv;
+    std::map<uint64_t, SCBSMaster::Response_t> completed; // by request ID
+    std::set<uint64_t> outstanding; // submitted and not completed yet
+    uint64_t last_request_id = 0;
+    uint32_t num_users = 0; // threads between Enter() and Leave()
+    bool is_shut_down = false;
+};
+
+typedef struct {
+    PyObject_HEAD
+    PyMasterClient * client;
+} MasterObject;
+
+static PyObject * NewResponse(PyMasterClient::Completion_t & completion) {
+    SCBSMaster::Response_t & response = completion.response;
+    PyObject * srs_strs = PyList_New(response.srs_strs.size());
+    if (srs_strs == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < response.srs_strs.size(); i++) {
+        PyList_SET_ITEM(srs_strs, i, PyUnicode_FromString(response.srs_strs[i].c_str()));
+    }
+    PyObject * result = PyStructSequence_New(response_type);
+    if (result == NULL) {
+        Py_DECREF(srs_strs);
+        return NULL;
+    }
+    PyStructSequence_SET_ITEM(result, 0, PyLong_FromUnsignedLongLong(completion.request_id));
+    PyStructSequence_SET_ITEM(result, 1, PyLong_FromLong(response.err_code));
+    PyStructSequence_SET_ITEM(result, 2, PyLong_FromLong(response.err_cell_id));
+    PyStructSequence_SET_ITEM(result, 3, PyLong_FromUnsignedLongLong(response.latency_us));
+    PyStructSequence_SET_ITEM(result, 4, PyUnicode_FromString(response.packet_str));
+    PyStructSequence_SET_ITEM(result, 5, srs_strs);
+    return result;
+}
+
+static bool CheckOpen(MasterObject * self) {
+    if (self->client == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Master is closed.");
+        return false;
+    }
+    return true;
+}
+
+static int MasterInit(MasterObject * self, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] = {"port", "baud", "window", "timeout_ms", NULL};
+    const char * port_path;
+    unsigned int baud = SerialPort::kDefaultBaud;
+    unsigned int window = SCBSMaster::kDefaultWindow;
+    unsigned int timeout_ms = SCBSMaster::kDefaultTimeoutMs;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|III", const_cast<char **>(keywords),
+        &port_path, &baud, &window, &timeout_ms)) {
+        return -1;
+    }
+    SCBSMaster::SCBSMasterConfig_t config;
+    config.window = static_cast<uint16_t>(window);
+    config.timeout_ms = timeout_ms;
+    delete self->client;
+    self->client = new PyMasterClient(config);
+    if (!self->client->Open(port_path, baud)) {
+        delete self->client;
+        self->client = NULL;
+        PyErr_Format(PyExc_OSError, "Unable to open %s.", port_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void MasterDealloc(MasterObject * self) {
+    if (self->client != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        delete self->client;
+        Py_END_ALLOW_THREADS
+    }
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+PyDoc_STRVAR(master_submit_doc,
+"submit(packet_str, priority=2) -> int\n\n"
+"Queues a request to be tagged and sent, and returns its request ID straight away. The packet's tag is replaced\n"
+"with one the master picks. Raises ValueError if packet_str isn't a valid packet or priority isn't below\n"
+"NUM_PRIORITIES.");
+
+static PyObject * MasterSubmit(MasterObject * self, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] = {"packet_str", "priority", NULL};
+    const char * str;
+    Py_ssize_t len;
+    unsigned int priority = SCBSMaster::kDefaultPriority;
+    if (!CheckOpen(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "s#|I", const_cast<char **>(keywords),
+        &str, &len, &priority)) {
+        return NULL;
+    }
+    if (priority >= SCBSMaster::kNumPriorities) {
+        PyErr_Format(PyExc_ValueError, "Priority %u is out of range, max is %u.", priority,
+            SCBSMaster::kNumPriorities - 1);
+        return NULL;
+    }
+    char packet_buf[BSPacket::kMaxPacketLen];
+    if (!CopyPacketStr(str, len, packet_buf)) {
+        return NULL;
+    }
+    BSPacket * packet = SCBSMaster::ParsePacket(packet_buf);
+    if (packet == NULL) {
+        PyErr_Format(PyExc_ValueError, "\"%s\" is not a valid packet.", packet_buf);
+        return NULL;
+    }
+    uint64_t request_id = self->client->Submit(*packet, static_cast<uint8_t>(priority));
+    delete packet;
+    return PyLong_FromUnsignedLongLong(request_id);
+}
+
+/**
+ * @brief Shared by wait() and collect().
+*/
+static PyObject * TakeCompleted(MasterObject * self, uint64_t request_id, PyObject * timeout_obj) {
+    double timeout_s = -1.0;
+    if (timeout_obj != NULL && timeout_obj != Py_None) {
+        timeout_s = PyFloat_AsDouble(timeout_obj);
+        if (timeout_s == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+    std::vector<PyMasterClient::Completion_t> completions;
+    PyMasterClient * client = self->client;
+    PyMasterClient::TakeResult_t result;
+    client->Enter(); // close() from another thread waits for this thread to Leave() before deleting the client
+    Py_BEGIN_ALLOW_THREADS
+    result = client->Take(request_id, timeout_s, completions);
+    client->Leave();
+    Py_END_ALLOW_THREADS
+
+    if (result == PyMasterClient::TAKE_UNKNOWN_REQUEST) {
+        PyErr_Format(PyExc_ValueError, "Request %llu was never submitted, or has already been picked up.",
+            static_cast<unsigned long long>(request_id));
+        return NULL;
+    } else if (result == PyMasterClient::TAKE_SHUT_DOWN) {
+        PyErr_SetString(PyExc_ValueError, "Master was closed while waiting.");
+        return NULL;
+    }
+    if (request_id != 0) {
+        if (completions.empty()) {
+            Py_RETURN_NONE;
+        }
+        return NewResponse(completions[0]);
+    }
+    PyObject * responses = PyList_New(completions.size());
+    if (responses == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < completions.size(); i++) {
+        PyObject * response = NewResponse(completions[i]);
+        if (response == NULL) {
+            Py_DECREF(responses);
+            return NULL;
+        }
+        PyList_SET_ITEM(responses, i, response);
+    }
+    return responses;
+}
+
+PyDoc_STRVAR(master_wait_doc,
+"wait(request_id, timeout=None) -> Response or None\n\n"
+"Waits for one request to complete. Returns None if it didn't complete within timeout seconds. Raises ValueError if\n"
+"the request was never submitted or has already been picked up by wait() or collect(), or if the master is closed\n"
+"while waiting.");
+
+static PyObject * MasterWait(MasterObject * self, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] = {"request_id", "timeout", NULL};
+    unsigned long long request_id;
+    PyObject * timeout_obj = NULL;
+    if (!CheckOpen(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "K|O", const_cast<char **>(keywords),
+        &request_id, &timeout_obj)) {
+        return NULL;
+    }
+    if (request_id == 0) {
+        PyErr_SetString(PyExc_ValueError, "Request IDs start at 1.");
+        return NULL;
+    }
+    return TakeCompleted(self, request_id, timeout_obj);
+}
+
+PyDoc_STRVAR(master_collect_doc,
+"collect(timeout=None) -> list of Response\n\n"
+"Returns every request that has completed and hasn't been picked up yet, waiting up to timeout seconds for at least\n"
+"one if there aren't any. A timeout of 0 never blocks. Raises ValueError if the master is closed while waiting.");
+
+static PyObject * MasterCollect(MasterObject * self, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] = {"timeout", NULL};
+    PyObject * timeout_obj = NULL;
+    if (!CheckOpen(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char **>(keywords),
+        &timeout_obj)) {
+        return NULL;
+    }
+    return TakeCompleted(self, 0, timeout_obj);
+}
+
+PyDoc_STRVAR(master_fileno_doc,
+"fileno() -> int\n\n"
+"File descriptor that's readable while completed requests are waiting to be collected.");
+
+static PyObject * MasterFileno(MasterObject * self, PyObject * Py_UNUSED(ignored)) {
+    if (!CheckOpen(self)) {
+        return NULL;
+    }
+    return PyLong_FromLong(self->client->event_fd);
+}
+
+PyDoc_STRVAR(master_stats_doc,
+"stats() -> dict\n\n"
+"Counters from the master: requests sent, completed, errors, timeouts and so on.");
+
+static PyObject * MasterStats(MasterObject * self, PyObject * Py_UNUSED(ignored)) {
+    if (!CheckOpen(self)) {
+        return NULL;
+    }
+    SCBSMaster::Stats_t stats = self->client->master.GetStats();
+    return Py_BuildValue("{sIsIsIsIsIsIsIsI}",
+        "num_sent", stats.num_sent,
+        "num_completed", stats.num_completed,
+        "num_errors", stats.num_errors,
+        "num_timeouts", stats.num_timeouts,
+        "num_invalid_packets", stats.num_invalid_packets,
+        "num_unsolicited_packets", stats.num_unsolicited_packets,
+        "num_cache_hits", stats.num_cache_hits,
+        "num_outstanding", self->client->master.GetNumOutstanding());
+}
+
+PyDoc_STRVAR(master_close_doc,
+"close()\n\n"
+"Stops the reactor thread and closes the port. Requests still outstanding complete with ERR_DISCONNECTED, and\n"
+"threads already waiting for them in wait() or collect() get those responses; any other waiting threads raise\n"
+"ValueError. Returns once they've all woken up.");
+
+static PyObject * MasterClose(MasterObject * self, PyObject * Py_UNUSED(ignored)) {
+    if (self->client != NULL) {
+        PyMasterClient * client = self->client;
+        self->client = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        client->Shutdown();
+        delete client;
+        Py_END_ALLOW_THREADS
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef master_methods[] = {
+    {"submit", reinterpret_cast<PyCFunction>(MasterSubmit), METH_VARARGS | METH_KEYWORDS, master_submit_doc},
+    {"wait", reinterpret_cast<PyCFunction>(MasterWait), METH_VARARGS | METH_KEYWORDS, master_wait_doc},
+    {"collect", reinterpret_cast<PyCFunction>(MasterCollect), METH_VARARGS | METH_KEYWORDS, master_collect_doc},
+    {"fileno", reinterpret_cast<PyCFunction>(MasterFileno), METH_NOARGS, master_fileno_doc},
+    {"stats", reinterpret_cast<PyCFunction>(MasterStats), METH_NOARGS, master_stats_doc},
+    {"close", reinterpret_cast<PyCFunction>(MasterClose), METH_NOARGS, master_close_doc},
+    {NULL, NULL, 0, NULL}
+};
+
+PyDoc_STRVAR(master_doc,
+"Master(port, baud=9600, window=8, timeout_ms=2000)\n\n"
+"Host end of an SCBS chain on a serial port. Requests are tagged and pipelined, up to window at a time, by a\n"
+"reactor running on its own thread. Raises OSError if the port can't be opened.");
+
+static PyTypeObject master_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+/** Module **/
+
+static PyMethodDef module_methods[] = {
+    {"calculate_checksum", CalculateChecksum, METH_VARARGS, calculate_checksum_doc},
+    {"packetize", reinterpret_cast<PyCFunction>(Packetize), METH_VARARGS | METH_KEYWORDS, packetize_doc},
+    {"parse_packet", ParsePacket, METH_VARARGS, parse_packet_doc},
+    {"retag", Retag, METH_VARARGS, retag_doc},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    "_scbs",
+    "Native SCBS packet codec and pipelined master.",
+    -1,
+    module_methods
+};
+
+PyMODINIT_FUNC PyInit__scbs(void) {
+    master_type.tp_name = "scbs_master._scbs.Master";
+    master_type.tp_doc = master_doc;
+    master_type.tp_basicsize = sizeof(MasterObject);
+    master_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
+    master_type.tp_new = PyType_GenericNew;
+    master_type.tp_init = reinterpret_cast<initproc>(MasterInit);
+    master_type.tp_dealloc = reinterpret_cast<destructor>(MasterDealloc);
+    master_type.tp_methods = master_methods;
+    if (PyType_Ready(&master_type) < 0) {
+        return NULL;
+    }
+    if (response_type == NULL) {
+        response_type = PyStructSequence_NewType(&response_desc);
+        if (response_type == NULL) {
+            return NULL;
+        }
+    }
+
+    PyObject * module = PyModule_Create(&module_def);
+    if (module == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&master_type);
+    Py_INCREF(response_type);
+    if (PyModule_AddObject(module, "Master", reinterpret_cast<PyObject *>(&master_type)) < 0
+        || PyModule_AddObject(module, "Response", reinterpret_cast<PyObject *>(response_type)) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    PyModule_AddIntConstant(module, "DEFAULT_WINDOW", SCBSMaster::kDefaultWindow);
+    PyModule_AddIntConstant(module, "DEFAULT_TIMEOUT_MS", SCBSMaster::kDefaultTimeoutMs);
+    PyModule_AddIntConstant(module, "DEFAULT_PRIORITY", SCBSMaster::kDefaultPriority);
+    PyModule_AddIntConstant(module, "NUM_PRIORITIES", SCBSMaster::kNumPriorities);
+    PyModule_AddIntConstant(module, "MAX_PACKET_LEN", BSPacket::kMaxPacketLen);
+    PyModule_AddIntConstant(module, "ERR_NONE", SCBSMaster::kErrCodeNone);
+    PyModule_AddIntConstant(module, "ERR_TIMEOUT", SCBSMaster::kErrCodeTimeout);
+    PyModule_AddIntConstant(module, "ERR_DISCONNECTED", SCBSMaster::kErrCodeDisconnected);
+    PyModule_AddIntConstant(module, "ERR_INVALID_REQUEST", SCBSMaster::kErrCodeInvalidRequest);
+    PyModule_AddIntConstant(module, "ERR_NOT_ANSWERED", SCBSMaster::kErrCodeNotAnswered);
+    PyModule_AddIntConstant(module, "ERR_QUEUE_FULL", SCBSMaster::kErrCodeQueueFull);
+    return module;
+}
@@ -1,5 +1,7 @@
 import argparse
 from ast import literal_eval
+import json
+import time
 import serial
 
 parser = argparse.ArgumentParser(description="SCBS master utility.")
@@ -17,6 +19,28 @@ parser.add_argument("serial_port", type=str, help="Serial port to use (e.g. 'COM
 args = parser.parse_args()
 
 MAX_REG_ADDR = 0x9999
+MAX_TAG = 0xFFFF # tag 0 means untagged
+TAG_DELIM = "#"
+DEFAULT_PIPELINE_WINDOW = 8 # max number of tagged requests in flight at once
+BROADCAST_CELL_ID = 0
+CELL_RANGE_DELIM = "-" # SWR/SRD cell ID field can be a range (e.g. 3-14)
+CELL_GROUP_PREFIX = "G" # or a group (e.g. G2, every cell with register 3001 set to 2)
+ALL_CELLS = "0-65535" # cell ID range that selects every cell, including ones that haven't been discovered
+UNIQUE_ID_REG_ADDR = "3002"
+SAVE_SETTINGS_REG_ADDR = "3003"
+VWR_MAX_NUM_VALUES = 20 # cells past this are written one at a time
+# Calibration CSV columns, in order: output error [V] at 0V, 0.45V, ... 4.5V, current offset [counts], current gain.
+CAL_REG_ADDRS = ["{:X}".format(0x3100 + i) for i in range(11)] + ["3110", "3111"]
+PRF_MAX_NUM_POINTS = 12 # profile points per BSPRF packet
+BRS_MAX_NUM_SAMPLES = 56 # capture samples per BSBRS packet
+BRS_SAMPLE_STR_LEN = 3 # samples are packed as fixed width hex
+CAPTURE_MA_PER_COUNT = 200.0 / 4096 # current sense full scale over ADC counts
+EVENT_NAMES = {
+    1: "current high",
+    2: "current high cleared",
+    3: "current low",
+    4: "current low cleared",
+}
 
 def validate_address(address_str):
     address = literal_eval(address_str)
@@ -43,6 +67,241 @@ def packetize(contents_str):
     """
     return "${}*{:x}\r\n".format(contents_str, calculate_checksum(contents_str))
 
+def tag_contents(contents_str, tag):
+    """
+    @brief Adds a tag to the header of a packet (e.g. BSSRD,3,2000 becomes BSSRD#1A,3,2000).
+    @param[in] contents_str String including header and contents (what would go between $ and *).
+    @param[in] tag Tag to add, between 1 and MAX_TAG.
+    @retval Tagged contents string, ready for packetize().
+    """
+    header, sep, fields = contents_str.partition(",")
+    return "{}{}{:X}{}{}".format(header, TAG_DELIM, tag, sep, fields)
+
+def parse_tag(packet_str):
+    """
+    @brief Pulls the tag out of a received packet string.
+    @param[in] packet_str Received packet string (e.g. $BSSRS#1A,3,OK*5F).
+    @retval Tag (integer), or None if the packet is untagged.
+    """
+    header = packet_str.split(",")[0]
+    if TAG_DELIM not in header:
+        return None
+    return int(header.split(TAG_DELIM)[1].split("*")[0], 16)
+
+class RequestPipeline:
+    """
+    @brief Keeps several tagged requests in flight on the chain at once and matches responses to requests by their
+    tag, so throughput on a long chain is limited by the link instead of one request per chain round trip.
+    """
+    def __init__(self, port, window=DEFAULT_PIPELINE_WINDOW):
+        self.port = port
+        self.window = window
+        self.next_tag = 1
+        self.outstanding = {} # tag -> request contents string
+
+    def send(self, contents_str):
+        """
+        @brief Tags and transmits a request, blocking on responses first if the window is full.
+        @param[in] contents_str Request string including header and contents (what would go between $ and *).
+        @retval List of (request, response) tuples that were received while waiting for room in the window.
+        """
+        completed = []
+        while len(self.outstanding) >= self.window:
+            result = self.receive()
+            if result is None:
+                break # timed out, give up on waiting for the window
+            completed.append(result)
+        tag = self.next_tag
+        self.next_tag = self.next_tag % MAX_TAG + 1 # skip 0 when wrapping around
+        self.outstanding[tag] = contents_str
+        self.port.write(bytes(packetize(tag_contents(contents_str, tag)), 'utf-8'))
+        return completed
+
+    def receive(self):
+        """
+        @brief Reads one packet from the chain and matches it to an outstanding request.
+        @retval (request, response) tuple, where request is None for untagged or unexpected packets (e.g. streamed
+        telemetry), or None if the read timed out.
+        """
+        line = self.port.readline()
+        if not line:
+            return None
+        response = line.decode('utf-8', errors='replace').strip()
+        return (self.outstanding.pop(parse_tag(response), None), response)
+
+    def drain(self):
+        """
+        @brief Waits for all outstanding requests to be answered.
+        @retval List of (request, response) tuples, in the order they were received.
+        """
+        completed = []
+        while self.outstanding:
+            result = self.receive()
+            if result is None:
+                break # timed out, whatever is left in outstanding got lost on the chain
+            completed.append(result)
+        return completed
+
+def read_profile_csv(file_name):
+    """
+    @brief Reads a voltage profile from a CSV file with one <time_ms>,<voltage> point per line.
+    @param[in] file_name Path to the CSV file.
+    @retval List of (time_ms, voltage) tuples.
+    """
+    points = []
+    with open(file_name) as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if len(fields) == 2:
+                points.append((int(fields[0]), float(fields[1])))
+    return points
+
+def upload_profile(port, cell_id, points):
+    """
+    @brief Loads a voltage profile into a cell (or all cells) in chunks of BSPRF packets.
+    @param[in] port Serial port connected to the chain.
+    @param[in] cell_id ID of the cell to load, or BROADCAST_CELL_ID for all cells.
+    @param[in] points List of (time_ms, voltage) tuples, in time order.
+    @retval List of responses, one per chunk.
+    """
+    responses = []
+    for first_point_index in range(0, len(points), PRF_MAX_NUM_POINTS):
+        chunk = points[first_point_index:first_point_index+PRF_MAX_NUM_POINTS]
+        points_str = ",".join("{}:{:.3f}".format(time_ms, voltage) for time_ms, voltage in chunk)
+        transmit(port, packetize("BSPRF,{},{},{}".format(cell_id, first_point_index, points_str)))
+        responses.append(port.readline())
+    return responses
+
+def read_calibration_csv(file_name):
+    """
+    @brief Reads per-cell calibrations from a CSV file with one line per cell in chain order, columns as in
+    CAL_REG_ADDRS.
+    @param[in] file_name Path to the CSV file.
+    @retval List of per-cell lists of value strings.
+    """
+    calibrations = []
+    with open(file_name) as f:
+        for line in f:
+            fields = [field.strip() for field in line.strip().split(",")]
+            if len(fields) == len(CAL_REG_ADDRS):
+                calibrations.append(fields)
+    return calibrations
+
+def upload_calibration(port, calibrations):
+    """
+    @brief Writes a calibration to every cell in the chain and saves it to flash. Each register goes to the first
+    VWR_MAX_NUM_VALUES cells in a single BSVWR packet, so a rack takes one packet per register instead of one per cell.
+    @param[in] port Serial port connected to the chain.
+    @param[in] calibrations Per-cell lists of value strings from read_calibration_csv(), first cell first.
+    @retval List of responses, one per packet sent.
+    """
+    responses = []
+    for column, reg_addr in enumerate(CAL_REG_ADDRS):
+        values = [calibration[column] for calibration in calibrations]
+        transmit(port, packetize("BSVWR,{},{}".format(reg_addr, ",".join(values[:VWR_MAX_NUM_VALUES]))))
+        responses.append(port.readline())
+        for cell_index in range(VWR_MAX_NUM_VALUES, len(values)):
+            transmit(port, packetize("BSSWR,{},{},{}".format(cell_index + 1, reg_addr, values[cell_index])))
+            responses.append(port.readline())
+    transmit(port, packetize("BSMWR,{},1".format(SAVE_SETTINGS_REG_ADDR)))
+    responses.append(port.readline())
+    return responses
+
+def read_capture(port, cell_id, num_samples):
+    """
+    @brief Reads a finished capture out of a cell in chunks of BSBRD packets.
+    @param[in] port Serial port connected to the chain.
+    @param[in] cell_id ID of the cell to read from.
+    @param[in] num_samples Number of samples in the capture (register 8005).
+    @retval List of currents in mA, oldest first.
+    """
+    currents = []
+    while len(currents) < num_samples:
+        transmit(port, packetize("BSBRD,{},{},{}".format(cell_id, len(currents), BRS_MAX_NUM_SAMPLES)))
+        response = port.readline().decode("utf-8").strip()
+        if not response.startswith("$BSBRS"):
+            raise Exception("Capture read failed at sample {}: {}".format(len(currents), response))
+        samples_str = response.split("*")[0].split(",")[3]
+        for i in range(0, len(samples_str), BRS_SAMPLE_STR_LEN):
+            currents.append(int(samples_str[i:i+BRS_SAMPLE_STR_LEN], 16) * CAPTURE_MA_PER_COUNT)
+    return currents
+
+def is_multicast(cell_str):
+    """
+    @brief Checks whether an SWR/SRD cell ID field selects a range or group of cells rather than a single cell.
+    @param[in] cell_str Cell ID field (e.g. 3, 3-14 or G2).
+    @retval True if the field can select more than one cell.
+    """
+    return cell_str.startswith(CELL_GROUP_PREFIX) or CELL_RANGE_DELIM in cell_str
+
+def read_multicast_responses(port, header):
+    """
+    @brief Reads responses to a range or group SWR/SRD until the request itself comes back around the chain.
+    @param[in] port Serial port connected to the chain.
+    @param[in] header Header of the request that was sent (e.g. $BSSRD).
+    @retval List of SRS responses, one per selected cell (fewer if a write failed part way down the chain).
+    """
+    responses = []
+    while True:
+        response = port.readline().decode("utf-8").strip()
+        if not response:
+            raise Exception("Timed out waiting for {} to come back around the chain.".format(header))
+        if response.split(",")[0].split(TAG_DELIM)[0] == header:
+            return responses
+        responses.append(response)
+        if header == "$BSSWR":
+            return responses # failed writes drop the packet, nothing more is coming
+
+def sweep_unique_ids(port):
+    """
+    @brief Reads every cell's unique board ID with a single SRD to the whole cell ID range.
+    @param[in] port Serial port connected to the chain.
+    @retval List of [cell_id, unique_id] in chain order. Cells that have never been discovered report cell ID 0.
+    """
+    transmit(port, packetize("BSSRD,{},{}".format(ALL_CELLS, UNIQUE_ID_REG_ADDR)))
+    topology = []
+    for response in read_multicast_responses(port, "$BSSRD"):
+        fields = response.split("*")[0].split(",")
+        topology.append([int(fields[1]), fields[2]])
+    return topology
+
+def verify_topology(port, topology_file):
+    """
+    @brief Boot-time check that the chain is still made of the same boards in the same order as last time. Cells keep
+    their cell IDs and saved settings across power cycles, so if nothing moved the chain is ready to go after one sweep.
+    Otherwise the chain is rediscovered (which saves the new cell IDs on each cell) and the topology file is updated.
+    @param[in] port Serial port connected to the chain.
+    @param[in] topology_file JSON file with the [cell_id, unique_id] list from the last boot.
+    @retval True if the chain was unchanged, False if it had to be rediscovered.
+    """
+    topology = sweep_unique_ids(port)
+    try:
+        with open(topology_file, "r") as f:
+            saved_topology = json.load(f)
+    except (OSError, ValueError):
+        saved_topology = None
+    in_order = all(cell_id == i + 1 for i, (cell_id, unique_id) in enumerate(topology))
+    if in_order and topology == saved_topology:
+        return True
+
+    transmit(port, packetize("BSDIS,0"))
+    port.readline()
+    topology = sweep_unique_ids(port)
+    with open(topology_file, "w") as f:
+        json.dump(topology, f)
+    return False
+
+def describe_event(packet_str):
+    """
+    @brief Turns an event packet into something readable.
+    @param[in] packet_str Received packet string (e.g. $BSEVT,3,1,152.34*5A).
+    @retval Description string, or None if the packet isn't an event.
+    """
+    if not packet_str.startswith("$BSEVT"):
+        return None
+    fields = packet_str.split("*")[0].split(",")
+    return "Cell {}: {} at {}mA".format(fields[1], EVENT_NAMES.get(int(fields[2]), "event " + fields[2]), fields[3])
+
 def transmit(port, packet):
     print("\tSending: {}".format(packet), end="")
     port.write(bytes(packet, 'utf-8'))
@@ -61,16 +320,38 @@ def main():
 Supported Commands:
     DIS - Cell Discover
         DIS <PREV_CELL_ID>
-    MRD - Multi Read
+    BOOT - Verify Topology (one sweep of unique IDs, only rediscovers if boards were added, removed or moved)
+        BOOT <TOPOLOGY_FILE>
+        Cells keep their cell ID across power cycles, MWR 3003 1 saves the rest of their settings too.
+    MRD - Multi Read (separate up to 4 addresses with '|' to read several registers per cell, e.g. 1000|2000)
         MRD <REG_ADDR>
     MWR - Multi Write
         MWR <REG_ADDR> <VALUE>
-    SRD - Single Read
+    SRD - Single Read (separate up to 4 addresses with '|' to read several registers, e.g. 1000|2000)
         SRD <CELL_ID> <REG_ADDR>
     SWR - Single Write
         SWR <CELL_ID> <REG_ADDR> <VALUE>
+        SRD/SWR <CELL_ID> can also be a range (e.g. 3-14) or a group (e.g. G2, set a cell's group with SWR 3001).
     SRS - Single Response
         SRS <CELL_ID> <VALUE>
+    VWR - Vector Write (one value per cell, first value goes to the first cell)
+        VWR <REG_ADDR> <VALUE_0> <VALUE_1> ...
+    PRF - Profile Upload (CSV with one <time_ms>,<voltage> point per line, cell ID 0 loads every cell)
+        PRF <CELL_ID> <CSV_FILE>
+        Then MWR 6000 1 to start, 0 to stop, or 2 to arm and SYN to start every cell in lockstep.
+    CAL - Calibration Upload (CSV with one line per cell, first cell first, saved to flash on every cell)
+        CAL <CSV_FILE>
+        Columns: output error [V] at 0V, 0.45V, ... 4.5V (11 values), current offset [ADC counts], current gain.
+    SYN - Synchronized Sample (all cells latch current DELAY_US after the first cell gets the packet, read back from 2001)
+        SYN <DELAY_US>
+        Also commits staged writes on every cell at the same moment (MWR 5002 1 to start staging, 5002 0 to stop).
+    CAP - Capture Readout (writes the current waveform to a CSV with one <sample_index>,<current_ma> per line)
+        CAP <CELL_ID> <CSV_FILE>
+        Set up with registers 8001-8004, then SWR/MWR 8000 1 to arm and 8000 2 to trigger by hand.
+    EVT - Listen for events (comparators are set up with registers 2200-2203 and report on their own)
+        EVT <SECONDS>
+    PIPE - Pipelined Single Reads (sends tagged SRDs with several in flight at once, reports throughput)
+        PIPE <COUNT> <CELL_ID> <REG_ADDR>
 Type EXIT to quit."""
     )
     ser = serial.Serial(args.serial_port,
@@ -94,6 +375,13 @@ Type EXIT to quit."""
                 continue
             transmit(ser, packetize("BSDIS,{}".format(command_words[1])))
             print("\tResponse: {}".format(ser.readline()))
+        elif command_words[0] == "BOOT":
+            if (num_args != 2):
+                print("Invalid number of arguments for BOOT! Expected 2 but got {}.".format(num_args))
+                continue
+            start_time = time.time()
+            unchanged = verify_topology(ser, command_words[1])
+            print("\tChain {} in {:.3f}s.".format("unchanged" if unchanged else "rediscovered", time.time() - start_time))
         elif command_words[0] == "MRD":
             if (num_args != 2):
                 print("Invalid number of arguments for BSDIS! Excpected 1 but got {}.".format(num_args))
@@ -111,12 +399,20 @@ Type EXIT to quit."""
                 print("Invalid number of arguments for BSSRD! Expected 3 but got {}.".format(num_args))
                 continue
             transmit(ser, packetize("BSSRD,{},{}".format(command_words[1], command_words[2])))
+            if is_multicast(command_words[1]):
+                for response in read_multicast_responses(ser, "$BSSRD"):
+                    print("\tResponse: {}".format(response))
+                continue
             print("\tResponse: {}".format(ser.readline()))
         elif command_words[0] == "SWR":
             if (num_args != 4):
                 print("Invalid number of arguments for BSSRD! Expected 4 but got {}.".format(num_args))
                 continue
             transmit(ser, packetize("BSSWR,{},{},{}".format(command_words[1], command_words[2], command_words[3])))
+            if is_multicast(command_words[1]):
+                responses = read_multicast_responses(ser, "$BSSWR")
+                print("\tResponse: {}".format(responses[0] if responses else "OK"))
+                continue
             print("\tResponse: {}".format(ser.readline()))
         elif command_words[0] == "SRS":
             if (num_args != 3):
@@ -124,6 +420,67 @@ Type EXIT to quit."""
                 continue
             transmit(ser, packetize("BSSRS,{},{}".format(command_words[1], command_words[2])))
             print("\tResponse: {}".format(ser.readline()))
+        elif command_words[0] == "VWR":
+            if (num_args < 3):
+                print("Invalid number of arguments for BSVWR! Expected at least 3 but got {}.".format(num_args))
+                continue
+            transmit(ser, packetize("BSVWR,{}".format(",".join(command_words[1:]))))
+            print("\tResponse: {}".format(ser.readline()))
+        elif command_words[0] == "PRF":
+            if (num_args != 3):
+                print("Invalid number of arguments for BSPRF! Expected 3 but got {}.".format(num_args))
+                continue
+            for response in upload_profile(ser, command_words[1], read_profile_csv(command_words[2])):
+                print("\tResponse: {}".format(response))
+        elif command_words[0] == "CAL":
+            if (num_args != 2):
+                print("Invalid number of arguments for CAL! Expected 2 but got {}.".format(num_args))
+                continue
+            for response in upload_calibration(ser, read_calibration_csv(command_words[1])):
+                print("\tResponse: {}".format(response))
+        elif command_words[0] == "SYN":
+            if (num_args != 2):
+                print("Invalid number of arguments for BSSYN! Expected 2 but got {}.".format(num_args))
+                continue
+            transmit(ser, packetize("BSSYN,{}".format(command_words[1])))
+            print("\tResponse: {}".format(ser.readline()))
+        elif command_words[0] == "CAP":
+            if (num_args != 3):
+                print("Invalid number of arguments for CAP! Expected 3 but got {}.".format(num_args))
+                continue
+            transmit(ser, packetize("BSSRD,{},8000|8005|8006".format(command_words[1])))
+            status = ser.readline().decode("utf-8").split("*")[0].split(",")
+            if len(status) != 5 or status[2] != "3":
+                print("\tCapture isn't done: {}".format(status))
+                continue
+            currents = read_capture(ser, command_words[1], int(status[3]))
+            with open(command_words[2], "w") as f:
+                for i, current in enumerate(currents):
+                    f.write("{},{:.3f}\n".format(i - int(status[4]), current))
+            print("\tWrote {} samples, trigger at sample 0.".format(len(currents)))
+        elif command_words[0] == "EVT":
+            if (num_args != 2):
+                print("Invalid number of arguments for EVT! Expected 2 but got {}.".format(num_args))
+                continue
+            end_time = time.time() + float(command_words[1])
+            while time.time() < end_time:
+                line = ser.readline().decode("utf-8", errors="replace").strip()
+                if line:
+                    print("\t{}".format(describe_event(line) or line))
+        elif command_words[0] == "PIPE":
+            if (num_args != 4):
+                print("Invalid number of arguments for PIPE! Expected 4 but got {}.".format(num_args))
+                continue
+            pipeline = RequestPipeline(ser)
+            completed = []
+            start_time = time.time()
+            for i in range(int(command_words[1])):
+                completed += pipeline.send("BSSRD,{},{}".format(command_words[2], command_words[3]))
+            completed += pipeline.drain()
+            elapsed_time = time.time() - start_time
+            for request, response in completed:
+                print("\tResponse: {}".format(response))
+            print("\tReceived {} responses in {:.3f}s, {} lost.".format(len(completed), elapsed_time, len(pipeline.outstanding)))
         else:
             print("Unrecognized argument.")
             